@@ -1,32 +1,260 @@
 #include "assert.h"
+#include "errno.h"
 #include "arpa/inet.h"
-#include "ifaddrs.h"
+#include "net/if.h"
 #include "stdio.h"
 #include "stdlib.h"
 #include "string.h"
 #include "sys/ioctl.h"
-#include "netdb.h"
+#include "time.h"
 #include "node_api.h"
 #include "unistd.h"
 #include "../externs/wireguard-tools/contrib/embeddable-wg-library/wireguard.h"
+#include "./arena.h"
+#include "./backend.h"
+#include "./conf.h"
 #include "./constants.h"
+#include "./keygen.h"
+#include "./lpm.h"
+#include "./metrics.h"
 #include "./napi_utils.h"
+#include "./netlink.h"
+#include "./netns.h"
+#include "./pool.h"
+#include "./registry.h"
+#include "./rtnl.h"
+#include "./snapshot.h"
+#include "./state.h"
+#include "./sync.h"
+#include "./uapi.h"
+#include "./watcher.h"
+#include "./workers.h"
+
+typedef enum
+{
+  KEY_FORMAT_BASE64,
+  KEY_FORMAT_BINARY,
+} key_format;
 
-static napi_value create_allowedip_object_from_wg_allowedip(napi_env env, const struct wg_allowedip *allowedip)
+// The names of the properties we read and write for every device, peer and allowed ip.
+typedef enum
 {
-  napi_value allowedip_obj;
-  NAPI_CALL(env, napi_create_object(env, &allowedip_obj));
+  PROPERTY_NAME,
+  PROPERTY_IFINDEX,
+  PROPERTY_FLAGS,
+  PROPERTY_PUBLIC_KEY,
+  PROPERTY_PRIVATE_KEY,
+  PROPERTY_PRESHARED_KEY,
+  PROPERTY_FWMARK,
+  PROPERTY_LISTEN_PORT,
+  PROPERTY_PEERS,
+  PROPERTY_ENDPOINT,
+  PROPERTY_LAST_HANDSHAKE_TIME,
+  PROPERTY_RX_BYTES,
+  PROPERTY_TX_BYTES,
+  PROPERTY_PERSISTENT_KEEPALIVE_INTERVAL,
+  PROPERTY_ALLOWED_IPS,
+  PROPERTY_ALLOWEDIPS,
+  PROPERTY_FAMILY,
+  PROPERTY_ADDR,
+  PROPERTY_CIDR,
+  PROPERTY_COUNT,
+} property_key;
+
+static const char *property_key_names[PROPERTY_COUNT] = {
+  [PROPERTY_NAME] = "name",
+  [PROPERTY_IFINDEX] = "ifindex",
+  [PROPERTY_FLAGS] = "flags",
+  [PROPERTY_PUBLIC_KEY] = "publicKey",
+  [PROPERTY_PRIVATE_KEY] = "privateKey",
+  [PROPERTY_PRESHARED_KEY] = "presharedKey",
+  [PROPERTY_FWMARK] = "fwmark",
+  [PROPERTY_LISTEN_PORT] = "listenPort",
+  [PROPERTY_PEERS] = "peers",
+  [PROPERTY_ENDPOINT] = "endpoint",
+  [PROPERTY_LAST_HANDSHAKE_TIME] = "lastHandshakeTime",
+  [PROPERTY_RX_BYTES] = "rxBytes",
+  [PROPERTY_TX_BYTES] = "txBytes",
+  [PROPERTY_PERSISTENT_KEEPALIVE_INTERVAL] = "persistentKeepaliveInterval",
+  [PROPERTY_ALLOWED_IPS] = "allowedIps",
+  [PROPERTY_ALLOWEDIPS] = "allowedips",
+  [PROPERTY_FAMILY] = "family",
+  [PROPERTY_ADDR] = "addr",
+  [PROPERTY_CIDR] = "cidr",
+};
+
+// The per-environment state of the addon, as the module may be loaded by several worker threads at once.
+typedef struct
+{
+  key_format default_key_format;
+  bool is_registry_enabled;
+  napi_ref property_keys_ref;
+} addon_data;
+
+static key_format get_default_key_format(napi_env env)
+{
+  addon_data *data;
+  if (napi_get_instance_data(env, (void **)&data) != napi_ok || data == NULL)
+  {
+    return KEY_FORMAT_BASE64;
+  }
+
+  return data->default_key_format;
+}
+
+// The names of the properties of an object are internalized by the engine, so we take the keys from one instead of creating the strings.
+// A property looked up by an internalized key skips hashing and interning the name on every call.
+static int create_property_keys(napi_env env, addon_data *data)
+{
+  napi_property_descriptor descriptors[PROPERTY_COUNT];
+  memset(descriptors, 0, sizeof(descriptors));
+
+  napi_value object, keys, value;
+  ASSERT_NAPI_CALL(env, napi_get_null(env, &value), 1);
+  for (size_t index = 0; index < PROPERTY_COUNT; index++)
+  {
+    descriptors[index].utf8name = property_key_names[index];
+    descriptors[index].value = value;
+    descriptors[index].attributes = napi_enumerable;
+  }
+
+  ASSERT_NAPI_CALL(env, napi_create_object(env, &object), 1);
+  ASSERT_NAPI_CALL(env, napi_define_properties(env, object, PROPERTY_COUNT, descriptors), 1);
+  ASSERT_NAPI_CALL(env, napi_get_property_names(env, object, &keys), 1);
+  ASSERT_NAPI_CALL(env, napi_create_reference(env, keys, 1, &data->property_keys_ref), 1);
+
+  return 0;
+}
+
+// The keys are held in an array, as only objects can be referenced before Node-API 10; we take them out once per call.
+static int get_property_keys(napi_env env, napi_value *keys)
+{
+  addon_data *data;
+  napi_value keys_array;
+  ASSERT_NAPI_CALL(env, napi_get_instance_data(env, (void **)&data), 1);
+  ASSERT_NAPI_CALL(env, napi_get_reference_value(env, data->property_keys_ref, &keys_array), 1);
+
+  for (uint32_t index = 0; index < PROPERTY_COUNT; index++)
+  {
+    ASSERT_NAPI_CALL(env, napi_get_element(env, keys_array, index, &keys[index]), 1);
+  }
+
+  return 0;
+}
+
+#define DECLARE_NAPI_VALUE_PROPERTY(key, value)                                             \
+  {                                                                                         \
+    0, key, 0, 0, 0, value, napi_writable | napi_enumerable | napi_configurable, 0          \
+  }
+
+static int get_key_format_from_napi_value(napi_env env, napi_value value, key_format *format)
+{
+  size_t length;
+  char format_str[8];
+  if (napi_get_value_string_utf8(env, value, format_str, sizeof(format_str), &length) == napi_ok)
+  {
+    if (strcmp(format_str, "base64") == 0)
+    {
+      *format = KEY_FORMAT_BASE64;
+      return 0;
+    }
+    if (strcmp(format_str, "binary") == 0)
+    {
+      *format = KEY_FORMAT_BINARY;
+      return 0;
+    }
+  }
+
+  napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected value of keyFormat is 'base64' or 'binary'!");
+  return 1;
+}
+
+// Reads the keyFormat property of the options, falling back to the one given by wg.setKeyFormat.
+static int get_key_format_from_napi_options(napi_env env, napi_value options, key_format *format)
+{
+  *format = get_default_key_format(env);
+
+  napi_valuetype options_type;
+  ASSERT_NAPI_CALL(env, napi_typeof(env, options, &options_type), 1);
+  if (options_type == napi_undefined)
+  {
+    return 0;
+  }
+  if (options_type != napi_object)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of options is object!");
+    return 1;
+  }
+
+  bool has_key_format;
+  ASSERT_NAPI_CALL(env, napi_has_named_property(env, options, "keyFormat", &has_key_format), 1);
+  if (!has_key_format)
+  {
+    return 0;
+  }
+
+  napi_value key_format_prop;
+  ASSERT_NAPI_CALL(env, napi_get_named_property(env, options, "keyFormat", &key_format_prop), 1);
+
+  return get_key_format_from_napi_value(env, key_format_prop, format);
+}
+
+static napi_value create_key_value_from_wg_key(napi_env env, const wg_key key, key_format format)
+{
+  napi_value result;
+  if (format == KEY_FORMAT_BINARY)
+  {
+    NAPI_CALL(env, napi_create_buffer_copy(env, sizeof(wg_key), key, NULL, &result));
+    return result;
+  }
+
+  wg_key_b64_string b64_key;
+  wg_key_to_base64(b64_key, key);
+  NAPI_CALL(env, napi_create_string_latin1(env, b64_key, sizeof(b64_key) - 1, &result));
+
+  return result;
+}
+
+// Reads the key from a base64 string, or from the 32 raw bytes of a Buffer, Uint8Array or any other view.
+// The string is read into the stack, so neither form allocates; an invalid base64 string leaves the key as is.
+static int get_wg_key_from_napi_value(napi_env env, napi_value value, wg_key key)
+{
+  napi_valuetype type;
+  ASSERT_NAPI_CALL(env, napi_typeof(env, value, &type), 1);
+  if (type == napi_string)
+  {
+    // The buffer has room for one more character, so the string longer than a key is never cut to the exact length.
+    char key_str[sizeof(wg_key_b64_string) + 1];
+    size_t length;
+    ASSERT_NAPI_CALL(env, napi_get_value_string_utf8(env, value, key_str, sizeof(key_str), &length), 1);
+    if (length == sizeof(wg_key_b64_string) - 1)
+    {
+      wg_key_from_base64(key, key_str);
+    }
+    return 0;
+  }
+
+  void *data;
+  size_t length;
+  if (napi_utils_get_value_bytes(env, value, &data, &length) == napi_ok && length == sizeof(wg_key))
+  {
+    memcpy(key, data, sizeof(wg_key));
+    return 0;
+  }
+
+  return 1;
+}
 
+static napi_value create_allowedip_object_from_wg_allowedip(napi_env env, const napi_value *keys, const struct wg_allowedip *allowedip)
+{
   char ip_str[INET6_ADDRSTRLEN];
   if (allowedip->family == AF_INET)
   {
-    struct sockaddr_in *addr_in = (struct sockaddr_in *) &allowedip->ip4;
-    inet_ntop(AF_INET, &(addr_in->sin_addr), ip_str, INET_ADDRSTRLEN);
+    inet_ntop(AF_INET, &allowedip->ip4, ip_str, INET_ADDRSTRLEN);
   }
   else if (allowedip->family == AF_INET6)
   {
-    struct sockaddr_in6 *addr_in6 = (struct sockaddr_in6 *) &allowedip->ip6;
-    inet_ntop(AF_INET6, &(addr_in6->sin6_addr), ip_str, INET6_ADDRSTRLEN);
+    inet_ntop(AF_INET6, &allowedip->ip6, ip_str, INET6_ADDRSTRLEN);
   }
   else
   {
@@ -34,48 +262,53 @@ static napi_value create_allowedip_object_from_wg_allowedip(napi_env env, const
     return NULL;
   }
 
-  napi_value family, addr, cidr;
+  napi_value allowedip_obj, family, addr, cidr;
+  NAPI_CALL(env, napi_create_object(env, &allowedip_obj));
   NAPI_CALL(env, napi_create_uint32(env, allowedip->family, &family));
-  NAPI_CALL(env, napi_create_string_utf8(env, ip_str, NAPI_AUTO_LENGTH, &addr));
+  NAPI_CALL(env, napi_create_string_latin1(env, ip_str, NAPI_AUTO_LENGTH, &addr));
   NAPI_CALL(env, napi_create_uint32(env, allowedip->cidr, &cidr));
-  NAPI_CALL(env, napi_set_named_property(env, allowedip_obj, "family", family));
-  NAPI_CALL(env, napi_set_named_property(env, allowedip_obj, "ip", addr));
-  NAPI_CALL(env, napi_set_named_property(env, allowedip_obj, "cidr", cidr));
+
+  napi_property_descriptor descriptors[] = {
+    DECLARE_NAPI_VALUE_PROPERTY(keys[PROPERTY_FAMILY], family),
+    DECLARE_NAPI_VALUE_PROPERTY(keys[PROPERTY_ADDR], addr),
+    DECLARE_NAPI_VALUE_PROPERTY(keys[PROPERTY_CIDR], cidr),
+  };
+  NAPI_CALL(env, napi_define_properties(env, allowedip_obj, sizeof(descriptors) / sizeof(descriptors[0]), descriptors));
 
   return allowedip_obj;
 }
 
-static napi_value create_peer_object_from_wg_peer(napi_env env, const struct wg_peer *peer)
+static double get_milliseconds_from_timespec64(const struct timespec64 *time)
 {
-  napi_value peer_obj;
-  NAPI_CALL(env, napi_create_object(env, &peer_obj));
-
-  napi_value public_key, preshared_key, endpoint, last_handshake_time, rx_bytes, tx_bytes, persistent_keepalive_interval, allowedips_array;
-  wg_key_b64_string b64_public_key, b64_preshared_key;
-  wg_key_to_base64(b64_public_key, peer->public_key);
-  wg_key_to_base64(b64_preshared_key, peer->preshared_key);
-
-  NAPI_CALL(env, napi_create_string_utf8(env, b64_public_key, NAPI_AUTO_LENGTH, &public_key));
-  NAPI_CALL(env, napi_create_string_utf8(env, b64_preshared_key, NAPI_AUTO_LENGTH, &preshared_key));
+  return (double) time->tv_sec * 1000 + (double) time->tv_nsec / 1000000;
+}
 
+static napi_value create_endpoint_string_from_wg_endpoint(napi_env env, const wg_endpoint *peer_endpoint)
+{
+  napi_value endpoint;
   char endpoint_str[INET6_ADDRSTRLEN + 6];
-  if (peer->endpoint.addr.sa_family == AF_INET)
+  if (peer_endpoint->addr.sa_family == AF_INET)
   {
     char ip[INET_ADDRSTRLEN];
-    uint16_t port = htons(peer->endpoint.addr4.sin_port);
-    inet_ntop(AF_INET, &peer->endpoint.addr4.sin_addr, ip, sizeof(ip));
+    uint16_t port = htons(peer_endpoint->addr4.sin_port);
+    inet_ntop(AF_INET, &peer_endpoint->addr4.sin_addr, ip, sizeof(ip));
 
     sprintf(endpoint_str, "%s:%d", ip, port);
-    NAPI_CALL(env, napi_create_string_utf8(env, endpoint_str, NAPI_AUTO_LENGTH, &endpoint));
+    NAPI_CALL(env, napi_create_string_latin1(env, endpoint_str, NAPI_AUTO_LENGTH, &endpoint));
   }
-  else if (peer->endpoint.addr.sa_family == AF_INET6)
+  else if (peer_endpoint->addr.sa_family == AF_INET6)
   {
     char ip[INET6_ADDRSTRLEN];
-    uint16_t port = htons(peer->endpoint.addr6.sin6_port);
-    inet_ntop(AF_INET6, &peer->endpoint.addr6.sin6_addr, ip, sizeof(ip));
+    uint16_t port = htons(peer_endpoint->addr6.sin6_port);
+    inet_ntop(AF_INET6, &peer_endpoint->addr6.sin6_addr, ip, sizeof(ip));
 
     sprintf(endpoint_str, "%s:%d", ip, port);
-    NAPI_CALL(env, napi_create_string_utf8(env, endpoint_str, NAPI_AUTO_LENGTH, &endpoint));
+    NAPI_CALL(env, napi_create_string_latin1(env, endpoint_str, NAPI_AUTO_LENGTH, &endpoint));
+  }
+  else if (peer_endpoint->addr.sa_family == AF_UNSPEC)
+  {
+    // The peer has no endpoint until it connects to us, or we set one.
+    NAPI_CALL(env, napi_create_string_utf8(env, "", 0, &endpoint));
   }
   else 
   {
@@ -83,459 +316,819 @@ static napi_value create_peer_object_from_wg_peer(napi_env env, const struct wg_
     return NULL;
   }
 
-  NAPI_CALL(env, napi_create_uint32(env, (uint32_t) peer->last_handshake_time.tv_nsec, &last_handshake_time));
-  NAPI_CALL(env, napi_create_uint32(env, (uint32_t) peer->rx_bytes, &rx_bytes));
-  NAPI_CALL(env, napi_create_uint32(env, (uint32_t) peer->tx_bytes, &tx_bytes));
-  NAPI_CALL(env, napi_create_uint32(env, peer->persistent_keepalive_interval, &persistent_keepalive_interval));
-  NAPI_CALL(env, napi_create_array(env, &allowedips_array));
+  return endpoint;
+}
+
+static napi_value create_peer_object_from_wg_peer(napi_env env, const napi_value *keys, const struct wg_peer *peer, key_format format)
+{
+  napi_value peer_obj;
+  NAPI_CALL(env, napi_create_object(env, &peer_obj));
+
+  napi_value public_key, preshared_key, endpoint, last_handshake_time, rx_bytes, tx_bytes, persistent_keepalive_interval, allowedips_array;
+  public_key = create_key_value_from_wg_key(env, peer->public_key, format);
+  preshared_key = create_key_value_from_wg_key(env, peer->preshared_key, format);
+  if (public_key == NULL || preshared_key == NULL)
+  {
+    return NULL;
+  }
+
+  endpoint = create_endpoint_string_from_wg_endpoint(env, &peer->endpoint);
+  if (endpoint == NULL)
+  {
+    return NULL;
+  }
 
+  uint32_t allowedips_length = 0;
   struct wg_allowedip *allowedip;
+  wg_for_each_allowedip(peer, allowedip)
+  {
+    allowedips_length++;
+  }
+
+  // The counters are exact in a double up to 8PiB, which is far more than we can expect from a peer.
+  NAPI_CALL(env, napi_create_double(env, get_milliseconds_from_timespec64(&peer->last_handshake_time), &last_handshake_time));
+  NAPI_CALL(env, napi_create_double(env, (double) peer->rx_bytes, &rx_bytes));
+  NAPI_CALL(env, napi_create_double(env, (double) peer->tx_bytes, &tx_bytes));
+  NAPI_CALL(env, napi_create_uint32(env, peer->persistent_keepalive_interval, &persistent_keepalive_interval));
+  NAPI_CALL(env, napi_create_array_with_length(env, allowedips_length, &allowedips_array));
+
   uint32_t index = 0;
   wg_for_each_allowedip(peer, allowedip)
   {
-    napi_value allowedip_obj = create_allowedip_object_from_wg_allowedip(env, allowedip);
+    napi_value allowedip_obj = create_allowedip_object_from_wg_allowedip(env, keys, allowedip);
+    if (allowedip_obj == NULL)
+    {
+      return NULL;
+    }
     NAPI_CALL(env, napi_set_element(env, allowedips_array, index++, allowedip_obj));
   }
 
-  NAPI_CALL(env, napi_set_named_property(env, peer_obj, "publicKey", public_key));
-  NAPI_CALL(env, napi_set_named_property(env, peer_obj, "presharedKey", preshared_key));
-  NAPI_CALL(env, napi_set_named_property(env, peer_obj, "endpoint", endpoint));
-  NAPI_CALL(env, napi_set_named_property(env, peer_obj, "lastHandshakeTime", last_handshake_time));
-  NAPI_CALL(env, napi_set_named_property(env, peer_obj, "rxBytes", rx_bytes));
-  NAPI_CALL(env, napi_set_named_property(env, peer_obj, "txBytes", tx_bytes));
-  NAPI_CALL(env, napi_set_named_property(env, peer_obj, "persistentKeepaliveInterval", persistent_keepalive_interval));
-  NAPI_CALL(env, napi_set_named_property(env, peer_obj, "allowedips", allowedips_array));
+  napi_property_descriptor descriptors[] = {
+    DECLARE_NAPI_VALUE_PROPERTY(keys[PROPERTY_PUBLIC_KEY], public_key),
+    DECLARE_NAPI_VALUE_PROPERTY(keys[PROPERTY_PRESHARED_KEY], preshared_key),
+    DECLARE_NAPI_VALUE_PROPERTY(keys[PROPERTY_ENDPOINT], endpoint),
+    DECLARE_NAPI_VALUE_PROPERTY(keys[PROPERTY_LAST_HANDSHAKE_TIME], last_handshake_time),
+    DECLARE_NAPI_VALUE_PROPERTY(keys[PROPERTY_RX_BYTES], rx_bytes),
+    DECLARE_NAPI_VALUE_PROPERTY(keys[PROPERTY_TX_BYTES], tx_bytes),
+    DECLARE_NAPI_VALUE_PROPERTY(keys[PROPERTY_PERSISTENT_KEEPALIVE_INTERVAL], persistent_keepalive_interval),
+    DECLARE_NAPI_VALUE_PROPERTY(keys[PROPERTY_ALLOWEDIPS], allowedips_array),
+  };
+  NAPI_CALL(env, napi_define_properties(env, peer_obj, sizeof(descriptors) / sizeof(descriptors[0]), descriptors));
 
   return peer_obj;
 }
 
-static napi_value create_device_object_from_wg_device(napi_env env, const struct wg_device *device)
+static napi_value create_device_object_from_wg_device(napi_env env, const struct wg_device *device, key_format format)
 {
+  napi_value keys[PROPERTY_COUNT];
+  if (get_property_keys(env, keys))
+  {
+    return NULL;
+  }
+
   napi_value device_obj;
   NAPI_CALL(env, napi_create_object(env, &device_obj));
 
   napi_value name, ifindex, flags, public_key, private_key, fwmark, listen_port, peers_array;
-  wg_key_b64_string b64_public_key, b64_private_key;
-  wg_key_to_base64(b64_public_key, device->public_key);
-  wg_key_to_base64(b64_private_key, device->private_key);
+  public_key = create_key_value_from_wg_key(env, device->public_key, format);
+  private_key = create_key_value_from_wg_key(env, device->private_key, format);
+  if (public_key == NULL || private_key == NULL)
+  {
+    return NULL;
+  }
+
+  uint32_t peers_length = 0;
+  struct wg_peer *peer;
+  wg_for_each_peer(device, peer)
+  {
+    peers_length++;
+  }
 
   NAPI_CALL(env, napi_create_string_utf8(env, device->name, NAPI_AUTO_LENGTH, &name));
   NAPI_CALL(env, napi_create_uint32(env, device->ifindex, &ifindex));
   NAPI_CALL(env, napi_create_uint32(env, device->flags, &flags));
-  NAPI_CALL(env, napi_create_string_utf8(env, b64_public_key, NAPI_AUTO_LENGTH, &public_key));
-  NAPI_CALL(env, napi_create_string_utf8(env, b64_private_key, NAPI_AUTO_LENGTH, &private_key));
   NAPI_CALL(env, napi_create_uint32(env, device->fwmark, &fwmark));
   NAPI_CALL(env, napi_create_uint32(env, device->listen_port, &listen_port));
-  NAPI_CALL(env, napi_create_array(env, &peers_array));
+  NAPI_CALL(env, napi_create_array_with_length(env, peers_length, &peers_array));
 
-  struct wg_peer *peer;
+  // The handles of a peer are not needed once it is in the array, so we let them go before the next one.
   uint32_t index = 0;
   wg_for_each_peer(device, peer)
   {
-    napi_value peer_obj = create_peer_object_from_wg_peer(env, peer);
-    NAPI_CALL(env, napi_set_element(env, peers_array, index++, peer_obj));
+    napi_handle_scope scope;
+    NAPI_CALL(env, napi_open_handle_scope(env, &scope));
+
+    napi_value peer_obj = create_peer_object_from_wg_peer(env, keys, peer, format);
+    napi_status status = peer_obj != NULL ? napi_set_element(env, peers_array, index++, peer_obj) : napi_pending_exception;
+
+    NAPI_CALL(env, napi_close_handle_scope(env, scope));
+    if (status != napi_ok)
+    {
+      return NULL;
+    }
   }
 
-  NAPI_CALL(env, napi_set_named_property(env, device_obj, "name", name));
-  NAPI_CALL(env, napi_set_named_property(env, device_obj, "ifindex", ifindex));
-  NAPI_CALL(env, napi_set_named_property(env, device_obj, "flags", flags));
-  NAPI_CALL(env, napi_set_named_property(env, device_obj, "publicKey", public_key));
-  NAPI_CALL(env, napi_set_named_property(env, device_obj, "privateKey", private_key));
-  NAPI_CALL(env, napi_set_named_property(env, device_obj, "fwmark", fwmark));
-  NAPI_CALL(env, napi_set_named_property(env, device_obj, "listenPort", listen_port));
-  NAPI_CALL(env, napi_set_named_property(env, device_obj, "peers", peers_array));
+  napi_property_descriptor descriptors[] = {
+    DECLARE_NAPI_VALUE_PROPERTY(keys[PROPERTY_NAME], name),
+    DECLARE_NAPI_VALUE_PROPERTY(keys[PROPERTY_IFINDEX], ifindex),
+    DECLARE_NAPI_VALUE_PROPERTY(keys[PROPERTY_FLAGS], flags),
+    DECLARE_NAPI_VALUE_PROPERTY(keys[PROPERTY_PUBLIC_KEY], public_key),
+    DECLARE_NAPI_VALUE_PROPERTY(keys[PROPERTY_PRIVATE_KEY], private_key),
+    DECLARE_NAPI_VALUE_PROPERTY(keys[PROPERTY_FWMARK], fwmark),
+    DECLARE_NAPI_VALUE_PROPERTY(keys[PROPERTY_LISTEN_PORT], listen_port),
+    DECLARE_NAPI_VALUE_PROPERTY(keys[PROPERTY_PEERS], peers_array),
+  };
+  NAPI_CALL(env, napi_define_properties(env, device_obj, sizeof(descriptors) / sizeof(descriptors[0]), descriptors));
 
   return device_obj;
 }
 
-static uint32_t get_wg_allowedip_from_napi_object(napi_env env, napi_value object, wg_allowedip *allowedip)
+// Builds the columnar stats of the peers without creating an object per peer.
+// The counters share a single ArrayBuffer, and the n-th element of every column belongs to the same peer.
+static napi_value create_peer_stats_object_from_wg_device(napi_env env, const struct wg_device *device)
 {
-  napi_value family_prop, ip_prop, cidr_prop;
-  ASSERT_NAPI_CALL(env, napi_get_named_property(env, object, "family", &family_prop), 1);
-  ASSERT_NAPI_CALL(env, napi_get_named_property(env, object, "addr", &ip_prop), 1);
-  ASSERT_NAPI_CALL(env, napi_get_named_property(env, object, "cidr", &cidr_prop), 1);
-
-  napi_valuetype family_type, ip_type, cidr_type;
-  ASSERT_NAPI_CALL(env, napi_typeof(env, family_prop, &family_type), 1);
-  ASSERT_NAPI_CALL(env, napi_typeof(env, ip_prop, &ip_type), 1);
-  ASSERT_NAPI_CALL(env, napi_typeof(env, cidr_prop, &cidr_type), 1);
-
-  if (family_type != napi_number)
-  {
-    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of family property of allowed ip is number!");
-    return 1;
-  }
-  if (ip_type != napi_string)
+  struct wg_peer *peer;
+  size_t count = 0;
+  wg_for_each_peer(device, peer)
   {
-    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of addr property of allowed ip is string!");
-    return 1;
+    count++;
   }
-  if (cidr_type != napi_number)
+
+  napi_value stats_obj, public_keys, counters, rx_bytes, tx_bytes, last_handshake_time;
+  uint8_t *public_key_data;
+  void *counter_data;
+  NAPI_CALL(env, napi_create_object(env, &stats_obj));
+  NAPI_CALL(env, napi_create_buffer(env, count * sizeof(wg_key), (void **) &public_key_data, &public_keys));
+  NAPI_CALL(env, napi_create_arraybuffer(env, count * (sizeof(uint64_t) * 2 + sizeof(double)), &counter_data, &counters));
+  NAPI_CALL(env, napi_create_typedarray(env, napi_biguint64_array, count, counters, 0, &rx_bytes));
+  NAPI_CALL(env, napi_create_typedarray(env, napi_biguint64_array, count, counters, count * sizeof(uint64_t), &tx_bytes));
+  NAPI_CALL(env, napi_create_typedarray(env, napi_float64_array, count, counters, count * sizeof(uint64_t) * 2, &last_handshake_time));
+
+  uint64_t *rx_data = counter_data;
+  uint64_t *tx_data = rx_data + count;
+  double *last_handshake_data = (double *) (tx_data + count);
+  size_t index = 0;
+  wg_for_each_peer(device, peer)
   {
-    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of cidr property of allowed ip is string!");
-    return 1;
+    memcpy(public_key_data + index * sizeof(wg_key), peer->public_key, sizeof(wg_key));
+    rx_data[index] = peer->rx_bytes;
+    tx_data[index] = peer->tx_bytes;
+    last_handshake_data[index] = get_milliseconds_from_timespec64(&peer->last_handshake_time);
+    index++;
   }
 
-  uint32_t family, cidr;
-  ASSERT_NAPI_CALL(env, napi_get_value_uint32(env, family_prop, &family), 1);
-  allowedip->family = family;
+  NAPI_CALL(env, napi_set_named_property(env, stats_obj, "publicKeys", public_keys));
+  NAPI_CALL(env, napi_set_named_property(env, stats_obj, "rxBytes", rx_bytes));
+  NAPI_CALL(env, napi_set_named_property(env, stats_obj, "txBytes", tx_bytes));
+  NAPI_CALL(env, napi_set_named_property(env, stats_obj, "lastHandshakeTime", last_handshake_time));
 
-  char *ip_str;
-  ASSERT_NAPI_CALL(env, napi_utils_get_value_string(env, ip_prop, &ip_str), 1);
+  return stats_obj;
+}
 
-  if (allowedip->family == AF_INET)
-  {
-    inet_pton(AF_INET, ip_str, &allowedip->ip4);
-  }
-  else if (allowedip->family == AF_INET6)
-  {
-    inet_pton(AF_INET6, ip_str, &allowedip->ip6);
-  }
-  else
+// The types we check a property for besides napi_valuetype, as an array is an object and a key is a string or bytes.
+// The key is checked by the caller while decoding it, with the message of the spec.
+#define PROPERTY_TYPE_ARRAY ((napi_valuetype)-1)
+#define PROPERTY_TYPE_KEY ((napi_valuetype)-2)
+
+typedef struct
+{
+  property_key key;
+  napi_valuetype type;
+  const char *message;
+} property_spec;
+
+static const property_spec allowedip_property_specs[] = {
+  {PROPERTY_FAMILY, napi_number, "The expected type of family property of allowed ip is number!"},
+  {PROPERTY_ADDR, napi_string, "The expected type of addr property of allowed ip is string!"},
+  {PROPERTY_CIDR, napi_number, "The expected type of cidr property of allowed ip is number!"},
+};
+
+static const property_spec peer_property_specs[] = {
+  {PROPERTY_FLAGS, napi_number, "The expected type of flags property of peer is number!"},
+  {PROPERTY_PUBLIC_KEY, PROPERTY_TYPE_KEY, "The expected type of publicKey property of peer is string or 32 bytes!"},
+  {PROPERTY_PRESHARED_KEY, PROPERTY_TYPE_KEY, "The expected type of presharedKey property of peer is string or 32 bytes!"},
+  {PROPERTY_ENDPOINT, napi_string, "The expected type of endpoint property of peer is string!"},
+  {PROPERTY_ALLOWED_IPS, PROPERTY_TYPE_ARRAY, "The expected type of allowedIps property of peer is array!"},
+  {PROPERTY_PERSISTENT_KEEPALIVE_INTERVAL, napi_number, "The expected type of persistentKeepaliveInterval property of peer is number!"},
+};
+
+static const property_spec device_property_specs[] = {
+  {PROPERTY_NAME, napi_string, "The expected type of name property of device is string!"},
+  {PROPERTY_IFINDEX, napi_number, "The expected type of ifindex property of device is number!"},
+  {PROPERTY_FLAGS, napi_number, "The expected type of flags property of device is number!"},
+  {PROPERTY_PUBLIC_KEY, PROPERTY_TYPE_KEY, "The expected type of publicKey property of device is string or 32 bytes!"},
+  {PROPERTY_PRIVATE_KEY, PROPERTY_TYPE_KEY, "The expected type of privateKey property of device is string or 32 bytes!"},
+  {PROPERTY_FWMARK, napi_number, "The expected type of fwmark property of device is number!"},
+  {PROPERTY_LISTEN_PORT, napi_number, "The expected type of listenPort property of device is number!"},
+  {PROPERTY_PEERS, PROPERTY_TYPE_ARRAY, "The expected type of peers property of device is array!"},
+};
+
+#define PROPERTY_SPEC_COUNT(specs) (sizeof(specs) / sizeof(specs[0]))
+
+// Reads the properties in the specs and checks their types in a single pass, throwing the message of the first mismatch.
+static int get_properties_from_napi_object(napi_env env, napi_value object, const napi_value *keys, const property_spec *specs, size_t count, napi_value *values)
+{
+  for (size_t index = 0; index < count; index++)
   {
-    free(ip_str);
+    ASSERT_NAPI_CALL(env, napi_get_property(env, object, keys[specs[index].key], &values[index]), 1);
 
-    napi_throw_error(env, EWB_AF_UNSPEC, "The expected format of addr property is ipv4 or ipv6!");
-    return 1;
-  }
-  free(ip_str);
+    bool is_valid = true;
+    if (specs[index].type == PROPERTY_TYPE_ARRAY)
+    {
+      ASSERT_NAPI_CALL(env, napi_is_array(env, values[index], &is_valid), 1);
+    }
+    else if (specs[index].type != PROPERTY_TYPE_KEY)
+    {
+      napi_valuetype type;
+      ASSERT_NAPI_CALL(env, napi_typeof(env, values[index], &type), 1);
+      is_valid = type == specs[index].type;
+    }
 
-  ASSERT_NAPI_CALL(env, napi_get_value_uint32(env, cidr_prop, &cidr), 1);
-  allowedip->cidr = cidr;
+    if (!is_valid)
+    {
+      napi_throw_type_error(env, EWB_ARG_UNSPEC, specs[index].message);
+      return 1;
+    }
+  }
 
   return 0;
 }
 
-static uint32_t get_wg_peer_from_napi_object(napi_env env, napi_value object, wg_peer *peer)
+static uint32_t get_wg_allowedip_from_napi_object(napi_env env, const napi_value *keys, napi_value object, wg_allowedip *allowedip)
 {
-  napi_value flags_prop, public_key_prop, preshared_key_prop, endpoint_prop, allowedips_prop, persistent_keepalive_interval_prop;
-  ASSERT_NAPI_CALL(env, napi_get_named_property(env, object, "flags", &flags_prop), 1);
-  ASSERT_NAPI_CALL(env, napi_get_named_property(env, object, "publicKey", &public_key_prop), 1);
-  ASSERT_NAPI_CALL(env, napi_get_named_property(env, object, "presharedKey", &preshared_key_prop), 1);
-  ASSERT_NAPI_CALL(env, napi_get_named_property(env, object, "endpoint", &endpoint_prop), 1);
-  ASSERT_NAPI_CALL(env, napi_get_named_property(env, object, "allowedIps", &allowedips_prop), 1);
-  ASSERT_NAPI_CALL(env, napi_get_named_property(env, object, "persistentKeepaliveInterval", &persistent_keepalive_interval_prop), 1);
-
-  napi_valuetype flags_type, public_key_type, preshared_key_type, endpoint_type, allowedips_type, persistent_keepalive_interval_type;
-  ASSERT_NAPI_CALL(env, napi_typeof(env, flags_prop, &flags_type), 1);
-  ASSERT_NAPI_CALL(env, napi_typeof(env, public_key_prop, &public_key_type), 1);
-  ASSERT_NAPI_CALL(env, napi_typeof(env, preshared_key_prop, &preshared_key_type), 1);
-  ASSERT_NAPI_CALL(env, napi_typeof(env, endpoint_prop, &endpoint_type), 1);
-  ASSERT_NAPI_CALL(env, napi_typeof(env, allowedips_prop, &allowedips_type), 1);
-  ASSERT_NAPI_CALL(env, napi_typeof(env, persistent_keepalive_interval_prop, &persistent_keepalive_interval_type), 1);
-
-  if (flags_type != napi_number)
+  napi_value values[PROPERTY_SPEC_COUNT(allowedip_property_specs)];
+  if (get_properties_from_napi_object(env, object, keys, allowedip_property_specs, PROPERTY_SPEC_COUNT(allowedip_property_specs), values))
   {
-    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of flags property of peer is number!");
     return 1;
   }
-  if (public_key_type != napi_string)
+
+  uint32_t family, cidr;
+  ASSERT_NAPI_CALL(env, napi_get_value_uint32(env, values[0], &family), 1);
+  ASSERT_NAPI_CALL(env, napi_get_value_uint32(env, values[2], &cidr), 1);
+  allowedip->family = family;
+  allowedip->cidr = cidr;
+
+  // The address is read into the stack, and the one longer than any ip is left unparsed, same as an invalid one.
+  char ip_str[INET6_ADDRSTRLEN + 1];
+  size_t ip_length;
+  ASSERT_NAPI_CALL(env, napi_get_value_string_utf8(env, values[1], ip_str, sizeof(ip_str), &ip_length), 1);
+
+  if (allowedip->family != AF_INET && allowedip->family != AF_INET6)
   {
-    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of publicKey property of peer is string!");
+    napi_throw_error(env, EWB_AF_UNSPEC, "The expected format of addr property is ipv4 or ipv6!");
     return 1;
   }
-  if (preshared_key_type != napi_string)
+  if (ip_length < sizeof(ip_str) - 1)
   {
-    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of presharedKey property of peer is string!");
-    return 1;
+    inet_pton(allowedip->family, ip_str, allowedip->family == AF_INET ? (void *)&allowedip->ip4 : (void *)&allowedip->ip6);
   }
-  if (endpoint_type != napi_string)
+
+  return 0;
+}
+
+static uint32_t get_wg_peer_from_napi_object(napi_env env, const napi_value *keys, ewb_arena *arena, napi_value object, wg_peer *peer)
+{
+  napi_value values[PROPERTY_SPEC_COUNT(peer_property_specs)];
+  if (get_properties_from_napi_object(env, object, keys, peer_property_specs, PROPERTY_SPEC_COUNT(peer_property_specs), values))
   {
-    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of endpoint property of peer is string!");
     return 1;
   }
-  bool is_allowedips_type_array;
-  ASSERT_NAPI_CALL(env, napi_is_array(env, allowedips_prop, &is_allowedips_type_array), 1);
-  if (allowedips_type != napi_object || !is_allowedips_type_array)
+  if (get_wg_key_from_napi_value(env, values[1], peer->public_key))
   {
-    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of allowedIps property of peer is array!");
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, peer_property_specs[1].message);
     return 1;
   }
-  if (persistent_keepalive_interval_type != napi_number)
+  if (get_wg_key_from_napi_value(env, values[2], peer->preshared_key))
   {
-    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of persistentKeepaliveInterval property of peer is number!");
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, peer_property_specs[2].message);
     return 1;
   }
 
-  uint32_t flags;
-  ASSERT_NAPI_CALL(env, napi_get_value_uint32(env, flags_prop, &flags), 1);
+  uint32_t flags, persistent_keepalive_interval;
+  ASSERT_NAPI_CALL(env, napi_get_value_uint32(env, values[0], &flags), 1);
+  ASSERT_NAPI_CALL(env, napi_get_value_uint32(env, values[5], &persistent_keepalive_interval), 1);
   peer->flags = flags;
+  peer->persistent_keepalive_interval = persistent_keepalive_interval;
 
-  char *public_key_str;
-  ASSERT_NAPI_CALL(env, napi_utils_get_value_string(env, public_key_prop, &public_key_str), 1);
-  wg_key_from_base64(peer->public_key, public_key_str);
-  free(public_key_str);
-
-  char *preshared_key_str;
-  ASSERT_NAPI_CALL(env, napi_utils_get_value_string(env, preshared_key_prop, &preshared_key_str), 1);
-  wg_key_from_base64(peer->preshared_key, preshared_key_str);
-  free(preshared_key_str);
-
-  char *endpoint_str;
-  ASSERT_NAPI_CALL(env, napi_utils_get_value_string(env, endpoint_prop, &endpoint_str), 1);
-  char *endpoint_port_str = strrchr(endpoint_str, ':');
-  if (endpoint_port_str == NULL)
+  // The endpoint is at most an ipv6 address and a port, so the one filling the buffer is not valid anyway.
+  char endpoint_str[INET6_ADDRSTRLEN + 8];
+  size_t endpoint_length;
+  ASSERT_NAPI_CALL(env, napi_get_value_string_utf8(env, values[3], endpoint_str, sizeof(endpoint_str), &endpoint_length), 1);
+  if (endpoint_length >= sizeof(endpoint_str) - 1)
   {
-    free(endpoint_str);
-
-    napi_throw_error(env, EWB_AI_UNFORMAT, "The endpoint property of peer should be in `ip:port` format!");
+    napi_throw_error(env, EWB_AF_UNSPEC, "The endpoint property of peer should be in the valid ipv4 or ipv6 format!");
     return 1;
   }
-  *endpoint_port_str++ = '\0';
-
-  if (inet_pton(AF_INET, endpoint_str, &(peer->endpoint.addr4.sin_addr)) == 1)
+  if (endpoint_str[0] != '\0')
   {
-    peer->endpoint.addr.sa_family = AF_INET;
-    peer->endpoint.addr4.sin_port = ntohs(atoi(endpoint_port_str));
+    // The empty endpoint leaves the endpoint of the peer as is, same as we give it for the peer without one.
+    char *endpoint_port_str = strrchr(endpoint_str, ':');
+    if (endpoint_port_str == NULL)
+    {
+      napi_throw_error(env, EWB_AI_UNFORMAT, "The endpoint property of peer should be in `ip:port` format!");
+      return 1;
+    }
+    *endpoint_port_str++ = '\0';
+
+    if (inet_pton(AF_INET, endpoint_str, &(peer->endpoint.addr4.sin_addr)) == 1)
+    {
+      peer->endpoint.addr.sa_family = AF_INET;
+      peer->endpoint.addr4.sin_port = ntohs(atoi(endpoint_port_str));
+    }
+    else if (inet_pton(AF_INET6, endpoint_str, &(peer->endpoint.addr6.sin6_addr)) == 1)
+    {
+      peer->endpoint.addr.sa_family = AF_INET6;
+      peer->endpoint.addr6.sin6_port = ntohs(atoi(endpoint_port_str));
+    }
+    else
+    {
+      napi_throw_error(env, EWB_AF_UNSPEC, "The endpoint property of peer should be in the valid ipv4 or ipv6 format!");
+      return 1;
+    }
   }
-  else if (inet_pton(AF_INET6, endpoint_str, &(peer->endpoint.addr6.sin6_addr)) == 1)
+
+  uint32_t allowedips_length;
+  ASSERT_NAPI_CALL(env, napi_get_array_length(env, values[4], &allowedips_length), 1);
+  if (allowedips_length == 0)
   {
-    peer->endpoint.addr.sa_family = AF_INET6;
-    peer->endpoint.addr6.sin6_port = ntohs(atoi(endpoint_port_str));
+    return 0;
   }
-  else
+
+  // The allowed ips of the peer are taken from the arena at once, and linked as they are read.
+  wg_allowedip *allowedips = ewb_arena_alloc(arena, (size_t)allowedips_length * sizeof(wg_allowedip));
+  if (allowedips == NULL)
   {
-    napi_throw_error(env, EWB_AF_UNSPEC, "The endpoint property of peer should be in the valid ipv4 or ipv6 format!");
+    napi_throw_error(env, EWB_NNA_CALLFAIL, "Failed to allocate the allowed ip!");
     return 1;
   }
-  free(endpoint_str);
-
-  uint32_t allowedips_length;
-  ASSERT_NAPI_CALL(env, napi_get_array_length(env, allowedips_prop, &allowedips_length), 1);
 
-  wg_allowedip *last_allowedip = NULL;
   for (uint32_t i = 0; i < allowedips_length; i++)
   {
     napi_value allowedip_value;
-    ASSERT_NAPI_CALL(env, napi_get_element(env, allowedips_prop, i, &allowedip_value), 1);
+    ASSERT_NAPI_CALL(env, napi_get_element(env, values[4], i, &allowedip_value), 1);
 
     napi_valuetype allowedip_type;
     ASSERT_NAPI_CALL(env, napi_typeof(env, allowedip_value, &allowedip_type), 1);
-    
     if (allowedip_type != napi_object)
     {
       napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of the element of allowedIps property is object!");
       return 1;
     }
 
-    wg_allowedip *allowedip = calloc(1, sizeof(wg_allowedip));
-    uint32_t ret = get_wg_allowedip_from_napi_object(env, allowedip_value, allowedip);
-
-    if (ret)
-    {
-      napi_throw_error(env, EWB_OBJ_UNSPEC, "Failed to unwrap the object to wg_allowedip!");
-      return 1;
-    }
-
+    wg_allowedip *allowedip = &allowedips[i];
     if (peer->first_allowedip == NULL)
     {
       peer->first_allowedip = allowedip;
-      last_allowedip = allowedip;
     }
     else
     {
-      last_allowedip->next_allowedip = allowedip;
-      last_allowedip = allowedip;
+      peer->last_allowedip->next_allowedip = allowedip;
     }
-  }
-  peer->last_allowedip = last_allowedip;
+    peer->last_allowedip = allowedip;
 
-  uint32_t persistent_keepalive_interval;
-  ASSERT_NAPI_CALL(env, napi_get_value_uint32(env, persistent_keepalive_interval_prop, &persistent_keepalive_interval), 1);
-  peer->persistent_keepalive_interval = persistent_keepalive_interval;
+    if (get_wg_allowedip_from_napi_object(env, keys, allowedip_value, allowedip))
+    {
+      return 1;
+    }
+  }
 
   return 0;
 }
 
-static uint32_t get_wg_device_from_napi_object(napi_env env, napi_value object, wg_device *device)
-{
-  napi_value name_props, ifindex_props, flags_props, public_key_props, private_key_props, fwmark_props, listen_port_props, peers_props;
-  ASSERT_NAPI_CALL(env, napi_get_named_property(env, object, "name", &name_props), 1);
-  ASSERT_NAPI_CALL(env, napi_get_named_property(env, object, "ifindex", &ifindex_props), 1);
-  ASSERT_NAPI_CALL(env, napi_get_named_property(env, object, "flags", &flags_props), 1);
-  ASSERT_NAPI_CALL(env, napi_get_named_property(env, object, "publicKey", &public_key_props), 1);
-  ASSERT_NAPI_CALL(env, napi_get_named_property(env, object, "privateKey", &private_key_props), 1);
-  ASSERT_NAPI_CALL(env, napi_get_named_property(env, object, "fwmark", &fwmark_props), 1);
-  ASSERT_NAPI_CALL(env, napi_get_named_property(env, object, "listenPort", &listen_port_props), 1);
-  ASSERT_NAPI_CALL(env, napi_get_named_property(env, object, "peers", &peers_props), 1);
-
-  napi_valuetype name_type, ifindex_type, flags_type, public_key_type, private_key_type, fwmark_type, listen_port_type, peers_type;
-  ASSERT_NAPI_CALL(env, napi_typeof(env, name_props, &name_type), 1);
-  ASSERT_NAPI_CALL(env, napi_typeof(env, ifindex_props, &ifindex_type), 1);
-  ASSERT_NAPI_CALL(env, napi_typeof(env, flags_props, &flags_type), 1);
-  ASSERT_NAPI_CALL(env, napi_typeof(env, public_key_props, &public_key_type), 1);
-  ASSERT_NAPI_CALL(env, napi_typeof(env, private_key_props, &private_key_type), 1);
-  ASSERT_NAPI_CALL(env, napi_typeof(env, fwmark_props, &fwmark_type), 1);
-  ASSERT_NAPI_CALL(env, napi_typeof(env, listen_port_props, &listen_port_type), 1);
-  ASSERT_NAPI_CALL(env, napi_typeof(env, peers_props, &peers_type), 1);
-
-  if (name_type != napi_string)
-  {
-    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of name property of device is string!");
-    return 1;
-  }
-  if (ifindex_type != napi_number)
-  {
-    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of ifindex property of device is number!");
-    return 1;
-  }
-  if (flags_type != napi_number)
-  {
-    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of flags property of device is number!");
-    return 1;
-  }
-  if (public_key_type != napi_string)
+static uint32_t get_wg_device_from_napi_object(napi_env env, napi_value object, ewb_arena *arena, wg_device *device)
+{
+  napi_value keys[PROPERTY_COUNT];
+  if (get_property_keys(env, keys))
   {
-    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of publicKey property of device is string!");
     return 1;
   }
-  if (private_key_type != napi_string)
+
+  napi_value values[PROPERTY_SPEC_COUNT(device_property_specs)];
+  if (get_properties_from_napi_object(env, object, keys, device_property_specs, PROPERTY_SPEC_COUNT(device_property_specs), values))
   {
-    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of privateKey property of device is string!");
     return 1;
   }
-  if (fwmark_type != napi_number)
+  if (get_wg_key_from_napi_value(env, values[3], device->public_key))
   {
-    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of fwmark property of device is number!");
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, device_property_specs[3].message);
     return 1;
   }
-  if (listen_port_type != napi_number)
+  if (get_wg_key_from_napi_value(env, values[4], device->private_key))
   {
-    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of listenPort property of device is number!");
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, device_property_specs[4].message);
     return 1;
   }
-  bool is_peers_type_array;
-  ASSERT_NAPI_CALL(env, napi_is_array(env, peers_props, &is_peers_type_array), 1);
-  if (peers_type != napi_object || !is_peers_type_array)
+
+  size_t name_length;
+  ASSERT_NAPI_CALL(env, napi_get_value_string_utf8(env, values[0], NULL, 0, &name_length), 1);
+  if (name_length >= IFNAMSIZ)
   {
-    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of peers property of device is array!");
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected length of name property of device is less than 16 bytes!");
     return 1;
   }
+  ASSERT_NAPI_CALL(env, napi_get_value_string_utf8(env, values[0], device->name, IFNAMSIZ, NULL), 1);
 
-  char *name;
-  ASSERT_NAPI_CALL(env, napi_utils_get_value_string(env, name_props, &name), 1);
-  strcpy(device->name, name);
-  free(name);
-
-  uint32_t ifindex;
-  ASSERT_NAPI_CALL(env, napi_get_value_uint32(env, ifindex_props, &ifindex), 1);
+  uint32_t ifindex, flags, fwmark, listen_port;
+  ASSERT_NAPI_CALL(env, napi_get_value_uint32(env, values[1], &ifindex), 1);
+  ASSERT_NAPI_CALL(env, napi_get_value_uint32(env, values[2], &flags), 1);
+  ASSERT_NAPI_CALL(env, napi_get_value_uint32(env, values[5], &fwmark), 1);
+  ASSERT_NAPI_CALL(env, napi_get_value_uint32(env, values[6], &listen_port), 1);
   device->ifindex = ifindex;
-
-  uint32_t flags;
-  ASSERT_NAPI_CALL(env, napi_get_value_uint32(env, flags_props, &flags), 1);
   device->flags = flags;
-
-  char *public_key_str;
-  ASSERT_NAPI_CALL(env, napi_utils_get_value_string(env, public_key_props, &public_key_str), 1);
-  wg_key_from_base64(device->public_key, public_key_str);
-  free(public_key_str);
-
-  char *private_key_str;
-  ASSERT_NAPI_CALL(env, napi_utils_get_value_string(env, private_key_props, &private_key_str), 1);
-  wg_key_from_base64(device->private_key, private_key_str);
-  free(private_key_str);
-
-  uint32_t fwmark;
-  ASSERT_NAPI_CALL(env, napi_get_value_uint32(env, fwmark_props, &fwmark), 1);
   device->fwmark = fwmark;
-
-  uint32_t listen_port;
-  ASSERT_NAPI_CALL(env, napi_get_value_uint32(env, listen_port_props, &listen_port), 1);
   device->listen_port = listen_port;
 
   uint32_t peers_length;
-  ASSERT_NAPI_CALL(env, napi_get_array_length(env, peers_props, &peers_length), 1);
+  ASSERT_NAPI_CALL(env, napi_get_array_length(env, values[7], &peers_length), 1);
+  if (peers_length == 0)
+  {
+    return 0;
+  }
+
+  // The peers are taken from the arena at once, as the length of the array is known up front.
+  wg_peer *peers = ewb_arena_alloc(arena, (size_t)peers_length * sizeof(wg_peer));
+  if (peers == NULL)
+  {
+    napi_throw_error(env, EWB_NNA_CALLFAIL, "Failed to allocate the peer!");
+    return 1;
+  }
 
-  wg_peer *last_peer = NULL;
   for (uint32_t i = 0; i < peers_length; i++)
   {
-    napi_value peer_value;
-    ASSERT_NAPI_CALL(env, napi_get_element(env, peers_props, i, &peer_value), 1);
+    // The handles of a peer are not needed once it is read, so we let them go before the next one.
+    napi_handle_scope scope;
+    ASSERT_NAPI_CALL(env, napi_open_handle_scope(env, &scope), 1);
 
+    napi_value peer_value;
     napi_valuetype peer_type;
-    ASSERT_NAPI_CALL(env, napi_typeof(env, peers_props, &peer_type), 1);
-
-    if (peer_type != napi_object)
+    if (napi_get_element(env, values[7], i, &peer_value) != napi_ok || napi_typeof(env, peer_value, &peer_type) != napi_ok || peer_type != napi_object)
     {
-      napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of the element of peer property is object!");
-      return 1;
-    }
-
-    wg_peer *peer = calloc(1, sizeof(wg_peer));
-    uint32_t ret = get_wg_peer_from_napi_object(env, peer_value, peer);
+      napi_close_handle_scope(env, scope);
 
-    if (ret)
-    {
-      napi_throw_error(env, EWB_OBJ_UNSPEC, "Failed to unwrap the object to wg_peer!");
+      napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of the element of peer property is object!");
       return 1;
     }
 
+    wg_peer *peer = &peers[i];
     if (device->first_peer == NULL)
     {
       device->first_peer = peer;
-      last_peer = peer;
     }
     else
     {
-      last_peer->next_peer = peer;
-      last_peer = peer;
+      device->last_peer->next_peer = peer;
     }
-  }
-  device->last_peer = last_peer;
+    device->last_peer = peer;
 
-  return 0;
-}
+    uint32_t ret = get_wg_peer_from_napi_object(env, keys, arena, peer_value, peer);
+    ASSERT_NAPI_CALL(env, napi_close_handle_scope(env, scope), 1);
+    if (ret)
+    {
+      return 1;
+    }
+  }
 
-static napi_value set_device(napi_env env, const napi_callback_info info)
+  return 0;
+}
+
+// The device is built in an arena of the call, which the caller releases instead of freeing the device.
+static struct wg_device *create_wg_device_from_napi_value(napi_env env, napi_value value, const char *binding_name, ewb_arena **arena)
 {
-  size_t argc = 1;
-  napi_value args[1];
-  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, NULL, NULL));
-  if (argc != 1)
+  napi_valuetype value_type;
+  NAPI_CALL(env, napi_typeof(env, value, &value_type));
+  if (value_type != napi_object)
   {
-    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected argument size of set_device is 1!");
+    char message[128];
+    snprintf(message, sizeof(message), "The expected type of first argument of %s is object!", binding_name);
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, message);
     return NULL;
   }
 
-  napi_valuetype argt_0;
+  *arena = ewb_arena_acquire();
+
+  struct wg_device *device = *arena == NULL ? NULL : ewb_arena_alloc(*arena, sizeof(struct wg_device));
+  if (device == NULL || get_wg_device_from_napi_object(env, value, *arena, device))
+  {
+    ewb_arena_release(*arena);
+    *arena = NULL;
+
+    napi_throw_error(env, EWB_OBJ_UNSPEC, "Failed to unwrap the object to wg_device!");
+    return NULL;
+  }
+
+  return device;
+}
+
+// Every native struct wrapped in an object starts with its kind, as napi_unwrap hands back whatever the object wraps.
+// A method called on another kind of object, such as pool.allocate.call(index), is then refused instead of reading the wrong struct.
+typedef enum
+{
+  WRAPPED_ADDRESS_POOL = 0x45574201,
+  WRAPPED_SESSION,
+  WRAPPED_ALLOWEDIP_INDEX,
+  WRAPPED_PEER_CURSOR,
+  WRAPPED_WATCH,
+  WRAPPED_DEVICE_WATCH,
+} wrapped_kind;
+
+static void *unwrap_kind(napi_env env, napi_value this_arg, wrapped_kind kind)
+{
+  void *data = NULL;
+  if (this_arg == NULL || napi_unwrap(env, this_arg, &data) != napi_ok || data == NULL || *(const wrapped_kind *)data != kind)
+  {
+    return NULL;
+  }
+
+  return data;
+}
+
+// The session keeps the sockets it opened in its namespace, so the calls on it never enter the namespace again.
+typedef struct
+{
+  wrapped_kind kind;
+  ewb_nl_session nl;
+  ewb_rtnl_socket rtnl;
+  // The namespace of the session, or -1 for the one of the process.
+  int netns_fd;
+} session_data;
+
+static session_data *unwrap_session_data(napi_env env, napi_value this_arg)
+{
+  // The device bindings are shared with the session object, so any other `this` is taken as no session.
+  return unwrap_kind(env, this_arg, WRAPPED_SESSION);
+}
+
+static ewb_nl_session *unwrap_session(napi_env env, napi_value this_arg)
+{
+  session_data *session = unwrap_session_data(env, this_arg);
+
+  return session != NULL ? &session->nl : NULL;
+}
+
+// Returns the route socket of the session in a namespace, or NULL for the socket shared by the namespace of the process.
+static ewb_rtnl_socket *unwrap_rtnl_socket(napi_env env, napi_value this_arg)
+{
+  session_data *session = unwrap_session_data(env, this_arg);
+
+  return session != NULL && session->netns_fd >= 0 ? &session->rtnl : NULL;
+}
+
+// Sets the ifindex to zero if the interface doesn't exist, and only fails if the route socket of the session does.
+static int get_rtnl_ifindex(ewb_rtnl_socket *rtnl, const char *name, uint32_t *ifindex)
+{
+  if (rtnl == NULL)
+  {
+    *ifindex = if_nametoindex(name);
+    return 0;
+  }
+
+  int ret = ewb_rtnl_get_ifindex(rtnl, name, ifindex);
+
+  return ret == -ENODEV ? 0 : ret;
+}
+
+static void record_wg_device_items(const struct wg_device *device)
+{
+  uint64_t peer_count = 0, allowedip_count = 0;
+
+  struct wg_peer *peer;
+  wg_for_each_peer(device, peer)
+  {
+    struct wg_allowedip *allowedip;
+    wg_for_each_allowedip(peer, allowedip)
+    {
+      allowedip_count++;
+    }
+    peer_count++;
+  }
+
+  ewb_metrics_record_items(peer_count, allowedip_count);
+}
+
+// The time in the backend, from the request to the decoded reply, is counted as kernel time of the current call.
+static int get_wg_device(ewb_nl_session *session, struct wg_device **device, const char *device_name)
+{
+  uint64_t started_at = ewb_metrics_now();
+  int ret = ewb_backend_get_device(session, device, device_name);
+  ewb_metrics_record_kernel_time(started_at);
+
+  if (!ret && *device != NULL)
+  {
+    record_wg_device_items(*device);
+  }
+
+  return ret;
+}
+
+static int set_wg_device(ewb_nl_session *session, struct wg_device *device)
+{
+  uint64_t started_at = ewb_metrics_now();
+  int ret = ewb_backend_set_device(session, device);
+  ewb_metrics_record_kernel_time(started_at);
+
+  if (!ret)
+  {
+    record_wg_device_items(device);
+  }
+
+  return ret;
+}
+
+static int sync_wg_device(ewb_nl_session *session, struct wg_device *desired, ewb_arena *arena, ewb_sync_summary *summary)
+{
+  struct wg_device *current = NULL;
+  int ret = get_wg_device(session, &current, desired->name);
+  if (ret || current == NULL)
+  {
+    wg_free_device(current);
+    return ret ? ret : -ENODEV;
+  }
+
+  ret = ewb_sync_reduce_device(current, desired, arena, summary);
+  wg_free_device(current);
+
+  // Everything left in the desired device after the reduction is the delta, which goes out as one set call.
+  if (!ret && (summary->is_device_changed || desired->first_peer != NULL))
+  {
+    ret = set_wg_device(session, desired);
+
+    // The caller only destroys the summary of a successful sync.
+    if (ret)
+    {
+      ewb_sync_summary_destroy(summary);
+    }
+  }
+
+  return ret;
+}
+
+static napi_value create_key_array_from_wg_keys(napi_env env, const wg_key *keys, size_t count)
+{
+  napi_value keys_array;
+  NAPI_CALL(env, napi_create_array_with_length(env, count, &keys_array));
+
+  key_format format = get_default_key_format(env);
+  for (size_t i = 0; i < count; i++)
+  {
+    napi_value key = create_key_value_from_wg_key(env, keys[i], format);
+    if (key == NULL)
+    {
+      return NULL;
+    }
+
+    NAPI_CALL(env, napi_set_element(env, keys_array, i, key));
+  }
+
+  return keys_array;
+}
+
+static napi_value create_summary_object_from_sync_summary(napi_env env, const ewb_sync_summary *summary)
+{
+  napi_value summary_obj;
+  NAPI_CALL(env, napi_create_object(env, &summary_obj));
+
+  napi_value added, removed, updated, unchanged, device_changed;
+  added = create_key_array_from_wg_keys(env, summary->added, summary->added_count);
+  removed = create_key_array_from_wg_keys(env, summary->removed, summary->removed_count);
+  updated = create_key_array_from_wg_keys(env, summary->updated, summary->updated_count);
+  if (added == NULL || removed == NULL || updated == NULL)
+  {
+    return NULL;
+  }
+
+  NAPI_CALL(env, napi_create_uint32(env, summary->unchanged_count, &unchanged));
+  NAPI_CALL(env, napi_get_boolean(env, summary->is_device_changed, &device_changed));
+  NAPI_CALL(env, napi_set_named_property(env, summary_obj, "added", added));
+  NAPI_CALL(env, napi_set_named_property(env, summary_obj, "removed", removed));
+  NAPI_CALL(env, napi_set_named_property(env, summary_obj, "updated", updated));
+  NAPI_CALL(env, napi_set_named_property(env, summary_obj, "unchanged", unchanged));
+  NAPI_CALL(env, napi_set_named_property(env, summary_obj, "deviceChanged", device_changed));
+
+  return summary_obj;
+}
+
+// Unwraps the arguments of sync_device, the name in the first argument takes precedence over the name in the config.
+static struct wg_device *get_desired_wg_device_from_napi_values(napi_env env, size_t argc, napi_value *args, const char *binding_name, ewb_arena **arena)
+{
+  char message[128];
+  if (argc != 2)
+  {
+    snprintf(message, sizeof(message), "The expected argument size of %s is 2!", binding_name);
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, message);
+    return NULL;
+  }
+
+  napi_valuetype argt_0, argt_1;
   NAPI_CALL(env, napi_typeof(env, args[0], &argt_0));
-  if (argt_0 != napi_object)
+  NAPI_CALL(env, napi_typeof(env, args[1], &argt_1));
+  if (argt_0 != napi_string)
+  {
+    snprintf(message, sizeof(message), "The expected type of first argument of %s is string!", binding_name);
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, message);
+    return NULL;
+  }
+  if (argt_1 != napi_object)
   {
-    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of first argument of set_device is object!");
+    snprintf(message, sizeof(message), "The expected type of second argument of %s is object!", binding_name);
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, message);
     return NULL;
   }
 
-  struct wg_device *device = calloc(1, sizeof(struct wg_device));
+  struct wg_device *device = create_wg_device_from_napi_value(env, args[1], binding_name, arena);
+  if (device == NULL)
+  {
+    return NULL;
+  }
 
-  if (get_wg_device_from_napi_object(env, args[0], device))
+  char *device_name;
+  if (napi_utils_get_value_string(env, args[0], &device_name) != napi_ok)
   {
-    wg_free_device(device);
+    ewb_arena_release(*arena);
+    *arena = NULL;
+    return NULL;
+  }
+  memset(device->name, 0, IFNAMSIZ);
+  strncpy(device->name, device_name, IFNAMSIZ - 1);
+  free(device_name);
 
-    napi_throw_error(env, EWB_OBJ_UNSPEC, "Failed to unwrap the object to wg_device!");
+  return device;
+}
+
+static napi_value sync_device(napi_env env, const napi_callback_info info)
+{
+  size_t argc = 2;
+  napi_value args[2], this_arg;
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, &this_arg, NULL));
+
+  ewb_arena *arena;
+  struct wg_device *device = get_desired_wg_device_from_napi_values(env, argc, args, "sync_device", &arena);
+  if (device == NULL)
+  {
     return NULL;
   }
 
-  if (wg_set_device(device))
+  ewb_sync_summary summary;
+  if (sync_wg_device(unwrap_session(env, this_arg), device, arena, &summary))
   {
-    wg_free_device(device);
+    ewb_arena_release(arena);
+
+    napi_throw_error(env, EWB_LIB_CALLFAIL, "Failed to sync the device!");
+    return NULL;
+  }
+
+  ewb_arena_release(arena);
+
+  napi_value result = create_summary_object_from_sync_summary(env, &summary);
+  ewb_sync_summary_destroy(&summary);
+
+  return result;
+}
+
+static napi_value set_device(napi_env env, const napi_callback_info info)
+{
+  size_t argc = 1;
+  napi_value args[1], this_arg;
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, &this_arg, NULL));
+  if (argc != 1)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected argument size of set_device is 1!");
+    return NULL;
+  }
+
+  ewb_arena *arena;
+  struct wg_device *device = create_wg_device_from_napi_value(env, args[0], "set_device", &arena);
+  if (device == NULL)
+  {
+    return NULL;
+  }
+
+  if (set_wg_device(unwrap_session(env, this_arg), device))
+  {
+    ewb_arena_release(arena);
 
     napi_throw_error(env, EWB_LIB_CALLFAIL, "Failed to set the device!");
     return NULL;
   }
 
-  wg_free_device(device);
+  ewb_arena_release(arena);
 
   return NULL;
 }
 
 static napi_value get_device(napi_env env, const napi_callback_info info)
 {
-  size_t argc = 1;
-  napi_value args[1];
-  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, NULL, NULL));
-  if (argc != 1)
+  size_t argc = 2;
+  napi_value args[2], this_arg;
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, &this_arg, NULL));
+  if (argc != 1 && argc != 2)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected argument size of get_device is 1 or 2!");
+    return NULL;
+  }
+
+  key_format format;
+  if (get_key_format_from_napi_options(env, args[1], &format))
   {
-    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected argument size of get_device is 1!");
     return NULL;
   }
 
@@ -551,7 +1144,7 @@ static napi_value get_device(napi_env env, const napi_callback_info info)
   NAPI_CALL(env, napi_utils_get_value_string(env, args[0], &device_name));
   struct wg_device *device = {0};
 
-  if (wg_get_device(&device, device_name))
+  if (get_wg_device(unwrap_session(env, this_arg), &device, device_name))
   {
     free(device_name);
     wg_free_device(device);
@@ -568,20 +1161,20 @@ static napi_value get_device(napi_env env, const napi_callback_info info)
     return NULL;
   }
 
-  napi_value result = create_device_object_from_wg_device(env, device);
+  napi_value result = create_device_object_from_wg_device(env, device, format);
   wg_free_device(device);
 
   return result;
 }
 
-static napi_value add_device(napi_env env, const napi_callback_info info)
+static napi_value get_peer_stats(napi_env env, const napi_callback_info info)
 {
   size_t argc = 1;
-  napi_value args[1];
-  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+  napi_value args[1], this_arg;
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, &this_arg, NULL));
   if (argc != 1)
   {
-    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected argument size of add_device is 1!");
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected argument size of get_peer_stats is 1!");
     return NULL;
   }
 
@@ -589,15 +1182,18 @@ static napi_value add_device(napi_env env, const napi_callback_info info)
   NAPI_CALL(env, napi_typeof(env, args[0], &argt_0));
   if (argt_0 != napi_string)
   {
-    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of first argument of add_device is string!");
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of first argument of get_peer_stats is string!");
     return NULL;
   }
 
   char *device_name;
   NAPI_CALL(env, napi_utils_get_value_string(env, args[0], &device_name));
-  if (wg_add_device(device_name))
+  struct wg_device *device = NULL;
+
+  if (get_wg_device(unwrap_session(env, this_arg), &device, device_name) || device == NULL)
   {
     free(device_name);
+    wg_free_device(device);
 
     napi_throw_error(env, EWB_LIB_CALLFAIL, "Failed to get the device!");
     return NULL;
@@ -605,17 +1201,20 @@ static napi_value add_device(napi_env env, const napi_callback_info info)
 
   free(device_name);
 
-  return NULL;
+  napi_value result = create_peer_stats_object_from_wg_device(env, device);
+  wg_free_device(device);
+
+  return result;
 }
 
-static napi_value remove_device(napi_env env, const napi_callback_info info)
+static napi_value get_device_snapshot(napi_env env, const napi_callback_info info)
 {
   size_t argc = 1;
-  napi_value args[1];
-  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+  napi_value args[1], this_arg;
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, &this_arg, NULL));
   if (argc != 1)
   {
-    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected argument size of add_device is 1!");
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected argument size of get_device_snapshot is 1!");
     return NULL;
   }
 
@@ -623,15 +1222,18 @@ static napi_value remove_device(napi_env env, const napi_callback_info info)
   NAPI_CALL(env, napi_typeof(env, args[0], &argt_0));
   if (argt_0 != napi_string)
   {
-    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of first argument of add_device is string!");
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of first argument of get_device_snapshot is string!");
     return NULL;
   }
 
   char *device_name;
   NAPI_CALL(env, napi_utils_get_value_string(env, args[0], &device_name));
-  if (wg_del_device(device_name))
+  struct wg_device *device = NULL;
+
+  if (get_wg_device(unwrap_session(env, this_arg), &device, device_name) || device == NULL)
   {
     free(device_name);
+    wg_free_device(device);
 
     napi_throw_error(env, EWB_LIB_CALLFAIL, "Failed to get the device!");
     return NULL;
@@ -639,133 +1241,156 @@ static napi_value remove_device(napi_env env, const napi_callback_info info)
 
   free(device_name);
 
-  return NULL;
-}
-
-static napi_value list_device_names(napi_env env, napi_callback_info info)
-{
-  napi_status status;
-  napi_value device_names_value;
+  // We write the snapshot straight into the memory of the ArrayBuffer, so there is nothing to copy afterwards.
+  napi_value result;
+  void *data;
+  if (napi_create_arraybuffer(env, ewb_snapshot_get_size(device), &data, &result) != napi_ok)
+  {
+    wg_free_device(device);
 
-  status = napi_create_array(env, &device_names_value);
-  assert(status == napi_ok);
+    napi_throw_error(env, EWB_NNA_CALLFAIL, "Failed to create the ArrayBuffer of the device snapshot!");
+    return NULL;
+  }
 
-  char *device_names = wg_list_device_names();
+  ewb_snapshot_write(device, data);
+  wg_free_device(device);
 
-  uint32_t segment_start_position = 0;
-  uint32_t device_names_value_iteration = 0;
-  size_t i = 0;
+  return result;
+}
 
-  for (;;)
+static napi_value set_device_from_snapshot(napi_env env, const napi_callback_info info)
+{
+  size_t argc = 1;
+  napi_value args[1], this_arg;
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, &this_arg, NULL));
+  if (argc != 1)
   {
-    if (device_names[i] == '\0')
-    {
-      size_t segment_size = i - segment_start_position;
-      char *segment_value = calloc(segment_size, sizeof(char));
-      strncpy(segment_value, device_names + segment_start_position, i - segment_start_position);
-
-      napi_value segment;
-      status = napi_create_string_utf8(env, segment_value, NAPI_AUTO_LENGTH, &segment);
-      assert(status == napi_ok);
-
-      status = napi_set_element(env, device_names_value, device_names_value_iteration++, segment);
-      assert(status == napi_ok);
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected argument size of set_device_from_snapshot is 1!");
+    return NULL;
+  }
 
-      segment_start_position = i + 1;
+  void *data;
+  size_t size;
+  if (napi_utils_get_value_bytes(env, args[0], &data, &size) != napi_ok)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of first argument of set_device_from_snapshot is ArrayBuffer or its view!");
+    return NULL;
+  }
 
-      free(segment_value);
+  struct wg_device *device;
+  if (ewb_snapshot_read(data, size, &device))
+  {
+    napi_throw_error(env, EWB_OBJ_UNSPEC, "Failed to read the device snapshot!");
+    return NULL;
+  }
+  ewb_snapshot_set_restore_flags(device);
 
-      if (device_names[i + 1] == '\0')
-      {
-        break;
-      }
-    }
+  if (set_wg_device(unwrap_session(env, this_arg), device))
+  {
+    wg_free_device(device);
 
-    i++;
+    napi_throw_error(env, EWB_LIB_CALLFAIL, "Failed to set the device!");
+    return NULL;
   }
-  free(device_names);
 
-  return device_names_value;
+  wg_free_device(device);
+
+  return NULL;
 }
 
-static napi_value generate_public_key(napi_env env, const napi_callback_info info)
+static napi_value set_conf_from_file(napi_env env, const napi_callback_info info)
 {
-  size_t argc = 1;
-  napi_value args[1];
-  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, NULL, NULL));
-  if (argc != 1)
+  size_t argc = 2;
+  napi_value args[2], this_arg;
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, &this_arg, NULL));
+  if (argc != 2)
   {
-    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected argument size of generate_public_key is 1!");
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected argument size of set_conf_from_file is 2!");
     return NULL;
   }
 
-  napi_valuetype argt_0;
+  napi_valuetype argt_0, argt_1;
   NAPI_CALL(env, napi_typeof(env, args[0], &argt_0));
+  NAPI_CALL(env, napi_typeof(env, args[1], &argt_1));
   if (argt_0 != napi_string)
   {
-    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of first argument of generate_public_key is string!");
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of first argument of set_conf_from_file is string!");
+    return NULL;
+  }
+  if (argt_1 != napi_string)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of second argument of set_conf_from_file is string!");
     return NULL;
   }
 
-  char *private_key_str;
-  wg_key private_key;
-  wg_key public_key;
+  char name[IFNAMSIZ];
+  size_t name_length;
+  NAPI_CALL(env, napi_get_value_string_utf8(env, args[0], NULL, 0, &name_length));
+  if (name_length >= IFNAMSIZ)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected length of first argument of set_conf_from_file is less than 16 bytes!");
+    return NULL;
+  }
+  NAPI_CALL(env, napi_get_value_string_utf8(env, args[0], name, sizeof(name), NULL));
+
+  char *path;
+  NAPI_CALL(env, napi_utils_get_value_string(env, args[1], &path));
 
-  NAPI_CALL(env, napi_utils_get_value_string(env, args[0], &private_key_str));
-  if (wg_key_from_base64(private_key, private_key_str))
+  ewb_arena *arena = ewb_arena_acquire();
+  if (arena == NULL)
   {
-    free(private_key_str);
+    free(path);
 
-    napi_throw_error(env, EWB_LIB_CALLFAIL, "Failed to parse base64 encoded key!");
+    napi_throw_error(env, EWB_LIB_CALLFAIL, "Failed to allocate the memory!");
     return NULL;
   }
 
-  wg_generate_public_key(public_key, private_key);
-  free(private_key_str);
+  struct wg_device *device;
+  size_t error_line;
+  int ret = ewb_conf_read_file(arena, path, &device, &error_line);
+  free(path);
 
-  wg_key_b64_string public_key_str;
-  wg_key_to_base64(public_key_str, public_key);
+  if (ret)
+  {
+    ewb_arena_release(arena);
 
-  napi_value result;
-  NAPI_CALL(env, napi_create_string_utf8(env, public_key_str, NAPI_AUTO_LENGTH, &result));
+    // The line is only known for the configs read to the end, so the other failures are of the file.
+    if (error_line > 0)
+    {
+      char message[64];
+      snprintf(message, sizeof(message), "The line %zu of the config is not valid!", error_line);
 
-  return result;
-}
+      napi_throw_error(env, EWB_AI_UNFORMAT, message);
+      return NULL;
+    }
 
-static napi_value generate_private_key(napi_env env, const napi_callback_info info)
-{
-  wg_key private_key;
-  wg_key_b64_string private_key_str;
-  wg_generate_private_key(private_key);
-  wg_key_to_base64(private_key_str, private_key);
+    napi_throw_error(env, EWB_ARG_UNSPEC, "Failed to read the config file!");
+    return NULL;
+  }
 
-  napi_value result;
-  NAPI_CALL(env, napi_create_string_utf8(env, private_key_str, NAPI_AUTO_LENGTH, &result));
+  memcpy(device->name, name, sizeof(name));
 
-  return result;
-}
+  if (set_wg_device(unwrap_session(env, this_arg), device))
+  {
+    ewb_arena_release(arena);
 
-static napi_value generate_preshared_key(napi_env env, const napi_callback_info info)
-{
-  wg_key preshared_key;
-  wg_key_b64_string preshared_key_str;
-  wg_generate_preshared_key(preshared_key);
-  wg_key_to_base64(preshared_key_str, preshared_key);
+    napi_throw_error(env, EWB_LIB_CALLFAIL, "Failed to set the device!");
+    return NULL;
+  }
 
-  napi_value result;
-  NAPI_CALL(env, napi_create_string_utf8(env, preshared_key_str, NAPI_AUTO_LENGTH, &result));
+  ewb_arena_release(arena);
 
-  return result;
+  return NULL;
 }
 
-static napi_value get_interface_address(napi_env env, const napi_callback_info info)
+static napi_value show_conf(napi_env env, const napi_callback_info info)
 {
   size_t argc = 1;
-  napi_value args[1];
-  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+  napi_value args[1], this_arg;
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, &this_arg, NULL));
   if (argc != 1)
   {
-    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected argument size of get_device is 1!");
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected argument size of show_conf is 1!");
     return NULL;
   }
 
@@ -773,203 +1398,5017 @@ static napi_value get_interface_address(napi_env env, const napi_callback_info i
   NAPI_CALL(env, napi_typeof(env, args[0], &argt_0));
   if (argt_0 != napi_string)
   {
-    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of first argument of get_interface_address is string!");
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of first argument of show_conf is string!");
     return NULL;
   }
 
   char *device_name;
   NAPI_CALL(env, napi_utils_get_value_string(env, args[0], &device_name));
+  struct wg_device *device = NULL;
 
-  struct ifaddrs *ifaddr, *ifa;
-  char host[NI_MAXHOST];
-
-  napi_value ifaddrs_value;
-  NAPI_CALL(env, napi_create_array(env, &ifaddrs_value));
-
-  if (getifaddrs(&ifaddr) == -1)
+  if (get_wg_device(unwrap_session(env, this_arg), &device, device_name) || device == NULL)
   {
     free(device_name);
+    wg_free_device(device);
 
-    napi_throw_error(env, EWB_SOC_CALLFAIL, "Unable to get socket addresses!");
+    napi_throw_error(env, EWB_LIB_CALLFAIL, "Failed to get the device!");
     return NULL;
   }
 
-  uint32_t index = 0;
-  for (ifa = ifaddr; ifa != NULL; ifa = ifa->ifa_next)
+  free(device_name);
+
+  size_t length;
+  char *text = ewb_conf_format(device, &length);
+  wg_free_device(device);
+
+  if (text == NULL)
   {
-    if (ifa->ifa_addr == NULL || strcmp(ifa->ifa_name, device_name) != 0)
-    {
-      continue;
-    }
+    napi_throw_error(env, EWB_LIB_CALLFAIL, "Failed to format the config!");
+    return NULL;
+  }
 
-    if (ifa->ifa_addr->sa_family == AF_INET)
-    {
-      struct sockaddr_in *sa = (struct sockaddr_in *)ifa->ifa_addr;
-      inet_ntop(AF_INET, &sa->sin_addr, host, NI_MAXHOST);
-    }
-    else if (ifa->ifa_addr->sa_family == AF_INET6)
-    {
-      struct sockaddr_in6 *sa = (struct sockaddr_in6 *)ifa->ifa_addr;
-      inet_ntop(AF_INET6, &sa->sin6_addr, host, NI_MAXHOST);
-    }
-    else
-    {
-      continue;
-    }
+  napi_value result;
+  napi_status status = napi_create_string_utf8(env, text, length, &result);
+  free(text);
+  NAPI_CALL(env, status);
 
-    napi_value entry_value, family_value, ip_value;
-    if (
-      napi_create_object(env, &entry_value) +
-      napi_create_string_utf8(env, host, NAPI_AUTO_LENGTH, &ip_value) +
-      napi_create_uint32(env, ifa->ifa_addr->sa_family, &family_value) +
-      napi_set_named_property(env, entry_value, "family", family_value) +
-      napi_set_named_property(env, entry_value, "ip", ip_value) +
-      napi_set_element(env, ifaddrs_value, index++, entry_value)
-      != (napi_ok * 6)
-    )
-    {
-      free(device_name);
-      freeifaddrs(ifaddr);
+  return result;
+}
 
-      return NULL;
-    }
-  }
+// The session in a namespace creates the link there, as the library only knows the namespace of the caller.
+static int add_wg_device(ewb_rtnl_socket *rtnl, const char *device_name)
+{
+  uint64_t started_at = ewb_metrics_now();
+  int ret = rtnl != NULL ? ewb_rtnl_add_link(rtnl, device_name, "wireguard") : wg_add_device(device_name);
+  ewb_metrics_record_kernel_time(started_at);
 
-  free(device_name);
-  freeifaddrs(ifaddr);
+  return ret;
+}
 
-  return ifaddrs_value;
+static int remove_wg_device(ewb_rtnl_socket *rtnl, const char *device_name)
+{
+  uint64_t started_at = ewb_metrics_now();
+  int ret = rtnl != NULL ? ewb_rtnl_del_link(rtnl, device_name) : wg_del_device(device_name);
+  ewb_metrics_record_kernel_time(started_at);
+
+  return ret;
 }
 
-static napi_value set_interface_address(napi_env env, const napi_callback_info info)
+static napi_value add_device(napi_env env, const napi_callback_info info)
 {
-  size_t argc = 2;
-  napi_value args[2];
-  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, NULL, NULL));
-  if (argc != 2)
+  size_t argc = 1;
+  napi_value args[1], this_arg;
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, &this_arg, NULL));
+  if (argc != 1)
   {
-    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected argument size of set_interface_address is 2!");
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected argument size of add_device is 1!");
     return NULL;
   }
 
-  napi_valuetype argt_0, argt_1;
+  napi_valuetype argt_0;
   NAPI_CALL(env, napi_typeof(env, args[0], &argt_0));
-  NAPI_CALL(env, napi_typeof(env, args[1], &argt_1));
-
   if (argt_0 != napi_string)
   {
-    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of first argument of set_interface_address is string!");
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of first argument of add_device is string!");
     return NULL;
   }
-  if (argt_1 != napi_object)
+
+  char *device_name;
+  NAPI_CALL(env, napi_utils_get_value_string(env, args[0], &device_name));
+  if (add_wg_device(unwrap_rtnl_socket(env, this_arg), device_name))
   {
-    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of second argument of set_interface_address is object!");
+    free(device_name);
+
+    napi_throw_error(env, EWB_LIB_CALLFAIL, "Failed to get the device!");
     return NULL;
   }
 
-  napi_value family_props, ip_props;
-  NAPI_CALL(env, napi_get_named_property(env, args[1], "family", &family_props));
-  NAPI_CALL(env, napi_get_named_property(env, args[1], "ip", &ip_props));
+  free(device_name);
 
-  napi_valuetype family_type, ip_type;
-  NAPI_CALL(env, napi_typeof(env, family_props, &family_type));
-  NAPI_CALL(env, napi_typeof(env, ip_props, &ip_type));
+  return NULL;
+}
 
-  if (family_type != napi_number)
+static napi_value remove_device(napi_env env, const napi_callback_info info)
+{
+  size_t argc = 1;
+  napi_value args[1], this_arg;
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, &this_arg, NULL));
+  if (argc != 1)
   {
-    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of family property of address is number!");
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected argument size of add_device is 1!");
     return NULL;
   }
-  if (ip_type != napi_string)
+
+  napi_valuetype argt_0;
+  NAPI_CALL(env, napi_typeof(env, args[0], &argt_0));
+  if (argt_0 != napi_string)
   {
-    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of ip property of address is string!");
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of first argument of add_device is string!");
     return NULL;
   }
 
-  uint32_t family;
-  char *device_name, *ip;
-  union
-  {
-    struct in_addr v4;
-    struct in6_addr v6;
-  } addr;
-  NAPI_CALL(env, napi_get_value_uint32(env, family_props, &family));
+  char *device_name;
   NAPI_CALL(env, napi_utils_get_value_string(env, args[0], &device_name));
-  NAPI_CALL(env, napi_utils_get_value_string(env, ip_props, &ip));
-
-  if (inet_pton(family, ip, &addr) != 1)
+  if (remove_wg_device(unwrap_rtnl_socket(env, this_arg), device_name))
   {
-    free(ip);
     free(device_name);
 
-    napi_throw_type_error(env, EWB_AF_UNSPEC, "Failed to validate the address family! Please, give a valid ip address.");
+    napi_throw_error(env, EWB_LIB_CALLFAIL, "Failed to get the device!");
     return NULL;
   }
 
-  free(ip);
+  free(device_name);
 
-  int sockfd = socket(family, SOCK_DGRAM, 0);
-  if (sockfd == -1)
+  return NULL;
+}
+
+static napi_value create_device_names_array_from_wg_device_names(napi_env env, char *device_names)
+{
+  napi_value device_names_value;
+  NAPI_CALL(env, napi_create_array(env, &device_names_value));
+
+  char *device_name;
+  size_t device_name_length;
+  uint32_t index = 0;
+  wg_for_each_device_name(device_names, device_name, device_name_length)
   {
-    napi_throw_error(env, EWB_SOC_CALLFAIL, "Failed to open socket for interface!");
+    napi_value segment;
+    NAPI_CALL(env, napi_create_string_utf8(env, device_name, device_name_length, &segment));
+    NAPI_CALL(env, napi_set_element(env, device_names_value, index++, segment));
+  }
+
+  return device_names_value;
+}
+
+static char *list_wg_device_names(void)
+{
+  uint64_t started_at = ewb_metrics_now();
+  char *device_names = ewb_backend_list_device_names();
+  ewb_metrics_record_kernel_time(started_at);
+
+  return device_names;
+}
+
+static napi_value list_device_names(napi_env env, napi_callback_info info)
+{
+  napi_value this_arg;
+  NAPI_CALL(env, napi_get_cb_info(env, info, NULL, NULL, &this_arg, NULL));
+
+  // Only a session in another namespace lists the links of its own socket, the others list the userspace devices too as wg.listDeviceNames does.
+  ewb_rtnl_socket *rtnl = unwrap_rtnl_socket(env, this_arg);
+  char *device_names = rtnl != NULL ? ewb_rtnl_list_links(rtnl, "wireguard") : list_wg_device_names();
+  if (device_names == NULL)
+  {
+    napi_throw_error(env, EWB_LIB_CALLFAIL, "Failed to list the device names!");
     return NULL;
   }
 
-  // The warning here is expected, but will not remove for the future debug and improvement.
-  struct ifreq ifr;
-  strncpy(ifr.ifr_name, device_name, IFNAMSIZ);
-  free(device_name);
+  napi_value result = create_device_names_array_from_wg_device_names(env, device_names);
+  free(device_names);
 
-  if (family == AF_INET)
+  return result;
+}
+
+typedef struct
+{
+  napi_async_work work;
+  napi_deferred deferred;
+  char *device_name;
+  struct wg_device *device;
+  // The arena of the device built from javascript, or NULL if the device comes from the kernel.
+  ewb_arena *arena;
+  char *device_names;
+  ewb_sync_summary summary;
+  ewb_nl_session *session;
+  napi_ref session_ref;
+  key_format key_format;
+  ewb_metrics_call metrics;
+  const char *error_code;
+  // The message to reject with, for the bindings sharing void_device_async_complete.
+  const char *failure_message;
+  int ret;
+} device_async_context;
+
+static void free_device_async_context(napi_env env, device_async_context *context)
+{
+  if (context->work != NULL)
   {
-    ifr.ifr_addr.sa_family = AF_INET;
-    memcpy(&((struct sockaddr_in *)&ifr.ifr_addr)->sin_addr, &addr.v4, sizeof(struct in_addr));
+    napi_delete_async_work(env, context->work);
+  }
+
+  if (context->session_ref != NULL)
+  {
+    napi_delete_reference(env, context->session_ref);
+  }
+
+  ewb_metrics_call_end(&context->metrics, context->error_code);
+
+  free(context->device_name);
+  free(context->device_names);
+  ewb_sync_summary_destroy(&context->summary);
+  if (context->arena != NULL)
+  {
+    ewb_arena_release(context->arena);
   }
   else
   {
-    ifr.ifr_addr.sa_family = AF_INET6;
-    memcpy(&((struct sockaddr_in6 *)&ifr.ifr_addr)->sin6_addr, &addr.v6, sizeof(struct in6_addr));
+    wg_free_device(context->device);
   }
+  free(context);
+}
+
+static void reject_deferred(napi_env env, napi_deferred deferred, const char *code, const char *message)
+{
+  napi_value error_code, error_message, error;
 
-  if (ioctl(sockfd, SIOCSIFADDR, &ifr) == -1)
+  // The pending exception from failed conversion has more detail than ours, so prefer it if any.
+  bool is_exception_pending;
+  if (napi_is_exception_pending(env, &is_exception_pending) == napi_ok && is_exception_pending)
   {
-    napi_throw_error(env, EWB_SOC_CALLFAIL, "SIOCSIFADDR");
+    if (napi_get_and_clear_last_exception(env, &error) == napi_ok)
+    {
+      napi_reject_deferred(env, deferred, error);
+      return;
+    }
+  }
 
-    close(sockfd);
+  if (
+    napi_create_string_utf8(env, code, NAPI_AUTO_LENGTH, &error_code) != napi_ok ||
+    napi_create_string_utf8(env, message, NAPI_AUTO_LENGTH, &error_message) != napi_ok ||
+    napi_create_error(env, error_code, error_message, &error) != napi_ok
+  )
+  {
+    napi_get_undefined(env, &error);
+  }
+
+  napi_reject_deferred(env, deferred, error);
+}
+
+// Settles the promise at once for the bindings failing before they have a context to queue, with the errno as in applyMany.
+static napi_value create_rejected_promise_from_errno(napi_env env, const char *code, const char *message, int ret)
+{
+  napi_value promise, error_code, error_message, error, error_errno;
+  napi_deferred deferred;
+  NAPI_CALL(env, napi_create_promise(env, &deferred, &promise));
+  NAPI_CALL(env, napi_create_string_utf8(env, code, NAPI_AUTO_LENGTH, &error_code));
+  NAPI_CALL(env, napi_create_string_utf8(env, message, NAPI_AUTO_LENGTH, &error_message));
+  NAPI_CALL(env, napi_create_error(env, error_code, error_message, &error));
+  NAPI_CALL(env, napi_create_int32(env, ret, &error_errno));
+  NAPI_CALL(env, napi_set_named_property(env, error, "errno", error_errno));
+  NAPI_CALL(env, napi_reject_deferred(env, deferred, error));
+
+  return promise;
+}
+
+static void reject_device_async_context(napi_env env, device_async_context *context, const char *code, const char *message)
+{
+  context->error_code = code;
+  reject_deferred(env, context->deferred, code, message);
+}
+
+static void attach_session_to_device_async_context(napi_env env, device_async_context *context, napi_value this_arg)
+{
+  context->session = unwrap_session(env, this_arg);
+
+  // The session object should outlive the work, so we hold it until the context is freed.
+  if (context->session != NULL && napi_create_reference(env, this_arg, 1, &context->session_ref) != napi_ok)
+  {
+    context->session = NULL;
+  }
+}
+
+static napi_value queue_device_async_context(napi_env env, device_async_context *context, const char *resource_name, napi_async_execute_callback execute, napi_async_complete_callback complete)
+{
+  // The call of the binding goes on with the work, so the context ends it when freed.
+  ewb_metrics_call_hand_off(&context->metrics);
+
+  napi_value promise, resource_name_value;
+  if (
+    napi_create_promise(env, &context->deferred, &promise) != napi_ok ||
+    napi_create_string_utf8(env, resource_name, NAPI_AUTO_LENGTH, &resource_name_value) != napi_ok ||
+    napi_create_async_work(env, NULL, resource_name_value, execute, complete, context, &context->work) != napi_ok ||
+    napi_queue_async_work(env, context->work) != napi_ok
+  )
+  {
+    // The promise is never settled if we reach here, so drop it with the context.
+    context->error_code = EWB_NNA_CALLFAIL;
+    free_device_async_context(env, context);
+
+    napi_throw_error(env, EWB_NNA_CALLFAIL, "Failed to queue the async work!");
     return NULL;
   }
 
-  close(sockfd);
-  return NULL;
+  return promise;
 }
 
-#define DECLARE_NAPI_METHOD(name, func)     \
-  {                                         \
-    name, 0, func, 0, 0, 0, napi_default, 0 \
+// The options are taken as the second argument only if the binding has them, such as getDeviceAsync.
+static device_async_context *create_device_async_context_from_device_name(napi_env env, const napi_callback_info info, const char *binding_name, bool has_options)
+{
+  size_t argc = 2;
+  napi_value args[2], this_arg;
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, &this_arg, NULL));
+  if (argc != 1 && !(has_options && argc == 2))
+  {
+    char message[128];
+    snprintf(message, sizeof(message), has_options ? "The expected argument size of %s is 1 or 2!" : "The expected argument size of %s is 1!", binding_name);
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, message);
+    return NULL;
   }
 
-static napi_value init(napi_env env, napi_value exports)
+  key_format format = get_default_key_format(env);
+  if (has_options && get_key_format_from_napi_options(env, args[1], &format))
+  {
+    return NULL;
+  }
+
+  napi_valuetype argt_0;
+  NAPI_CALL(env, napi_typeof(env, args[0], &argt_0));
+  if (argt_0 != napi_string)
+  {
+    char message[128];
+    snprintf(message, sizeof(message), "The expected type of first argument of %s is string!", binding_name);
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, message);
+    return NULL;
+  }
+
+  device_async_context *context = calloc(1, sizeof(device_async_context));
+  if (context == NULL)
+  {
+    napi_throw_error(env, EWB_NNA_CALLFAIL, "Failed to allocate the context!");
+    return NULL;
+  }
+  if (napi_utils_get_value_string(env, args[0], &context->device_name) != napi_ok)
+  {
+    free(context);
+    return NULL;
+  }
+  context->key_format = format;
+
+  attach_session_to_device_async_context(env, context, this_arg);
+
+  return context;
+}
+
+static void get_device_async_execute(napi_env env, void *data)
+{
+  device_async_context *context = (device_async_context *)data;
+
+  ewb_metrics_call_attach(&context->metrics);
+  context->ret = get_wg_device(context->session, &context->device, context->device_name);
+  ewb_metrics_call_detach(&context->metrics);
+}
+
+static void get_device_async_complete(napi_env env, napi_status status, void *data)
 {
-  napi_property_descriptor get_device_descriptor = DECLARE_NAPI_METHOD("getDevice", get_device);
-  napi_property_descriptor set_device_descriptor = DECLARE_NAPI_METHOD("setDevice", set_device);
-  napi_property_descriptor add_device_descriptor = DECLARE_NAPI_METHOD("addDevice", add_device);
-  napi_property_descriptor remove_device_descriptor = DECLARE_NAPI_METHOD("removeDevice", remove_device);
-  napi_property_descriptor list_device_names_descriptor = DECLARE_NAPI_METHOD("listDeviceNames", list_device_names);
-  napi_property_descriptor generate_public_key_descriptor = DECLARE_NAPI_METHOD("generatePublicKey", generate_public_key);
-  napi_property_descriptor generate_private_key_descriptor = DECLARE_NAPI_METHOD("generatePrivateKey", generate_private_key);
-  napi_property_descriptor generate_preshared_key_descriptor = DECLARE_NAPI_METHOD("generatePresharedKey", generate_preshared_key);
-  napi_property_descriptor get_interface_address_descriptor = DECLARE_NAPI_METHOD("getInterfaceAddress", get_interface_address);
-  napi_property_descriptor set_interface_address_descriptor = DECLARE_NAPI_METHOD("setInterfaceAddress", set_interface_address);
+  device_async_context *context = (device_async_context *)data;
+
+  ewb_metrics_call_resume(&context->metrics);
+
+  if (status != napi_ok || context->ret || context->device == NULL)
+  {
+    reject_device_async_context(env, context, EWB_LIB_CALLFAIL, "Failed to get the device!");
+    free_device_async_context(env, context);
+    return;
+  }
+
+  napi_value result = create_device_object_from_wg_device(env, context->device, context->key_format);
+  if (result == NULL)
+  {
+    reject_device_async_context(env, context, EWB_OBJ_UNSPEC, "Failed to wrap the wg_device to object!");
+  }
+  else
+  {
+    napi_resolve_deferred(env, context->deferred, result);
+  }
+
+  free_device_async_context(env, context);
+}
+
+static napi_value get_device_async(napi_env env, const napi_callback_info info)
+{
+  device_async_context *context = create_device_async_context_from_device_name(env, info, "get_device_async", true);
+  if (context == NULL)
+  {
+    return NULL;
+  }
+
+  return queue_device_async_context(env, context, "getDeviceAsync", get_device_async_execute, get_device_async_complete);
+}
+
+static void set_device_async_execute(napi_env env, void *data)
+{
+  device_async_context *context = (device_async_context *)data;
+
+  ewb_metrics_call_attach(&context->metrics);
+  context->ret = set_wg_device(context->session, context->device);
+  ewb_metrics_call_detach(&context->metrics);
+}
+
+static void void_device_async_complete(napi_env env, napi_status status, void *data)
+{
+  device_async_context *context = (device_async_context *)data;
+
+  ewb_metrics_call_resume(&context->metrics);
+
+  if (status != napi_ok || context->ret)
+  {
+    reject_device_async_context(env, context, EWB_LIB_CALLFAIL, context->failure_message);
+    free_device_async_context(env, context);
+    return;
+  }
+
+  napi_value undefined;
+  napi_get_undefined(env, &undefined);
+  napi_resolve_deferred(env, context->deferred, undefined);
+
+  free_device_async_context(env, context);
+}
+
+static napi_value set_device_async(napi_env env, const napi_callback_info info)
+{
+  size_t argc = 1;
+  napi_value args[1], this_arg;
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, &this_arg, NULL));
+  if (argc != 1)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected argument size of set_device_async is 1!");
+    return NULL;
+  }
+
+  // The object can only be read on the main thread, so we unwrap it here and leave the netlink call to the pool.
+  ewb_arena *arena;
+  struct wg_device *device = create_wg_device_from_napi_value(env, args[0], "set_device_async", &arena);
+  if (device == NULL)
+  {
+    return NULL;
+  }
+
+  device_async_context *context = calloc(1, sizeof(device_async_context));
+  context->device = device;
+  context->arena = arena;
+  context->failure_message = "Failed to set the device!";
+
+  attach_session_to_device_async_context(env, context, this_arg);
+
+  return queue_device_async_context(env, context, "setDeviceAsync", set_device_async_execute, void_device_async_complete);
+}
+
+static void sync_device_async_execute(napi_env env, void *data)
+{
+  device_async_context *context = (device_async_context *)data;
+
+  ewb_metrics_call_attach(&context->metrics);
+  context->ret = sync_wg_device(context->session, context->device, context->arena, &context->summary);
+  ewb_metrics_call_detach(&context->metrics);
+}
+
+static void sync_device_async_complete(napi_env env, napi_status status, void *data)
+{
+  device_async_context *context = (device_async_context *)data;
+
+  ewb_metrics_call_resume(&context->metrics);
+
+  if (status != napi_ok || context->ret)
+  {
+    reject_device_async_context(env, context, EWB_LIB_CALLFAIL, "Failed to sync the device!");
+    free_device_async_context(env, context);
+    return;
+  }
+
+  napi_value result = create_summary_object_from_sync_summary(env, &context->summary);
+  if (result == NULL)
+  {
+    reject_device_async_context(env, context, EWB_NNA_CALLFAIL, "Failed to create the summary object!");
+  }
+  else
+  {
+    napi_resolve_deferred(env, context->deferred, result);
+  }
+
+  free_device_async_context(env, context);
+}
+
+static napi_value sync_device_async(napi_env env, const napi_callback_info info)
+{
+  size_t argc = 2;
+  napi_value args[2], this_arg;
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, &this_arg, NULL));
+
+  ewb_arena *arena;
+  struct wg_device *device = get_desired_wg_device_from_napi_values(env, argc, args, "sync_device_async", &arena);
+  if (device == NULL)
+  {
+    return NULL;
+  }
+
+  device_async_context *context = calloc(1, sizeof(device_async_context));
+  context->device = device;
+  context->arena = arena;
+  attach_session_to_device_async_context(env, context, this_arg);
+
+  return queue_device_async_context(env, context, "syncDeviceAsync", sync_device_async_execute, sync_device_async_complete);
+}
+
+// The peers sent in one set call of a chunked apply without chunkSize, well within a few netlink messages.
+#define SET_CHUNK_SIZE 512
+
+// The chunks are applied one async work at a time, and the progress is reported on the main thread between them.
+// The device stays whole in the arena, and each chunk is cut out of the peer list only while its work runs.
+typedef struct
+{
+  napi_async_work work;
+  napi_deferred deferred;
+  ewb_arena *arena;
+  struct wg_device *device;
+  struct wg_peer *start_peer;
+  struct wg_peer *chunk_peer;
+  uint32_t chunk_size;
+  uint32_t chunk_length;
+  uint32_t start_offset;
+  uint32_t offset;
+  uint32_t total;
+  napi_ref progress_ref;
+  ewb_nl_session *session;
+  napi_ref session_ref;
+  ewb_metrics_call metrics;
+  const char *error_code;
+  int ret;
+} set_chunks_context;
+
+static void free_set_chunks_context(napi_env env, set_chunks_context *context)
+{
+  if (context->work != NULL)
+  {
+    napi_delete_async_work(env, context->work);
+  }
+  if (context->progress_ref != NULL)
+  {
+    napi_delete_reference(env, context->progress_ref);
+  }
+  if (context->session_ref != NULL)
+  {
+    napi_delete_reference(env, context->session_ref);
+  }
+
+  ewb_metrics_call_end(&context->metrics, context->error_code);
+
+  ewb_arena_release(context->arena);
+  free(context);
+}
+
+static napi_value create_key_array_from_wg_peers(napi_env env, const struct wg_peer *peer, uint32_t count)
+{
+  napi_value keys_array;
+  NAPI_CALL(env, napi_create_array_with_length(env, count, &keys_array));
+
+  key_format format = get_default_key_format(env);
+  for (uint32_t i = 0; i < count && peer != NULL; i++, peer = peer->next_peer)
+  {
+    napi_value key = create_key_value_from_wg_key(env, peer->public_key, format);
+    if (key == NULL)
+    {
+      return NULL;
+    }
+
+    NAPI_CALL(env, napi_set_element(env, keys_array, i, key));
+  }
+
+  return keys_array;
+}
+
+static napi_value create_progress_object_from_set_chunks_context(napi_env env, const set_chunks_context *context)
+{
+  napi_value progress_obj, applied, total, offset;
+  NAPI_CALL(env, napi_create_object(env, &progress_obj));
+  NAPI_CALL(env, napi_create_uint32(env, context->offset - context->start_offset, &applied));
+  NAPI_CALL(env, napi_create_uint32(env, context->total, &total));
+  NAPI_CALL(env, napi_create_uint32(env, context->offset, &offset));
+
+  NAPI_CALL(env, napi_set_named_property(env, progress_obj, "applied", applied));
+  NAPI_CALL(env, napi_set_named_property(env, progress_obj, "total", total));
+  NAPI_CALL(env, napi_set_named_property(env, progress_obj, "offset", offset));
+
+  return progress_obj;
+}
+
+// The peers of the committed chunks are applied, and the rest after the chunk that failed was never sent.
+// The chunk that failed may go out in several messages, each committed by the kernel on its own, so its peers are indeterminate.
+static napi_value create_result_object_from_set_chunks_context(napi_env env, const set_chunks_context *context, napi_value error)
+{
+  napi_value result_obj, applied, indeterminate, offset, done;
+  NAPI_CALL(env, napi_create_object(env, &result_obj));
+
+  applied = create_key_array_from_wg_peers(env, context->start_peer, context->offset - context->start_offset);
+  indeterminate = create_key_array_from_wg_peers(env, context->chunk_peer, error != NULL ? context->chunk_length : 0);
+  if (applied == NULL || indeterminate == NULL)
+  {
+    return NULL;
+  }
+
+  NAPI_CALL(env, napi_create_uint32(env, context->offset, &offset));
+  NAPI_CALL(env, napi_get_boolean(env, error == NULL, &done));
+  if (error == NULL)
+  {
+    NAPI_CALL(env, napi_get_null(env, &error));
+  }
+
+  NAPI_CALL(env, napi_set_named_property(env, result_obj, "applied", applied));
+  NAPI_CALL(env, napi_set_named_property(env, result_obj, "indeterminate", indeterminate));
+  NAPI_CALL(env, napi_set_named_property(env, result_obj, "offset", offset));
+  NAPI_CALL(env, napi_set_named_property(env, result_obj, "done", done));
+  NAPI_CALL(env, napi_set_named_property(env, result_obj, "error", error));
+
+  return result_obj;
+}
+
+static void set_chunk_execute(napi_env env, void *data)
+{
+  set_chunks_context *context = (set_chunks_context *)data;
+
+  // The device attributes go with the first chunk of the config only, so a resumed apply never replaces the peers already in.
+  struct wg_device chunk = *context->device;
+  if (context->offset > 0)
+  {
+    chunk.flags = 0;
+  }
+
+  struct wg_peer *last_peer = NULL, *next_peer = NULL;
+  if (context->chunk_length > 0)
+  {
+    last_peer = context->chunk_peer;
+    for (uint32_t i = 1; i < context->chunk_length; i++)
+    {
+      last_peer = last_peer->next_peer;
+    }
+    next_peer = last_peer->next_peer;
+    last_peer->next_peer = NULL;
+  }
+  chunk.first_peer = context->chunk_peer;
+  chunk.last_peer = last_peer;
+
+  ewb_metrics_call_attach(&context->metrics);
+  context->ret = set_wg_device(context->session, &chunk);
+  ewb_metrics_call_detach(&context->metrics);
+
+  if (last_peer != NULL)
+  {
+    last_peer->next_peer = next_peer;
+  }
+}
+
+static void set_chunk_complete(napi_env env, napi_status status, void *data);
+
+static int queue_set_chunk(napi_env env, set_chunks_context *context)
+{
+  context->chunk_length = context->total - context->offset < context->chunk_size ? context->total - context->offset : context->chunk_size;
+
+  napi_value resource_name;
+  if (
+    napi_create_string_utf8(env, "setDeviceChunked", NAPI_AUTO_LENGTH, &resource_name) != napi_ok ||
+    napi_create_async_work(env, NULL, resource_name, set_chunk_execute, set_chunk_complete, context, &context->work) != napi_ok ||
+    napi_queue_async_work(env, context->work) != napi_ok
+  )
+  {
+    return 1;
+  }
+
+  return 0;
+}
+
+static void set_chunk_complete(napi_env env, napi_status status, void *data)
+{
+  set_chunks_context *context = (set_chunks_context *)data;
+
+  ewb_metrics_call_resume(&context->metrics);
+
+  napi_delete_async_work(env, context->work);
+  context->work = NULL;
+
+  napi_value error = NULL;
+  if (status != napi_ok || context->ret)
+  {
+    context->ret = context->ret ? context->ret : -ECANCELED;
+    context->error_code = EWB_LIB_CALLFAIL;
+
+    napi_value error_code, error_message;
+    if (
+      napi_create_string_utf8(env, EWB_LIB_CALLFAIL, NAPI_AUTO_LENGTH, &error_code) != napi_ok ||
+      napi_create_string_utf8(env, "Failed to set the device!", NAPI_AUTO_LENGTH, &error_message) != napi_ok ||
+      napi_create_error(env, error_code, error_message, &error) != napi_ok
+    )
+    {
+      napi_get_undefined(env, &error);
+    }
+  }
+  else
+  {
+    for (uint32_t i = 0; i < context->chunk_length; i++)
+    {
+      context->chunk_peer = context->chunk_peer->next_peer;
+    }
+    context->offset += context->chunk_length;
+    context->chunk_length = 0;
+
+    // The callback sees every committed chunk, and throwing from it stops the apply like a failed chunk.
+    napi_value progress_callback, progress, undefined;
+    if (
+      context->progress_ref != NULL &&
+      napi_get_reference_value(env, context->progress_ref, &progress_callback) == napi_ok &&
+      napi_get_undefined(env, &undefined) == napi_ok &&
+      (progress = create_progress_object_from_set_chunks_context(env, context)) != NULL &&
+      napi_call_function(env, undefined, progress_callback, 1, &progress, NULL) != napi_ok
+    )
+    {
+      context->ret = -ECANCELED;
+      context->error_code = EWB_NNA_CALLFAIL;
+      if (napi_get_and_clear_last_exception(env, &error) != napi_ok)
+      {
+        napi_get_undefined(env, &error);
+      }
+    }
+  }
+
+  if (error == NULL && context->offset < context->total)
+  {
+    ewb_metrics_call_pause(&context->metrics);
+    if (!queue_set_chunk(env, context))
+    {
+      return;
+    }
+
+    ewb_metrics_call_resume(&context->metrics);
+    context->ret = -ENOMEM;
+    context->error_code = EWB_NNA_CALLFAIL;
+    reject_deferred(env, context->deferred, EWB_NNA_CALLFAIL, "Failed to queue the async work!");
+    free_set_chunks_context(env, context);
+    return;
+  }
+
+  napi_value result = create_result_object_from_set_chunks_context(env, context, error);
+  if (result == NULL)
+  {
+    reject_deferred(env, context->deferred, EWB_NNA_CALLFAIL, "Failed to create the apply result!");
+  }
+  else
+  {
+    napi_resolve_deferred(env, context->deferred, result);
+  }
+
+  free_set_chunks_context(env, context);
+}
+
+static int get_set_chunks_options_from_napi_value(napi_env env, napi_value options, set_chunks_context *context)
+{
+  napi_valuetype options_type;
+  ASSERT_NAPI_CALL(env, napi_typeof(env, options, &options_type), 1);
+  if (options_type == napi_undefined)
+  {
+    return 0;
+  }
+  if (options_type != napi_object)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of options is object!");
+    return 1;
+  }
+
+  bool has_property;
+  napi_value property;
+  ASSERT_NAPI_CALL(env, napi_has_named_property(env, options, "chunkSize", &has_property), 1);
+  if (has_property)
+  {
+    ASSERT_NAPI_CALL(env, napi_get_named_property(env, options, "chunkSize", &property), 1);
+    if (napi_get_value_uint32(env, property, &context->chunk_size) != napi_ok || context->chunk_size == 0)
+    {
+      napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of chunkSize property of set_device_chunked options is positive number!");
+      return 1;
+    }
+  }
+
+  ASSERT_NAPI_CALL(env, napi_has_named_property(env, options, "offset", &has_property), 1);
+  if (has_property)
+  {
+    ASSERT_NAPI_CALL(env, napi_get_named_property(env, options, "offset", &property), 1);
+    if (napi_get_value_uint32(env, property, &context->offset) != napi_ok || context->offset > context->total)
+    {
+      napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected offset property of set_device_chunked options is a number up to the size of peers!");
+      return 1;
+    }
+  }
+
+  ASSERT_NAPI_CALL(env, napi_has_named_property(env, options, "onProgress", &has_property), 1);
+  if (has_property)
+  {
+    napi_valuetype property_type;
+    ASSERT_NAPI_CALL(env, napi_get_named_property(env, options, "onProgress", &property), 1);
+    ASSERT_NAPI_CALL(env, napi_typeof(env, property, &property_type), 1);
+    if (property_type != napi_function)
+    {
+      napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of onProgress property of set_device_chunked options is function!");
+      return 1;
+    }
+
+    ASSERT_NAPI_CALL(env, napi_create_reference(env, property, 1, &context->progress_ref), 1);
+  }
+
+  return 0;
+}
+
+// Applies the peers of the device in chunks of chunkSize, each committed by its own set call.
+// The apply stops at the first chunk that fails, and the offset of the result resumes it from there.
+static napi_value set_device_chunked(napi_env env, const napi_callback_info info)
+{
+  size_t argc = 2;
+  napi_value args[2], this_arg;
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, &this_arg, NULL));
+  if (argc != 1 && argc != 2)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected argument size of set_device_chunked is 1 or 2!");
+    return NULL;
+  }
+
+  set_chunks_context *context = calloc(1, sizeof(set_chunks_context));
+  if (context == NULL)
+  {
+    napi_throw_error(env, EWB_NNA_CALLFAIL, "Failed to allocate the context!");
+    return NULL;
+  }
+  context->chunk_size = SET_CHUNK_SIZE;
+
+  if ((context->device = create_wg_device_from_napi_value(env, args[0], "set_device_chunked", &context->arena)) == NULL)
+  {
+    free_set_chunks_context(env, context);
+    return NULL;
+  }
+
+  struct wg_peer *peer;
+  wg_for_each_peer(context->device, peer)
+  {
+    context->total++;
+  }
+
+  if (get_set_chunks_options_from_napi_value(env, args[1], context))
+  {
+    free_set_chunks_context(env, context);
+    return NULL;
+  }
+
+  context->start_offset = context->offset;
+  context->start_peer = context->device->first_peer;
+  for (uint32_t i = 0; i < context->offset; i++)
+  {
+    context->start_peer = context->start_peer->next_peer;
+  }
+  context->chunk_peer = context->start_peer;
+
+  // The session object should outlive the work, so we hold it until the context is freed.
+  context->session = unwrap_session(env, this_arg);
+  if (context->session != NULL && napi_create_reference(env, this_arg, 1, &context->session_ref) != napi_ok)
+  {
+    context->session = NULL;
+  }
+
+  // The call of the binding goes on with the chunks, so the context ends it when freed.
+  ewb_metrics_call_hand_off(&context->metrics);
+
+  napi_value promise;
+  if (napi_create_promise(env, &context->deferred, &promise) != napi_ok || queue_set_chunk(env, context))
+  {
+    context->ret = -ENOMEM;
+    context->error_code = EWB_NNA_CALLFAIL;
+    free_set_chunks_context(env, context);
+
+    napi_throw_error(env, EWB_NNA_CALLFAIL, "Failed to queue the async work!");
+    return NULL;
+  }
+
+  return promise;
+}
+
+typedef struct
+{
+  char name[IFNAMSIZ];
+  ewb_arena *arena;
+  struct wg_device *device;
+  ewb_sync_summary summary;
+  int ret;
+} apply_many_entry;
+
+// The devices are unwrapped on the main thread and synced by the workers, each entry touched by a single worker.
+typedef struct
+{
+  napi_async_work work;
+  napi_deferred deferred;
+  apply_many_entry *entries;
+  uint32_t count;
+  size_t concurrency;
+} apply_many_context;
+
+static void free_apply_many_context(napi_env env, apply_many_context *context)
+{
+  if (context->work != NULL)
+  {
+    napi_delete_async_work(env, context->work);
+  }
+
+  for (uint32_t index = 0; index < context->count; index++)
+  {
+    ewb_sync_summary_destroy(&context->entries[index].summary);
+    ewb_arena_release(context->entries[index].arena);
+  }
+
+  free(context->entries);
+  free(context);
+}
+
+// Reads the entry of {name, config}, where the name takes precedence over the name in the config.
+static int get_apply_many_entry_from_napi_value(napi_env env, napi_value value, apply_many_entry *entry)
+{
+  napi_valuetype value_type;
+  ASSERT_NAPI_CALL(env, napi_typeof(env, value, &value_type), 1);
+  if (value_type != napi_object)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of the element of first argument of apply_many is object!");
+    return 1;
+  }
+
+  napi_value name, config;
+  napi_valuetype name_type, config_type;
+  ASSERT_NAPI_CALL(env, napi_get_named_property(env, value, "name", &name), 1);
+  ASSERT_NAPI_CALL(env, napi_get_named_property(env, value, "config", &config), 1);
+  ASSERT_NAPI_CALL(env, napi_typeof(env, name, &name_type), 1);
+  ASSERT_NAPI_CALL(env, napi_typeof(env, config, &config_type), 1);
+  if (name_type != napi_string)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of name property of apply_many entry is string!");
+    return 1;
+  }
+  if (config_type != napi_object)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of config property of apply_many entry is object!");
+    return 1;
+  }
+
+  size_t name_length;
+  ASSERT_NAPI_CALL(env, napi_get_value_string_utf8(env, name, NULL, 0, &name_length), 1);
+  if (name_length >= IFNAMSIZ)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected length of name property of apply_many entry is less than 16 bytes!");
+    return 1;
+  }
+  ASSERT_NAPI_CALL(env, napi_get_value_string_utf8(env, name, entry->name, IFNAMSIZ, NULL), 1);
+
+  if ((entry->device = create_wg_device_from_napi_value(env, config, "apply_many", &entry->arena)) == NULL)
+  {
+    return 1;
+  }
+  memcpy(entry->device->name, entry->name, IFNAMSIZ);
+
+  return 0;
+}
+
+static int compare_apply_many_entry_names(const void *a, const void *b)
+{
+  return strcmp((*(const apply_many_entry *const *)a)->name, (*(const apply_many_entry *const *)b)->name);
+}
+
+// The entries of the same device would race each other on the workers, so we refuse them up front.
+static bool has_duplicate_apply_many_entry(const apply_many_context *context)
+{
+  const apply_many_entry **sorted = malloc((context->count + 1) * sizeof(apply_many_entry *));
+  if (sorted == NULL)
+  {
+    return false;
+  }
+
+  for (uint32_t index = 0; index < context->count; index++)
+  {
+    sorted[index] = &context->entries[index];
+  }
+  qsort(sorted, context->count, sizeof(apply_many_entry *), compare_apply_many_entry_names);
+
+  bool is_duplicate = false;
+  for (uint32_t index = 1; index < context->count && !is_duplicate; index++)
+  {
+    is_duplicate = strcmp(sorted[index - 1]->name, sorted[index]->name) == 0;
+  }
+  free(sorted);
+
+  return is_duplicate;
+}
+
+static int get_apply_many_options_from_napi_value(napi_env env, napi_value options, size_t *concurrency)
+{
+  *concurrency = ewb_workers_get_default_concurrency();
+
+  napi_valuetype options_type;
+  ASSERT_NAPI_CALL(env, napi_typeof(env, options, &options_type), 1);
+  if (options_type == napi_undefined)
+  {
+    return 0;
+  }
+  if (options_type != napi_object)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of options is object!");
+    return 1;
+  }
+
+  bool has_concurrency;
+  ASSERT_NAPI_CALL(env, napi_has_named_property(env, options, "concurrency", &has_concurrency), 1);
+  if (!has_concurrency)
+  {
+    return 0;
+  }
+
+  napi_value concurrency_prop;
+  uint32_t value;
+  ASSERT_NAPI_CALL(env, napi_get_named_property(env, options, "concurrency", &concurrency_prop), 1);
+  if (napi_get_value_uint32(env, concurrency_prop, &value) != napi_ok || value == 0)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of concurrency property of apply_many options is positive number!");
+    return 1;
+  }
+  *concurrency = value;
+
+  return 0;
+}
+
+// Runs on a worker of the pool, and counts each device as a call of setDevice in the metrics.
+static void apply_many_entry_on_worker(ewb_nl_session *session, size_t index, void *data)
+{
+  apply_many_entry *entry = &((apply_many_context *)data)->entries[index];
+
+  ewb_metrics_call metrics;
+  ewb_metrics_call_begin(&metrics, EWB_METRICS_SET_DEVICE);
+  entry->ret = sync_wg_device(session, entry->device, entry->arena, &entry->summary);
+  ewb_metrics_call_end(&metrics, entry->ret ? EWB_LIB_CALLFAIL : NULL);
+
+  // The device is not needed past the sync, so we give the memory back while the other workers run.
+  ewb_arena_release(entry->arena);
+  entry->arena = NULL;
+  entry->device = NULL;
+}
+
+static void apply_many_execute(napi_env env, void *data)
+{
+  apply_many_context *context = (apply_many_context *)data;
+
+  ewb_workers_run(context->count, context->concurrency, apply_many_entry_on_worker, context);
+}
+
+static napi_value create_result_object_from_apply_many_entry(napi_env env, const apply_many_entry *entry)
+{
+  napi_value result_obj, name, summary, error;
+  NAPI_CALL(env, napi_create_object(env, &result_obj));
+  NAPI_CALL(env, napi_create_string_utf8(env, entry->name, NAPI_AUTO_LENGTH, &name));
+
+  if (entry->ret)
+  {
+    napi_value error_code, error_message, error_errno;
+    NAPI_CALL(env, napi_get_null(env, &summary));
+    NAPI_CALL(env, napi_create_string_utf8(env, EWB_LIB_CALLFAIL, NAPI_AUTO_LENGTH, &error_code));
+    NAPI_CALL(env, napi_create_string_utf8(env, "Failed to sync the device!", NAPI_AUTO_LENGTH, &error_message));
+    NAPI_CALL(env, napi_create_error(env, error_code, error_message, &error));
+    // The errno is negative as in the system errors of Node, e.g. -19 for ENODEV.
+    NAPI_CALL(env, napi_create_int32(env, entry->ret, &error_errno));
+    NAPI_CALL(env, napi_set_named_property(env, error, "errno", error_errno));
+  }
+  else
+  {
+    NAPI_CALL(env, napi_get_null(env, &error));
+    if ((summary = create_summary_object_from_sync_summary(env, &entry->summary)) == NULL)
+    {
+      return NULL;
+    }
+  }
+
+  NAPI_CALL(env, napi_set_named_property(env, result_obj, "name", name));
+  NAPI_CALL(env, napi_set_named_property(env, result_obj, "summary", summary));
+  NAPI_CALL(env, napi_set_named_property(env, result_obj, "error", error));
+
+  return result_obj;
+}
+
+static napi_value create_report_object_from_apply_many_context(napi_env env, const apply_many_context *context)
+{
+  napi_value report_obj, results_array, succeeded, failed;
+  NAPI_CALL(env, napi_create_object(env, &report_obj));
+  NAPI_CALL(env, napi_create_array_with_length(env, context->count, &results_array));
+
+  uint32_t failed_count = 0;
+  for (uint32_t index = 0; index < context->count; index++)
+  {
+    napi_value result_obj = create_result_object_from_apply_many_entry(env, &context->entries[index]);
+    if (result_obj == NULL)
+    {
+      return NULL;
+    }
+
+    NAPI_CALL(env, napi_set_element(env, results_array, index, result_obj));
+    failed_count += context->entries[index].ret != 0;
+  }
+
+  NAPI_CALL(env, napi_create_uint32(env, context->count - failed_count, &succeeded));
+  NAPI_CALL(env, napi_create_uint32(env, failed_count, &failed));
+  NAPI_CALL(env, napi_set_named_property(env, report_obj, "results", results_array));
+  NAPI_CALL(env, napi_set_named_property(env, report_obj, "succeeded", succeeded));
+  NAPI_CALL(env, napi_set_named_property(env, report_obj, "failed", failed));
+
+  return report_obj;
+}
+
+static void apply_many_complete(napi_env env, napi_status status, void *data)
+{
+  apply_many_context *context = (apply_many_context *)data;
+
+  napi_value report = status == napi_ok ? create_report_object_from_apply_many_context(env, context) : NULL;
+  if (report == NULL)
+  {
+    reject_deferred(env, context->deferred, EWB_NNA_CALLFAIL, "Failed to create the apply report!");
+  }
+  else
+  {
+    napi_resolve_deferred(env, context->deferred, report);
+  }
+
+  free_apply_many_context(env, context);
+}
+
+// Syncs every device to its config on a pool of threads with a netlink socket each, and reports the results in the order of the entries.
+// A device failing does not stop the others, and its error is in the report instead.
+static napi_value apply_many(napi_env env, const napi_callback_info info)
+{
+  size_t argc = 2;
+  napi_value args[2];
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+  if (argc != 1 && argc != 2)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected argument size of apply_many is 1 or 2!");
+    return NULL;
+  }
+
+  bool is_array;
+  NAPI_CALL(env, napi_is_array(env, args[0], &is_array));
+  if (!is_array)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of first argument of apply_many is array!");
+    return NULL;
+  }
+
+  size_t concurrency;
+  if (get_apply_many_options_from_napi_value(env, args[1], &concurrency))
+  {
+    return NULL;
+  }
+
+  uint32_t length;
+  NAPI_CALL(env, napi_get_array_length(env, args[0], &length));
+
+  apply_many_context *context = calloc(1, sizeof(apply_many_context));
+  if (context == NULL || (context->entries = calloc(length + 1, sizeof(apply_many_entry))) == NULL)
+  {
+    free(context);
+
+    napi_throw_error(env, EWB_NNA_CALLFAIL, "Failed to allocate the context!");
+    return NULL;
+  }
+  context->concurrency = concurrency;
+
+  for (uint32_t index = 0; index < length; index++)
+  {
+    napi_handle_scope scope;
+    napi_value entry_value;
+    apply_many_entry *entry = &context->entries[index];
+    context->count = index + 1;
+
+    int ret = napi_open_handle_scope(env, &scope) != napi_ok;
+    if (!ret)
+    {
+      ret = napi_get_element(env, args[0], index, &entry_value) != napi_ok || get_apply_many_entry_from_napi_value(env, entry_value, entry);
+      napi_close_handle_scope(env, scope);
+    }
+    if (ret)
+    {
+      free_apply_many_context(env, context);
+      return NULL;
+    }
+  }
+
+  if (has_duplicate_apply_many_entry(context))
+  {
+    free_apply_many_context(env, context);
+
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The names of apply_many entries should be unique!");
+    return NULL;
+  }
+
+  napi_value promise, resource_name;
+  if (
+    napi_create_promise(env, &context->deferred, &promise) != napi_ok ||
+    napi_create_string_utf8(env, "applyMany", NAPI_AUTO_LENGTH, &resource_name) != napi_ok ||
+    napi_create_async_work(env, NULL, resource_name, apply_many_execute, apply_many_complete, context, &context->work) != napi_ok ||
+    napi_queue_async_work(env, context->work) != napi_ok
+  )
+  {
+    free_apply_many_context(env, context);
+
+    napi_throw_error(env, EWB_NNA_CALLFAIL, "Failed to queue the async work!");
+    return NULL;
+  }
+
+  return promise;
+}
+
+typedef struct
+{
+  char name[IFNAMSIZ];
+  struct wg_device *device;
+  int ret;
+} save_state_entry;
+
+// The devices are read by the workers, and the file is written once every device is in memory.
+typedef struct
+{
+  napi_async_work work;
+  napi_deferred deferred;
+  char *path;
+  save_state_entry *entries;
+  uint32_t count;
+  bool has_names;
+  const char *error_code;
+  const char *error_message;
+} save_state_context;
+
+static void free_save_state_context(napi_env env, save_state_context *context)
+{
+  if (context->work != NULL)
+  {
+    napi_delete_async_work(env, context->work);
+  }
+
+  for (uint32_t index = 0; index < context->count; index++)
+  {
+    wg_free_device(context->entries[index].device);
+  }
+
+  free(context->entries);
+  free(context->path);
+  free(context);
+}
+
+static int get_save_state_entries_from_device_names(save_state_context *context)
+{
+  char *device_names = ewb_backend_list_device_names();
+  if (device_names == NULL)
+  {
+    return -ENOMEM;
+  }
+
+  uint32_t count = 0;
+  for (char *device_name = device_names; *device_name != '\0'; device_name += strlen(device_name) + 1)
+  {
+    count++;
+  }
+
+  if ((context->entries = calloc(count + 1, sizeof(save_state_entry))) == NULL)
+  {
+    free(device_names);
+    return -ENOMEM;
+  }
+
+  for (char *device_name = device_names; *device_name != '\0'; device_name += strlen(device_name) + 1)
+  {
+    strncpy(context->entries[context->count++].name, device_name, IFNAMSIZ - 1);
+  }
+  free(device_names);
+
+  return 0;
+}
+
+// Runs on a worker of the pool, and counts each device as a call of getDevice in the metrics.
+static void save_state_entry_on_worker(ewb_nl_session *session, size_t index, void *data)
+{
+  save_state_entry *entry = &((save_state_context *)data)->entries[index];
+
+  ewb_metrics_call metrics;
+  ewb_metrics_call_begin(&metrics, EWB_METRICS_GET_DEVICE);
+  entry->ret = get_wg_device(session, &entry->device, entry->name);
+  if (!entry->ret && entry->device == NULL)
+  {
+    entry->ret = -ENODEV;
+  }
+  ewb_metrics_call_end(&metrics, entry->ret ? EWB_LIB_CALLFAIL : NULL);
+}
+
+static int compare_rtnl_address_ifindexes(const void *a, const void *b)
+{
+  uint32_t a_ifindex = ((const ewb_rtnl_address *)a)->ifindex, b_ifindex = ((const ewb_rtnl_address *)b)->ifindex;
+
+  return (a_ifindex > b_ifindex) - (a_ifindex < b_ifindex);
+}
+
+// The addresses are sorted by the ifindex, so the addresses of an interface are the range starting at the first of its ifindex.
+static void get_rtnl_address_range(const ewb_rtnl_addresses *addresses, uint32_t ifindex, const ewb_rtnl_address **first, size_t *count)
+{
+  size_t low = 0, high = addresses->count;
+  while (low < high)
+  {
+    size_t middle = low + (high - low) / 2;
+    if (addresses->addresses[middle].ifindex < ifindex)
+    {
+      low = middle + 1;
+    }
+    else
+    {
+      high = middle;
+    }
+  }
+
+  *first = &addresses->addresses[low];
+  *count = 0;
+  while (ifindex != 0 && low + *count < addresses->count && addresses->addresses[low + *count].ifindex == ifindex)
+  {
+    (*count)++;
+  }
+}
+
+static void save_state_execute(napi_env env, void *data)
+{
+  save_state_context *context = (save_state_context *)data;
+
+  if (!context->has_names && get_save_state_entries_from_device_names(context))
+  {
+    context->error_code = EWB_LIB_CALLFAIL;
+    context->error_message = "Failed to list the device names!";
+    return;
+  }
+
+  ewb_workers_run(context->count, ewb_workers_get_default_concurrency(), save_state_entry_on_worker, context);
+
+  // A listed device may be gone by the time it is read, such as one behind a stale socket, which is not a part of the state.
+  uint32_t count = 0;
+  for (uint32_t index = 0; index < context->count; index++)
+  {
+    int ret = context->entries[index].ret;
+    if (ret && (ret != -ENODEV || context->has_names))
+    {
+      context->error_code = EWB_LIB_CALLFAIL;
+      context->error_message = "Failed to get the device!";
+      return;
+    }
+  }
+  for (uint32_t index = 0; index < context->count; index++)
+  {
+    if (!context->entries[index].ret)
+    {
+      context->entries[count++] = context->entries[index];
+    }
+  }
+  context->count = count;
+
+  ewb_rtnl_addresses addresses = {0};
+  if (ewb_rtnl_get_addresses(NULL, 0, &addresses))
+  {
+    context->error_code = EWB_SOC_CALLFAIL;
+    context->error_message = "Failed to get the interface addresses!";
+    return;
+  }
+  qsort(addresses.addresses, addresses.count, sizeof(ewb_rtnl_address), compare_rtnl_address_ifindexes);
+
+  ewb_state_entry *state_entries = calloc(context->count + 1, sizeof(ewb_state_entry));
+  if (state_entries == NULL)
+  {
+    ewb_rtnl_addresses_destroy(&addresses);
+
+    context->error_code = EWB_LIB_CALLFAIL;
+    context->error_message = "Failed to allocate the memory!";
+    return;
+  }
+
+  for (uint32_t index = 0; index < context->count; index++)
+  {
+    const struct wg_device *device = context->entries[index].device;
+
+    // The devices of userspace implementations have no ifindex of their own, but their tun interfaces do.
+    uint32_t ifindex = device->ifindex != 0 ? device->ifindex : if_nametoindex(context->entries[index].name);
+
+    state_entries[index].device = device;
+    get_rtnl_address_range(&addresses, ifindex, &state_entries[index].addresses, &state_entries[index].address_count);
+  }
+
+  if (ewb_state_write_file(context->path, state_entries, context->count))
+  {
+    context->error_code = EWB_LIB_CALLFAIL;
+    context->error_message = "Failed to write the state file!";
+  }
+
+  free(state_entries);
+  ewb_rtnl_addresses_destroy(&addresses);
+}
+
+static void save_state_complete(napi_env env, napi_status status, void *data)
+{
+  save_state_context *context = (save_state_context *)data;
+
+  napi_value device_names = NULL;
+  if (status == napi_ok && context->error_code == NULL && napi_create_array_with_length(env, context->count, &device_names) == napi_ok)
+  {
+    for (uint32_t index = 0; index < context->count && device_names != NULL; index++)
+    {
+      napi_value device_name;
+      if (
+        napi_create_string_utf8(env, context->entries[index].name, NAPI_AUTO_LENGTH, &device_name) != napi_ok ||
+        napi_set_element(env, device_names, index, device_name) != napi_ok
+      )
+      {
+        device_names = NULL;
+      }
+    }
+  }
+
+  if (context->error_code != NULL)
+  {
+    reject_deferred(env, context->deferred, context->error_code, context->error_message);
+  }
+  else if (device_names == NULL)
+  {
+    reject_deferred(env, context->deferred, EWB_NNA_CALLFAIL, "Failed to create the device names array!");
+  }
+  else
+  {
+    napi_resolve_deferred(env, context->deferred, device_names);
+  }
+
+  free_save_state_context(env, context);
+}
+
+static int get_save_state_entries_from_napi_value(napi_env env, napi_value value, save_state_context *context)
+{
+  uint32_t length;
+  ASSERT_NAPI_CALL(env, napi_get_array_length(env, value, &length), 1);
+
+  if ((context->entries = calloc(length + 1, sizeof(save_state_entry))) == NULL)
+  {
+    napi_throw_error(env, EWB_NNA_CALLFAIL, "Failed to allocate the context!");
+    return 1;
+  }
+
+  for (uint32_t index = 0; index < length; index++)
+  {
+    napi_value name;
+    napi_valuetype name_type;
+    size_t name_length;
+    ASSERT_NAPI_CALL(env, napi_get_element(env, value, index, &name), 1);
+    ASSERT_NAPI_CALL(env, napi_typeof(env, name, &name_type), 1);
+    if (name_type != napi_string)
+    {
+      napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of the element of second argument of save_state is string!");
+      return 1;
+    }
+
+    ASSERT_NAPI_CALL(env, napi_get_value_string_utf8(env, name, NULL, 0, &name_length), 1);
+    if (name_length >= IFNAMSIZ)
+    {
+      napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected length of the element of second argument of save_state is less than 16 bytes!");
+      return 1;
+    }
+    ASSERT_NAPI_CALL(env, napi_get_value_string_utf8(env, name, context->entries[index].name, IFNAMSIZ, NULL), 1);
+    context->count = index + 1;
+  }
+
+  return 0;
+}
+
+// Writes the devices with their interface addresses into a state file, every device if no names are given.
+// The devices are read on a pool of threads, and the file replaces the one at the path only once it is written whole.
+static napi_value save_state(napi_env env, const napi_callback_info info)
+{
+  size_t argc = 2;
+  napi_value args[2];
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+  if (argc != 1 && argc != 2)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected argument size of save_state is 1 or 2!");
+    return NULL;
+  }
+
+  napi_valuetype argt_0, argt_1 = napi_undefined;
+  NAPI_CALL(env, napi_typeof(env, args[0], &argt_0));
+  if (argc == 2)
+  {
+    NAPI_CALL(env, napi_typeof(env, args[1], &argt_1));
+  }
+  if (argt_0 != napi_string)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of first argument of save_state is string!");
+    return NULL;
+  }
+
+  bool is_array = false;
+  if (argt_1 != napi_undefined)
+  {
+    NAPI_CALL(env, napi_is_array(env, args[1], &is_array));
+    if (!is_array)
+    {
+      napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of second argument of save_state is array!");
+      return NULL;
+    }
+  }
+
+  save_state_context *context = calloc(1, sizeof(save_state_context));
+  if (context == NULL)
+  {
+    napi_throw_error(env, EWB_NNA_CALLFAIL, "Failed to allocate the context!");
+    return NULL;
+  }
+  context->has_names = is_array;
+
+  if (napi_utils_get_value_string(env, args[0], &context->path) != napi_ok || (is_array && get_save_state_entries_from_napi_value(env, args[1], context)))
+  {
+    free_save_state_context(env, context);
+    return NULL;
+  }
+
+  napi_value promise, resource_name;
+  if (
+    napi_create_promise(env, &context->deferred, &promise) != napi_ok ||
+    napi_create_string_utf8(env, "saveState", NAPI_AUTO_LENGTH, &resource_name) != napi_ok ||
+    napi_create_async_work(env, NULL, resource_name, save_state_execute, save_state_complete, context, &context->work) != napi_ok ||
+    napi_queue_async_work(env, context->work) != napi_ok
+  )
+  {
+    free_save_state_context(env, context);
+
+    napi_throw_error(env, EWB_NNA_CALLFAIL, "Failed to queue the async work!");
+    return NULL;
+  }
+
+  return promise;
+}
+
+typedef struct
+{
+  char name[IFNAMSIZ];
+  const char *error_code;
+  const char *error_message;
+} restore_state_entry;
+
+// The file stays mapped while the workers read their devices out of it, each entry touched by a single worker.
+typedef struct
+{
+  napi_async_work work;
+  napi_deferred deferred;
+  char *path;
+  ewb_state_file file;
+  restore_state_entry *entries;
+  uint32_t count;
+  int ret;
+} restore_state_context;
+
+static void free_restore_state_context(napi_env env, restore_state_context *context)
+{
+  if (context->work != NULL)
+  {
+    napi_delete_async_work(env, context->work);
+  }
+
+  ewb_state_close_file(&context->file);
+  free(context->entries);
+  free(context->path);
+  free(context);
+}
+
+static void restore_state_device(ewb_nl_session *session, const ewb_state_file *file, uint32_t index, restore_state_entry *entry)
+{
+  struct wg_device *device;
+  ewb_rtnl_address *addresses;
+  size_t address_count;
+  if (ewb_state_read_device(file, index, &device, &addresses, &address_count))
+  {
+    entry->error_code = EWB_OBJ_UNSPEC;
+    entry->error_message = "Failed to read the device of the state file!";
+    return;
+  }
+  memcpy(entry->name, device->name, IFNAMSIZ);
+
+  // The kernel device is created if it is gone after a restart, while a userspace one should be running already.
+  int ret = 0;
+  if (ewb_backend_for_device(session, device->name) == &ewb_kernel_backend && (ret = wg_add_device(device->name)) == -EEXIST)
+  {
+    ret = 0;
+  }
+  if (ret)
+  {
+    entry->error_code = EWB_LIB_CALLFAIL;
+    entry->error_message = "Failed to add the device!";
+  }
+  else if (set_wg_device(session, device))
+  {
+    entry->error_code = EWB_LIB_CALLFAIL;
+    entry->error_message = "Failed to set the device!";
+  }
+  else if (address_count > 0)
+  {
+    ewb_rtnl_link_config config = {.addresses = addresses, .address_count = address_count};
+    uint32_t ifindex = if_nametoindex(device->name);
+    if (ifindex == 0 || ewb_rtnl_configure_link(NULL, ifindex, &config))
+    {
+      entry->error_code = EWB_SOC_CALLFAIL;
+      entry->error_message = "Failed to set the interface addresses!";
+    }
+  }
+
+  free(addresses);
+  wg_free_device(device);
+}
+
+// Runs on a worker of the pool, and counts each device as a call of setDevice in the metrics.
+static void restore_state_entry_on_worker(ewb_nl_session *session, size_t index, void *data)
+{
+  restore_state_context *context = (restore_state_context *)data;
+  restore_state_entry *entry = &context->entries[index];
+
+  ewb_metrics_call metrics;
+  ewb_metrics_call_begin(&metrics, EWB_METRICS_SET_DEVICE);
+  restore_state_device(session, &context->file, (uint32_t)index, entry);
+  ewb_metrics_call_end(&metrics, entry->error_code);
+}
+
+static void restore_state_execute(napi_env env, void *data)
+{
+  restore_state_context *context = (restore_state_context *)data;
+
+  if ((context->ret = ewb_state_open_file(context->path, &context->file)))
+  {
+    return;
+  }
+
+  if ((context->entries = calloc(context->file.device_count + 1, sizeof(restore_state_entry))) == NULL)
+  {
+    context->ret = -ENOMEM;
+    return;
+  }
+  context->count = context->file.device_count;
+
+  ewb_workers_run(context->count, ewb_workers_get_default_concurrency(), restore_state_entry_on_worker, context);
+}
+
+static napi_value create_result_object_from_restore_state_entry(napi_env env, const restore_state_entry *entry)
+{
+  napi_value result_obj, name, error;
+  NAPI_CALL(env, napi_create_object(env, &result_obj));
+  NAPI_CALL(env, napi_create_string_utf8(env, entry->name, NAPI_AUTO_LENGTH, &name));
+
+  if (entry->error_code != NULL)
+  {
+    napi_value error_code, error_message;
+    NAPI_CALL(env, napi_create_string_utf8(env, entry->error_code, NAPI_AUTO_LENGTH, &error_code));
+    NAPI_CALL(env, napi_create_string_utf8(env, entry->error_message, NAPI_AUTO_LENGTH, &error_message));
+    NAPI_CALL(env, napi_create_error(env, error_code, error_message, &error));
+  }
+  else
+  {
+    NAPI_CALL(env, napi_get_null(env, &error));
+  }
+
+  NAPI_CALL(env, napi_set_named_property(env, result_obj, "name", name));
+  NAPI_CALL(env, napi_set_named_property(env, result_obj, "error", error));
+
+  return result_obj;
+}
+
+static napi_value create_report_object_from_restore_state_context(napi_env env, const restore_state_context *context)
+{
+  napi_value report_obj, results_array, succeeded, failed;
+  NAPI_CALL(env, napi_create_object(env, &report_obj));
+  NAPI_CALL(env, napi_create_array_with_length(env, context->count, &results_array));
+
+  uint32_t failed_count = 0;
+  for (uint32_t index = 0; index < context->count; index++)
+  {
+    napi_value result_obj = create_result_object_from_restore_state_entry(env, &context->entries[index]);
+    if (result_obj == NULL)
+    {
+      return NULL;
+    }
+
+    NAPI_CALL(env, napi_set_element(env, results_array, index, result_obj));
+    failed_count += context->entries[index].error_code != NULL;
+  }
+
+  NAPI_CALL(env, napi_create_uint32(env, context->count - failed_count, &succeeded));
+  NAPI_CALL(env, napi_create_uint32(env, failed_count, &failed));
+  NAPI_CALL(env, napi_set_named_property(env, report_obj, "results", results_array));
+  NAPI_CALL(env, napi_set_named_property(env, report_obj, "succeeded", succeeded));
+  NAPI_CALL(env, napi_set_named_property(env, report_obj, "failed", failed));
+
+  return report_obj;
+}
+
+static void restore_state_complete(napi_env env, napi_status status, void *data)
+{
+  restore_state_context *context = (restore_state_context *)data;
+
+  if (context->ret)
+  {
+    reject_deferred(env, context->deferred, context->ret == -EINVAL ? EWB_OBJ_UNSPEC : EWB_ARG_UNSPEC, context->ret == -EINVAL ? "The state file is not valid!" : "Failed to read the state file!");
+    free_restore_state_context(env, context);
+    return;
+  }
+
+  napi_value report = status == napi_ok ? create_report_object_from_restore_state_context(env, context) : NULL;
+  if (report == NULL)
+  {
+    reject_deferred(env, context->deferred, EWB_NNA_CALLFAIL, "Failed to create the restore report!");
+  }
+  else
+  {
+    napi_resolve_deferred(env, context->deferred, report);
+  }
+
+  free_restore_state_context(env, context);
+}
+
+// Maps the state file and replays every device in it on a pool of threads, creating the kernel devices that are gone.
+// A device failing does not stop the others, and its error is in the report instead.
+static napi_value restore_state(napi_env env, const napi_callback_info info)
+{
+  size_t argc = 1;
+  napi_value args[1];
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+  if (argc != 1)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected argument size of restore_state is 1!");
+    return NULL;
+  }
+
+  napi_valuetype argt_0;
+  NAPI_CALL(env, napi_typeof(env, args[0], &argt_0));
+  if (argt_0 != napi_string)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of first argument of restore_state is string!");
+    return NULL;
+  }
+
+  restore_state_context *context = calloc(1, sizeof(restore_state_context));
+  if (context == NULL)
+  {
+    napi_throw_error(env, EWB_NNA_CALLFAIL, "Failed to allocate the context!");
+    return NULL;
+  }
+
+  if (napi_utils_get_value_string(env, args[0], &context->path) != napi_ok)
+  {
+    free_restore_state_context(env, context);
+    return NULL;
+  }
+
+  napi_value promise, resource_name;
+  if (
+    napi_create_promise(env, &context->deferred, &promise) != napi_ok ||
+    napi_create_string_utf8(env, "restoreState", NAPI_AUTO_LENGTH, &resource_name) != napi_ok ||
+    napi_create_async_work(env, NULL, resource_name, restore_state_execute, restore_state_complete, context, &context->work) != napi_ok ||
+    napi_queue_async_work(env, context->work) != napi_ok
+  )
+  {
+    free_restore_state_context(env, context);
+
+    napi_throw_error(env, EWB_NNA_CALLFAIL, "Failed to queue the async work!");
+    return NULL;
+  }
+
+  return promise;
+}
+
+static void add_device_async_execute(napi_env env, void *data)
+{
+  device_async_context *context = (device_async_context *)data;
+
+  ewb_metrics_call_attach(&context->metrics);
+  context->ret = add_wg_device(NULL, context->device_name);
+  ewb_metrics_call_detach(&context->metrics);
+}
+
+static napi_value add_device_async(napi_env env, const napi_callback_info info)
+{
+  device_async_context *context = create_device_async_context_from_device_name(env, info, "add_device_async", false);
+  if (context == NULL)
+  {
+    return NULL;
+  }
+  context->failure_message = "Failed to add the device!";
+
+  return queue_device_async_context(env, context, "addDeviceAsync", add_device_async_execute, void_device_async_complete);
+}
+
+static void remove_device_async_execute(napi_env env, void *data)
+{
+  device_async_context *context = (device_async_context *)data;
+
+  ewb_metrics_call_attach(&context->metrics);
+  context->ret = remove_wg_device(NULL, context->device_name);
+  ewb_metrics_call_detach(&context->metrics);
+}
+
+static napi_value remove_device_async(napi_env env, const napi_callback_info info)
+{
+  device_async_context *context = create_device_async_context_from_device_name(env, info, "remove_device_async", false);
+  if (context == NULL)
+  {
+    return NULL;
+  }
+  context->failure_message = "Failed to remove the device!";
+
+  return queue_device_async_context(env, context, "removeDeviceAsync", remove_device_async_execute, void_device_async_complete);
+}
+
+static void list_device_names_async_execute(napi_env env, void *data)
+{
+  device_async_context *context = (device_async_context *)data;
+
+  ewb_metrics_call_attach(&context->metrics);
+  context->device_names = list_wg_device_names();
+  context->ret = context->device_names == NULL;
+  ewb_metrics_call_detach(&context->metrics);
+}
+
+static void list_device_names_async_complete(napi_env env, napi_status status, void *data)
+{
+  device_async_context *context = (device_async_context *)data;
+
+  ewb_metrics_call_resume(&context->metrics);
+
+  if (status != napi_ok || context->ret)
+  {
+    reject_device_async_context(env, context, EWB_LIB_CALLFAIL, "Failed to list the device names!");
+    free_device_async_context(env, context);
+    return;
+  }
+
+  napi_value result = create_device_names_array_from_wg_device_names(env, context->device_names);
+  if (result == NULL)
+  {
+    reject_device_async_context(env, context, EWB_NNA_CALLFAIL, "Failed to create the array of device names!");
+  }
+  else
+  {
+    napi_resolve_deferred(env, context->deferred, result);
+  }
+
+  free_device_async_context(env, context);
+}
+
+static napi_value list_device_names_async(napi_env env, napi_callback_info info)
+{
+  device_async_context *context = calloc(1, sizeof(device_async_context));
+  if (context == NULL)
+  {
+    return create_rejected_promise_from_errno(env, EWB_NNA_CALLFAIL, "Failed to allocate the context!", -ENOMEM);
+  }
+
+  return queue_device_async_context(env, context, "listDeviceNamesAsync", list_device_names_async_execute, list_device_names_async_complete);
+}
+
+// The loopback only serves the benchmark, so it is left out of the binding unless built with `ewb_bench=1`.
+#ifdef EWB_BENCH
+static double get_milliseconds_since(const struct timespec *start)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (double)(now.tv_sec - start->tv_sec) * 1000 + (double)(now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static napi_value create_stats_object_from_loopback_stats(napi_env env, const ewb_nl_loopback_stats *stats, double unmarshal_ms, double marshal_ms)
+{
+  napi_value stats_obj;
+  NAPI_CALL(env, napi_create_object(env, &stats_obj));
+
+  napi_value messages, bytes, unmarshal, encode, decode, marshal;
+  NAPI_CALL(env, napi_create_double(env, (double)stats->messages, &messages));
+  NAPI_CALL(env, napi_create_double(env, (double)stats->bytes, &bytes));
+  NAPI_CALL(env, napi_create_double(env, unmarshal_ms, &unmarshal));
+  NAPI_CALL(env, napi_create_double(env, (double)stats->encode_ns / 1e6, &encode));
+  NAPI_CALL(env, napi_create_double(env, (double)stats->decode_ns / 1e6, &decode));
+  NAPI_CALL(env, napi_create_double(env, marshal_ms, &marshal));
+
+  NAPI_CALL(env, napi_set_named_property(env, stats_obj, "messages", messages));
+  NAPI_CALL(env, napi_set_named_property(env, stats_obj, "bytes", bytes));
+  NAPI_CALL(env, napi_set_named_property(env, stats_obj, "unmarshalMs", unmarshal));
+  NAPI_CALL(env, napi_set_named_property(env, stats_obj, "encodeMs", encode));
+  NAPI_CALL(env, napi_set_named_property(env, stats_obj, "decodeMs", decode));
+  NAPI_CALL(env, napi_set_named_property(env, stats_obj, "marshalMs", marshal));
+
+  return stats_obj;
+}
+
+// Runs a device through every stage of setDevice and getDevice with the netlink messages looped back in memory, timing each stage.
+static napi_value loopback_device(napi_env env, const napi_callback_info info)
+{
+  size_t argc = 2;
+  napi_value args[2];
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+  if (argc != 1 && argc != 2)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected argument size of loopback_device is 1 or 2!");
+    return NULL;
+  }
+
+  key_format format;
+  if (get_key_format_from_napi_options(env, args[1], &format))
+  {
+    return NULL;
+  }
+
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  ewb_arena *arena;
+  struct wg_device *device = create_wg_device_from_napi_value(env, args[0], "loopback_device", &arena);
+  if (device == NULL)
+  {
+    return NULL;
+  }
+  double unmarshal_ms = get_milliseconds_since(&start);
+
+  struct wg_device *result;
+  ewb_nl_loopback_stats stats;
+  int ret = ewb_nl_loopback_device(device, &result, &stats);
+  ewb_arena_release(arena);
+
+  if (ret)
+  {
+    napi_throw_error(env, EWB_LIB_CALLFAIL, "Failed to loop the device back!");
+    return NULL;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  napi_value device_obj = create_device_object_from_wg_device(env, result, format);
+  double marshal_ms = get_milliseconds_since(&start);
+  wg_free_device(result);
+
+  if (device_obj == NULL)
+  {
+    return NULL;
+  }
+
+  napi_value stats_obj = create_stats_object_from_loopback_stats(env, &stats, unmarshal_ms, marshal_ms);
+  if (stats_obj == NULL)
+  {
+    return NULL;
+  }
+
+  napi_value result_obj;
+  NAPI_CALL(env, napi_create_object(env, &result_obj));
+  NAPI_CALL(env, napi_set_named_property(env, result_obj, "device", device_obj));
+  NAPI_CALL(env, napi_set_named_property(env, result_obj, "stats", stats_obj));
+
+  return result_obj;
+}
+#endif
+
+static napi_value generate_public_key(napi_env env, const napi_callback_info info)
+{
+  size_t argc = 1;
+  napi_value args[1];
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+  if (argc != 1)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected argument size of generate_public_key is 1!");
+    return NULL;
+  }
+
+  napi_valuetype argt_0;
+  NAPI_CALL(env, napi_typeof(env, args[0], &argt_0));
+
+  // The public key is returned in the same format as the private key is given.
+  wg_key private_key;
+  wg_key public_key;
+  if (argt_0 == napi_string)
+  {
+    char *private_key_str;
+    NAPI_CALL(env, napi_utils_get_value_string(env, args[0], &private_key_str));
+    if (wg_key_from_base64(private_key, private_key_str))
+    {
+      free(private_key_str);
+
+      napi_throw_error(env, EWB_LIB_CALLFAIL, "Failed to parse base64 encoded key!");
+      return NULL;
+    }
+
+    free(private_key_str);
+  }
+  else if (get_wg_key_from_napi_value(env, args[0], private_key))
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of first argument of generate_public_key is string or 32 bytes!");
+    return NULL;
+  }
+
+  uint64_t started_at = ewb_metrics_now();
+  wg_generate_public_key(public_key, private_key);
+  ewb_metrics_record_kernel_time(started_at);
+
+  return create_key_value_from_wg_key(env, public_key, argt_0 == napi_string ? KEY_FORMAT_BASE64 : KEY_FORMAT_BINARY);
+}
+
+// The key is in the format of the options, or of setKeyFormat without them.
+static napi_value generate_private_key(napi_env env, const napi_callback_info info)
+{
+  size_t argc = 1;
+  napi_value args[1];
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+  if (argc > 1)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected argument size of generate_private_key is 0 or 1!");
+    return NULL;
+  }
+
+  key_format format;
+  if (get_key_format_from_napi_options(env, args[0], &format))
+  {
+    return NULL;
+  }
+
+  wg_key private_key;
+  uint64_t started_at = ewb_metrics_now();
+  wg_generate_private_key(private_key);
+  ewb_metrics_record_kernel_time(started_at);
+
+  return create_key_value_from_wg_key(env, private_key, format);
+}
+
+static napi_value generate_preshared_key(napi_env env, const napi_callback_info info)
+{
+  size_t argc = 1;
+  napi_value args[1];
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+  if (argc > 1)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected argument size of generate_preshared_key is 0 or 1!");
+    return NULL;
+  }
+
+  key_format format;
+  if (get_key_format_from_napi_options(env, args[0], &format))
+  {
+    return NULL;
+  }
+
+  wg_key preshared_key;
+  uint64_t started_at = ewb_metrics_now();
+  wg_generate_preshared_key(preshared_key);
+  ewb_metrics_record_kernel_time(started_at);
+
+  return create_key_value_from_wg_key(env, preshared_key, format);
+}
+
+static napi_value set_key_format(napi_env env, const napi_callback_info info)
+{
+  size_t argc = 1;
+  napi_value args[1];
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+  if (argc != 1)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected argument size of set_key_format is 1!");
+    return NULL;
+  }
+
+  addon_data *data;
+  NAPI_CALL(env, napi_get_instance_data(env, (void **)&data));
+
+  key_format format;
+  if (data == NULL || get_key_format_from_napi_value(env, args[0], &format))
+  {
+    return NULL;
+  }
+
+  data->default_key_format = format;
+
+  return NULL;
+}
+
+static napi_value set_uapi_socket_directory(napi_env env, const napi_callback_info info)
+{
+  size_t argc = 1;
+  napi_value args[1];
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+  if (argc != 1)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected argument size of set_uapi_socket_directory is 1!");
+    return NULL;
+  }
+
+  napi_valuetype argt_0;
+  NAPI_CALL(env, napi_typeof(env, args[0], &argt_0));
+  if (argt_0 != napi_string)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of first argument of set_uapi_socket_directory is string!");
+    return NULL;
+  }
+
+  char *directory;
+  NAPI_CALL(env, napi_utils_get_value_string(env, args[0], &directory));
+  ewb_uapi_set_socket_directory(directory);
+  free(directory);
+
+  return NULL;
+}
+
+static int get_key_count_from_callback_info(napi_env env, const napi_callback_info info, const char *binding_name, uint32_t *count)
+{
+  size_t argc = 1;
+  napi_value args[1];
+  ASSERT_NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, NULL, NULL), 1);
+
+  char message[128];
+  if (argc != 1)
+  {
+    snprintf(message, sizeof(message), "The expected argument size of %s is 1!", binding_name);
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, message);
+    return 1;
+  }
+
+  double value;
+  if (napi_get_value_double(env, args[0], &value) != napi_ok || !(value >= 0 && value <= UINT32_MAX) || value != (uint32_t)value)
+  {
+    snprintf(message, sizeof(message), "The expected type of first argument of %s is non-negative integer!", binding_name);
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, message);
+    return 1;
+  }
+
+  *count = (uint32_t)value;
+
+  return 0;
+}
+
+static int fill_keys(uint8_t *data, uint32_t count, bool is_key_pairs)
+{
+  uint64_t started_at = ewb_metrics_now();
+  int ret = is_key_pairs ? ewb_keygen_fill_key_pairs(data, count) : ewb_keygen_fill_preshared_keys(data, count);
+  ewb_metrics_record_kernel_time(started_at);
+
+  return ret;
+}
+
+static napi_value generate_keys(napi_env env, const napi_callback_info info, const char *binding_name, bool is_key_pairs)
+{
+  uint32_t count;
+  if (get_key_count_from_callback_info(env, info, binding_name, &count))
+  {
+    return NULL;
+  }
+
+  void *data;
+  napi_value result;
+  NAPI_CALL(env, napi_create_buffer(env, (size_t)count * sizeof(wg_key) * (is_key_pairs ? 2 : 1), &data, &result));
+
+  if (fill_keys(data, count, is_key_pairs))
+  {
+    napi_throw_error(env, EWB_SOC_CALLFAIL, "Failed to generate the keys!");
+    return NULL;
+  }
+
+  return result;
+}
+
+static napi_value generate_key_pairs(napi_env env, const napi_callback_info info)
+{
+  return generate_keys(env, info, "generate_key_pairs", true);
+}
+
+static napi_value generate_preshared_keys(napi_env env, const napi_callback_info info)
+{
+  return generate_keys(env, info, "generate_preshared_keys", false);
+}
+
+typedef struct
+{
+  napi_async_work work;
+  napi_deferred deferred;
+  napi_ref buffer_ref;
+  uint8_t *data;
+  uint32_t count;
+  bool is_key_pairs;
+  ewb_metrics_call metrics;
+  int ret;
+} keys_async_context;
+
+static void generate_keys_async_execute(napi_env env, void *data)
+{
+  keys_async_context *context = (keys_async_context *)data;
+
+  ewb_metrics_call_attach(&context->metrics);
+  context->ret = fill_keys(context->data, context->count, context->is_key_pairs);
+  ewb_metrics_call_detach(&context->metrics);
+}
+
+static void generate_keys_async_complete(napi_env env, napi_status status, void *data)
+{
+  keys_async_context *context = (keys_async_context *)data;
+  ewb_metrics_call_resume(&context->metrics);
+
+  napi_value buffer, code, message, error;
+  if (status == napi_ok && context->ret == 0 && napi_get_reference_value(env, context->buffer_ref, &buffer) == napi_ok)
+  {
+    napi_resolve_deferred(env, context->deferred, buffer);
+    ewb_metrics_call_end(&context->metrics, NULL);
+  }
+  else
+  {
+    if (
+      napi_create_string_utf8(env, EWB_SOC_CALLFAIL, NAPI_AUTO_LENGTH, &code) == napi_ok &&
+      napi_create_string_utf8(env, "Failed to generate the keys!", NAPI_AUTO_LENGTH, &message) == napi_ok &&
+      napi_create_error(env, code, message, &error) == napi_ok
+    )
+    {
+      napi_reject_deferred(env, context->deferred, error);
+    }
+    ewb_metrics_call_end(&context->metrics, EWB_SOC_CALLFAIL);
+  }
+
+  napi_delete_reference(env, context->buffer_ref);
+  napi_delete_async_work(env, context->work);
+  free(context);
+}
+
+static napi_value generate_keys_async(napi_env env, const napi_callback_info info, const char *binding_name, const char *resource_name_str, bool is_key_pairs)
+{
+  uint32_t count;
+  if (get_key_count_from_callback_info(env, info, binding_name, &count))
+  {
+    return NULL;
+  }
+
+  keys_async_context *context = calloc(1, sizeof(keys_async_context));
+  if (context == NULL)
+  {
+    napi_throw_error(env, EWB_NNA_CALLFAIL, "Failed to allocate the async work!");
+    return NULL;
+  }
+  context->count = count;
+  context->is_key_pairs = is_key_pairs;
+
+  // The keys are written straight into the Buffer from the thread pool, so we hold the Buffer until the work completes.
+  napi_value buffer, promise, resource_name;
+  if (
+    napi_create_buffer(env, (size_t)count * sizeof(wg_key) * (is_key_pairs ? 2 : 1), (void **)&context->data, &buffer) != napi_ok ||
+    napi_create_reference(env, buffer, 1, &context->buffer_ref) != napi_ok
+  )
+  {
+    free(context);
+
+    napi_throw_error(env, EWB_NNA_CALLFAIL, "Failed to create the Buffer of the keys!");
+    return NULL;
+  }
+
+  ewb_metrics_call_hand_off(&context->metrics);
+
+  if (
+    napi_create_promise(env, &context->deferred, &promise) != napi_ok ||
+    napi_create_string_utf8(env, resource_name_str, NAPI_AUTO_LENGTH, &resource_name) != napi_ok ||
+    napi_create_async_work(env, NULL, resource_name, generate_keys_async_execute, generate_keys_async_complete, context, &context->work) != napi_ok ||
+    napi_queue_async_work(env, context->work) != napi_ok
+  )
+  {
+    if (context->work != NULL)
+    {
+      napi_delete_async_work(env, context->work);
+    }
+    napi_delete_reference(env, context->buffer_ref);
+    ewb_metrics_call_end(&context->metrics, EWB_NNA_CALLFAIL);
+    free(context);
+
+    napi_throw_error(env, EWB_NNA_CALLFAIL, "Failed to queue the async work!");
+    return NULL;
+  }
+
+  return promise;
+}
+
+static napi_value generate_key_pairs_async(napi_env env, const napi_callback_info info)
+{
+  return generate_keys_async(env, info, "generate_key_pairs_async", "generateKeyPairsAsync", true);
+}
+
+static napi_value generate_preshared_keys_async(napi_env env, const napi_callback_info info)
+{
+  return generate_keys_async(env, info, "generate_preshared_keys_async", "generatePresharedKeysAsync", false);
+}
+
+static napi_value create_address_object_from_rtnl_address(napi_env env, const ewb_rtnl_address *address)
+{
+  napi_value address_obj;
+  NAPI_CALL(env, napi_create_object(env, &address_obj));
+
+  char ip_str[INET6_ADDRSTRLEN];
+  inet_ntop(address->family, address->addr, ip_str, sizeof(ip_str));
+
+  napi_value family, ip, prefix;
+  NAPI_CALL(env, napi_create_uint32(env, address->family, &family));
+  NAPI_CALL(env, napi_create_string_utf8(env, ip_str, NAPI_AUTO_LENGTH, &ip));
+  NAPI_CALL(env, napi_create_uint32(env, address->prefix, &prefix));
+  NAPI_CALL(env, napi_set_named_property(env, address_obj, "family", family));
+  NAPI_CALL(env, napi_set_named_property(env, address_obj, "ip", ip));
+  NAPI_CALL(env, napi_set_named_property(env, address_obj, "prefix", prefix));
+
+  return address_obj;
+}
+
+static napi_value get_interface_address(napi_env env, const napi_callback_info info)
+{
+  size_t argc = 1;
+  napi_value args[1], this_arg;
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, &this_arg, NULL));
+  if (argc != 1)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected argument size of get_interface_address is 1!");
+    return NULL;
+  }
+
+  napi_valuetype argt_0;
+  NAPI_CALL(env, napi_typeof(env, args[0], &argt_0));
+  if (argt_0 != napi_string)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of first argument of get_interface_address is string!");
+    return NULL;
+  }
+
+  char *device_name;
+  NAPI_CALL(env, napi_utils_get_value_string(env, args[0], &device_name));
+  ewb_rtnl_socket *rtnl = unwrap_rtnl_socket(env, this_arg);
+  uint32_t ifindex;
+  int ret = get_rtnl_ifindex(rtnl, device_name, &ifindex);
+  free(device_name);
+  if (ret)
+  {
+    napi_throw_error(env, EWB_SOC_CALLFAIL, "Unable to get socket addresses!");
+    return NULL;
+  }
+
+  napi_value ifaddrs_value;
+  NAPI_CALL(env, napi_create_array(env, &ifaddrs_value));
+
+  // The interface that doesn't exist has no address, same as we filtered the addresses of the host by the name.
+  if (ifindex == 0)
+  {
+    return ifaddrs_value;
+  }
+
+  ewb_rtnl_addresses addresses;
+  uint64_t started_at = ewb_metrics_now();
+  ret = ewb_rtnl_get_addresses(rtnl, ifindex, &addresses);
+  ewb_metrics_record_kernel_time(started_at);
+  if (ret)
+  {
+    napi_throw_error(env, EWB_SOC_CALLFAIL, "Unable to get socket addresses!");
+    return NULL;
+  }
+
+  for (size_t index = 0; index < addresses.count; index++)
+  {
+    napi_value address_obj = create_address_object_from_rtnl_address(env, &addresses.addresses[index]);
+    if (address_obj == NULL || napi_set_element(env, ifaddrs_value, index, address_obj) != napi_ok)
+    {
+      ewb_rtnl_addresses_destroy(&addresses);
+      return NULL;
+    }
+  }
+
+  ewb_rtnl_addresses_destroy(&addresses);
+
+  return ifaddrs_value;
+}
+
+typedef struct
+{
+  uint32_t ifindex;
+  uint32_t index;
+} interface_entry;
+
+static int compare_interface_entries(const void *a, const void *b)
+{
+  uint32_t ifindex_a = ((const interface_entry *)a)->ifindex, ifindex_b = ((const interface_entry *)b)->ifindex;
+
+  return ifindex_a < ifindex_b ? -1 : ifindex_a > ifindex_b;
+}
+
+static napi_value get_interface_addresses(napi_env env, const napi_callback_info info)
+{
+  size_t argc = 1;
+  napi_value args[1], this_arg;
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, &this_arg, NULL));
+  if (argc != 1)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected argument size of get_interface_addresses is 1!");
+    return NULL;
+  }
+
+  bool is_array;
+  NAPI_CALL(env, napi_is_array(env, args[0], &is_array));
+  if (!is_array)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of first argument of get_interface_addresses is array!");
+    return NULL;
+  }
+
+  uint32_t length;
+  NAPI_CALL(env, napi_get_array_length(env, args[0], &length));
+
+  napi_value result;
+  NAPI_CALL(env, napi_create_array_with_length(env, length, &result));
+
+  ewb_rtnl_socket *rtnl = unwrap_rtnl_socket(env, this_arg);
+  interface_entry *entries = calloc(length + 1, sizeof(interface_entry));
+  uint32_t *counts = calloc(length + 1, sizeof(uint32_t));
+  if (entries == NULL || counts == NULL)
+  {
+    free(entries);
+    free(counts);
+
+    napi_throw_error(env, EWB_NNA_CALLFAIL, "Failed to allocate the interfaces!");
+    return NULL;
+  }
+
+  for (uint32_t index = 0; index < length; index++)
+  {
+    napi_value element, addresses_value;
+    char name[IFNAMSIZ];
+    size_t name_length;
+    if (
+      napi_get_element(env, args[0], index, &element) != napi_ok ||
+      napi_get_value_string_utf8(env, element, name, sizeof(name), &name_length) != napi_ok ||
+      napi_create_array(env, &addresses_value) != napi_ok ||
+      napi_set_element(env, result, index, addresses_value) != napi_ok
+    )
+    {
+      free(entries);
+      free(counts);
+
+      napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of the element of first argument of get_interface_addresses is string!");
+      return NULL;
+    }
+
+    // The name longer than the limit is cut by the buffer, so we take it as missing rather than the interface of the prefix.
+    entries[index].ifindex = 0;
+    entries[index].index = index;
+    if (name_length < IFNAMSIZ - 1 && get_rtnl_ifindex(rtnl, name, &entries[index].ifindex))
+    {
+      free(entries);
+      free(counts);
+
+      napi_throw_error(env, EWB_SOC_CALLFAIL, "Unable to get socket addresses!");
+      return NULL;
+    }
+  }
+  qsort(entries, length, sizeof(interface_entry), compare_interface_entries);
+
+  // A single dump answers every interface, as the filtered dumps would cost a round trip each.
+  ewb_rtnl_addresses addresses;
+  uint64_t started_at = ewb_metrics_now();
+  int ret = length > 0 ? ewb_rtnl_get_addresses(rtnl, 0, &addresses) : 0;
+  ewb_metrics_record_kernel_time(started_at);
+  if (ret)
+  {
+    free(entries);
+    free(counts);
+
+    napi_throw_error(env, EWB_SOC_CALLFAIL, "Unable to get socket addresses!");
+    return NULL;
+  }
+  if (length == 0)
+  {
+    memset(&addresses, 0, sizeof(addresses));
+  }
+
+  for (size_t address_index = 0; address_index < addresses.count; address_index++)
+  {
+    const ewb_rtnl_address *address = &addresses.addresses[address_index];
+
+    interface_entry key = {.ifindex = address->ifindex};
+    interface_entry *entry = bsearch(&key, entries, length, sizeof(interface_entry), compare_interface_entries);
+    if (entry == NULL)
+    {
+      continue;
+    }
+
+    // The same name may be given more than once, and bsearch may land on any of them.
+    while (entry > entries && (entry - 1)->ifindex == address->ifindex)
+    {
+      entry--;
+    }
+
+    napi_value address_obj = create_address_object_from_rtnl_address(env, address);
+    for (; address_obj != NULL && entry < entries + length && entry->ifindex == address->ifindex; entry++)
+    {
+      napi_value addresses_value;
+      if (
+        napi_get_element(env, result, entry->index, &addresses_value) != napi_ok ||
+        napi_set_element(env, addresses_value, counts[entry->index]++, address_obj) != napi_ok
+      )
+      {
+        address_obj = NULL;
+      }
+    }
+
+    if (address_obj == NULL)
+    {
+      ewb_rtnl_addresses_destroy(&addresses);
+      free(entries);
+      free(counts);
+      return NULL;
+    }
+  }
+
+  ewb_rtnl_addresses_destroy(&addresses);
+  free(entries);
+  free(counts);
+
+  return result;
+}
+
+static napi_value set_interface_address(napi_env env, const napi_callback_info info)
+{
+  size_t argc = 2;
+  napi_value args[2];
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+  if (argc != 2)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected argument size of set_interface_address is 2!");
+    return NULL;
+  }
+
+  napi_valuetype argt_0, argt_1;
+  NAPI_CALL(env, napi_typeof(env, args[0], &argt_0));
+  NAPI_CALL(env, napi_typeof(env, args[1], &argt_1));
+
+  if (argt_0 != napi_string)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of first argument of set_interface_address is string!");
+    return NULL;
+  }
+  if (argt_1 != napi_object)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of second argument of set_interface_address is object!");
+    return NULL;
+  }
+
+  napi_value family_props, ip_props;
+  NAPI_CALL(env, napi_get_named_property(env, args[1], "family", &family_props));
+  NAPI_CALL(env, napi_get_named_property(env, args[1], "ip", &ip_props));
+
+  napi_valuetype family_type, ip_type;
+  NAPI_CALL(env, napi_typeof(env, family_props, &family_type));
+  NAPI_CALL(env, napi_typeof(env, ip_props, &ip_type));
+
+  if (family_type != napi_number)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of family property of address is number!");
+    return NULL;
+  }
+  if (ip_type != napi_string)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of ip property of address is string!");
+    return NULL;
+  }
+
+  uint32_t family;
+  char *device_name, *ip;
+  union
+  {
+    struct in_addr v4;
+    struct in6_addr v6;
+  } addr;
+  NAPI_CALL(env, napi_get_value_uint32(env, family_props, &family));
+  NAPI_CALL(env, napi_utils_get_value_string(env, args[0], &device_name));
+  NAPI_CALL(env, napi_utils_get_value_string(env, ip_props, &ip));
+
+  if (inet_pton(family, ip, &addr) != 1)
+  {
+    free(ip);
+    free(device_name);
+
+    napi_throw_type_error(env, EWB_AF_UNSPEC, "Failed to validate the address family! Please, give a valid ip address.");
+    return NULL;
+  }
+
+  free(ip);
+
+  int sockfd = socket(family, SOCK_DGRAM, 0);
+  if (sockfd == -1)
+  {
+    napi_throw_error(env, EWB_SOC_CALLFAIL, "Failed to open socket for interface!");
+    return NULL;
+  }
+
+  // The warning here is expected, but will not remove for the future debug and improvement.
+  struct ifreq ifr;
+  strncpy(ifr.ifr_name, device_name, IFNAMSIZ);
+  free(device_name);
+
+  if (family == AF_INET)
+  {
+    ifr.ifr_addr.sa_family = AF_INET;
+    memcpy(&((struct sockaddr_in *)&ifr.ifr_addr)->sin_addr, &addr.v4, sizeof(struct in_addr));
+  }
+  else
+  {
+    ifr.ifr_addr.sa_family = AF_INET6;
+    memcpy(&((struct sockaddr_in6 *)&ifr.ifr_addr)->sin6_addr, &addr.v6, sizeof(struct in6_addr));
+  }
+
+  uint64_t started_at = ewb_metrics_now();
+  int ret = ioctl(sockfd, SIOCSIFADDR, &ifr);
+  ewb_metrics_record_kernel_time(started_at);
+  if (ret == -1)
+  {
+    napi_throw_error(env, EWB_SOC_CALLFAIL, "SIOCSIFADDR");
+
+    close(sockfd);
+    return NULL;
+  }
+
+  close(sockfd);
+  return NULL;
+}
+
+static int get_link_address_from_napi_object(napi_env env, napi_value object, ewb_rtnl_address *address)
+{
+  napi_valuetype object_type;
+  ASSERT_NAPI_CALL(env, napi_typeof(env, object, &object_type), 1);
+  if (object_type != napi_object)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of the element of addresses property is object!");
+    return 1;
+  }
+
+  napi_value ip_prop, prefix_prop;
+  ASSERT_NAPI_CALL(env, napi_get_named_property(env, object, "ip", &ip_prop), 1);
+  ASSERT_NAPI_CALL(env, napi_get_named_property(env, object, "prefix", &prefix_prop), 1);
+
+  memset(address, 0, sizeof(ewb_rtnl_address));
+
+  char ip_str[INET6_ADDRSTRLEN];
+  size_t length;
+  if (napi_get_value_string_utf8(env, ip_prop, ip_str, sizeof(ip_str), &length) != napi_ok || length >= sizeof(ip_str) - 1)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of ip property of address is string!");
+    return 1;
+  }
+  if (inet_pton(AF_INET, ip_str, address->addr) == 1)
+  {
+    address->family = AF_INET;
+  }
+  else if (inet_pton(AF_INET6, ip_str, address->addr) == 1)
+  {
+    address->family = AF_INET6;
+  }
+  else
+  {
+    napi_throw_error(env, EWB_AF_UNSPEC, "The ip property of address should be in the valid ipv4 or ipv6 format!");
+    return 1;
+  }
+
+  // The address without the prefix length is the address alone, same as `ip address add` takes it.
+  uint32_t max_prefix = address->family == AF_INET6 ? 128 : 32;
+  uint32_t prefix = max_prefix;
+  napi_valuetype prefix_type;
+  ASSERT_NAPI_CALL(env, napi_typeof(env, prefix_prop, &prefix_type), 1);
+  if (prefix_type != napi_undefined && (napi_get_value_uint32(env, prefix_prop, &prefix) != napi_ok || prefix > max_prefix))
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of prefix property of address is number up to the length of the address!");
+    return 1;
+  }
+  address->prefix = (uint8_t)prefix;
+
+  return 0;
+}
+
+static napi_value configure_link(napi_env env, const napi_callback_info info)
+{
+  size_t argc = 2;
+  napi_value args[2], this_arg;
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, &this_arg, NULL));
+  if (argc != 2)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected argument size of configure_link is 2!");
+    return NULL;
+  }
+
+  napi_valuetype argt_0, argt_1;
+  NAPI_CALL(env, napi_typeof(env, args[0], &argt_0));
+  NAPI_CALL(env, napi_typeof(env, args[1], &argt_1));
+  if (argt_0 != napi_string)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of first argument of configure_link is string!");
+    return NULL;
+  }
+  if (argt_1 != napi_object)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of second argument of configure_link is object!");
+    return NULL;
+  }
+
+  ewb_rtnl_link_config config;
+  memset(&config, 0, sizeof(config));
+
+  napi_value up_prop, mtu_prop, addresses_prop;
+  napi_valuetype up_type, mtu_type, addresses_type;
+  NAPI_CALL(env, napi_get_named_property(env, args[1], "up", &up_prop));
+  NAPI_CALL(env, napi_get_named_property(env, args[1], "mtu", &mtu_prop));
+  NAPI_CALL(env, napi_get_named_property(env, args[1], "addresses", &addresses_prop));
+  NAPI_CALL(env, napi_typeof(env, up_prop, &up_type));
+  NAPI_CALL(env, napi_typeof(env, mtu_prop, &mtu_type));
+  NAPI_CALL(env, napi_typeof(env, addresses_prop, &addresses_type));
+
+  if (up_type != napi_undefined)
+  {
+    if (up_type != napi_boolean)
+    {
+      napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of up property of link is boolean!");
+      return NULL;
+    }
+    NAPI_CALL(env, napi_get_value_bool(env, up_prop, &config.is_up));
+    config.has_up = true;
+  }
+  if (mtu_type != napi_undefined)
+  {
+    if (mtu_type != napi_number || napi_get_value_uint32(env, mtu_prop, &config.mtu) != napi_ok)
+    {
+      napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of mtu property of link is number!");
+      return NULL;
+    }
+    config.has_mtu = true;
+  }
+
+  ewb_rtnl_address *addresses = NULL;
+  if (addresses_type != napi_undefined)
+  {
+    bool is_array;
+    uint32_t length;
+    NAPI_CALL(env, napi_is_array(env, addresses_prop, &is_array));
+    if (!is_array)
+    {
+      napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of addresses property of link is array!");
+      return NULL;
+    }
+    NAPI_CALL(env, napi_get_array_length(env, addresses_prop, &length));
+
+    addresses = calloc(length + 1, sizeof(ewb_rtnl_address));
+    if (addresses == NULL)
+    {
+      napi_throw_error(env, EWB_NNA_CALLFAIL, "Failed to allocate the addresses!");
+      return NULL;
+    }
+
+    for (uint32_t index = 0; index < length; index++)
+    {
+      napi_value element;
+      if (napi_get_element(env, addresses_prop, index, &element) != napi_ok || get_link_address_from_napi_object(env, element, &addresses[index]))
+      {
+        free(addresses);
+        return NULL;
+      }
+    }
+
+    config.addresses = addresses;
+    config.address_count = length;
+  }
+
+  char *device_name;
+  if (napi_utils_get_value_string(env, args[0], &device_name) != napi_ok)
+  {
+    free(addresses);
+    return NULL;
+  }
+  ewb_rtnl_socket *rtnl = unwrap_rtnl_socket(env, this_arg);
+  uint32_t ifindex = 0;
+  get_rtnl_ifindex(rtnl, device_name, &ifindex);
+  free(device_name);
+
+  if (ifindex == 0)
+  {
+    free(addresses);
+
+    napi_throw_error(env, EWB_SOC_CALLFAIL, "Failed to find the interface!");
+    return NULL;
+  }
+
+  uint64_t started_at = ewb_metrics_now();
+  int ret = ewb_rtnl_configure_link(rtnl, ifindex, &config);
+  ewb_metrics_record_kernel_time(started_at);
+  free(addresses);
+
+  if (ret)
+  {
+    napi_throw_error(env, EWB_SOC_CALLFAIL, "Failed to configure the link!");
+    return NULL;
+  }
+
+  return NULL;
+}
+
+#define DECLARE_NAPI_METHOD(name, func)     \
+  {                                         \
+    name, 0, func, 0, 0, 0, napi_default, 0 \
+  }
+
+// The binding counted into the metrics of the operation, called through call_metered_binding.
+typedef struct
+{
+  napi_callback callback;
+  ewb_metrics_operation operation;
+} metered_binding;
+
+#define DECLARE_NAPI_METERED_METHOD(name, binding)                        \
+  {                                                                       \
+    name, 0, call_metered_binding, 0, 0, 0, napi_default, (void *)&binding \
+  }
+
+// The code of the pending exception, which is thrown again as it was, or NULL if nothing was thrown.
+static const char *get_pending_error_code(napi_env env, char *code, size_t size)
+{
+  bool is_exception_pending;
+  napi_value error, code_value;
+  if (napi_is_exception_pending(env, &is_exception_pending) != napi_ok || !is_exception_pending)
+  {
+    return NULL;
+  }
+
+  code[0] = '\0';
+  if (napi_get_and_clear_last_exception(env, &error) != napi_ok)
+  {
+    return code;
+  }
+
+  napi_valuetype error_type;
+  if (napi_typeof(env, error, &error_type) == napi_ok && error_type == napi_object && napi_get_named_property(env, error, "code", &code_value) == napi_ok)
+  {
+    napi_get_value_string_utf8(env, code_value, code, size, NULL);
+  }
+
+  napi_throw(env, error);
+
+  return code;
+}
+
+static napi_value call_metered_binding(napi_env env, const napi_callback_info info)
+{
+  metered_binding *binding;
+  NAPI_CALL(env, napi_get_cb_info(env, info, NULL, NULL, NULL, (void **)&binding));
+
+  ewb_metrics_call call;
+  ewb_metrics_call_begin(&call, binding->operation);
+
+  napi_value result = binding->callback(env, info);
+
+  // The asynchronous bindings hand the call off to their work, which ends it on completion.
+  if (!call.is_handed_off)
+  {
+    char code[32];
+    ewb_metrics_call_end(&call, get_pending_error_code(env, code, sizeof(code)));
+  }
+
+  return result;
+}
+
+static const metered_binding get_device_binding = {get_device, EWB_METRICS_GET_DEVICE};
+static const metered_binding get_device_async_binding = {get_device_async, EWB_METRICS_GET_DEVICE};
+static const metered_binding set_device_binding = {set_device, EWB_METRICS_SET_DEVICE};
+static const metered_binding set_device_async_binding = {set_device_async, EWB_METRICS_SET_DEVICE};
+static const metered_binding set_device_chunked_binding = {set_device_chunked, EWB_METRICS_SET_DEVICE};
+static const metered_binding set_conf_from_file_binding = {set_conf_from_file, EWB_METRICS_SET_DEVICE};
+static const metered_binding show_conf_binding = {show_conf, EWB_METRICS_GET_DEVICE};
+static const metered_binding list_device_names_binding = {list_device_names, EWB_METRICS_LIST_DEVICE_NAMES};
+static const metered_binding list_device_names_async_binding = {list_device_names_async, EWB_METRICS_LIST_DEVICE_NAMES};
+static const metered_binding generate_public_key_binding = {generate_public_key, EWB_METRICS_GENERATE_KEYS};
+static const metered_binding generate_private_key_binding = {generate_private_key, EWB_METRICS_GENERATE_KEYS};
+static const metered_binding generate_preshared_key_binding = {generate_preshared_key, EWB_METRICS_GENERATE_KEYS};
+static const metered_binding generate_key_pairs_binding = {generate_key_pairs, EWB_METRICS_GENERATE_KEYS};
+static const metered_binding generate_preshared_keys_binding = {generate_preshared_keys, EWB_METRICS_GENERATE_KEYS};
+static const metered_binding generate_key_pairs_async_binding = {generate_key_pairs_async, EWB_METRICS_GENERATE_KEYS};
+static const metered_binding generate_preshared_keys_async_binding = {generate_preshared_keys_async, EWB_METRICS_GENERATE_KEYS};
+static const metered_binding get_interface_address_binding = {get_interface_address, EWB_METRICS_INTERFACE_ADDRESS};
+static const metered_binding get_interface_addresses_binding = {get_interface_addresses, EWB_METRICS_INTERFACE_ADDRESS};
+static const metered_binding set_interface_address_binding = {set_interface_address, EWB_METRICS_INTERFACE_ADDRESS};
+static const metered_binding configure_link_binding = {configure_link, EWB_METRICS_INTERFACE_ADDRESS};
+static const metered_binding add_device_binding = {add_device, EWB_METRICS_ADD_REMOVE_DEVICE};
+static const metered_binding add_device_async_binding = {add_device_async, EWB_METRICS_ADD_REMOVE_DEVICE};
+static const metered_binding remove_device_binding = {remove_device, EWB_METRICS_ADD_REMOVE_DEVICE};
+static const metered_binding remove_device_async_binding = {remove_device_async, EWB_METRICS_ADD_REMOVE_DEVICE};
+
+static const char *metrics_operation_names[] = {
+  [EWB_METRICS_GET_DEVICE] = "getDevice",
+  [EWB_METRICS_SET_DEVICE] = "setDevice",
+  [EWB_METRICS_LIST_DEVICE_NAMES] = "listDeviceNames",
+  [EWB_METRICS_GENERATE_KEYS] = "generateKeys",
+  [EWB_METRICS_INTERFACE_ADDRESS] = "interfaceAddress",
+  [EWB_METRICS_ADD_REMOVE_DEVICE] = "addRemoveDevice",
+};
+
+static double get_milliseconds_from_metrics_bucket(size_t bucket)
+{
+  return (double)ewb_metrics_bucket_upper_bound(bucket) / 1e6;
+}
+
+// The percentile is the upper bound of the bucket it falls into, so it is never under the real value by more than 1/8.
+static double get_percentile_from_metrics_buckets(const uint64_t *buckets, uint64_t count, double percentile)
+{
+  uint64_t rank = (uint64_t)(percentile * (double)count + 0.999999), seen = 0;
+  for (size_t bucket = 0; bucket < EWB_METRICS_BUCKETS; bucket++)
+  {
+    seen += buckets[bucket];
+    if (seen >= rank && seen > 0)
+    {
+      return get_milliseconds_from_metrics_bucket(bucket);
+    }
+  }
+
+  return 0;
+}
+
+static napi_value create_histogram_object_from_metrics_snapshot(napi_env env, const ewb_metrics_snapshot *snapshot, ewb_metrics_phase phase)
+{
+  const uint64_t *buckets = snapshot->buckets[phase];
+
+  napi_value histogram_obj, buckets_value, count, mean, p50, p90, p99, p999, max;
+  NAPI_CALL(env, napi_create_object(env, &histogram_obj));
+  NAPI_CALL(env, napi_create_array(env, &buckets_value));
+
+  uint64_t total = 0;
+  size_t last_bucket = 0;
+  uint32_t length = 0;
+  for (size_t bucket = 0; bucket < EWB_METRICS_BUCKETS; bucket++)
+  {
+    if (buckets[bucket] == 0)
+    {
+      continue;
+    }
+
+    // The buckets are given as [upper bound in ms, count] for the ones counted into only.
+    napi_value pair, upper_bound, bucket_count;
+    NAPI_CALL(env, napi_create_array_with_length(env, 2, &pair));
+    NAPI_CALL(env, napi_create_double(env, get_milliseconds_from_metrics_bucket(bucket), &upper_bound));
+    NAPI_CALL(env, napi_create_double(env, (double)buckets[bucket], &bucket_count));
+    NAPI_CALL(env, napi_set_element(env, pair, 0, upper_bound));
+    NAPI_CALL(env, napi_set_element(env, pair, 1, bucket_count));
+    NAPI_CALL(env, napi_set_element(env, buckets_value, length++, pair));
+
+    total += buckets[bucket];
+    last_bucket = bucket;
+  }
+
+  NAPI_CALL(env, napi_create_double(env, (double)total, &count));
+  NAPI_CALL(env, napi_create_double(env, total ? (double)snapshot->sum_ns[phase] / (double)total / 1e6 : 0, &mean));
+  NAPI_CALL(env, napi_create_double(env, get_percentile_from_metrics_buckets(buckets, total, 0.5), &p50));
+  NAPI_CALL(env, napi_create_double(env, get_percentile_from_metrics_buckets(buckets, total, 0.9), &p90));
+  NAPI_CALL(env, napi_create_double(env, get_percentile_from_metrics_buckets(buckets, total, 0.99), &p99));
+  NAPI_CALL(env, napi_create_double(env, get_percentile_from_metrics_buckets(buckets, total, 0.999), &p999));
+  NAPI_CALL(env, napi_create_double(env, total ? get_milliseconds_from_metrics_bucket(last_bucket) : 0, &max));
+
+  NAPI_CALL(env, napi_set_named_property(env, histogram_obj, "count", count));
+  NAPI_CALL(env, napi_set_named_property(env, histogram_obj, "meanMs", mean));
+  NAPI_CALL(env, napi_set_named_property(env, histogram_obj, "p50Ms", p50));
+  NAPI_CALL(env, napi_set_named_property(env, histogram_obj, "p90Ms", p90));
+  NAPI_CALL(env, napi_set_named_property(env, histogram_obj, "p99Ms", p99));
+  NAPI_CALL(env, napi_set_named_property(env, histogram_obj, "p999Ms", p999));
+  NAPI_CALL(env, napi_set_named_property(env, histogram_obj, "maxMs", max));
+  NAPI_CALL(env, napi_set_named_property(env, histogram_obj, "buckets", buckets_value));
+
+  return histogram_obj;
+}
+
+static napi_value create_metrics_object_from_metrics_snapshot(napi_env env, const ewb_metrics_snapshot *snapshot)
+{
+  napi_value metrics_obj, errors_obj, calls, error_count, bytes_sent, bytes_received, peers, allowedips, marshal, kernel;
+  NAPI_CALL(env, napi_create_object(env, &metrics_obj));
+  NAPI_CALL(env, napi_create_object(env, &errors_obj));
+
+  // The errors without a code, thrown by the runtime rather than us, are counted as EWB_UNKNOWN.
+  for (size_t index = 0; index < EWB_METRICS_ERROR_CODES; index++)
+  {
+    if (snapshot->errors[index] == 0)
+    {
+      continue;
+    }
+
+    NAPI_CALL(env, napi_create_double(env, (double)snapshot->errors[index], &error_count));
+    NAPI_CALL(env, napi_set_named_property(env, errors_obj, ewb_metrics_error_codes[index][0] ? ewb_metrics_error_codes[index] : "EWB_UNKNOWN", error_count));
+  }
+
+  NAPI_CALL(env, napi_create_double(env, (double)snapshot->calls, &calls));
+  NAPI_CALL(env, napi_create_double(env, (double)snapshot->bytes_sent, &bytes_sent));
+  NAPI_CALL(env, napi_create_double(env, (double)snapshot->bytes_received, &bytes_received));
+  NAPI_CALL(env, napi_create_double(env, (double)snapshot->peers, &peers));
+  NAPI_CALL(env, napi_create_double(env, (double)snapshot->allowedips, &allowedips));
+
+  marshal = create_histogram_object_from_metrics_snapshot(env, snapshot, EWB_METRICS_MARSHAL);
+  kernel = create_histogram_object_from_metrics_snapshot(env, snapshot, EWB_METRICS_KERNEL);
+  if (marshal == NULL || kernel == NULL)
+  {
+    return NULL;
+  }
+
+  NAPI_CALL(env, napi_set_named_property(env, metrics_obj, "calls", calls));
+  NAPI_CALL(env, napi_set_named_property(env, metrics_obj, "errors", errors_obj));
+  NAPI_CALL(env, napi_set_named_property(env, metrics_obj, "bytesSent", bytes_sent));
+  NAPI_CALL(env, napi_set_named_property(env, metrics_obj, "bytesReceived", bytes_received));
+  NAPI_CALL(env, napi_set_named_property(env, metrics_obj, "peers", peers));
+  NAPI_CALL(env, napi_set_named_property(env, metrics_obj, "allowedips", allowedips));
+  NAPI_CALL(env, napi_set_named_property(env, metrics_obj, "marshal", marshal));
+  NAPI_CALL(env, napi_set_named_property(env, metrics_obj, "kernel", kernel));
+
+  return metrics_obj;
+}
+
+static napi_value get_metrics(napi_env env, const napi_callback_info info)
+{
+  ewb_metrics_snapshot *snapshots = malloc(sizeof(ewb_metrics_snapshot) * EWB_METRICS_OPERATIONS);
+  if (snapshots == NULL)
+  {
+    napi_throw_error(env, EWB_NNA_CALLFAIL, "Failed to allocate the metrics!");
+    return NULL;
+  }
+  ewb_metrics_get_snapshot(snapshots);
+
+  napi_value result = NULL;
+  if (napi_create_object(env, &result) == napi_ok)
+  {
+    for (size_t operation = 0; operation < EWB_METRICS_OPERATIONS && result != NULL; operation++)
+    {
+      napi_value metrics_obj = create_metrics_object_from_metrics_snapshot(env, &snapshots[operation]);
+      if (metrics_obj == NULL || napi_set_named_property(env, result, metrics_operation_names[operation], metrics_obj) != napi_ok)
+      {
+        result = NULL;
+      }
+    }
+  }
+  free(snapshots);
+
+  return result;
+}
+
+static napi_value reset_metrics(napi_env env, const napi_callback_info info)
+{
+  ewb_metrics_reset();
+
+  return NULL;
+}
+
+// The batch of a peer iterator without batchSize, small enough to keep the handles of a batch cheap.
+#define PEER_CURSOR_BATCH_SIZE 256
+
+// The cursor holds the device fetched in the pool and hands its peers out in batches as the iterator is consumed.
+// The iterator object is held until the fetch completes, so the context outlives the work.
+typedef struct
+{
+  wrapped_kind kind;
+  napi_async_work work;
+  napi_ref iterator_ref;
+  napi_ref session_ref;
+  ewb_nl_session *session;
+  char *device_name;
+  struct wg_device *device;
+  const struct wg_peer *next_peer;
+  uint32_t batch_size;
+  key_format key_format;
+  // The calls of next made before the device is fetched, settled in order once it is.
+  napi_deferred *pending;
+  size_t pending_count;
+  size_t pending_capacity;
+  bool is_fetched;
+  bool is_done;
+  ewb_metrics_call metrics;
+  int ret;
+} peer_cursor_context;
+
+static void free_peer_cursor_device(peer_cursor_context *context)
+{
+  wg_free_device(context->device);
+  context->device = NULL;
+  context->next_peer = NULL;
+}
+
+static void finalize_peer_cursor(napi_env env, void *data, void *hint)
+{
+  peer_cursor_context *context = (peer_cursor_context *)data;
+
+  free_peer_cursor_device(context);
+  free(context->pending);
+  free(context->device_name);
+  free(context);
+}
+
+static napi_value create_iterator_result_object(napi_env env, napi_value value, bool is_done)
+{
+  napi_value result_obj, done;
+  NAPI_CALL(env, napi_create_object(env, &result_obj));
+  NAPI_CALL(env, napi_get_boolean(env, is_done, &done));
+  if (value == NULL)
+  {
+    NAPI_CALL(env, napi_get_undefined(env, &value));
+  }
+
+  NAPI_CALL(env, napi_set_named_property(env, result_obj, "value", value));
+  NAPI_CALL(env, napi_set_named_property(env, result_obj, "done", done));
+
+  return result_obj;
+}
+
+static napi_value create_peers_array_from_peer_cursor(napi_env env, peer_cursor_context *context)
+{
+  napi_value keys[PROPERTY_COUNT];
+  if (get_property_keys(env, keys))
+  {
+    return NULL;
+  }
+
+  uint32_t length = 0;
+  const struct wg_peer *peer = context->next_peer;
+  while (peer != NULL && length < context->batch_size)
+  {
+    peer = peer->next_peer;
+    length++;
+  }
+
+  napi_value peers_array;
+  NAPI_CALL(env, napi_create_array_with_length(env, length, &peers_array));
+
+  for (uint32_t index = 0; index < length; index++)
+  {
+    napi_handle_scope scope;
+    NAPI_CALL(env, napi_open_handle_scope(env, &scope));
+
+    napi_value peer_obj = create_peer_object_from_wg_peer(env, keys, context->next_peer, context->key_format);
+    napi_status status = peer_obj != NULL ? napi_set_element(env, peers_array, index, peer_obj) : napi_pending_exception;
+
+    NAPI_CALL(env, napi_close_handle_scope(env, scope));
+    if (status != napi_ok)
+    {
+      return NULL;
+    }
+
+    context->next_peer = context->next_peer->next_peer;
+  }
+
+  return peers_array;
+}
+
+static void settle_peer_cursor_next(napi_env env, peer_cursor_context *context, napi_deferred deferred)
+{
+  // The failure of the fetch is reported to the first call of next only, as the iteration ends with it.
+  if (context->ret && !context->is_done)
+  {
+    context->is_done = true;
+    reject_deferred(env, deferred, EWB_LIB_CALLFAIL, "Failed to get the device!");
+    return;
+  }
+
+  napi_value peers_array = NULL;
+  if (!context->is_done && context->next_peer != NULL)
+  {
+    if ((peers_array = create_peers_array_from_peer_cursor(env, context)) == NULL)
+    {
+      context->is_done = true;
+      free_peer_cursor_device(context);
+
+      reject_deferred(env, deferred, EWB_OBJ_UNSPEC, "Failed to wrap the wg_peer to object!");
+      return;
+    }
+  }
+
+  // The device is let go as soon as its last peer is out, so a drained iterator holds nothing.
+  if (context->next_peer == NULL)
+  {
+    context->is_done = peers_array == NULL;
+    free_peer_cursor_device(context);
+  }
+
+  napi_value result = create_iterator_result_object(env, peers_array, peers_array == NULL);
+  if (result == NULL)
+  {
+    reject_deferred(env, deferred, EWB_NNA_CALLFAIL, "Failed to create the iterator result!");
+    return;
+  }
+
+  napi_resolve_deferred(env, deferred, result);
+}
+
+static peer_cursor_context *unwrap_peer_cursor(napi_env env, napi_value this_arg, const char *binding_name)
+{
+  peer_cursor_context *context = unwrap_kind(env, this_arg, WRAPPED_PEER_CURSOR);
+  if (context == NULL)
+  {
+    char message[128];
+    snprintf(message, sizeof(message), "The %s method should be called on the peer iterator!", binding_name);
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, message);
+    return NULL;
+  }
+
+  return context;
+}
+
+static napi_value next_peer_cursor(napi_env env, const napi_callback_info info)
+{
+  napi_value this_arg;
+  NAPI_CALL(env, napi_get_cb_info(env, info, NULL, NULL, &this_arg, NULL));
+
+  peer_cursor_context *context = unwrap_peer_cursor(env, this_arg, "next");
+  if (context == NULL)
+  {
+    return NULL;
+  }
+
+  napi_deferred deferred;
+  napi_value promise;
+  NAPI_CALL(env, napi_create_promise(env, &deferred, &promise));
+
+  if (context->is_fetched)
+  {
+    settle_peer_cursor_next(env, context, deferred);
+    return promise;
+  }
+
+  if (context->pending_count == context->pending_capacity)
+  {
+    size_t capacity = context->pending_capacity ? context->pending_capacity * 2 : 4;
+    napi_deferred *pending = realloc(context->pending, capacity * sizeof(napi_deferred));
+    if (pending == NULL)
+    {
+      reject_deferred(env, deferred, EWB_NNA_CALLFAIL, "Failed to queue the call of next!");
+      return promise;
+    }
+
+    context->pending = pending;
+    context->pending_capacity = capacity;
+  }
+  context->pending[context->pending_count++] = deferred;
+
+  return promise;
+}
+
+static napi_value return_peer_cursor(napi_env env, const napi_callback_info info)
+{
+  size_t argc = 1;
+  napi_value args[1], this_arg;
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, &this_arg, NULL));
+
+  peer_cursor_context *context = unwrap_peer_cursor(env, this_arg, "return");
+  if (context == NULL)
+  {
+    return NULL;
+  }
+
+  // The device still being fetched is freed on completion instead, as the work owns it until then.
+  context->is_done = true;
+  if (context->is_fetched)
+  {
+    free_peer_cursor_device(context);
+  }
+
+  napi_deferred deferred;
+  napi_value promise;
+  NAPI_CALL(env, napi_create_promise(env, &deferred, &promise));
+
+  napi_value result = create_iterator_result_object(env, argc >= 1 ? args[0] : NULL, true);
+  if (result == NULL)
+  {
+    reject_deferred(env, deferred, EWB_NNA_CALLFAIL, "Failed to create the iterator result!");
+    return promise;
+  }
+
+  napi_resolve_deferred(env, deferred, result);
+
+  return promise;
+}
+
+static napi_value get_peer_cursor_iterator(napi_env env, const napi_callback_info info)
+{
+  napi_value this_arg;
+  NAPI_CALL(env, napi_get_cb_info(env, info, NULL, NULL, &this_arg, NULL));
+
+  return this_arg;
+}
+
+static void fetch_peer_cursor_execute(napi_env env, void *data)
+{
+  peer_cursor_context *context = (peer_cursor_context *)data;
+
+  ewb_metrics_call_attach(&context->metrics);
+  context->ret = get_wg_device(context->session, &context->device, context->device_name);
+  ewb_metrics_call_detach(&context->metrics);
+}
+
+static void fetch_peer_cursor_complete(napi_env env, napi_status status, void *data)
+{
+  peer_cursor_context *context = (peer_cursor_context *)data;
+
+  ewb_metrics_call_resume(&context->metrics);
+
+  napi_delete_async_work(env, context->work);
+  context->work = NULL;
+  context->is_fetched = true;
+
+  if (status != napi_ok || context->ret || context->device == NULL)
+  {
+    context->ret = context->ret ? context->ret : -ENODEV;
+    free_peer_cursor_device(context);
+  }
+  else if (context->is_done)
+  {
+    free_peer_cursor_device(context);
+  }
+  else
+  {
+    context->next_peer = context->device->first_peer;
+  }
+
+  for (size_t index = 0; index < context->pending_count; index++)
+  {
+    settle_peer_cursor_next(env, context, context->pending[index]);
+  }
+  free(context->pending);
+  context->pending = NULL;
+  context->pending_count = 0;
+  context->pending_capacity = 0;
+
+  ewb_metrics_call_end(&context->metrics, context->ret ? EWB_LIB_CALLFAIL : NULL);
+
+  if (context->session_ref != NULL)
+  {
+    napi_delete_reference(env, context->session_ref);
+    context->session_ref = NULL;
+  }
+
+  // The iterator can be collected from now on, which frees the context.
+  napi_delete_reference(env, context->iterator_ref);
+  context->iterator_ref = NULL;
+}
+
+static int get_batch_size_from_napi_options(napi_env env, napi_value options, uint32_t *batch_size)
+{
+  napi_valuetype options_type;
+  ASSERT_NAPI_CALL(env, napi_typeof(env, options, &options_type), 1);
+  if (options_type != napi_object)
+  {
+    return 0;
+  }
+
+  bool has_batch_size;
+  ASSERT_NAPI_CALL(env, napi_has_named_property(env, options, "batchSize", &has_batch_size), 1);
+  if (!has_batch_size)
+  {
+    return 0;
+  }
+
+  napi_value batch_size_prop;
+  ASSERT_NAPI_CALL(env, napi_get_named_property(env, options, "batchSize", &batch_size_prop), 1);
+  if (napi_get_value_uint32(env, batch_size_prop, batch_size) != napi_ok || *batch_size == 0)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of batchSize property of iterate_peers options is positive number!");
+    return 1;
+  }
+
+  return 0;
+}
+
+// Fetches the device in the pool right away, and the iterator hands out its peers in batches of batchSize.
+static napi_value iterate_peers(napi_env env, const napi_callback_info info)
+{
+  size_t argc = 2;
+  napi_value args[2], this_arg;
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, &this_arg, NULL));
+  if (argc != 1 && argc != 2)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected argument size of iterate_peers is 1 or 2!");
+    return NULL;
+  }
+
+  napi_valuetype argt_0;
+  NAPI_CALL(env, napi_typeof(env, args[0], &argt_0));
+  if (argt_0 != napi_string)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of first argument of iterate_peers is string!");
+    return NULL;
+  }
+
+  key_format format;
+  uint32_t batch_size = PEER_CURSOR_BATCH_SIZE;
+  if (get_key_format_from_napi_options(env, args[1], &format) || get_batch_size_from_napi_options(env, args[1], &batch_size))
+  {
+    return NULL;
+  }
+
+  napi_value global, symbol_constructor, async_iterator_symbol;
+  NAPI_CALL(env, napi_get_global(env, &global));
+  NAPI_CALL(env, napi_get_named_property(env, global, "Symbol", &symbol_constructor));
+  NAPI_CALL(env, napi_get_named_property(env, symbol_constructor, "asyncIterator", &async_iterator_symbol));
+
+  peer_cursor_context *context = calloc(1, sizeof(peer_cursor_context));
+  if (context == NULL || napi_utils_get_value_string(env, args[0], &context->device_name) != napi_ok)
+  {
+    free(context);
+    return NULL;
+  }
+  context->kind = WRAPPED_PEER_CURSOR;
+  context->batch_size = batch_size;
+  context->key_format = format;
+
+  napi_value iterator_obj;
+  if (
+    napi_create_object(env, &iterator_obj) != napi_ok ||
+    napi_wrap(env, iterator_obj, context, finalize_peer_cursor, NULL, NULL) != napi_ok
+  )
+  {
+    finalize_peer_cursor(env, context, NULL);
+
+    napi_throw_error(env, EWB_NNA_CALLFAIL, "Failed to wrap the peer iterator!");
+    return NULL;
+  }
+
+  napi_property_descriptor descriptors[] = {
+    DECLARE_NAPI_METHOD("next", next_peer_cursor),
+    DECLARE_NAPI_METHOD("return", return_peer_cursor),
+    {NULL, async_iterator_symbol, get_peer_cursor_iterator, NULL, NULL, NULL, napi_default, NULL},
+  };
+  NAPI_CALL(env, napi_define_properties(env, iterator_obj, sizeof(descriptors) / sizeof(descriptors[0]), descriptors));
+
+  // The session object should outlive the work, so we hold it until the fetch completes.
+  context->session = unwrap_session(env, this_arg);
+  if (context->session != NULL && napi_create_reference(env, this_arg, 1, &context->session_ref) != napi_ok)
+  {
+    context->session = NULL;
+  }
+
+  // The call of the binding goes on with the fetch, so the completion ends it.
+  ewb_metrics_call_hand_off(&context->metrics);
+
+  napi_value resource_name;
+  if (
+    napi_create_reference(env, iterator_obj, 1, &context->iterator_ref) != napi_ok ||
+    napi_create_string_utf8(env, "iteratePeers", NAPI_AUTO_LENGTH, &resource_name) != napi_ok ||
+    napi_create_async_work(env, NULL, resource_name, fetch_peer_cursor_execute, fetch_peer_cursor_complete, context, &context->work) != napi_ok ||
+    napi_queue_async_work(env, context->work) != napi_ok
+  )
+  {
+    // The context stays with the iterator, which is collected with nothing left to settle.
+    if (context->work != NULL)
+    {
+      napi_delete_async_work(env, context->work);
+      context->work = NULL;
+    }
+    if (context->iterator_ref != NULL)
+    {
+      napi_delete_reference(env, context->iterator_ref);
+      context->iterator_ref = NULL;
+    }
+    if (context->session_ref != NULL)
+    {
+      napi_delete_reference(env, context->session_ref);
+      context->session_ref = NULL;
+    }
+    ewb_metrics_call_end(&context->metrics, EWB_NNA_CALLFAIL);
+
+    napi_throw_error(env, EWB_NNA_CALLFAIL, "Failed to queue the async work!");
+    return NULL;
+  }
+
+  return iterator_obj;
+}
+
+static const metered_binding iterate_peers_binding = {iterate_peers, EWB_METRICS_GET_DEVICE};
+
+typedef struct
+{
+  wrapped_kind kind;
+  ewb_watcher watcher;
+  napi_threadsafe_function tsfn;
+  key_format key_format;
+  // The handle and the function both hold the context, so the last of them to go frees it.
+  int refs;
+  bool is_stopped;
+} watch_context;
+
+static const char *watch_event_type_names[] = {
+  [EWB_WATCH_PEER_ADDED] = "added",
+  [EWB_WATCH_PEER_REMOVED] = "removed",
+  [EWB_WATCH_HANDSHAKE] = "handshake",
+  [EWB_WATCH_ENDPOINT] = "endpoint",
+  [EWB_WATCH_TRANSFER] = "transfer",
+};
+
+static napi_value create_event_object_from_watch_event(napi_env env, const ewb_watch_event *event, key_format format)
+{
+  napi_value event_obj;
+  NAPI_CALL(env, napi_create_object(env, &event_obj));
+
+  napi_value type, public_key, endpoint, last_handshake_time, rx_bytes, tx_bytes;
+  NAPI_CALL(env, napi_create_string_utf8(env, watch_event_type_names[event->type], NAPI_AUTO_LENGTH, &type));
+  public_key = create_key_value_from_wg_key(env, event->public_key, format);
+  endpoint = create_endpoint_string_from_wg_endpoint(env, &event->endpoint);
+  if (public_key == NULL || endpoint == NULL)
+  {
+    return NULL;
+  }
+  NAPI_CALL(env, napi_create_double(env, get_milliseconds_from_timespec64(&event->last_handshake_time), &last_handshake_time));
+  NAPI_CALL(env, napi_create_double(env, (double) event->rx_bytes, &rx_bytes));
+  NAPI_CALL(env, napi_create_double(env, (double) event->tx_bytes, &tx_bytes));
+
+  NAPI_CALL(env, napi_set_named_property(env, event_obj, "type", type));
+  NAPI_CALL(env, napi_set_named_property(env, event_obj, "publicKey", public_key));
+  NAPI_CALL(env, napi_set_named_property(env, event_obj, "endpoint", endpoint));
+  NAPI_CALL(env, napi_set_named_property(env, event_obj, "lastHandshakeTime", last_handshake_time));
+  NAPI_CALL(env, napi_set_named_property(env, event_obj, "rxBytes", rx_bytes));
+  NAPI_CALL(env, napi_set_named_property(env, event_obj, "txBytes", tx_bytes));
+
+  return event_obj;
+}
+
+// Runs on the main thread for each batch queued by the watcher thread.
+static void call_watch_callback(napi_env env, napi_value js_callback, void *context, void *data)
+{
+  ewb_watch_batch *batch = (ewb_watch_batch *)data;
+  key_format format = ((watch_context *)context)->key_format;
+
+  // The environment is being torn down, so we only have to free the batch.
+  if (env == NULL || js_callback == NULL)
+  {
+    ewb_watch_batch_destroy(batch);
+    return;
+  }
+
+  napi_value undefined, argv[2];
+  napi_get_undefined(env, &undefined);
+
+  if (batch->error)
+  {
+    napi_value code, message;
+    if (
+      napi_create_string_utf8(env, EWB_LIB_CALLFAIL, NAPI_AUTO_LENGTH, &code) == napi_ok &&
+      napi_create_string_utf8(env, "Failed to get the device!", NAPI_AUTO_LENGTH, &message) == napi_ok &&
+      napi_create_error(env, code, message, &argv[0]) == napi_ok &&
+      napi_create_array_with_length(env, 0, &argv[1]) == napi_ok
+    )
+    {
+      napi_call_function(env, undefined, js_callback, 2, argv, NULL);
+    }
+
+    ewb_watch_batch_destroy(batch);
+    return;
+  }
+
+  bool is_created = napi_get_null(env, &argv[0]) == napi_ok && napi_create_array_with_length(env, batch->count, &argv[1]) == napi_ok;
+  for (size_t index = 0; is_created && index < batch->count; index++)
+  {
+    napi_value event_obj = create_event_object_from_watch_event(env, &batch->events[index], format);
+    is_created = event_obj != NULL && napi_set_element(env, argv[1], index, event_obj) == napi_ok;
+  }
+
+  ewb_watch_batch_destroy(batch);
+
+  if (is_created)
+  {
+    napi_call_function(env, undefined, js_callback, 2, argv, NULL);
+  }
+}
+
+// Runs on the watcher thread; queueing the batch never blocks, so stopping the watcher can't deadlock with the main thread.
+static void queue_watch_batch(ewb_watch_batch *batch, void *data)
+{
+  watch_context *context = (watch_context *)data;
+
+  if (napi_call_threadsafe_function(context->tsfn, batch, napi_tsfn_nonblocking) != napi_ok)
+  {
+    ewb_watch_batch_destroy(batch);
+  }
+}
+
+static void unref_watch_context(watch_context *context)
+{
+  if (--context->refs == 0)
+  {
+    free(context);
+  }
+}
+
+static void finalize_watch_context(napi_env env, void *data, void *hint)
+{
+  unref_watch_context((watch_context *)data);
+}
+
+// The environment is torn down before the watcher was closed, so we stop the thread before the function goes away under it.
+static void cleanup_watch_context(void *data)
+{
+  watch_context *context = (watch_context *)data;
+
+  ewb_watcher_stop(&context->watcher);
+  context->is_stopped = true;
+}
+
+static void stop_watch_context(napi_env env, watch_context *context)
+{
+  if (context->is_stopped)
+  {
+    return;
+  }
+
+  napi_remove_env_cleanup_hook(env, cleanup_watch_context, context);
+  cleanup_watch_context(context);
+
+  napi_release_threadsafe_function(context->tsfn, napi_tsfn_release);
+}
+
+// The handle was collected without being closed, so we stop the thread rather than leaving it polling for nobody.
+static void finalize_watch_handle(napi_env env, void *data, void *hint)
+{
+  watch_context *context = (watch_context *)data;
+
+  stop_watch_context(env, context);
+  unref_watch_context(context);
+}
+
+static napi_value close_watch(napi_env env, const napi_callback_info info)
+{
+  napi_value this_arg;
+  NAPI_CALL(env, napi_get_cb_info(env, info, NULL, NULL, &this_arg, NULL));
+
+  // We take the context off the handle, so closing it twice does not touch the freed context.
+  watch_context *context;
+  if (unwrap_kind(env, this_arg, WRAPPED_WATCH) == NULL || napi_remove_wrap(env, this_arg, (void **)&context) != napi_ok)
+  {
+    return NULL;
+  }
+
+  stop_watch_context(env, context);
+  unref_watch_context(context);
+
+  return NULL;
+}
+
+static napi_value ref_watch(napi_env env, const napi_callback_info info)
+{
+  napi_value this_arg;
+  NAPI_CALL(env, napi_get_cb_info(env, info, NULL, NULL, &this_arg, NULL));
+
+  watch_context *context = unwrap_kind(env, this_arg, WRAPPED_WATCH);
+  if (context != NULL)
+  {
+    NAPI_CALL(env, napi_ref_threadsafe_function(env, context->tsfn));
+  }
+
+  return this_arg;
+}
+
+static napi_value unref_watch(napi_env env, const napi_callback_info info)
+{
+  napi_value this_arg;
+  NAPI_CALL(env, napi_get_cb_info(env, info, NULL, NULL, &this_arg, NULL));
+
+  watch_context *context = unwrap_kind(env, this_arg, WRAPPED_WATCH);
+  if (context != NULL)
+  {
+    NAPI_CALL(env, napi_unref_threadsafe_function(env, context->tsfn));
+  }
+
+  return this_arg;
+}
+
+static napi_value watch(napi_env env, const napi_callback_info info)
+{
+  size_t argc = 3;
+  napi_value args[3];
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+  if (argc != 3)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected argument size of watch is 3!");
+    return NULL;
+  }
+
+  napi_valuetype argt_0, argt_1, argt_2;
+  NAPI_CALL(env, napi_typeof(env, args[0], &argt_0));
+  NAPI_CALL(env, napi_typeof(env, args[1], &argt_1));
+  NAPI_CALL(env, napi_typeof(env, args[2], &argt_2));
+  if (argt_0 != napi_string)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of first argument of watch is string!");
+    return NULL;
+  }
+  if (argt_1 != napi_object)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of second argument of watch is object!");
+    return NULL;
+  }
+  if (argt_2 != napi_function)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of third argument of watch is function!");
+    return NULL;
+  }
+
+  uint32_t interval_ms = 1000;
+  bool has_interval;
+  NAPI_CALL(env, napi_has_named_property(env, args[1], "intervalMs", &has_interval));
+  if (has_interval)
+  {
+    napi_value interval_prop;
+    NAPI_CALL(env, napi_get_named_property(env, args[1], "intervalMs", &interval_prop));
+    if (napi_get_value_uint32(env, interval_prop, &interval_ms) != napi_ok || interval_ms == 0)
+    {
+      napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of intervalMs property of watch options is positive number!");
+      return NULL;
+    }
+  }
+
+  key_format format;
+  if (get_key_format_from_napi_options(env, args[1], &format))
+  {
+    return NULL;
+  }
+
+  watch_context *context = calloc(1, sizeof(watch_context));
+  if (context == NULL)
+  {
+    napi_throw_error(env, EWB_NNA_CALLFAIL, "Failed to allocate the watcher!");
+    return NULL;
+  }
+  context->kind = WRAPPED_WATCH;
+  context->key_format = format;
+  context->refs = 1;
+
+  napi_value resource_name;
+  NAPI_CALL(env, napi_create_string_utf8(env, "watch", NAPI_AUTO_LENGTH, &resource_name));
+  if (napi_create_threadsafe_function(env, args[2], NULL, resource_name, 0, 1, context, finalize_watch_context, context, call_watch_callback, &context->tsfn) != napi_ok)
+  {
+    free(context);
+
+    napi_throw_error(env, EWB_NNA_CALLFAIL, "Failed to create the callback of the watcher!");
+    return NULL;
+  }
+
+  // The function owns the context from here, so releasing it is what frees the context.
+  char *device_name;
+  if (napi_utils_get_value_string(env, args[0], &device_name) != napi_ok)
+  {
+    napi_release_threadsafe_function(context->tsfn, napi_tsfn_abort);
+
+    napi_throw_error(env, EWB_NNA_CALLFAIL, "Failed to get the device name of watch!");
+    return NULL;
+  }
+  int ret = ewb_watcher_start(&context->watcher, device_name, interval_ms, queue_watch_batch, context);
+  free(device_name);
+
+  if (ret)
+  {
+    napi_release_threadsafe_function(context->tsfn, napi_tsfn_abort);
+
+    napi_throw_error(env, EWB_SOC_CALLFAIL, "Failed to start the watcher thread!");
+    return NULL;
+  }
+
+  NAPI_CALL(env, napi_add_env_cleanup_hook(env, cleanup_watch_context, context));
+
+  napi_value handle_obj;
+  NAPI_CALL(env, napi_create_object(env, &handle_obj));
+  NAPI_CALL(env, napi_wrap(env, handle_obj, context, finalize_watch_handle, NULL, NULL));
+  context->refs++;
+
+  napi_property_descriptor descriptors[] = {
+    DECLARE_NAPI_METHOD("close", close_watch),
+    DECLARE_NAPI_METHOD("ref", ref_watch),
+    DECLARE_NAPI_METHOD("unref", unref_watch),
+  };
+  NAPI_CALL(env, napi_define_properties(env, handle_obj, sizeof(descriptors) / sizeof(descriptors[0]), descriptors));
+
+  return handle_obj;
+}
+
+static napi_value enable_device_registry(napi_env env, const napi_callback_info info)
+{
+  addon_data *data;
+  NAPI_CALL(env, napi_get_instance_data(env, (void **)&data));
+
+  if (data->is_registry_enabled)
+  {
+    return NULL;
+  }
+
+  if (ewb_registry_acquire())
+  {
+    napi_throw_error(env, EWB_SOC_CALLFAIL, "Failed to start the device registry!");
+    return NULL;
+  }
+  data->is_registry_enabled = true;
+
+  return NULL;
+}
+
+static napi_value disable_device_registry(napi_env env, const napi_callback_info info)
+{
+  addon_data *data;
+  NAPI_CALL(env, napi_get_instance_data(env, (void **)&data));
+
+  if (data->is_registry_enabled)
+  {
+    ewb_registry_release();
+    data->is_registry_enabled = false;
+  }
+
+  return NULL;
+}
+
+typedef struct
+{
+  wrapped_kind kind;
+  ewb_registry_listener listener;
+  napi_threadsafe_function tsfn;
+  // The handle and the function both hold the context, so the last of them to go frees it.
+  int refs;
+  bool is_stopped;
+} device_watch_context;
+
+static const char *device_event_type_names[] = {
+  [EWB_REGISTRY_DEVICE_ADDED] = "added",
+  [EWB_REGISTRY_DEVICE_REMOVED] = "removed",
+};
+
+static napi_value create_event_object_from_registry_event(napi_env env, const ewb_registry_event *event)
+{
+  napi_value event_obj;
+  NAPI_CALL(env, napi_create_object(env, &event_obj));
+
+  napi_value type, name, ifindex;
+  NAPI_CALL(env, napi_create_string_utf8(env, device_event_type_names[event->type], NAPI_AUTO_LENGTH, &type));
+  NAPI_CALL(env, napi_create_string_utf8(env, event->name, strnlen(event->name, IFNAMSIZ), &name));
+  NAPI_CALL(env, napi_create_uint32(env, event->ifindex, &ifindex));
+
+  NAPI_CALL(env, napi_set_named_property(env, event_obj, "type", type));
+  NAPI_CALL(env, napi_set_named_property(env, event_obj, "name", name));
+  NAPI_CALL(env, napi_set_named_property(env, event_obj, "ifindex", ifindex));
+
+  return event_obj;
+}
+
+// Runs on the main thread for each batch queued by the registry thread.
+static void call_device_watch_callback(napi_env env, napi_value js_callback, void *context, void *data)
+{
+  ewb_registry_batch *batch = (ewb_registry_batch *)data;
+
+  // The environment is being torn down, so we only have to free the batch.
+  if (env == NULL || js_callback == NULL)
+  {
+    ewb_registry_batch_destroy(batch);
+    return;
+  }
+
+  napi_value undefined, events;
+  napi_get_undefined(env, &undefined);
+
+  bool is_created = napi_create_array_with_length(env, batch->count, &events) == napi_ok;
+  for (size_t index = 0; is_created && index < batch->count; index++)
+  {
+    napi_value event_obj = create_event_object_from_registry_event(env, &batch->events[index]);
+    is_created = event_obj != NULL && napi_set_element(env, events, index, event_obj) == napi_ok;
+  }
+
+  ewb_registry_batch_destroy(batch);
+
+  if (is_created)
+  {
+    napi_call_function(env, undefined, js_callback, 1, &events, NULL);
+  }
+}
+
+// Runs on the registry thread with its lock held, so queueing should never block.
+static void queue_device_watch_batch(ewb_registry_batch *batch, void *data)
+{
+  device_watch_context *context = (device_watch_context *)data;
+
+  if (napi_call_threadsafe_function(context->tsfn, batch, napi_tsfn_nonblocking) != napi_ok)
+  {
+    ewb_registry_batch_destroy(batch);
+  }
+}
+
+static void unref_device_watch_context(device_watch_context *context)
+{
+  if (--context->refs == 0)
+  {
+    free(context);
+  }
+}
+
+static void finalize_device_watch_context(napi_env env, void *data, void *hint)
+{
+  unref_device_watch_context((device_watch_context *)data);
+}
+
+// The environment is torn down before the handle was closed, so we stop listening before the function goes away.
+static void cleanup_device_watch_context(void *data)
+{
+  device_watch_context *context = (device_watch_context *)data;
+
+  ewb_registry_remove_listener(&context->listener);
+  ewb_registry_release();
+  context->is_stopped = true;
+}
+
+static void stop_device_watch_context(napi_env env, device_watch_context *context)
+{
+  if (context->is_stopped)
+  {
+    return;
+  }
+
+  napi_remove_env_cleanup_hook(env, cleanup_device_watch_context, context);
+  cleanup_device_watch_context(context);
+
+  napi_release_threadsafe_function(context->tsfn, napi_tsfn_release);
+}
+
+// The handle was collected without being closed, so we stop listening rather than queueing batches for nobody.
+static void finalize_device_watch_handle(napi_env env, void *data, void *hint)
+{
+  device_watch_context *context = (device_watch_context *)data;
+
+  stop_device_watch_context(env, context);
+  unref_device_watch_context(context);
+}
+
+static napi_value close_device_watch(napi_env env, const napi_callback_info info)
+{
+  napi_value this_arg;
+  NAPI_CALL(env, napi_get_cb_info(env, info, NULL, NULL, &this_arg, NULL));
+
+  // We take the context off the handle, so closing it twice does not touch the freed context.
+  device_watch_context *context;
+  if (unwrap_kind(env, this_arg, WRAPPED_DEVICE_WATCH) == NULL || napi_remove_wrap(env, this_arg, (void **)&context) != napi_ok)
+  {
+    return NULL;
+  }
+
+  stop_device_watch_context(env, context);
+  unref_device_watch_context(context);
+
+  return NULL;
+}
+
+static napi_value ref_device_watch(napi_env env, const napi_callback_info info)
+{
+  napi_value this_arg;
+  NAPI_CALL(env, napi_get_cb_info(env, info, NULL, NULL, &this_arg, NULL));
+
+  device_watch_context *context = unwrap_kind(env, this_arg, WRAPPED_DEVICE_WATCH);
+  if (context != NULL)
+  {
+    NAPI_CALL(env, napi_ref_threadsafe_function(env, context->tsfn));
+  }
+
+  return this_arg;
+}
+
+static napi_value unref_device_watch(napi_env env, const napi_callback_info info)
+{
+  napi_value this_arg;
+  NAPI_CALL(env, napi_get_cb_info(env, info, NULL, NULL, &this_arg, NULL));
+
+  device_watch_context *context = unwrap_kind(env, this_arg, WRAPPED_DEVICE_WATCH);
+  if (context != NULL)
+  {
+    NAPI_CALL(env, napi_unref_threadsafe_function(env, context->tsfn));
+  }
+
+  return this_arg;
+}
+
+static napi_value watch_devices(napi_env env, const napi_callback_info info)
+{
+  size_t argc = 1;
+  napi_value args[1];
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+  if (argc != 1)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected argument size of watch_devices is 1!");
+    return NULL;
+  }
+
+  napi_valuetype argt_0;
+  NAPI_CALL(env, napi_typeof(env, args[0], &argt_0));
+  if (argt_0 != napi_function)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of first argument of watch_devices is function!");
+    return NULL;
+  }
+
+  device_watch_context *context = calloc(1, sizeof(device_watch_context));
+  if (context == NULL)
+  {
+    napi_throw_error(env, EWB_NNA_CALLFAIL, "Failed to allocate the device watcher!");
+    return NULL;
+  }
+  context->kind = WRAPPED_DEVICE_WATCH;
+  context->refs = 1;
+  context->listener.callback = queue_device_watch_batch;
+  context->listener.data = context;
+
+  napi_value resource_name;
+  NAPI_CALL(env, napi_create_string_utf8(env, "watchDevices", NAPI_AUTO_LENGTH, &resource_name));
+  if (napi_create_threadsafe_function(env, args[0], NULL, resource_name, 0, 1, context, finalize_device_watch_context, context, call_device_watch_callback, &context->tsfn) != napi_ok)
+  {
+    free(context);
+
+    napi_throw_error(env, EWB_NNA_CALLFAIL, "Failed to create the callback of the device watcher!");
+    return NULL;
+  }
+
+  // The handle keeps the registry running by itself, so watching does not depend on enableDeviceRegistry.
+  if (ewb_registry_acquire())
+  {
+    napi_release_threadsafe_function(context->tsfn, napi_tsfn_abort);
+
+    napi_throw_error(env, EWB_SOC_CALLFAIL, "Failed to start the device registry!");
+    return NULL;
+  }
+  ewb_registry_add_listener(&context->listener);
+
+  NAPI_CALL(env, napi_add_env_cleanup_hook(env, cleanup_device_watch_context, context));
+
+  napi_value handle_obj;
+  NAPI_CALL(env, napi_create_object(env, &handle_obj));
+  NAPI_CALL(env, napi_wrap(env, handle_obj, context, finalize_device_watch_handle, NULL, NULL));
+  context->refs++;
+
+  napi_property_descriptor descriptors[] = {
+    DECLARE_NAPI_METHOD("close", close_device_watch),
+    DECLARE_NAPI_METHOD("ref", ref_device_watch),
+    DECLARE_NAPI_METHOD("unref", unref_device_watch),
+  };
+  NAPI_CALL(env, napi_define_properties(env, handle_obj, sizeof(descriptors) / sizeof(descriptors[0]), descriptors));
+
+  return handle_obj;
+}
+
+typedef struct
+{
+  wrapped_kind kind;
+  ewb_lpm lpm;
+  key_format key_format;
+} allowedip_index_context;
+
+static napi_value create_allowedip_object_from_lpm_prefix(napi_env env, const ewb_lpm_prefix *prefix)
+{
+  struct wg_allowedip allowedip;
+  memset(&allowedip, 0, sizeof(allowedip));
+  allowedip.family = prefix->family;
+  allowedip.cidr = prefix->cidr;
+  memcpy(&allowedip.ip6, prefix->addr, prefix->family == AF_INET6 ? sizeof(struct in6_addr) : sizeof(struct in_addr));
+
+  napi_value keys[PROPERTY_COUNT];
+  if (get_property_keys(env, keys))
+  {
+    return NULL;
+  }
+
+  return create_allowedip_object_from_wg_allowedip(env, keys, &allowedip);
+}
+
+static napi_value create_match_object_from_lpm_prefix(napi_env env, const allowedip_index_context *context, const ewb_lpm_prefix *prefix)
+{
+  napi_value match_obj;
+  NAPI_CALL(env, napi_create_object(env, &match_obj));
+
+  napi_value public_key = create_key_value_from_wg_key(env, ewb_lpm_get_owner_key(&context->lpm, prefix->owner), context->key_format);
+  napi_value allowedip = create_allowedip_object_from_lpm_prefix(env, prefix);
+  if (public_key == NULL || allowedip == NULL)
+  {
+    return NULL;
+  }
+
+  NAPI_CALL(env, napi_set_named_property(env, match_obj, "publicKey", public_key));
+  NAPI_CALL(env, napi_set_named_property(env, match_obj, "allowedIp", allowedip));
+
+  return match_obj;
+}
+
+// Parses the ip address without the prefix length, the family comes from the format.
+static int get_address_from_napi_value(napi_env env, napi_value value, uint16_t *family, struct in6_addr *addr)
+{
+  char ip_str[INET6_ADDRSTRLEN];
+  size_t length;
+  if (napi_get_value_string_utf8(env, value, ip_str, sizeof(ip_str), &length) != napi_ok || length >= sizeof(ip_str) - 1)
+  {
+    return 1;
+  }
+
+  if (inet_pton(AF_INET, ip_str, addr) == 1)
+  {
+    *family = AF_INET;
+    return 0;
+  }
+  if (inet_pton(AF_INET6, ip_str, addr) == 1)
+  {
+    *family = AF_INET6;
+    return 0;
+  }
+
+  return 1;
+}
+
+static allowedip_index_context *unwrap_allowedip_index(napi_env env, napi_value this_arg, const char *binding_name)
+{
+  allowedip_index_context *context = unwrap_kind(env, this_arg, WRAPPED_ALLOWEDIP_INDEX);
+  if (context == NULL)
+  {
+    char message[128];
+    snprintf(message, sizeof(message), "The %s method should be called on the allowed ip index!", binding_name);
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, message);
+    return NULL;
+  }
+
+  return context;
+}
+
+static napi_value lookup_allowedip_index(napi_env env, const napi_callback_info info)
+{
+  size_t argc = 1;
+  napi_value args[1], this_arg;
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, &this_arg, NULL));
+
+  allowedip_index_context *context = unwrap_allowedip_index(env, this_arg, "lookup");
+  if (context == NULL)
+  {
+    return NULL;
+  }
+
+  uint16_t family;
+  struct in6_addr addr;
+  if (argc != 1 || get_address_from_napi_value(env, args[0], &family, &addr))
+  {
+    napi_throw_type_error(env, EWB_AF_UNSPEC, "The expected type of first argument of lookup is ipv4 or ipv6 string!");
+    return NULL;
+  }
+
+  ewb_lpm_prefix match;
+  if (ewb_lpm_lookup(&context->lpm, family, &addr, &match) == 0)
+  {
+    napi_value null;
+    NAPI_CALL(env, napi_get_null(env, &null));
+    return null;
+  }
+
+  return create_match_object_from_lpm_prefix(env, context, &match);
+}
+
+static napi_value classify_allowedip_index(napi_env env, const napi_callback_info info)
+{
+  size_t argc = 1;
+  napi_value args[1], this_arg;
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, &this_arg, NULL));
+
+  allowedip_index_context *context = unwrap_allowedip_index(env, this_arg, "classify");
+  if (context == NULL)
+  {
+    return NULL;
+  }
+
+  bool is_array = false;
+  if (argc == 1)
+  {
+    NAPI_CALL(env, napi_is_array(env, args[0], &is_array));
+  }
+  if (!is_array)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of first argument of classify is array!");
+    return NULL;
+  }
+
+  uint32_t length;
+  NAPI_CALL(env, napi_get_array_length(env, args[0], &length));
+
+  // The keys are created once for each peer, as most of the addresses fall into a few peers.
+  napi_value *key_values = calloc(context->lpm.owner_count + 1, sizeof(napi_value));
+  if (key_values == NULL)
+  {
+    napi_throw_error(env, EWB_NNA_CALLFAIL, "Failed to allocate the keys!");
+    return NULL;
+  }
+
+  napi_value result, null;
+  if (napi_create_array_with_length(env, length, &result) != napi_ok || napi_get_null(env, &null) != napi_ok)
+  {
+    free(key_values);
+
+    napi_throw_error(env, EWB_NNA_CALLFAIL, "NAPI call failed");
+    return NULL;
+  }
+
+  for (uint32_t index = 0; index < length; index++)
+  {
+    napi_value element;
+    uint16_t family;
+    struct in6_addr addr;
+    if (napi_get_element(env, args[0], index, &element) != napi_ok || get_address_from_napi_value(env, element, &family, &addr))
+    {
+      free(key_values);
+
+      napi_throw_type_error(env, EWB_AF_UNSPEC, "The expected type of the element of first argument of classify is ipv4 or ipv6 string!");
+      return NULL;
+    }
+
+    napi_value owner_value = null;
+    uint32_t owner = ewb_lpm_lookup(&context->lpm, family, &addr, NULL);
+    if (owner != 0)
+    {
+      if (key_values[owner] == NULL)
+      {
+        key_values[owner] = create_key_value_from_wg_key(env, ewb_lpm_get_owner_key(&context->lpm, owner), context->key_format);
+      }
+      owner_value = key_values[owner];
+    }
+
+    if (owner_value == NULL || napi_set_element(env, result, index, owner_value) != napi_ok)
+    {
+      free(key_values);
+      return NULL;
+    }
+  }
+
+  free(key_values);
+
+  return result;
+}
+
+static napi_value find_allowedip_index_overlaps(napi_env env, const napi_callback_info info)
+{
+  size_t argc = 1;
+  napi_value args[1], this_arg;
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, &this_arg, NULL));
+
+  allowedip_index_context *context = unwrap_allowedip_index(env, this_arg, "findOverlaps");
+  if (context == NULL)
+  {
+    return NULL;
+  }
+  if (argc != 1)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected argument size of findOverlaps is 1!");
+    return NULL;
+  }
+
+  ewb_arena *arena;
+  struct wg_device *device = create_wg_device_from_napi_value(env, args[0], "findOverlaps", &arena);
+  if (device == NULL)
+  {
+    return NULL;
+  }
+
+  ewb_lpm_overlaps overlaps;
+  int ret = ewb_lpm_find_overlaps(&context->lpm, device, &overlaps);
+  ewb_arena_release(arena);
+
+  if (ret == -EINVAL)
+  {
+    napi_throw_error(env, EWB_AF_UNSPEC, "The allowed ips of the config should be valid ipv4 or ipv6 prefixes!");
+    return NULL;
+  }
+  if (ret)
+  {
+    napi_throw_error(env, EWB_NNA_CALLFAIL, "Failed to allocate the overlaps!");
+    return NULL;
+  }
+
+  napi_value result;
+  bool is_created = napi_create_array_with_length(env, overlaps.count, &result) == napi_ok;
+  for (size_t index = 0; is_created && index < overlaps.count; index++)
+  {
+    const ewb_lpm_overlap *overlap = &overlaps.overlaps[index];
+
+    napi_value overlap_obj, public_key, allowedip, conflicting_public_key, conflicting_allowedip;
+    is_created =
+      napi_create_object(env, &overlap_obj) == napi_ok &&
+      (public_key = create_key_value_from_wg_key(env, overlap->public_key, context->key_format)) != NULL &&
+      (allowedip = create_allowedip_object_from_lpm_prefix(env, &overlap->allowedip)) != NULL &&
+      (conflicting_public_key = create_key_value_from_wg_key(env, overlap->conflicting_public_key, context->key_format)) != NULL &&
+      (conflicting_allowedip = create_allowedip_object_from_lpm_prefix(env, &overlap->conflicting_allowedip)) != NULL &&
+      napi_set_named_property(env, overlap_obj, "publicKey", public_key) == napi_ok &&
+      napi_set_named_property(env, overlap_obj, "allowedIp", allowedip) == napi_ok &&
+      napi_set_named_property(env, overlap_obj, "conflictingPublicKey", conflicting_public_key) == napi_ok &&
+      napi_set_named_property(env, overlap_obj, "conflictingAllowedIp", conflicting_allowedip) == napi_ok &&
+      napi_set_element(env, result, index, overlap_obj) == napi_ok;
+  }
+
+  ewb_lpm_overlaps_destroy(&overlaps);
+
+  return is_created ? result : NULL;
+}
+
+static napi_value update_allowedip_index(napi_env env, const napi_callback_info info)
+{
+  size_t argc = 1;
+  napi_value args[1], this_arg;
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, &this_arg, NULL));
+
+  allowedip_index_context *context = unwrap_allowedip_index(env, this_arg, "update");
+  if (context == NULL)
+  {
+    return NULL;
+  }
+  if (argc != 1)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected argument size of update is 1!");
+    return NULL;
+  }
+
+  ewb_arena *arena;
+  struct wg_device *device = create_wg_device_from_napi_value(env, args[0], "update", &arena);
+  if (device == NULL)
+  {
+    return NULL;
+  }
+
+  int ret = ewb_lpm_apply_device(&context->lpm, device);
+  ewb_arena_release(arena);
+
+  if (ret == -EINVAL)
+  {
+    napi_throw_error(env, EWB_AF_UNSPEC, "The allowed ips of the config should be valid ipv4 or ipv6 prefixes!");
+    return NULL;
+  }
+  if (ret)
+  {
+    napi_throw_error(env, EWB_NNA_CALLFAIL, "Failed to allocate the allowed ip index!");
+    return NULL;
+  }
+
+  return this_arg;
+}
+
+static void finalize_allowedip_index(napi_env env, void *data, void *hint)
+{
+  allowedip_index_context *context = (allowedip_index_context *)data;
+
+  ewb_lpm_destroy(&context->lpm);
+  free(context);
+}
+
+static napi_value create_allowedip_index(napi_env env, const napi_callback_info info)
+{
+  size_t argc = 2;
+  napi_value args[2];
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+  if (argc > 2)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected argument size of create_allowedip_index is 0 to 2!");
+    return NULL;
+  }
+
+  key_format format = get_default_key_format(env);
+  if (argc == 2 && get_key_format_from_napi_options(env, args[1], &format))
+  {
+    return NULL;
+  }
+
+  // The index starts empty without a config, so it can be filled by update as the peers are added.
+  ewb_arena *arena = NULL;
+  struct wg_device *device = NULL;
+  napi_valuetype argt_0 = napi_undefined;
+  if (argc >= 1)
+  {
+    NAPI_CALL(env, napi_typeof(env, args[0], &argt_0));
+  }
+  if (argt_0 != napi_undefined && argt_0 != napi_null)
+  {
+    device = create_wg_device_from_napi_value(env, args[0], "create_allowedip_index", &arena);
+    if (device == NULL)
+    {
+      return NULL;
+    }
+  }
+
+  allowedip_index_context *context = calloc(1, sizeof(allowedip_index_context));
+  if (context == NULL || ewb_lpm_init(&context->lpm))
+  {
+    free(context);
+    ewb_arena_release(arena);
+
+    napi_throw_error(env, EWB_NNA_CALLFAIL, "Failed to allocate the allowed ip index!");
+    return NULL;
+  }
+  context->kind = WRAPPED_ALLOWEDIP_INDEX;
+  context->key_format = format;
+
+  int ret = device != NULL ? ewb_lpm_apply_device(&context->lpm, device) : 0;
+  ewb_arena_release(arena);
+  if (ret)
+  {
+    finalize_allowedip_index(env, context, NULL);
+
+    napi_throw_error(env, ret == -EINVAL ? EWB_AF_UNSPEC : EWB_NNA_CALLFAIL, "Failed to build the allowed ip index!");
+    return NULL;
+  }
+
+  napi_value index_obj;
+  if (
+    napi_create_object(env, &index_obj) != napi_ok ||
+    napi_wrap(env, index_obj, context, finalize_allowedip_index, NULL, NULL) != napi_ok
+  )
+  {
+    finalize_allowedip_index(env, context, NULL);
+
+    napi_throw_error(env, EWB_NNA_CALLFAIL, "Failed to wrap the allowed ip index!");
+    return NULL;
+  }
+
+  napi_property_descriptor descriptors[] = {
+    DECLARE_NAPI_METHOD("lookup", lookup_allowedip_index),
+    DECLARE_NAPI_METHOD("classify", classify_allowedip_index),
+    DECLARE_NAPI_METHOD("findOverlaps", find_allowedip_index_overlaps),
+    DECLARE_NAPI_METHOD("update", update_allowedip_index),
+  };
+  NAPI_CALL(env, napi_define_properties(env, index_obj, sizeof(descriptors) / sizeof(descriptors[0]), descriptors));
+
+  return index_obj;
+}
+
+// Parses the ip address with an optional prefix length, which is the length of the address if not given.
+static int get_prefix_from_napi_value(napi_env env, napi_value value, uint16_t *family, struct in6_addr *addr, uint8_t *cidr, bool is_cidr_required)
+{
+  char prefix_str[INET6_ADDRSTRLEN + 4];
+  size_t length;
+  if (napi_get_value_string_utf8(env, value, prefix_str, sizeof(prefix_str), &length) != napi_ok || length >= sizeof(prefix_str) - 1)
+  {
+    return 1;
+  }
+
+  char *cidr_str = strchr(prefix_str, '/');
+  if (cidr_str != NULL)
+  {
+    *cidr_str++ = '\0';
+  }
+  else if (is_cidr_required)
+  {
+    return 1;
+  }
+
+  if (inet_pton(AF_INET, prefix_str, addr) == 1)
+  {
+    *family = AF_INET;
+  }
+  else if (inet_pton(AF_INET6, prefix_str, addr) == 1)
+  {
+    *family = AF_INET6;
+  }
+  else
+  {
+    return 1;
+  }
+
+  unsigned long max_cidr = *family == AF_INET6 ? 128 : 32;
+  unsigned long parsed_cidr = max_cidr;
+  if (cidr_str != NULL)
+  {
+    char *end;
+    parsed_cidr = strtoul(cidr_str, &end, 10);
+    if (cidr_str[0] == '\0' || *end != '\0' || parsed_cidr > max_cidr)
+    {
+      return 1;
+    }
+  }
+  *cidr = (uint8_t)parsed_cidr;
+
+  return 0;
+}
+
+typedef struct
+{
+  wrapped_kind kind;
+  ewb_pool pool;
+} address_pool_context;
+
+static ewb_pool *unwrap_address_pool(napi_env env, napi_value this_arg, const char *binding_name)
+{
+  address_pool_context *context = unwrap_kind(env, this_arg, WRAPPED_ADDRESS_POOL);
+  if (context == NULL)
+  {
+    char message[128];
+    snprintf(message, sizeof(message), "The %s method should be called on the address pool!", binding_name);
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, message);
+    return NULL;
+  }
+
+  return &context->pool;
+}
+
+static napi_value allocate_address_pool(napi_env env, const napi_callback_info info)
+{
+  napi_value this_arg;
+  NAPI_CALL(env, napi_get_cb_info(env, info, NULL, NULL, &this_arg, NULL));
+
+  ewb_pool *pool = unwrap_address_pool(env, this_arg, "allocate");
+  if (pool == NULL)
+  {
+    return NULL;
+  }
+
+  struct in6_addr addr;
+  if (ewb_pool_allocate(pool, &addr))
+  {
+    napi_value null;
+    NAPI_CALL(env, napi_get_null(env, &null));
+    return null;
+  }
+
+  char ip_str[INET6_ADDRSTRLEN];
+  inet_ntop(pool->family, &addr, ip_str, sizeof(ip_str));
+
+  napi_value ip;
+  NAPI_CALL(env, napi_create_string_utf8(env, ip_str, NAPI_AUTO_LENGTH, &ip));
+
+  return ip;
+}
+
+static napi_value release_address_pool(napi_env env, const napi_callback_info info)
+{
+  size_t argc = 1;
+  napi_value args[1], this_arg;
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, &this_arg, NULL));
+
+  ewb_pool *pool = unwrap_address_pool(env, this_arg, "release");
+  if (pool == NULL)
+  {
+    return NULL;
+  }
+
+  uint16_t family;
+  struct in6_addr addr;
+  uint8_t cidr;
+  if (argc != 1 || get_prefix_from_napi_value(env, args[0], &family, &addr, &cidr, false) || cidr != (family == AF_INET6 ? 128 : 32))
+  {
+    napi_throw_type_error(env, EWB_AF_UNSPEC, "The expected type of first argument of release is ipv4 or ipv6 string!");
+    return NULL;
+  }
+
+  int ret = family == pool->family ? ewb_pool_release(pool, &addr) : -EINVAL;
+  if (ret == -EINVAL)
+  {
+    napi_throw_range_error(env, EWB_ARG_UNSPEC, "The address to release is not an allocatable address of the pool!");
+    return NULL;
+  }
+
+  napi_value result;
+  NAPI_CALL(env, napi_get_boolean(env, ret == 0, &result));
+
+  return result;
+}
+
+static napi_value reserve_address_pool(napi_env env, const napi_callback_info info)
+{
+  size_t argc = 1;
+  napi_value args[1], this_arg;
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, &this_arg, NULL));
+
+  ewb_pool *pool = unwrap_address_pool(env, this_arg, "reserve");
+  if (pool == NULL)
+  {
+    return NULL;
+  }
+
+  uint16_t family;
+  struct in6_addr addr;
+  uint8_t cidr;
+  if (argc != 1 || get_prefix_from_napi_value(env, args[0], &family, &addr, &cidr, false))
+  {
+    napi_throw_type_error(env, EWB_AF_UNSPEC, "The expected type of first argument of reserve is ipv4 or ipv6 string with an optional prefix length!");
+    return NULL;
+  }
+
+  napi_value result;
+  NAPI_CALL(env, napi_create_double(env, (double)ewb_pool_reserve(pool, family, &addr, cidr), &result));
+
+  return result;
+}
+
+static napi_value seed_address_pool(napi_env env, const napi_callback_info info)
+{
+  size_t argc = 1;
+  napi_value args[1], this_arg;
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, &this_arg, NULL));
+
+  ewb_pool *pool = unwrap_address_pool(env, this_arg, "seed");
+  if (pool == NULL)
+  {
+    return NULL;
+  }
+  if (argc != 1)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected argument size of seed is 1!");
+    return NULL;
+  }
+
+  ewb_arena *arena;
+  struct wg_device *device = create_wg_device_from_napi_value(env, args[0], "seed", &arena);
+  if (device == NULL)
+  {
+    return NULL;
+  }
+
+  int64_t count = ewb_pool_reserve_device(pool, device);
+  ewb_arena_release(arena);
+
+  if (count < 0)
+  {
+    napi_throw_error(env, EWB_AF_UNSPEC, "The allowed ips of the config should be valid ipv4 or ipv6 prefixes!");
+    return NULL;
+  }
+
+  napi_value result;
+  NAPI_CALL(env, napi_create_double(env, (double)count, &result));
+
+  return result;
+}
+
+static napi_value get_address_pool_available(napi_env env, const napi_callback_info info)
+{
+  napi_value this_arg;
+  NAPI_CALL(env, napi_get_cb_info(env, info, NULL, NULL, &this_arg, NULL));
+
+  ewb_pool *pool = unwrap_address_pool(env, this_arg, "available");
+  if (pool == NULL)
+  {
+    return NULL;
+  }
+
+  napi_value result;
+  NAPI_CALL(env, napi_create_double(env, (double)pool->available, &result));
+
+  return result;
+}
+
+static void finalize_address_pool(napi_env env, void *data, void *hint)
+{
+  address_pool_context *context = (address_pool_context *)data;
+
+  ewb_pool_destroy(&context->pool);
+  free(context);
+}
+
+static napi_value create_address_pool(napi_env env, const napi_callback_info info)
+{
+  size_t argc = 2;
+  napi_value args[2];
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+  if (argc < 1 || argc > 2)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected argument size of create_address_pool is 1 or 2!");
+    return NULL;
+  }
+
+  uint16_t family;
+  struct in6_addr addr;
+  uint8_t cidr;
+  if (get_prefix_from_napi_value(env, args[0], &family, &addr, &cidr, true))
+  {
+    napi_throw_type_error(env, EWB_AF_UNSPEC, "The expected type of first argument of create_address_pool is ipv4 or ipv6 string with a prefix length!");
+    return NULL;
+  }
+
+  ewb_arena *arena = NULL;
+  struct wg_device *device = NULL;
+  napi_valuetype argt_1 = napi_undefined;
+  if (argc == 2)
+  {
+    NAPI_CALL(env, napi_typeof(env, args[1], &argt_1));
+  }
+  if (argt_1 != napi_undefined && argt_1 != napi_null)
+  {
+    device = create_wg_device_from_napi_value(env, args[1], "create_address_pool", &arena);
+    if (device == NULL)
+    {
+      return NULL;
+    }
+  }
+
+  address_pool_context *context = malloc(sizeof(address_pool_context));
+  int ret = context != NULL ? ewb_pool_init(&context->pool, family, &addr, cidr) : -ENOMEM;
+  if (context != NULL)
+  {
+    context->kind = WRAPPED_ADDRESS_POOL;
+  }
+  if (ret == 0 && device != NULL)
+  {
+    ret = ewb_pool_reserve_device(&context->pool, device) < 0 ? -EINVAL : 0;
+    if (ret)
+    {
+      ewb_pool_destroy(&context->pool);
+    }
+  }
+  ewb_arena_release(arena);
+  if (ret)
+  {
+    free(context);
+
+    napi_throw_error(env, ret == -EINVAL ? EWB_AF_UNSPEC : EWB_NNA_CALLFAIL, "Failed to create the address pool!");
+    return NULL;
+  }
+
+  napi_value pool_obj;
+  if (
+    napi_create_object(env, &pool_obj) != napi_ok ||
+    napi_wrap(env, pool_obj, context, finalize_address_pool, NULL, NULL) != napi_ok
+  )
+  {
+    finalize_address_pool(env, context, NULL);
+
+    napi_throw_error(env, EWB_NNA_CALLFAIL, "Failed to wrap the address pool!");
+    return NULL;
+  }
+
+  napi_property_descriptor descriptors[] = {
+    DECLARE_NAPI_METHOD("allocate", allocate_address_pool),
+    DECLARE_NAPI_METHOD("release", release_address_pool),
+    DECLARE_NAPI_METHOD("reserve", reserve_address_pool),
+    DECLARE_NAPI_METHOD("seed", seed_address_pool),
+    DECLARE_NAPI_METHOD("available", get_address_pool_available),
+  };
+  NAPI_CALL(env, napi_define_properties(env, pool_obj, sizeof(descriptors) / sizeof(descriptors[0]), descriptors));
+  NAPI_CALL(env, napi_utils_define_uint32_value(env, pool_obj, "family", family));
+  NAPI_CALL(env, napi_utils_define_uint32_value(env, pool_obj, "cidr", cidr));
+
+  return pool_obj;
+}
+
+static void destroy_session_data(session_data *session)
+{
+  ewb_nl_session_destroy(&session->nl);
+  ewb_rtnl_socket_destroy(&session->rtnl);
+  if (session->netns_fd >= 0)
+  {
+    close(session->netns_fd);
+  }
+  free(session);
+}
+
+static void finalize_session(napi_env env, void *data, void *hint)
+{
+  destroy_session_data((session_data *)data);
+}
+
+static napi_value close_session(napi_env env, const napi_callback_info info)
+{
+  napi_value this_arg;
+  NAPI_CALL(env, napi_get_cb_info(env, info, NULL, NULL, &this_arg, NULL));
+
+  session_data *session = unwrap_session_data(env, this_arg);
+  if (session == NULL)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The close method should be called on the session!");
+    return NULL;
+  }
+
+  ewb_nl_session_close(&session->nl);
+  ewb_rtnl_socket_close(&session->rtnl);
+
+  return NULL;
+}
+
+// Opens the namespace of the netns option into an fd owned by the session, or sets -1 if there is no option.
+static int get_session_netns_from_napi_value(napi_env env, napi_value options, int *netns_fd)
+{
+  *netns_fd = -1;
+
+  napi_valuetype options_type;
+  ASSERT_NAPI_CALL(env, napi_typeof(env, options, &options_type), 1);
+  if (options_type == napi_undefined)
+  {
+    return 0;
+  }
+  if (options_type != napi_object)
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of options is object!");
+    return 1;
+  }
+
+  napi_value netns_prop;
+  napi_valuetype netns_type;
+  ASSERT_NAPI_CALL(env, napi_get_named_property(env, options, "netns", &netns_prop), 1);
+  ASSERT_NAPI_CALL(env, napi_typeof(env, netns_prop, &netns_type), 1);
+
+  int fd;
+  if (netns_type == napi_undefined)
+  {
+    return 0;
+  }
+  else if (netns_type == napi_string)
+  {
+    char *path;
+    ASSERT_NAPI_CALL(env, napi_utils_get_value_string(env, netns_prop, &path), 1);
+    fd = ewb_netns_open(path);
+    free(path);
+  }
+  else if (netns_type == napi_number)
+  {
+    int32_t value;
+    ASSERT_NAPI_CALL(env, napi_get_value_int32(env, netns_prop, &value), 1);
+    // We keep a duplicate, so the caller may close its fd while the session is open.
+    fd = value >= 0 ? ewb_netns_dup(value) : -EBADF;
+  }
+  else
+  {
+    napi_throw_type_error(env, EWB_ARG_UNSPEC, "The expected type of netns property of open_session options is string or number!");
+    return 1;
+  }
+
+  if (fd < 0)
+  {
+    napi_throw_error(env, EWB_SOC_CALLFAIL, "Failed to open the network namespace!");
+    return 1;
+  }
+  *netns_fd = fd;
+
+  return 0;
+}
+
+static napi_value open_session(napi_env env, const napi_callback_info info)
+{
+  size_t argc = 1;
+  napi_value args[1];
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, NULL, NULL));
+
+  int netns_fd = -1;
+  if (argc > 0 && get_session_netns_from_napi_value(env, args[0], &netns_fd))
+  {
+    return NULL;
+  }
+
+  session_data *session = calloc(1, sizeof(session_data));
+  if (session == NULL || ewb_nl_session_init_netns(&session->nl, netns_fd))
+  {
+    free(session);
+    if (netns_fd >= 0)
+    {
+      close(netns_fd);
+    }
+
+    napi_throw_error(env, EWB_SOC_CALLFAIL, "Failed to open the netlink session!");
+    return NULL;
+  }
+  ewb_rtnl_socket_init(&session->rtnl, netns_fd);
+  session->kind = WRAPPED_SESSION;
+  session->netns_fd = netns_fd;
+
+  napi_value session_obj;
+  if (
+    napi_create_object(env, &session_obj) != napi_ok ||
+    napi_wrap(env, session_obj, session, finalize_session, NULL, NULL) != napi_ok
+  )
+  {
+    destroy_session_data(session);
+
+    napi_throw_error(env, EWB_NNA_CALLFAIL, "Failed to wrap the netlink session!");
+    return NULL;
+  }
+
+  napi_property_descriptor descriptors[] = {
+    DECLARE_NAPI_METERED_METHOD("getDevice", get_device_binding),
+    DECLARE_NAPI_METERED_METHOD("setDevice", set_device_binding),
+    DECLARE_NAPI_METERED_METHOD("getDeviceAsync", get_device_async_binding),
+    DECLARE_NAPI_METERED_METHOD("setDeviceAsync", set_device_async_binding),
+    DECLARE_NAPI_METERED_METHOD("setDeviceChunked", set_device_chunked_binding),
+    DECLARE_NAPI_METERED_METHOD("iteratePeers", iterate_peers_binding),
+    DECLARE_NAPI_METHOD("getPeerStats", get_peer_stats),
+    DECLARE_NAPI_METHOD("getDeviceSnapshot", get_device_snapshot),
+    DECLARE_NAPI_METHOD("setDeviceFromSnapshot", set_device_from_snapshot),
+    DECLARE_NAPI_METERED_METHOD("setConfFromFile", set_conf_from_file_binding),
+    DECLARE_NAPI_METERED_METHOD("showConf", show_conf_binding),
+    DECLARE_NAPI_METHOD("syncDevice", sync_device),
+    DECLARE_NAPI_METHOD("syncDeviceAsync", sync_device_async),
+    DECLARE_NAPI_METERED_METHOD("addDevice", add_device_binding),
+    DECLARE_NAPI_METERED_METHOD("removeDevice", remove_device_binding),
+    DECLARE_NAPI_METERED_METHOD("listDeviceNames", list_device_names_binding),
+    DECLARE_NAPI_METERED_METHOD("getInterfaceAddress", get_interface_address_binding),
+    DECLARE_NAPI_METERED_METHOD("getInterfaceAddresses", get_interface_addresses_binding),
+    DECLARE_NAPI_METERED_METHOD("configureLink", configure_link_binding),
+    DECLARE_NAPI_METHOD("close", close_session),
+  };
+  NAPI_CALL(env, napi_define_properties(env, session_obj, sizeof(descriptors) / sizeof(descriptors[0]), descriptors));
+
+  return session_obj;
+}
+
+static void finalize_addon_data(napi_env env, void *data, void *hint)
+{
+  // The registry is shared by the environments, so we only let go of the reference taken by this one.
+  if (((addon_data *)data)->is_registry_enabled)
+  {
+    ewb_registry_release();
+  }
+
+  if (((addon_data *)data)->property_keys_ref != NULL)
+  {
+    napi_delete_reference(env, ((addon_data *)data)->property_keys_ref);
+  }
+
+  free(data);
+}
+
+static napi_value init(napi_env env, napi_value exports)
+{
+  addon_data *data = calloc(1, sizeof(addon_data));
+  if (data == NULL || create_property_keys(env, data) || napi_set_instance_data(env, data, finalize_addon_data, NULL) != napi_ok)
+  {
+    free(data);
+
+    napi_throw_error(env, EWB_NNA_CALLFAIL, "Failed to initialize the addon!");
+    return NULL;
+  }
+
+  napi_property_descriptor get_device_descriptor = DECLARE_NAPI_METERED_METHOD("getDevice", get_device_binding);
+  napi_property_descriptor set_device_descriptor = DECLARE_NAPI_METERED_METHOD("setDevice", set_device_binding);
+  napi_property_descriptor add_device_descriptor = DECLARE_NAPI_METERED_METHOD("addDevice", add_device_binding);
+  napi_property_descriptor remove_device_descriptor = DECLARE_NAPI_METERED_METHOD("removeDevice", remove_device_binding);
+  napi_property_descriptor list_device_names_descriptor = DECLARE_NAPI_METERED_METHOD("listDeviceNames", list_device_names_binding);
+  napi_property_descriptor get_device_async_descriptor = DECLARE_NAPI_METERED_METHOD("getDeviceAsync", get_device_async_binding);
+  napi_property_descriptor set_device_async_descriptor = DECLARE_NAPI_METERED_METHOD("setDeviceAsync", set_device_async_binding);
+  napi_property_descriptor add_device_async_descriptor = DECLARE_NAPI_METERED_METHOD("addDeviceAsync", add_device_async_binding);
+  napi_property_descriptor remove_device_async_descriptor = DECLARE_NAPI_METERED_METHOD("removeDeviceAsync", remove_device_async_binding);
+  napi_property_descriptor list_device_names_async_descriptor = DECLARE_NAPI_METERED_METHOD("listDeviceNamesAsync", list_device_names_async_binding);
+  napi_property_descriptor set_device_chunked_descriptor = DECLARE_NAPI_METERED_METHOD("setDeviceChunked", set_device_chunked_binding);
+  napi_property_descriptor apply_many_descriptor = DECLARE_NAPI_METHOD("applyMany", apply_many);
+  napi_property_descriptor save_state_descriptor = DECLARE_NAPI_METHOD("saveState", save_state);
+  napi_property_descriptor restore_state_descriptor = DECLARE_NAPI_METHOD("restoreState", restore_state);
+  napi_property_descriptor iterate_peers_descriptor = DECLARE_NAPI_METERED_METHOD("iteratePeers", iterate_peers_binding);
+  napi_property_descriptor get_peer_stats_descriptor = DECLARE_NAPI_METHOD("getPeerStats", get_peer_stats);
+  napi_property_descriptor get_device_snapshot_descriptor = DECLARE_NAPI_METHOD("getDeviceSnapshot", get_device_snapshot);
+  napi_property_descriptor set_device_from_snapshot_descriptor = DECLARE_NAPI_METHOD("setDeviceFromSnapshot", set_device_from_snapshot);
+  napi_property_descriptor set_conf_from_file_descriptor = DECLARE_NAPI_METERED_METHOD("setConfFromFile", set_conf_from_file_binding);
+  napi_property_descriptor show_conf_descriptor = DECLARE_NAPI_METERED_METHOD("showConf", show_conf_binding);
+  napi_property_descriptor sync_device_descriptor = DECLARE_NAPI_METHOD("syncDevice", sync_device);
+  napi_property_descriptor sync_device_async_descriptor = DECLARE_NAPI_METHOD("syncDeviceAsync", sync_device_async);
+  napi_property_descriptor watch_descriptor = DECLARE_NAPI_METHOD("watch", watch);
+  napi_property_descriptor watch_devices_descriptor = DECLARE_NAPI_METHOD("watchDevices", watch_devices);
+  napi_property_descriptor enable_device_registry_descriptor = DECLARE_NAPI_METHOD("enableDeviceRegistry", enable_device_registry);
+  napi_property_descriptor disable_device_registry_descriptor = DECLARE_NAPI_METHOD("disableDeviceRegistry", disable_device_registry);
+  napi_property_descriptor create_allowedip_index_descriptor = DECLARE_NAPI_METHOD("createAllowedIpIndex", create_allowedip_index);
+  napi_property_descriptor create_address_pool_descriptor = DECLARE_NAPI_METHOD("createAddressPool", create_address_pool);
+  napi_property_descriptor open_session_descriptor = DECLARE_NAPI_METHOD("openSession", open_session);
+  napi_property_descriptor generate_public_key_descriptor = DECLARE_NAPI_METERED_METHOD("generatePublicKey", generate_public_key_binding);
+  napi_property_descriptor generate_private_key_descriptor = DECLARE_NAPI_METERED_METHOD("generatePrivateKey", generate_private_key_binding);
+  napi_property_descriptor generate_preshared_key_descriptor = DECLARE_NAPI_METERED_METHOD("generatePresharedKey", generate_preshared_key_binding);
+  napi_property_descriptor set_key_format_descriptor = DECLARE_NAPI_METHOD("setKeyFormat", set_key_format);
+  napi_property_descriptor set_uapi_socket_directory_descriptor = DECLARE_NAPI_METHOD("setUapiSocketDirectory", set_uapi_socket_directory);
+  napi_property_descriptor generate_key_pairs_descriptor = DECLARE_NAPI_METERED_METHOD("generateKeyPairs", generate_key_pairs_binding);
+  napi_property_descriptor generate_preshared_keys_descriptor = DECLARE_NAPI_METERED_METHOD("generatePresharedKeys", generate_preshared_keys_binding);
+  napi_property_descriptor generate_key_pairs_async_descriptor = DECLARE_NAPI_METERED_METHOD("generateKeyPairsAsync", generate_key_pairs_async_binding);
+  napi_property_descriptor generate_preshared_keys_async_descriptor = DECLARE_NAPI_METERED_METHOD("generatePresharedKeysAsync", generate_preshared_keys_async_binding);
+  napi_property_descriptor get_interface_address_descriptor = DECLARE_NAPI_METERED_METHOD("getInterfaceAddress", get_interface_address_binding);
+  napi_property_descriptor get_interface_addresses_descriptor = DECLARE_NAPI_METERED_METHOD("getInterfaceAddresses", get_interface_addresses_binding);
+  napi_property_descriptor set_interface_address_descriptor = DECLARE_NAPI_METERED_METHOD("setInterfaceAddress", set_interface_address_binding);
+  napi_property_descriptor configure_link_descriptor = DECLARE_NAPI_METERED_METHOD("configureLink", configure_link_binding);
+  napi_property_descriptor get_metrics_descriptor = DECLARE_NAPI_METHOD("getMetrics", get_metrics);
+  napi_property_descriptor reset_metrics_descriptor = DECLARE_NAPI_METHOD("resetMetrics", reset_metrics);
   NAPI_CALL(env, napi_define_properties(env, exports, 1, &get_device_descriptor));
   NAPI_CALL(env, napi_define_properties(env, exports, 1, &set_device_descriptor));
   NAPI_CALL(env, napi_define_properties(env, exports, 1, &add_device_descriptor));
   NAPI_CALL(env, napi_define_properties(env, exports, 1, &remove_device_descriptor));
   NAPI_CALL(env, napi_define_properties(env, exports, 1, &list_device_names_descriptor));
+  NAPI_CALL(env, napi_define_properties(env, exports, 1, &get_device_async_descriptor));
+  NAPI_CALL(env, napi_define_properties(env, exports, 1, &set_device_async_descriptor));
+  NAPI_CALL(env, napi_define_properties(env, exports, 1, &add_device_async_descriptor));
+  NAPI_CALL(env, napi_define_properties(env, exports, 1, &remove_device_async_descriptor));
+  NAPI_CALL(env, napi_define_properties(env, exports, 1, &list_device_names_async_descriptor));
+  NAPI_CALL(env, napi_define_properties(env, exports, 1, &set_device_chunked_descriptor));
+  NAPI_CALL(env, napi_define_properties(env, exports, 1, &apply_many_descriptor));
+  NAPI_CALL(env, napi_define_properties(env, exports, 1, &save_state_descriptor));
+  NAPI_CALL(env, napi_define_properties(env, exports, 1, &restore_state_descriptor));
+  NAPI_CALL(env, napi_define_properties(env, exports, 1, &iterate_peers_descriptor));
+#ifdef EWB_BENCH
+  napi_property_descriptor loopback_device_descriptor = DECLARE_NAPI_METHOD("loopbackDevice", loopback_device);
+  NAPI_CALL(env, napi_define_properties(env, exports, 1, &loopback_device_descriptor));
+#endif
+  NAPI_CALL(env, napi_define_properties(env, exports, 1, &get_peer_stats_descriptor));
+  NAPI_CALL(env, napi_define_properties(env, exports, 1, &get_device_snapshot_descriptor));
+  NAPI_CALL(env, napi_define_properties(env, exports, 1, &set_device_from_snapshot_descriptor));
+  NAPI_CALL(env, napi_define_properties(env, exports, 1, &set_conf_from_file_descriptor));
+  NAPI_CALL(env, napi_define_properties(env, exports, 1, &show_conf_descriptor));
+  NAPI_CALL(env, napi_define_properties(env, exports, 1, &sync_device_descriptor));
+  NAPI_CALL(env, napi_define_properties(env, exports, 1, &sync_device_async_descriptor));
+  NAPI_CALL(env, napi_define_properties(env, exports, 1, &watch_descriptor));
+  NAPI_CALL(env, napi_define_properties(env, exports, 1, &watch_devices_descriptor));
+  NAPI_CALL(env, napi_define_properties(env, exports, 1, &enable_device_registry_descriptor));
+  NAPI_CALL(env, napi_define_properties(env, exports, 1, &disable_device_registry_descriptor));
+  NAPI_CALL(env, napi_define_properties(env, exports, 1, &create_allowedip_index_descriptor));
+  NAPI_CALL(env, napi_define_properties(env, exports, 1, &create_address_pool_descriptor));
+  NAPI_CALL(env, napi_define_properties(env, exports, 1, &open_session_descriptor));
   NAPI_CALL(env, napi_define_properties(env, exports, 1, &generate_public_key_descriptor));
   NAPI_CALL(env, napi_define_properties(env, exports, 1, &generate_private_key_descriptor));
   NAPI_CALL(env, napi_define_properties(env, exports, 1, &generate_preshared_key_descriptor));
+  NAPI_CALL(env, napi_define_properties(env, exports, 1, &set_key_format_descriptor));
+  NAPI_CALL(env, napi_define_properties(env, exports, 1, &set_uapi_socket_directory_descriptor));
+  NAPI_CALL(env, napi_define_properties(env, exports, 1, &generate_key_pairs_descriptor));
+  NAPI_CALL(env, napi_define_properties(env, exports, 1, &generate_preshared_keys_descriptor));
+  NAPI_CALL(env, napi_define_properties(env, exports, 1, &generate_key_pairs_async_descriptor));
+  NAPI_CALL(env, napi_define_properties(env, exports, 1, &generate_preshared_keys_async_descriptor));
   NAPI_CALL(env, napi_define_properties(env, exports, 1, &get_interface_address_descriptor));
+  NAPI_CALL(env, napi_define_properties(env, exports, 1, &get_interface_addresses_descriptor));
   NAPI_CALL(env, napi_define_properties(env, exports, 1, &set_interface_address_descriptor));
+  NAPI_CALL(env, napi_define_properties(env, exports, 1, &configure_link_descriptor));
+  NAPI_CALL(env, napi_define_properties(env, exports, 1, &get_metrics_descriptor));
+  NAPI_CALL(env, napi_define_properties(env, exports, 1, &reset_metrics_descriptor));
   NAPI_CALL(env, napi_utils_define_uint32_value(env, exports, "WGDEVICE_REPLACE_PEERS", WGDEVICE_REPLACE_PEERS));
   NAPI_CALL(env, napi_utils_define_uint32_value(env, exports, "WGDEVICE_HAS_PRIVATE_KEY", WGDEVICE_HAS_PRIVATE_KEY));
   NAPI_CALL(env, napi_utils_define_uint32_value(env, exports, "WGDEVICE_HAS_PUBLIC_KEY", WGDEVICE_HAS_PUBLIC_KEY));
@@ -0,0 +1,137 @@
+#include "pthread.h"
+#include "stdint.h"
+#include "stdlib.h"
+#include "string.h"
+#include "./arena.h"
+
+#define ARENA_ALIGNMENT 16
+
+struct ewb_arena_chunk
+{
+  struct ewb_arena_chunk *previous;
+  size_t capacity;
+  size_t used;
+  unsigned char data[] __attribute__((aligned(ARENA_ALIGNMENT)));
+};
+
+// The arena kept for the next call on the thread, freed with the thread.
+static pthread_key_t thread_arena_key;
+static pthread_once_t thread_arena_once = PTHREAD_ONCE_INIT;
+
+static void free_chunks(ewb_arena *arena)
+{
+  ewb_arena_chunk *chunk = arena->chunk;
+  while (chunk != NULL)
+  {
+    ewb_arena_chunk *previous = chunk->previous;
+    free(chunk);
+    chunk = previous;
+  }
+
+  arena->chunk = NULL;
+  arena->capacity = 0;
+}
+
+static void destroy_arena(void *arena)
+{
+  free_chunks(arena);
+  free(arena);
+}
+
+static void create_thread_arena_key(void)
+{
+  pthread_key_create(&thread_arena_key, destroy_arena);
+}
+
+static ewb_arena_chunk *create_chunk(size_t capacity, ewb_arena_chunk *previous)
+{
+  ewb_arena_chunk *chunk = malloc(sizeof(ewb_arena_chunk) + capacity);
+  if (chunk == NULL)
+  {
+    return NULL;
+  }
+
+  chunk->previous = previous;
+  chunk->capacity = capacity;
+  chunk->used = 0;
+
+  return chunk;
+}
+
+extern ewb_arena *ewb_arena_acquire(void)
+{
+  pthread_once(&thread_arena_once, create_thread_arena_key);
+
+  ewb_arena *arena = pthread_getspecific(thread_arena_key);
+  if (arena != NULL)
+  {
+    pthread_setspecific(thread_arena_key, NULL);
+    return arena;
+  }
+
+  return calloc(1, sizeof(ewb_arena));
+}
+
+extern void ewb_arena_release(ewb_arena *arena)
+{
+  if (arena == NULL)
+  {
+    return;
+  }
+
+  if (arena->chunk != NULL && (arena->chunk->previous != NULL || arena->capacity > EWB_ARENA_RETAIN_SIZE))
+  {
+    size_t capacity = arena->capacity;
+    free_chunks(arena);
+
+    if (capacity <= EWB_ARENA_RETAIN_SIZE && (arena->chunk = create_chunk(capacity, NULL)) != NULL)
+    {
+      arena->capacity = capacity;
+    }
+  }
+  else if (arena->chunk != NULL)
+  {
+    arena->chunk->used = 0;
+  }
+
+  // The arena is released on the thread that acquired it in most cases, but an asynchronous call may hold another one.
+  if (pthread_getspecific(thread_arena_key) == NULL && pthread_setspecific(thread_arena_key, arena) == 0)
+  {
+    return;
+  }
+
+  destroy_arena(arena);
+}
+
+extern void *ewb_arena_alloc(ewb_arena *arena, size_t size)
+{
+  if (size > SIZE_MAX - ARENA_ALIGNMENT)
+  {
+    return NULL;
+  }
+  size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+
+  ewb_arena_chunk *chunk = arena->chunk;
+  if (chunk == NULL || chunk->capacity - chunk->used < size)
+  {
+    // Every chunk is as large as the chunks before it together, so a tree of n nodes takes O(log n) chunks.
+    size_t capacity = arena->capacity > EWB_ARENA_CHUNK_SIZE ? arena->capacity : EWB_ARENA_CHUNK_SIZE;
+    if (capacity < size)
+    {
+      capacity = size;
+    }
+
+    if ((chunk = create_chunk(capacity, arena->chunk)) == NULL)
+    {
+      return NULL;
+    }
+    arena->chunk = chunk;
+    arena->capacity += capacity;
+  }
+
+  void *memory = chunk->data + chunk->used;
+  chunk->used += size;
+  memset(memory, 0, size);
+
+  return memory;
+}
@@ -0,0 +1,28 @@
+#ifndef EWB_ARENA_H
+#define EWB_ARENA_H
+
+#include "stddef.h"
+
+// The first chunk of an arena, enough for a device of a few hundred peers.
+#define EWB_ARENA_CHUNK_SIZE 65536
+// The arena kept for the next call on the thread is dropped above this, so a large device once does not pin its memory.
+#define EWB_ARENA_RETAIN_SIZE 16777216
+
+typedef struct ewb_arena_chunk ewb_arena_chunk;
+
+// The bump allocator for the trees built from javascript, released as a whole instead of node by node.
+typedef struct
+{
+  ewb_arena_chunk *chunk;
+  size_t capacity;
+} ewb_arena;
+
+// Takes the arena kept on the thread, or a new one if it is in use.
+ewb_arena *ewb_arena_acquire(void);
+// Gives every allocation back at once, and keeps the arena on the thread for the next call.
+// The chunks are merged into one, so the next call of the same size never grows the arena.
+void ewb_arena_release(ewb_arena *arena);
+// Allocates the zeroed memory aligned for any struct, or returns NULL.
+void *ewb_arena_alloc(ewb_arena *arena, size_t size);
+
+#endif
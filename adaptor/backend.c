@@ -0,0 +1,143 @@
+#include "errno.h"
+#include "stdlib.h"
+#include "string.h"
+#include "./backend.h"
+#include "./registry.h"
+#include "./uapi.h"
+
+static int get_kernel_device(ewb_nl_session *session, struct wg_device **device, const char *device_name)
+{
+  if (session != NULL)
+  {
+    return ewb_nl_session_get_device(session, device, device_name);
+  }
+
+  return wg_get_device(device, device_name);
+}
+
+static int set_kernel_device(ewb_nl_session *session, struct wg_device *device)
+{
+  if (session != NULL)
+  {
+    return ewb_nl_session_set_device(session, device);
+  }
+
+  return wg_set_device(device);
+}
+
+// The registry keeps the names in memory while it runs, so we only ask the kernel when it does not.
+static char *list_kernel_device_names(void)
+{
+  char *device_names = ewb_registry_list_device_names();
+  if (device_names != NULL)
+  {
+    return device_names;
+  }
+
+  return wg_list_device_names();
+}
+
+static int get_uapi_device(ewb_nl_session *session, struct wg_device **device, const char *device_name)
+{
+  return ewb_uapi_get_device(device, device_name);
+}
+
+static int set_uapi_device(ewb_nl_session *session, struct wg_device *device)
+{
+  return ewb_uapi_set_device(device);
+}
+
+const ewb_backend ewb_kernel_backend = {
+  .name = "kernel",
+  .get_device = get_kernel_device,
+  .set_device = set_kernel_device,
+  .list_device_names = list_kernel_device_names,
+};
+
+const ewb_backend ewb_uapi_backend = {
+  .name = "uapi",
+  .get_device = get_uapi_device,
+  .set_device = set_uapi_device,
+  .list_device_names = ewb_uapi_list_device_names,
+};
+
+extern const ewb_backend *ewb_backend_for_device(const ewb_nl_session *session, const char *device_name)
+{
+  // The control sockets are in the filesystem of the caller, so they never name a device of another namespace.
+  if (session != NULL && session->netns_fd >= 0)
+  {
+    return &ewb_kernel_backend;
+  }
+
+  return ewb_uapi_has_device(device_name) ? &ewb_uapi_backend : &ewb_kernel_backend;
+}
+
+extern int ewb_backend_get_device(ewb_nl_session *session, struct wg_device **device, const char *device_name)
+{
+  const ewb_backend *backend = ewb_backend_for_device(session, device_name);
+  int ret = backend->get_device(session, device, device_name);
+
+  // The socket is left behind by a userspace implementation that exited, so the device may still be in the kernel.
+  if (ret == -ECONNREFUSED && backend != &ewb_kernel_backend)
+  {
+    ret = ewb_kernel_backend.get_device(session, device, device_name);
+  }
+
+  return ret;
+}
+
+extern int ewb_backend_set_device(ewb_nl_session *session, struct wg_device *device)
+{
+  const ewb_backend *backend = ewb_backend_for_device(session, device->name);
+  int ret = backend->set_device(session, device);
+
+  if (ret == -ECONNREFUSED && backend != &ewb_kernel_backend)
+  {
+    ret = ewb_kernel_backend.set_device(session, device);
+  }
+
+  return ret;
+}
+
+static size_t get_device_names_length(const char *device_names)
+{
+  size_t length = 0;
+  while (device_names[length] != '\0')
+  {
+    length += strlen(device_names + length) + 1;
+  }
+
+  return length;
+}
+
+extern char *ewb_backend_list_device_names(void)
+{
+  char *kernel_names = ewb_kernel_backend.list_device_names();
+  if (kernel_names == NULL)
+  {
+    return NULL;
+  }
+
+  char *uapi_names = ewb_uapi_backend.list_device_names();
+  if (uapi_names == NULL || uapi_names[0] == '\0')
+  {
+    free(uapi_names);
+    return kernel_names;
+  }
+
+  size_t kernel_length = get_device_names_length(kernel_names);
+  size_t uapi_length = get_device_names_length(uapi_names);
+
+  char *device_names = realloc(kernel_names, kernel_length + uapi_length + 1);
+  if (device_names == NULL)
+  {
+    free(kernel_names);
+    free(uapi_names);
+    return NULL;
+  }
+
+  memcpy(device_names + kernel_length, uapi_names, uapi_length + 1);
+  free(uapi_names);
+
+  return device_names;
+}
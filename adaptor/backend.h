@@ -0,0 +1,27 @@
+#ifndef EWB_BACKEND_H
+#define EWB_BACKEND_H
+
+#include "./netlink.h"
+
+// The implementation of wireguard behind a device, which is the kernel module or a userspace one such as wireguard-go or boringtun.
+// The session is the optional netlink session of the kernel, and the other backends leave it alone.
+typedef struct
+{
+  const char *name;
+  int (*get_device)(ewb_nl_session *session, struct wg_device **device, const char *device_name);
+  int (*set_device)(ewb_nl_session *session, struct wg_device *device);
+  char *(*list_device_names)(void);
+} ewb_backend;
+
+extern const ewb_backend ewb_kernel_backend;
+extern const ewb_backend ewb_uapi_backend;
+
+// Picks the userspace backend if the device has a control socket, and the kernel otherwise, the same as wg(8).
+// The session in another network namespace always goes to the kernel through its own socket.
+const ewb_backend *ewb_backend_for_device(const ewb_nl_session *session, const char *device_name);
+int ewb_backend_get_device(ewb_nl_session *session, struct wg_device **device, const char *device_name);
+int ewb_backend_set_device(ewb_nl_session *session, struct wg_device *device);
+// Lists the devices of every backend, in the format of wg_list_device_names.
+char *ewb_backend_list_device_names(void);
+
+#endif
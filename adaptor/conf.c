@@ -0,0 +1,592 @@
+#include "ctype.h"
+#include "errno.h"
+#include "fcntl.h"
+#include "netdb.h"
+#include "stdarg.h"
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "strings.h"
+#include "unistd.h"
+#include "arpa/inet.h"
+#include "sys/stat.h"
+#include "./conf.h"
+
+typedef enum
+{
+  CONF_SECTION_NONE,
+  CONF_SECTION_INTERFACE,
+  CONF_SECTION_PEER,
+} conf_section;
+
+static char *trim(char *value)
+{
+  while (isspace((unsigned char)*value))
+  {
+    value++;
+  }
+
+  size_t length = strlen(value);
+  while (length > 0 && isspace((unsigned char)value[length - 1]))
+  {
+    value[--length] = '\0';
+  }
+
+  return value;
+}
+
+static int parse_uint(const char *value, int base, uint64_t max, uint64_t *result)
+{
+  char *end;
+  errno = 0;
+  unsigned long long parsed = strtoull(value, &end, base);
+  if (errno || end == value || *end != '\0' || value[0] == '-' || parsed > max)
+  {
+    return -EINVAL;
+  }
+
+  *result = parsed;
+
+  return 0;
+}
+
+// The keepalive and the fwmark take off for 0, the same as wg(8).
+static int parse_uint_or_off(const char *value, int base, uint64_t max, uint64_t *result)
+{
+  if (strcasecmp(value, "off") == 0)
+  {
+    *result = 0;
+    return 0;
+  }
+
+  return parse_uint(value, base, max, result);
+}
+
+static int parse_key(const char *value, wg_key key)
+{
+  return wg_key_from_base64(key, value) ? -EINVAL : 0;
+}
+
+// The host of the endpoint is resolved if it is not an address, which blocks the thread as wg(8) does.
+static int parse_endpoint(char *value, wg_endpoint *endpoint)
+{
+  char *port = strrchr(value, ':');
+  if (port == NULL)
+  {
+    return -EINVAL;
+  }
+  *port++ = '\0';
+
+  uint64_t port_number;
+  if (parse_uint(port, 10, 65535, &port_number))
+  {
+    return -EINVAL;
+  }
+
+  size_t length = strlen(value);
+  if (length >= 2 && value[0] == '[' && value[length - 1] == ']')
+  {
+    value[length - 1] = '\0';
+    value++;
+  }
+
+  if (inet_pton(AF_INET, value, &endpoint->addr4.sin_addr) == 1)
+  {
+    endpoint->addr4.sin_family = AF_INET;
+    endpoint->addr4.sin_port = htons((uint16_t)port_number);
+    return 0;
+  }
+  if (inet_pton(AF_INET6, value, &endpoint->addr6.sin6_addr) == 1)
+  {
+    endpoint->addr6.sin6_family = AF_INET6;
+    endpoint->addr6.sin6_port = htons((uint16_t)port_number);
+    return 0;
+  }
+
+  struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_DGRAM, .ai_protocol = IPPROTO_UDP};
+  struct addrinfo *resolved;
+  if (getaddrinfo(value, NULL, &hints, &resolved) != 0)
+  {
+    return -EHOSTUNREACH;
+  }
+
+  int ret = -EHOSTUNREACH;
+  if (resolved->ai_family == AF_INET && resolved->ai_addrlen == sizeof(struct sockaddr_in))
+  {
+    memcpy(&endpoint->addr4, resolved->ai_addr, sizeof(struct sockaddr_in));
+    endpoint->addr4.sin_port = htons((uint16_t)port_number);
+    ret = 0;
+  }
+  else if (resolved->ai_family == AF_INET6 && resolved->ai_addrlen == sizeof(struct sockaddr_in6))
+  {
+    memcpy(&endpoint->addr6, resolved->ai_addr, sizeof(struct sockaddr_in6));
+    endpoint->addr6.sin6_port = htons((uint16_t)port_number);
+    ret = 0;
+  }
+  freeaddrinfo(resolved);
+
+  return ret;
+}
+
+// The prefix length defaults to the whole address, such as 10.0.0.1 for 10.0.0.1/32.
+static int parse_allowedip(char *value, struct wg_allowedip *allowedip)
+{
+  char *cidr = strchr(value, '/');
+  if (cidr != NULL)
+  {
+    *cidr++ = '\0';
+  }
+
+  allowedip->family = strchr(value, ':') != NULL ? AF_INET6 : AF_INET;
+
+  uint64_t max_cidr = allowedip->family == AF_INET6 ? 128 : 32, cidr_number = max_cidr;
+  if (
+    inet_pton(allowedip->family, trim(value), &allowedip->ip6) != 1 ||
+    (cidr != NULL && parse_uint(trim(cidr), 10, max_cidr, &cidr_number))
+  )
+  {
+    return -EINVAL;
+  }
+  allowedip->cidr = (uint8_t)cidr_number;
+
+  return 0;
+}
+
+static int parse_allowedips(ewb_arena *arena, char *value, struct wg_peer *peer)
+{
+  char *next_value;
+  for (; value != NULL; value = next_value)
+  {
+    next_value = strchr(value, ',');
+    if (next_value != NULL)
+    {
+      *next_value++ = '\0';
+    }
+
+    value = trim(value);
+    if (*value == '\0')
+    {
+      // The empty value clears the allowed ips, the same as wg(8).
+      if (next_value == NULL)
+      {
+        break;
+      }
+      return -EINVAL;
+    }
+
+    struct wg_allowedip *allowedip = ewb_arena_alloc(arena, sizeof(struct wg_allowedip));
+    if (allowedip == NULL)
+    {
+      return -ENOMEM;
+    }
+    if (parse_allowedip(value, allowedip))
+    {
+      return -EINVAL;
+    }
+
+    if (peer->first_allowedip == NULL)
+    {
+      peer->first_allowedip = allowedip;
+    }
+    else
+    {
+      peer->last_allowedip->next_allowedip = allowedip;
+    }
+    peer->last_allowedip = allowedip;
+  }
+
+  return 0;
+}
+
+static int parse_interface_line(struct wg_device *device, const char *key, char *value)
+{
+  uint64_t number;
+
+  if (strcasecmp(key, "PrivateKey") == 0)
+  {
+    return parse_key(value, device->private_key);
+  }
+  if (strcasecmp(key, "ListenPort") == 0)
+  {
+    if (parse_uint(value, 10, 65535, &number))
+    {
+      return -EINVAL;
+    }
+    device->listen_port = (uint16_t)number;
+    return 0;
+  }
+  if (strcasecmp(key, "FwMark") == 0)
+  {
+    if (parse_uint_or_off(value, 0, UINT32_MAX, &number))
+    {
+      return -EINVAL;
+    }
+    device->fwmark = (uint32_t)number;
+    return 0;
+  }
+
+  return -EINVAL;
+}
+
+static int parse_peer_line(ewb_arena *arena, struct wg_peer *peer, const char *key, char *value)
+{
+  uint64_t number;
+
+  if (strcasecmp(key, "PublicKey") == 0)
+  {
+    if (parse_key(value, peer->public_key))
+    {
+      return -EINVAL;
+    }
+    peer->flags |= WGPEER_HAS_PUBLIC_KEY;
+    return 0;
+  }
+  if (strcasecmp(key, "PresharedKey") == 0)
+  {
+    if (parse_key(value, peer->preshared_key))
+    {
+      return -EINVAL;
+    }
+    peer->flags |= WGPEER_HAS_PRESHARED_KEY;
+    return 0;
+  }
+  if (strcasecmp(key, "AllowedIPs") == 0)
+  {
+    return parse_allowedips(arena, value, peer);
+  }
+  if (strcasecmp(key, "Endpoint") == 0)
+  {
+    return parse_endpoint(value, &peer->endpoint);
+  }
+  if (strcasecmp(key, "PersistentKeepalive") == 0)
+  {
+    if (parse_uint_or_off(value, 10, 65535, &number))
+    {
+      return -EINVAL;
+    }
+    peer->persistent_keepalive_interval = (uint16_t)number;
+    peer->flags |= WGPEER_HAS_PERSISTENT_KEEPALIVE_INTERVAL;
+    return 0;
+  }
+
+  return -EINVAL;
+}
+
+extern int ewb_conf_parse(ewb_arena *arena, char *text, size_t length, struct wg_device **device, size_t *error_line)
+{
+  *device = NULL;
+  *error_line = 0;
+
+  struct wg_device *result = ewb_arena_alloc(arena, sizeof(struct wg_device));
+  if (result == NULL)
+  {
+    return -ENOMEM;
+  }
+  // The values missing from the config are reset, as setconf replaces the whole config of the interface.
+  result->flags = WGDEVICE_REPLACE_PEERS | WGDEVICE_HAS_PRIVATE_KEY | WGDEVICE_HAS_LISTEN_PORT | WGDEVICE_HAS_FWMARK;
+
+  conf_section section = CONF_SECTION_NONE;
+  struct wg_peer *peer = NULL;
+  size_t peer_line = 0, line_number = 0;
+  char *end = text + length;
+  int ret = 0;
+
+  for (char *line = text; line < end && !ret;)
+  {
+    char *next_line = memchr(line, '\n', (size_t)(end - line));
+    if (next_line == NULL)
+    {
+      next_line = end;
+    }
+    *next_line = '\0';
+    line_number++;
+
+    char *comment = strchr(line, '#');
+    if (comment != NULL)
+    {
+      *comment = '\0';
+    }
+    char *content = trim(line);
+    line = next_line + 1;
+
+    if (*content == '\0')
+    {
+      continue;
+    }
+
+    if (*content == '[')
+    {
+      // The peer is complete once the next section starts, and a peer without the public key is not one.
+      if (peer != NULL && !(peer->flags & WGPEER_HAS_PUBLIC_KEY))
+      {
+        *error_line = peer_line;
+        return -EINVAL;
+      }
+
+      if (strcasecmp(content, "[Interface]") == 0)
+      {
+        section = CONF_SECTION_INTERFACE;
+        peer = NULL;
+        continue;
+      }
+      if (strcasecmp(content, "[Peer]") != 0)
+      {
+        ret = -EINVAL;
+        break;
+      }
+      if ((peer = ewb_arena_alloc(arena, sizeof(struct wg_peer))) == NULL)
+      {
+        ret = -ENOMEM;
+        break;
+      }
+
+      section = CONF_SECTION_PEER;
+      peer_line = line_number;
+      peer->flags = WGPEER_REPLACE_ALLOWEDIPS;
+      if (result->first_peer == NULL)
+      {
+        result->first_peer = peer;
+      }
+      else
+      {
+        result->last_peer->next_peer = peer;
+      }
+      result->last_peer = peer;
+      continue;
+    }
+
+    char *value = strchr(content, '=');
+    if (value == NULL)
+    {
+      ret = -EINVAL;
+      break;
+    }
+    *value++ = '\0';
+
+    char *key = trim(content);
+    value = trim(value);
+    if (section == CONF_SECTION_INTERFACE)
+    {
+      ret = parse_interface_line(result, key, value);
+    }
+    else if (section == CONF_SECTION_PEER)
+    {
+      ret = parse_peer_line(arena, peer, key, value);
+    }
+    else
+    {
+      ret = -EINVAL;
+    }
+  }
+
+  if (ret)
+  {
+    *error_line = line_number;
+    return ret;
+  }
+  if (peer != NULL && !(peer->flags & WGPEER_HAS_PUBLIC_KEY))
+  {
+    *error_line = peer_line;
+    return -EINVAL;
+  }
+
+  *device = result;
+
+  return 0;
+}
+
+extern int ewb_conf_read_file(ewb_arena *arena, const char *path, struct wg_device **device, size_t *error_line)
+{
+  *device = NULL;
+  *error_line = 0;
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    return -errno;
+  }
+
+  struct stat sbuf;
+  if (fstat(fd, &sbuf) < 0)
+  {
+    int ret = -errno;
+    close(fd);
+    return ret;
+  }
+  if (!S_ISREG(sbuf.st_mode))
+  {
+    close(fd);
+    return -EINVAL;
+  }
+
+  // The text is read into the arena with the device, so the file is one read and nothing to free on its own.
+  size_t size = (size_t)sbuf.st_size, length = 0;
+  char *text = ewb_arena_alloc(arena, size + 1);
+  if (text == NULL)
+  {
+    close(fd);
+    return -ENOMEM;
+  }
+
+  while (length < size)
+  {
+    ssize_t count = read(fd, text + length, size - length);
+    if (count < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (count <= 0)
+    {
+      int ret = count < 0 ? -errno : -EIO;
+      close(fd);
+      return ret;
+    }
+
+    length += (size_t)count;
+  }
+  close(fd);
+  text[length] = '\0';
+
+  return ewb_conf_parse(arena, text, length, device, error_line);
+}
+
+// The text grows as it is written, sized up front for a device of short peers.
+typedef struct
+{
+  char *data;
+  size_t length;
+  size_t capacity;
+  int error;
+} conf_writer;
+
+static void write_line(conf_writer *writer, const char *format, ...)
+{
+  while (!writer->error)
+  {
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(writer->data + writer->length, writer->capacity - writer->length, format, args);
+    va_end(args);
+
+    if (length < 0)
+    {
+      writer->error = -EINVAL;
+      return;
+    }
+    if ((size_t)length < writer->capacity - writer->length)
+    {
+      writer->length += (size_t)length;
+      return;
+    }
+
+    size_t capacity = writer->capacity * 2 > writer->length + (size_t)length + 1 ? writer->capacity * 2 : writer->length + (size_t)length + 1;
+    char *data = realloc(writer->data, capacity);
+    if (data == NULL)
+    {
+      writer->error = -ENOMEM;
+      return;
+    }
+    writer->data = data;
+    writer->capacity = capacity;
+  }
+}
+
+static void write_key_line(conf_writer *writer, const char *name, const wg_key key)
+{
+  wg_key_b64_string base64;
+  wg_key_to_base64(base64, key);
+
+  write_line(writer, "%s = %s\n", name, base64);
+}
+
+static void write_endpoint_line(conf_writer *writer, const wg_endpoint *endpoint)
+{
+  char addr[INET6_ADDRSTRLEN];
+
+  if (endpoint->addr.sa_family == AF_INET && inet_ntop(AF_INET, &endpoint->addr4.sin_addr, addr, sizeof(addr)) != NULL)
+  {
+    write_line(writer, "Endpoint = %s:%u\n", addr, ntohs(endpoint->addr4.sin_port));
+  }
+  else if (endpoint->addr.sa_family == AF_INET6 && inet_ntop(AF_INET6, &endpoint->addr6.sin6_addr, addr, sizeof(addr)) != NULL)
+  {
+    write_line(writer, "Endpoint = [%s]:%u\n", addr, ntohs(endpoint->addr6.sin6_port));
+  }
+}
+
+static void write_allowedips_line(conf_writer *writer, const struct wg_peer *peer)
+{
+  if (peer->first_allowedip == NULL)
+  {
+    return;
+  }
+
+  write_line(writer, "AllowedIPs = ");
+
+  char addr[INET6_ADDRSTRLEN];
+  struct wg_allowedip *allowedip;
+  wg_for_each_allowedip(peer, allowedip)
+  {
+    if (inet_ntop(allowedip->family, &allowedip->ip6, addr, sizeof(addr)) != NULL)
+    {
+      write_line(writer, allowedip == peer->first_allowedip ? "%s/%u" : ", %s/%u", addr, allowedip->cidr);
+    }
+  }
+
+  write_line(writer, "\n");
+}
+
+extern char *ewb_conf_format(const struct wg_device *device, size_t *length)
+{
+  size_t peers_count = 0;
+  struct wg_peer *peer;
+  wg_for_each_peer(device, peer)
+  {
+    peers_count++;
+  }
+
+  conf_writer writer = {.capacity = 256 + peers_count * 192};
+  if ((writer.data = malloc(writer.capacity)) == NULL)
+  {
+    return NULL;
+  }
+
+  write_line(&writer, "[Interface]\n");
+  if (device->listen_port)
+  {
+    write_line(&writer, "ListenPort = %u\n", device->listen_port);
+  }
+  if (device->fwmark)
+  {
+    write_line(&writer, "FwMark = 0x%x\n", device->fwmark);
+  }
+  if (!wg_key_is_zero(device->private_key))
+  {
+    write_key_line(&writer, "PrivateKey", device->private_key);
+  }
+
+  wg_for_each_peer(device, peer)
+  {
+    write_line(&writer, "\n[Peer]\n");
+    write_key_line(&writer, "PublicKey", peer->public_key);
+    if (!wg_key_is_zero(peer->preshared_key))
+    {
+      write_key_line(&writer, "PresharedKey", peer->preshared_key);
+    }
+    write_allowedips_line(&writer, peer);
+    write_endpoint_line(&writer, &peer->endpoint);
+    if (peer->persistent_keepalive_interval)
+    {
+      write_line(&writer, "PersistentKeepalive = %u\n", peer->persistent_keepalive_interval);
+    }
+  }
+
+  if (writer.error)
+  {
+    free(writer.data);
+    return NULL;
+  }
+
+  *length = writer.length;
+
+  return writer.data;
+}
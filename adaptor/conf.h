@@ -0,0 +1,17 @@
+#ifndef EWB_CONF_H
+#define EWB_CONF_H
+
+#include "stddef.h"
+#include "./arena.h"
+#include "../externs/wireguard-tools/contrib/embeddable-wg-library/wireguard.h"
+
+// The config files in the format of wg setconf and wg showconf, see wg(8) for the format.
+// The parsed device is built in the arena with the flags of setconf, so it replaces every peer of the interface.
+// The text is parsed in place, and the byte after its length is overwritten, so it should be NUL-terminated.
+// The error line is the line the config failed to parse at, or 0 if the failure is not of a line, such as reading the file.
+int ewb_conf_parse(ewb_arena *arena, char *text, size_t length, struct wg_device **device, size_t *error_line);
+int ewb_conf_read_file(ewb_arena *arena, const char *path, struct wg_device **device, size_t *error_line);
+// Formats the device in the format of wg showconf, into a text the caller frees.
+char *ewb_conf_format(const struct wg_device *device, size_t *length);
+
+#endif
@@ -0,0 +1,114 @@
+#include "errno.h"
+#include "pthread.h"
+#include "string.h"
+#include "unistd.h"
+#include "sys/random.h"
+#include "../externs/wireguard-tools/contrib/embeddable-wg-library/wireguard.h"
+#include "./keygen.h"
+
+typedef struct
+{
+  uint8_t *buffer;
+  size_t count;
+} key_pair_range;
+
+static int fill_random(uint8_t *buffer, size_t size)
+{
+  // A single call returns at most 32MiB and may be interrupted, so we keep calling until the buffer is full.
+  while (size > 0)
+  {
+    ssize_t ret = getrandom(buffer, size, 0);
+    if (ret < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+
+      return -errno;
+    }
+
+    buffer += ret;
+    size -= ret;
+  }
+
+  return 0;
+}
+
+static void *fill_public_keys(void *data)
+{
+  key_pair_range *range = data;
+
+  for (size_t index = 0; index < range->count; index++)
+  {
+    uint8_t *private_key = range->buffer + index * sizeof(wg_key) * 2;
+
+    // Clamping the random bytes is all wg_generate_private_key does besides asking for them.
+    private_key[0] &= 248;
+    private_key[31] = (private_key[31] & 127) | 64;
+    wg_generate_public_key(private_key + sizeof(wg_key), private_key);
+  }
+
+  return NULL;
+}
+
+static size_t get_thread_count(size_t count)
+{
+  long processor_count = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t thread_count = (count + EWB_KEYGEN_KEYS_PER_THREAD - 1) / EWB_KEYGEN_KEYS_PER_THREAD;
+
+  if (processor_count > 0 && thread_count > (size_t)processor_count)
+  {
+    thread_count = processor_count;
+  }
+  if (thread_count > EWB_KEYGEN_MAX_THREADS)
+  {
+    thread_count = EWB_KEYGEN_MAX_THREADS;
+  }
+
+  return thread_count ? thread_count : 1;
+}
+
+extern int ewb_keygen_fill_key_pairs(uint8_t *buffer, size_t count)
+{
+  // We draw the whole buffer in a single call, and the public keys then overwrite their halves in place.
+  int ret = fill_random(buffer, count * sizeof(wg_key) * 2);
+  if (ret)
+  {
+    return ret;
+  }
+
+  size_t thread_count = get_thread_count(count);
+  key_pair_range ranges[EWB_KEYGEN_MAX_THREADS];
+  pthread_t threads[EWB_KEYGEN_MAX_THREADS];
+  size_t started_count = 0, offset = 0;
+
+  for (size_t index = 0; index < thread_count; index++)
+  {
+    size_t range_count = count / thread_count + (index < count % thread_count ? 1 : 0);
+    ranges[index].buffer = buffer + offset * sizeof(wg_key) * 2;
+    ranges[index].count = range_count;
+    offset += range_count;
+
+    // The last range runs on the calling thread, and so does any range we could not start a thread for.
+    if (index == thread_count - 1 || pthread_create(&threads[started_count], NULL, fill_public_keys, &ranges[index]))
+    {
+      fill_public_keys(&ranges[index]);
+      continue;
+    }
+
+    started_count++;
+  }
+
+  for (size_t index = 0; index < started_count; index++)
+  {
+    pthread_join(threads[index], NULL);
+  }
+
+  return 0;
+}
+
+extern int ewb_keygen_fill_preshared_keys(uint8_t *buffer, size_t count)
+{
+  return fill_random(buffer, count * sizeof(wg_key));
+}
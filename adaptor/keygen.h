@@ -0,0 +1,16 @@
+#ifndef EWB_KEYGEN_H
+#define EWB_KEYGEN_H
+
+#include "stddef.h"
+#include "stdint.h"
+
+// The batches smaller than this are generated on the calling thread, as spawning threads costs more than the work.
+#define EWB_KEYGEN_KEYS_PER_THREAD 2048
+#define EWB_KEYGEN_MAX_THREADS 16
+
+// Fills the buffer with the pairs of a private key and its public key, 64 bytes each.
+int ewb_keygen_fill_key_pairs(uint8_t *buffer, size_t count);
+// Fills the buffer with the preshared keys, 32 bytes each.
+int ewb_keygen_fill_preshared_keys(uint8_t *buffer, size_t count);
+
+#endif
@@ -0,0 +1,731 @@
+#include "errno.h"
+#include "stdlib.h"
+#include "string.h"
+#include "./lpm.h"
+
+#define IPV4_TRIE 0
+#define IPV6_TRIE 1
+
+// The prefix in the owner list, the node index with the trie in the lowest bit.
+#define ENCODE_PREFIX(trie, node) (((node) << 1) | (trie))
+
+typedef int (*overlap_callback)(const ewb_lpm_prefix *prefix, void *data);
+
+static int get_trie_index(uint16_t family, uint8_t cidr)
+{
+  if (family == AF_INET && cidr <= 32)
+  {
+    return IPV4_TRIE;
+  }
+  if (family == AF_INET6 && cidr <= 128)
+  {
+    return IPV6_TRIE;
+  }
+
+  return -EINVAL;
+}
+
+static int get_address_bit(const uint8_t *addr, size_t bit)
+{
+  return (addr[bit / 8] >> (7 - bit % 8)) & 1;
+}
+
+static void set_address_bit(uint8_t *addr, size_t bit)
+{
+  addr[bit / 8] |= 0x80 >> (bit % 8);
+}
+
+static int init_trie(ewb_lpm_trie *trie)
+{
+  trie->nodes = calloc(64, sizeof(ewb_lpm_node));
+  if (trie->nodes == NULL)
+  {
+    return -ENOMEM;
+  }
+
+  // The root is the prefix of zero length, so `0.0.0.0/0` lives on it.
+  trie->size = 1;
+  trie->capacity = 64;
+
+  return 0;
+}
+
+static void destroy_trie(ewb_lpm_trie *trie)
+{
+  free(trie->nodes);
+  trie->nodes = NULL;
+  trie->size = 0;
+  trie->capacity = 0;
+}
+
+static void clear_trie(ewb_lpm_trie *trie)
+{
+  memset(&trie->nodes[0], 0, sizeof(ewb_lpm_node));
+  trie->size = 1;
+  trie->free_node = 0;
+}
+
+static int64_t insert_trie_node(ewb_lpm_trie *trie, const uint8_t *addr, uint8_t cidr)
+{
+  uint32_t node = 0;
+  for (size_t bit = 0; bit < cidr; bit++)
+  {
+    int side = get_address_bit(addr, bit);
+    if (trie->nodes[node].children[side] != 0)
+    {
+      node = trie->nodes[node].children[side];
+      continue;
+    }
+
+    uint32_t child;
+    if (trie->free_node != 0)
+    {
+      child = trie->free_node;
+      trie->free_node = trie->nodes[child].children[0];
+    }
+    else
+    {
+      if (trie->size == trie->capacity)
+      {
+        if (trie->capacity >= UINT32_MAX >> 1)
+        {
+          return -ENOMEM;
+        }
+
+        ewb_lpm_node *nodes = realloc(trie->nodes, trie->capacity * 2 * sizeof(ewb_lpm_node));
+        if (nodes == NULL)
+        {
+          return -ENOMEM;
+        }
+        trie->nodes = nodes;
+        trie->capacity *= 2;
+      }
+
+      child = (uint32_t)trie->size++;
+    }
+
+    memset(&trie->nodes[child], 0, sizeof(ewb_lpm_node));
+    trie->nodes[child].parent = node;
+    trie->nodes[node].children[side] = child;
+    node = child;
+  }
+
+  return node;
+}
+
+static void set_prefix(ewb_lpm_prefix *prefix, uint16_t family, const uint8_t *addr, uint8_t cidr, uint32_t owner)
+{
+  memset(prefix, 0, sizeof(ewb_lpm_prefix));
+  prefix->family = family;
+  prefix->cidr = cidr;
+  prefix->owner = owner;
+
+  for (size_t bit = 0; bit < cidr; bit++)
+  {
+    if (get_address_bit(addr, bit))
+    {
+      set_address_bit(prefix->addr, bit);
+    }
+  }
+}
+
+// Calls back every prefix covering the given prefix and every prefix under it, stopping on the first non-zero return.
+static int walk_trie_overlaps(const ewb_lpm_trie *trie, uint16_t family, const uint8_t *addr, uint8_t cidr, overlap_callback callback, void *data)
+{
+  ewb_lpm_prefix prefix;
+
+  uint32_t node = 0;
+  for (size_t bit = 0;; bit++)
+  {
+    if (trie->nodes[node].owner != 0)
+    {
+      set_prefix(&prefix, family, addr, (uint8_t)bit, trie->nodes[node].owner);
+
+      int ret = callback(&prefix, data);
+      if (ret)
+      {
+        return ret;
+      }
+    }
+
+    if (bit == cidr)
+    {
+      break;
+    }
+
+    node = trie->nodes[node].children[get_address_bit(addr, bit)];
+    if (node == 0)
+    {
+      return 0;
+    }
+  }
+
+  // The depth-first walk under the prefix never holds more than a node for each bit in the stack.
+  struct
+  {
+    uint32_t node;
+    uint8_t depth;
+    uint8_t addr[16];
+  } stack[129];
+  size_t stack_size = 0;
+
+  set_prefix(&prefix, family, addr, cidr, 0);
+  for (int side = 1; side >= 0; side--)
+  {
+    if (trie->nodes[node].children[side] != 0)
+    {
+      stack[stack_size].node = trie->nodes[node].children[side];
+      stack[stack_size].depth = cidr + 1;
+      memcpy(stack[stack_size].addr, prefix.addr, sizeof(prefix.addr));
+      if (side)
+      {
+        set_address_bit(stack[stack_size].addr, cidr);
+      }
+      stack_size++;
+    }
+  }
+
+  while (stack_size > 0)
+  {
+    stack_size--;
+    uint32_t current = stack[stack_size].node;
+    uint8_t depth = stack[stack_size].depth;
+    uint8_t current_addr[16];
+    memcpy(current_addr, stack[stack_size].addr, sizeof(current_addr));
+
+    if (trie->nodes[current].owner != 0)
+    {
+      set_prefix(&prefix, family, current_addr, depth, trie->nodes[current].owner);
+
+      int ret = callback(&prefix, data);
+      if (ret)
+      {
+        return ret;
+      }
+    }
+
+    for (int side = 1; side >= 0; side--)
+    {
+      if (trie->nodes[current].children[side] != 0)
+      {
+        stack[stack_size].node = trie->nodes[current].children[side];
+        stack[stack_size].depth = depth + 1;
+        memcpy(stack[stack_size].addr, current_addr, sizeof(current_addr));
+        if (side)
+        {
+          set_address_bit(stack[stack_size].addr, depth);
+        }
+        stack_size++;
+      }
+    }
+  }
+
+  return 0;
+}
+
+extern int ewb_lpm_init(ewb_lpm *lpm)
+{
+  memset(lpm, 0, sizeof(ewb_lpm));
+
+  if (init_trie(&lpm->tries[IPV4_TRIE]) || init_trie(&lpm->tries[IPV6_TRIE]) || ewb_peer_table_init(&lpm->owner_table, 0))
+  {
+    destroy_trie(&lpm->tries[IPV4_TRIE]);
+    destroy_trie(&lpm->tries[IPV6_TRIE]);
+    return -ENOMEM;
+  }
+
+  return 0;
+}
+
+extern void ewb_lpm_destroy(ewb_lpm *lpm)
+{
+  destroy_trie(&lpm->tries[IPV4_TRIE]);
+  destroy_trie(&lpm->tries[IPV6_TRIE]);
+
+  for (size_t index = 0; index < lpm->owner_count; index++)
+  {
+    free(lpm->owners[index].prefixes);
+  }
+  free(lpm->owners);
+  lpm->owners = NULL;
+  lpm->owner_count = 0;
+  lpm->owner_capacity = 0;
+
+  ewb_peer_table_destroy(&lpm->owner_table);
+}
+
+// Drops every prefix, but keeps the owners so the ids given out before stay valid.
+extern void ewb_lpm_clear(ewb_lpm *lpm)
+{
+  clear_trie(&lpm->tries[IPV4_TRIE]);
+  clear_trie(&lpm->tries[IPV6_TRIE]);
+
+  for (size_t index = 0; index < lpm->owner_count; index++)
+  {
+    lpm->owners[index].count = 0;
+  }
+}
+
+static uint32_t find_owner(const ewb_lpm *lpm, const wg_key public_key)
+{
+  return (uint32_t)(uintptr_t)ewb_peer_table_get(&lpm->owner_table, public_key);
+}
+
+static int64_t get_or_create_owner(ewb_lpm *lpm, const wg_key public_key)
+{
+  uint32_t owner = find_owner(lpm, public_key);
+  if (owner != 0)
+  {
+    return owner;
+  }
+
+  if (lpm->owner_count == lpm->owner_capacity)
+  {
+    size_t capacity = lpm->owner_capacity ? lpm->owner_capacity * 2 : 16;
+    ewb_lpm_owner *owners = realloc(lpm->owners, capacity * sizeof(ewb_lpm_owner));
+    if (owners == NULL)
+    {
+      return -ENOMEM;
+    }
+    lpm->owners = owners;
+    lpm->owner_capacity = capacity;
+  }
+
+  owner = (uint32_t)lpm->owner_count + 1;
+  int ret = ewb_peer_table_set(&lpm->owner_table, public_key, (void *)(uintptr_t)owner);
+  if (ret)
+  {
+    return ret;
+  }
+
+  ewb_lpm_owner *entry = &lpm->owners[lpm->owner_count++];
+  memset(entry, 0, sizeof(ewb_lpm_owner));
+  memcpy(entry->public_key, public_key, sizeof(wg_key));
+
+  return owner;
+}
+
+static int insert_prefix(ewb_lpm *lpm, uint32_t owner, uint16_t family, const void *addr, uint8_t cidr)
+{
+  int trie_index = get_trie_index(family, cidr);
+  if (trie_index < 0)
+  {
+    return trie_index;
+  }
+
+  ewb_lpm_trie *trie = &lpm->tries[trie_index];
+  int64_t node = insert_trie_node(trie, addr, cidr);
+  if (node < 0)
+  {
+    return (int)node;
+  }
+
+  // The kernel moves the prefix to the last peer given it, so we do the same.
+  if (trie->nodes[node].owner == owner)
+  {
+    return 0;
+  }
+
+  ewb_lpm_owner *entry = &lpm->owners[owner - 1];
+  if (entry->count == entry->capacity)
+  {
+    size_t capacity = entry->capacity ? entry->capacity * 2 : 4;
+    uint32_t *prefixes = realloc(entry->prefixes, capacity * sizeof(uint32_t));
+    if (prefixes == NULL)
+    {
+      return -ENOMEM;
+    }
+    entry->prefixes = prefixes;
+    entry->capacity = capacity;
+  }
+
+  entry->prefixes[entry->count++] = ENCODE_PREFIX((uint32_t)trie_index, (uint32_t)node);
+  trie->nodes[node].owner = owner;
+
+  return 0;
+}
+
+extern int ewb_lpm_insert(ewb_lpm *lpm, const wg_key public_key, uint16_t family, const void *addr, uint8_t cidr)
+{
+  if (get_trie_index(family, cidr) < 0)
+  {
+    return -EINVAL;
+  }
+
+  int64_t owner = get_or_create_owner(lpm, public_key);
+  if (owner < 0)
+  {
+    return (int)owner;
+  }
+
+  return insert_prefix(lpm, (uint32_t)owner, family, addr, cidr);
+}
+
+// Unlinks the node and its parents up to the first one with an owner or another child, so the removed peers do not grow the trie.
+static void prune_trie_node(ewb_lpm_trie *trie, uint32_t node)
+{
+  while (node != 0 && trie->nodes[node].owner == 0 && trie->nodes[node].children[0] == 0 && trie->nodes[node].children[1] == 0)
+  {
+    uint32_t parent = trie->nodes[node].parent;
+    trie->nodes[parent].children[trie->nodes[parent].children[1] == node] = 0;
+
+    trie->nodes[node].children[0] = trie->free_node;
+    trie->free_node = node;
+
+    node = parent;
+  }
+}
+
+// The pruned nodes have no owner, so the stale prefixes of the lists pointing at them are skipped the same as the moved ones.
+static void clear_owner(ewb_lpm *lpm, uint32_t owner)
+{
+  ewb_lpm_owner *entry = &lpm->owners[owner - 1];
+  for (size_t index = 0; index < entry->count; index++)
+  {
+    ewb_lpm_trie *trie = &lpm->tries[entry->prefixes[index] & 1];
+    uint32_t node = entry->prefixes[index] >> 1;
+    if (trie->nodes[node].owner == owner)
+    {
+      trie->nodes[node].owner = 0;
+      prune_trie_node(trie, node);
+    }
+  }
+
+  entry->count = 0;
+}
+
+extern void ewb_lpm_remove_owner(ewb_lpm *lpm, const wg_key public_key)
+{
+  uint32_t owner = find_owner(lpm, public_key);
+  if (owner != 0)
+  {
+    clear_owner(lpm, owner);
+  }
+}
+
+// Applies the config with the same semantics of setDevice, so the index follows the device without getting it again.
+extern int ewb_lpm_apply_device(ewb_lpm *lpm, const struct wg_device *device)
+{
+  if (device->flags & WGDEVICE_REPLACE_PEERS)
+  {
+    ewb_lpm_clear(lpm);
+  }
+
+  const struct wg_peer *peer;
+  wg_for_each_peer(device, peer)
+  {
+    if (peer->flags & (WGPEER_REMOVE_ME | WGPEER_REPLACE_ALLOWEDIPS))
+    {
+      ewb_lpm_remove_owner(lpm, peer->public_key);
+    }
+    if (peer->flags & WGPEER_REMOVE_ME)
+    {
+      continue;
+    }
+
+    const struct wg_allowedip *allowedip;
+    wg_for_each_allowedip(peer, allowedip)
+    {
+      int ret = ewb_lpm_insert(lpm, peer->public_key, allowedip->family, &allowedip->ip6, allowedip->cidr);
+      if (ret)
+      {
+        return ret;
+      }
+    }
+  }
+
+  return 0;
+}
+
+extern uint32_t ewb_lpm_lookup(const ewb_lpm *lpm, uint16_t family, const void *addr, ewb_lpm_prefix *match)
+{
+  uint8_t max_cidr = family == AF_INET6 ? 128 : 32;
+  int trie_index = get_trie_index(family, max_cidr);
+  if (trie_index < 0)
+  {
+    return 0;
+  }
+
+  const ewb_lpm_trie *trie = &lpm->tries[trie_index];
+  uint32_t owner = 0;
+  uint8_t cidr = 0;
+
+  uint32_t node = 0;
+  for (size_t bit = 0;; bit++)
+  {
+    if (trie->nodes[node].owner != 0)
+    {
+      owner = trie->nodes[node].owner;
+      cidr = (uint8_t)bit;
+    }
+
+    if (bit == max_cidr)
+    {
+      break;
+    }
+
+    node = trie->nodes[node].children[get_address_bit(addr, bit)];
+    if (node == 0)
+    {
+      break;
+    }
+  }
+
+  if (owner != 0 && match != NULL)
+  {
+    set_prefix(match, family, addr, cidr, owner);
+  }
+
+  return owner;
+}
+
+extern const uint8_t *ewb_lpm_get_owner_key(const ewb_lpm *lpm, uint32_t owner)
+{
+  if (owner == 0 || owner > lpm->owner_count)
+  {
+    return NULL;
+  }
+
+  return lpm->owners[owner - 1].public_key;
+}
+
+// The owners of the config are the ones of the index, and the peers new to the index get the ids after them for the call only.
+typedef struct
+{
+  const ewb_lpm *lpm;
+  const wg_key *config_keys;
+  uint32_t *owners;
+  size_t config_key_count;
+} config_owners;
+
+static const uint8_t *get_config_owner_key(const config_owners *owners, uint32_t owner)
+{
+  if (owner <= owners->lpm->owner_count)
+  {
+    return owners->lpm->owners[owner - 1].public_key;
+  }
+
+  return owners->config_keys[owner - owners->lpm->owner_count - 1];
+}
+
+typedef struct
+{
+  ewb_lpm_overlaps *overlaps;
+  const config_owners *owners;
+  const bool *is_cleared;
+  uint32_t owner;
+  ewb_lpm_prefix allowedip;
+} overlap_context;
+
+static int push_overlap(const ewb_lpm_prefix *prefix, void *data)
+{
+  overlap_context *context = (overlap_context *)data;
+
+  // The peer may hold the prefix already, and the prefixes of the peers cleared by the config are gone once it is applied.
+  if (prefix->owner == context->owner || (context->is_cleared != NULL && context->is_cleared[prefix->owner - 1]))
+  {
+    return 0;
+  }
+
+  ewb_lpm_overlaps *overlaps = context->overlaps;
+  if (overlaps->count == overlaps->capacity)
+  {
+    size_t capacity = overlaps->capacity ? overlaps->capacity * 2 : 16;
+    ewb_lpm_overlap *grown = realloc(overlaps->overlaps, capacity * sizeof(ewb_lpm_overlap));
+    if (grown == NULL)
+    {
+      return -ENOMEM;
+    }
+    overlaps->overlaps = grown;
+    overlaps->capacity = capacity;
+  }
+
+  ewb_lpm_overlap *overlap = &overlaps->overlaps[overlaps->count++];
+  memcpy(overlap->public_key, get_config_owner_key(context->owners, context->owner), sizeof(wg_key));
+  overlap->allowedip = context->allowedip;
+  memcpy(overlap->conflicting_public_key, get_config_owner_key(context->owners, prefix->owner), sizeof(wg_key));
+  overlap->conflicting_allowedip = *prefix;
+
+  return 0;
+}
+
+static int find_config_overlaps(const ewb_lpm *lpm, const struct wg_device *device, const config_owners *owners, ewb_lpm *config, bool *is_cleared, ewb_lpm_overlaps *overlaps)
+{
+  bool is_replacing_peers = device->flags & WGDEVICE_REPLACE_PEERS;
+
+  size_t index = 0;
+  const struct wg_peer *peer;
+  wg_for_each_peer(device, peer)
+  {
+    uint32_t owner = owners->owners[index++];
+    if (peer->flags & WGPEER_REMOVE_ME)
+    {
+      continue;
+    }
+
+    overlap_context context = {
+      .overlaps = overlaps,
+      .owners = owners,
+      .is_cleared = is_cleared,
+      .owner = owner,
+    };
+
+    const struct wg_allowedip *allowedip;
+    wg_for_each_allowedip(peer, allowedip)
+    {
+      int trie_index = get_trie_index(allowedip->family, allowedip->cidr);
+      if (trie_index < 0)
+      {
+        return trie_index;
+      }
+      set_prefix(&context.allowedip, allowedip->family, (const uint8_t *)&allowedip->ip6, allowedip->cidr, context.owner);
+
+      int ret = 0;
+      if (!is_replacing_peers)
+      {
+        context.is_cleared = is_cleared;
+        ret = walk_trie_overlaps(&lpm->tries[trie_index], allowedip->family, context.allowedip.addr, allowedip->cidr, push_overlap, &context);
+      }
+      if (ret == 0)
+      {
+        context.is_cleared = NULL;
+        ret = walk_trie_overlaps(&config->tries[trie_index], allowedip->family, context.allowedip.addr, allowedip->cidr, push_overlap, &context);
+      }
+      if (ret == 0)
+      {
+        ret = insert_prefix(config, context.owner, allowedip->family, context.allowedip.addr, allowedip->cidr);
+      }
+      if (ret)
+      {
+        return ret;
+      }
+    }
+  }
+
+  return 0;
+}
+
+// Gives every peer of the config its owner id in the order of the peers, so the overlaps between the peers of the config share the ids.
+static int get_config_owners(const ewb_lpm *lpm, const struct wg_device *device, size_t peer_count, wg_key *config_keys, config_owners *owners)
+{
+  ewb_peer_table table;
+  int ret = ewb_peer_table_init(&table, peer_count);
+  if (ret)
+  {
+    return ret;
+  }
+
+  size_t index = 0;
+  const struct wg_peer *peer;
+  wg_for_each_peer(device, peer)
+  {
+    uint32_t owner = find_owner(lpm, peer->public_key);
+    if (owner == 0)
+    {
+      owner = (uint32_t)(uintptr_t)ewb_peer_table_get(&table, peer->public_key);
+    }
+    if (owner == 0)
+    {
+      owner = (uint32_t)(lpm->owner_count + ++owners->config_key_count);
+      memcpy(config_keys[owner - lpm->owner_count - 1], peer->public_key, sizeof(wg_key));
+      if ((ret = ewb_peer_table_set(&table, peer->public_key, (void *)(uintptr_t)owner)))
+      {
+        break;
+      }
+    }
+
+    owners->owners[index++] = owner;
+  }
+
+  ewb_peer_table_destroy(&table);
+
+  return ret;
+}
+
+extern int ewb_lpm_find_overlaps(const ewb_lpm *lpm, const struct wg_device *device, ewb_lpm_overlaps *overlaps)
+{
+  memset(overlaps, 0, sizeof(ewb_lpm_overlaps));
+
+  size_t peer_count = 0;
+  const struct wg_peer *peer;
+  wg_for_each_peer(device, peer)
+  {
+    peer_count++;
+  }
+
+  wg_key *config_keys = malloc((peer_count + 1) * sizeof(wg_key));
+  config_owners owners = {
+    .lpm = lpm,
+    .config_keys = config_keys,
+    .owners = malloc((peer_count + 1) * sizeof(uint32_t)),
+  };
+
+  bool *is_cleared = NULL;
+  ewb_lpm config;
+  memset(&config, 0, sizeof(ewb_lpm));
+
+  int ret = config_keys == NULL || owners.owners == NULL ? -ENOMEM : get_config_owners(lpm, device, peer_count, config_keys, &owners);
+  if (ret)
+  {
+    goto out;
+  }
+
+  size_t owner_count = lpm->owner_count + owners.config_key_count;
+  if ((is_cleared = calloc(owner_count + 1, sizeof(bool))) == NULL)
+  {
+    ret = -ENOMEM;
+    goto out;
+  }
+
+  size_t index = 0;
+  wg_for_each_peer(device, peer)
+  {
+    uint32_t owner = owners.owners[index++];
+    if (peer->flags & (WGPEER_REMOVE_ME | WGPEER_REPLACE_ALLOWEDIPS))
+    {
+      is_cleared[owner - 1] = true;
+    }
+  }
+
+  // The config side is a trie of its own, but the owners are shared with the index.
+  config.owners = calloc(owner_count + 1, sizeof(ewb_lpm_owner));
+  config.owner_count = owner_count;
+  config.owner_capacity = owner_count;
+  if (config.owners == NULL || init_trie(&config.tries[IPV4_TRIE]) || init_trie(&config.tries[IPV6_TRIE]))
+  {
+    ret = -ENOMEM;
+    goto out;
+  }
+
+  ret = find_config_overlaps(lpm, device, &owners, &config, is_cleared, overlaps);
+
+out:
+  free(config_keys);
+  free(owners.owners);
+  free(is_cleared);
+  if (config.owners != NULL)
+  {
+    for (size_t owner = 0; owner < config.owner_count; owner++)
+    {
+      free(config.owners[owner].prefixes);
+    }
+  }
+  free(config.owners);
+  destroy_trie(&config.tries[IPV4_TRIE]);
+  destroy_trie(&config.tries[IPV6_TRIE]);
+
+  if (ret)
+  {
+    ewb_lpm_overlaps_destroy(overlaps);
+  }
+
+  return ret;
+}
+
+extern void ewb_lpm_overlaps_destroy(ewb_lpm_overlaps *overlaps)
+{
+  free(overlaps->overlaps);
+  overlaps->overlaps = NULL;
+  overlaps->count = 0;
+  overlaps->capacity = 0;
+}
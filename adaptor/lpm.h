@@ -0,0 +1,83 @@
+#ifndef EWB_LPM_H
+#define EWB_LPM_H
+
+#include "stdbool.h"
+#include "stddef.h"
+#include "stdint.h"
+#include "../externs/wireguard-tools/contrib/embeddable-wg-library/wireguard.h"
+#include "./peer_table.h"
+
+// The node of the binary trie; children are indexes into the nodes of the trie, and zero means no child as the root is never a child.
+typedef struct
+{
+  uint32_t children[2];
+  uint32_t parent;
+  uint32_t owner;
+} ewb_lpm_node;
+
+// The nodes pruned off the trie are chained by their first child from free_node, and taken again by the next inserts.
+typedef struct
+{
+  ewb_lpm_node *nodes;
+  size_t size;
+  size_t capacity;
+  uint32_t free_node;
+} ewb_lpm_trie;
+
+// The peer owning the prefixes, we keep the nodes of its prefixes to clear them without walking the tries.
+// Prefixes moved to another peer stay in the list and are skipped by the owner check on clear.
+typedef struct
+{
+  wg_key public_key;
+  uint32_t *prefixes;
+  size_t count;
+  size_t capacity;
+} ewb_lpm_owner;
+
+// The longest prefix match index of allowed ips, which maps the prefixes to the owning peers the same way the kernel routes.
+// The owner ids start from one and are never reused, so zero means no owner.
+typedef struct
+{
+  ewb_lpm_trie tries[2];
+  ewb_lpm_owner *owners;
+  size_t owner_count;
+  size_t owner_capacity;
+  ewb_peer_table owner_table;
+} ewb_lpm;
+
+typedef struct
+{
+  uint16_t family;
+  uint8_t cidr;
+  uint8_t addr[16];
+  uint32_t owner;
+} ewb_lpm_prefix;
+
+typedef struct
+{
+  wg_key public_key;
+  ewb_lpm_prefix allowedip;
+  wg_key conflicting_public_key;
+  ewb_lpm_prefix conflicting_allowedip;
+} ewb_lpm_overlap;
+
+typedef struct
+{
+  ewb_lpm_overlap *overlaps;
+  size_t count;
+  size_t capacity;
+} ewb_lpm_overlaps;
+
+int ewb_lpm_init(ewb_lpm *lpm);
+void ewb_lpm_destroy(ewb_lpm *lpm);
+void ewb_lpm_clear(ewb_lpm *lpm);
+int ewb_lpm_insert(ewb_lpm *lpm, const wg_key public_key, uint16_t family, const void *addr, uint8_t cidr);
+void ewb_lpm_remove_owner(ewb_lpm *lpm, const wg_key public_key);
+int ewb_lpm_apply_device(ewb_lpm *lpm, const struct wg_device *device);
+uint32_t ewb_lpm_lookup(const ewb_lpm *lpm, uint16_t family, const void *addr, ewb_lpm_prefix *match);
+const uint8_t *ewb_lpm_get_owner_key(const ewb_lpm *lpm, uint32_t owner);
+// The overlaps of the config against the index and between the peers of the config, leaving the index as it was.
+int ewb_lpm_find_overlaps(const ewb_lpm *lpm, const struct wg_device *device, ewb_lpm_overlaps *overlaps);
+void ewb_lpm_overlaps_destroy(ewb_lpm_overlaps *overlaps);
+
+#endif
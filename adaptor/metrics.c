@@ -0,0 +1,275 @@
+#include "string.h"
+#include "time.h"
+#include "./constants.h"
+#include "./metrics.h"
+
+const char *const ewb_metrics_error_codes[EWB_METRICS_ERROR_CODES] = {
+    EWB_AF_UNSPEC,
+    EWB_AI_UNFORMAT,
+    EWB_OBJ_UNSPEC,
+    EWB_ARG_UNSPEC,
+    EWB_LIB_CALLFAIL,
+    EWB_NNA_CALLFAIL,
+    EWB_SOC_CALLFAIL,
+    "",
+};
+
+// The snapshot is all of uint64_t, so we sum and reset the counters as arrays.
+typedef ewb_metrics_snapshot metrics_counters;
+
+typedef struct
+{
+  metrics_counters operations[EWB_METRICS_OPERATIONS];
+} __attribute__((aligned(64))) metrics_shard;
+
+static metrics_shard shards[EWB_METRICS_SHARDS];
+static unsigned int next_shard = 0;
+
+static __thread metrics_shard *thread_shard = NULL;
+static __thread ewb_metrics_call *current_call = NULL;
+
+static inline void add_counter(uint64_t *counter, uint64_t value)
+{
+  __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+static inline metrics_counters *get_counters(ewb_metrics_operation operation)
+{
+  if (thread_shard == NULL)
+  {
+    thread_shard = &shards[__atomic_fetch_add(&next_shard, 1, __ATOMIC_RELAXED) % EWB_METRICS_SHARDS];
+  }
+
+  return &thread_shard->operations[operation];
+}
+
+static size_t get_bucket(uint64_t value)
+{
+  if (value < (1 << EWB_METRICS_SUB_BUCKET_BITS))
+  {
+    return (size_t)value;
+  }
+
+  int exponent = 63 - __builtin_clzll(value);
+  size_t sub_bucket = (size_t)(value >> (exponent - EWB_METRICS_SUB_BUCKET_BITS)) & ((1 << EWB_METRICS_SUB_BUCKET_BITS) - 1);
+  size_t bucket = ((size_t)(exponent - EWB_METRICS_SUB_BUCKET_BITS + 1) << EWB_METRICS_SUB_BUCKET_BITS) + sub_bucket;
+
+  return bucket < EWB_METRICS_BUCKETS ? bucket : EWB_METRICS_BUCKETS - 1;
+}
+
+extern uint64_t ewb_metrics_bucket_upper_bound(size_t bucket)
+{
+  if (bucket < (1 << EWB_METRICS_SUB_BUCKET_BITS))
+  {
+    return (uint64_t)bucket;
+  }
+
+  int shift = (int)(bucket >> EWB_METRICS_SUB_BUCKET_BITS) - 1;
+  uint64_t lower = (uint64_t)((1 << EWB_METRICS_SUB_BUCKET_BITS) + (bucket & ((1 << EWB_METRICS_SUB_BUCKET_BITS) - 1))) << shift;
+
+  return lower + ((uint64_t)1 << shift) - 1;
+}
+
+static void record_latency(metrics_counters *counters, ewb_metrics_phase phase, uint64_t value)
+{
+  add_counter(&counters->sum_ns[phase], value);
+  add_counter(&counters->buckets[phase][get_bucket(value)], 1);
+}
+
+extern uint64_t ewb_metrics_now(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+extern void ewb_metrics_call_begin(ewb_metrics_call *call, ewb_metrics_operation operation)
+{
+  memset(call, 0, sizeof(*call));
+  call->operation = operation;
+  call->is_active = true;
+  call->resumed_at = ewb_metrics_now();
+
+  add_counter(&get_counters(operation)->calls, 1);
+
+  current_call = call;
+}
+
+extern void ewb_metrics_call_pause(ewb_metrics_call *call)
+{
+  if (!call->is_active || call->resumed_at == 0)
+  {
+    return;
+  }
+
+  call->marshal_ns += ewb_metrics_now() - call->resumed_at;
+  call->resumed_at = 0;
+
+  if (current_call == call)
+  {
+    current_call = NULL;
+  }
+}
+
+extern void ewb_metrics_call_resume(ewb_metrics_call *call)
+{
+  if (!call->is_active)
+  {
+    return;
+  }
+
+  call->resumed_at = ewb_metrics_now();
+  current_call = call;
+}
+
+extern void ewb_metrics_call_end(ewb_metrics_call *call, const char *error_code)
+{
+  if (!call->is_active)
+  {
+    return;
+  }
+
+  ewb_metrics_call_pause(call);
+  call->is_active = false;
+
+  metrics_counters *counters = get_counters(call->operation);
+
+  // The kernel time measured while the call was running on this thread is not marshal time.
+  record_latency(counters, EWB_METRICS_MARSHAL, call->marshal_ns > call->overlap_ns ? call->marshal_ns - call->overlap_ns : 0);
+  if (call->kernel_ns > 0)
+  {
+    record_latency(counters, EWB_METRICS_KERNEL, call->kernel_ns);
+  }
+
+  if (error_code != NULL)
+  {
+    size_t index = 0;
+    while (index < EWB_METRICS_ERROR_CODES - 1 && strcmp(ewb_metrics_error_codes[index], error_code) != 0)
+    {
+      index++;
+    }
+
+    add_counter(&counters->errors[index], 1);
+  }
+
+  if (current_call == call)
+  {
+    current_call = NULL;
+  }
+}
+
+extern bool ewb_metrics_call_hand_off(ewb_metrics_call *call)
+{
+  ewb_metrics_call *from = current_call;
+  if (from == NULL)
+  {
+    call->is_active = false;
+    return false;
+  }
+
+  ewb_metrics_call_pause(from);
+  *call = *from;
+  from->is_active = false;
+  from->is_handed_off = true;
+
+  return true;
+}
+
+extern void ewb_metrics_call_attach(ewb_metrics_call *call)
+{
+  if (call->is_active)
+  {
+    current_call = call;
+  }
+}
+
+extern void ewb_metrics_call_detach(ewb_metrics_call *call)
+{
+  if (current_call == call)
+  {
+    current_call = NULL;
+  }
+}
+
+extern void ewb_metrics_record_kernel_time(uint64_t started_at)
+{
+  ewb_metrics_call *call = current_call;
+  if (call == NULL)
+  {
+    return;
+  }
+
+  uint64_t elapsed = ewb_metrics_now() - started_at;
+  call->kernel_ns += elapsed;
+  if (call->resumed_at != 0)
+  {
+    call->overlap_ns += elapsed;
+  }
+}
+
+extern void ewb_metrics_record_bytes(size_t sent, size_t received)
+{
+  ewb_metrics_call *call = current_call;
+  if (call == NULL)
+  {
+    return;
+  }
+
+  metrics_counters *counters = get_counters(call->operation);
+  if (sent > 0)
+  {
+    add_counter(&counters->bytes_sent, sent);
+  }
+  if (received > 0)
+  {
+    add_counter(&counters->bytes_received, received);
+  }
+}
+
+extern void ewb_metrics_record_items(uint64_t peers, uint64_t allowedips)
+{
+  ewb_metrics_call *call = current_call;
+  if (call == NULL)
+  {
+    return;
+  }
+
+  metrics_counters *counters = get_counters(call->operation);
+  add_counter(&counters->peers, peers);
+  add_counter(&counters->allowedips, allowedips);
+}
+
+static void add_counters(uint64_t *to, uint64_t *from, size_t count)
+{
+  for (size_t index = 0; index < count; index++)
+  {
+    to[index] += __atomic_load_n(&from[index], __ATOMIC_RELAXED);
+  }
+}
+
+extern void ewb_metrics_get_snapshot(ewb_metrics_snapshot snapshots[EWB_METRICS_OPERATIONS])
+{
+  memset(snapshots, 0, sizeof(ewb_metrics_snapshot) * EWB_METRICS_OPERATIONS);
+
+  for (size_t shard = 0; shard < EWB_METRICS_SHARDS; shard++)
+  {
+    for (size_t operation = 0; operation < EWB_METRICS_OPERATIONS; operation++)
+    {
+      add_counters((uint64_t *)&snapshots[operation], (uint64_t *)&shards[shard].operations[operation], sizeof(metrics_counters) / sizeof(uint64_t));
+    }
+  }
+}
+
+extern void ewb_metrics_reset(void)
+{
+  // The calls running meanwhile may be counted partly, which is fine for the metrics.
+  for (size_t shard = 0; shard < EWB_METRICS_SHARDS; shard++)
+  {
+    uint64_t *counters = (uint64_t *)&shards[shard].operations;
+    for (size_t index = 0; index < EWB_METRICS_OPERATIONS * sizeof(metrics_counters) / sizeof(uint64_t); index++)
+    {
+      __atomic_store_n(&counters[index], 0, __ATOMIC_RELAXED);
+    }
+  }
+}
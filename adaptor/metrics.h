@@ -0,0 +1,85 @@
+#ifndef EWB_METRICS_H
+#define EWB_METRICS_H
+
+#include "stdbool.h"
+#include "stddef.h"
+#include "stdint.h"
+
+// The counters are striped over shards picked per thread, so the threads of the pool rarely share a cache line.
+#define EWB_METRICS_SHARDS 16
+// The values below 8ns are exact, and every power of two above is split into 8 buckets, up to 2^41ns.
+#define EWB_METRICS_SUB_BUCKET_BITS 3
+#define EWB_METRICS_BUCKETS 312
+
+typedef enum
+{
+  EWB_METRICS_GET_DEVICE,
+  EWB_METRICS_SET_DEVICE,
+  EWB_METRICS_LIST_DEVICE_NAMES,
+  EWB_METRICS_GENERATE_KEYS,
+  EWB_METRICS_INTERFACE_ADDRESS,
+  EWB_METRICS_ADD_REMOVE_DEVICE,
+  EWB_METRICS_OPERATIONS,
+} ewb_metrics_operation;
+
+typedef enum
+{
+  EWB_METRICS_MARSHAL,
+  EWB_METRICS_KERNEL,
+  EWB_METRICS_PHASES,
+} ewb_metrics_phase;
+
+// The error codes of constants.h, and the last one for an error without a code.
+#define EWB_METRICS_ERROR_CODES 8
+
+extern const char *const ewb_metrics_error_codes[EWB_METRICS_ERROR_CODES];
+
+// A call of a binding, owned by the thread running it or by the asynchronous work it is handed off to.
+// The time the call runs outside the kernel is counted as marshal time, while paused is not counted at all.
+typedef struct
+{
+  ewb_metrics_operation operation;
+  bool is_active;
+  bool is_handed_off;
+  uint64_t resumed_at;
+  uint64_t marshal_ns;
+  uint64_t kernel_ns;
+  uint64_t overlap_ns;
+} ewb_metrics_call;
+
+typedef struct
+{
+  uint64_t calls;
+  uint64_t errors[EWB_METRICS_ERROR_CODES];
+  uint64_t bytes_sent;
+  uint64_t bytes_received;
+  uint64_t peers;
+  uint64_t allowedips;
+  uint64_t sum_ns[EWB_METRICS_PHASES];
+  uint64_t buckets[EWB_METRICS_PHASES][EWB_METRICS_BUCKETS];
+} ewb_metrics_snapshot;
+
+uint64_t ewb_metrics_now(void);
+
+void ewb_metrics_call_begin(ewb_metrics_call *call, ewb_metrics_operation operation);
+// The error code is NULL on success.
+void ewb_metrics_call_end(ewb_metrics_call *call, const char *error_code);
+void ewb_metrics_call_pause(ewb_metrics_call *call);
+void ewb_metrics_call_resume(ewb_metrics_call *call);
+// Moves the current call of the thread into the call, paused, and returns false if the thread has no call.
+bool ewb_metrics_call_hand_off(ewb_metrics_call *call);
+// Makes the call current on the thread running its work, without counting the time as marshal time.
+void ewb_metrics_call_attach(ewb_metrics_call *call);
+void ewb_metrics_call_detach(ewb_metrics_call *call);
+
+// The functions below count to the current call of the thread, and do nothing without one.
+void ewb_metrics_record_kernel_time(uint64_t started_at);
+void ewb_metrics_record_bytes(size_t sent, size_t received);
+void ewb_metrics_record_items(uint64_t peers, uint64_t allowedips);
+
+void ewb_metrics_get_snapshot(ewb_metrics_snapshot snapshots[EWB_METRICS_OPERATIONS]);
+void ewb_metrics_reset(void);
+// The largest value in nanoseconds counted into the bucket.
+uint64_t ewb_metrics_bucket_upper_bound(size_t bucket);
+
+#endif
@@ -14,6 +14,58 @@ extern napi_status napi_utils_get_value_string(napi_env env, napi_value value, c
   return napi_ok;
 }
 
+// Gets the bytes behind an ArrayBuffer or any view of it, such as Buffer, without copying them.
+// Returns napi_arraybuffer_expected without throwing if the value is none of them.
+extern napi_status napi_utils_get_value_bytes(napi_env env, napi_value value, void **data, size_t *length)
+{
+  bool is_arraybuffer, is_typedarray, is_dataview;
+  ASSERT_NAPI_CALL(env, napi_is_arraybuffer(env, value, &is_arraybuffer), napi_generic_failure);
+  ASSERT_NAPI_CALL(env, napi_is_typedarray(env, value, &is_typedarray), napi_generic_failure);
+  ASSERT_NAPI_CALL(env, napi_is_dataview(env, value, &is_dataview), napi_generic_failure);
+
+  if (is_arraybuffer)
+  {
+    ASSERT_NAPI_CALL(env, napi_get_arraybuffer_info(env, value, data, length), napi_generic_failure);
+  }
+  else if (is_dataview)
+  {
+    ASSERT_NAPI_CALL(env, napi_get_dataview_info(env, value, length, data, NULL, NULL), napi_generic_failure);
+  }
+  else if (is_typedarray)
+  {
+    napi_typedarray_type type;
+    size_t element_count;
+    ASSERT_NAPI_CALL(env, napi_get_typedarray_info(env, value, &type, &element_count, data, NULL, NULL), napi_generic_failure);
+
+    switch (type)
+    {
+    case napi_int16_array:
+    case napi_uint16_array:
+      *length = element_count * 2;
+      break;
+    case napi_int32_array:
+    case napi_uint32_array:
+    case napi_float32_array:
+      *length = element_count * 4;
+      break;
+    case napi_float64_array:
+    case napi_bigint64_array:
+    case napi_biguint64_array:
+      *length = element_count * 8;
+      break;
+    default:
+      *length = element_count;
+      break;
+    }
+  }
+  else
+  {
+    return napi_arraybuffer_expected;
+  }
+
+  return napi_ok;
+}
+
 extern napi_status napi_utils_define_uint32_value(napi_env env, napi_value exports, char *utf8name, uint32_t source)
 {
   napi_value value;
@@ -0,0 +1,1051 @@
+#include "errno.h"
+#include "stdlib.h"
+#include "string.h"
+#include "time.h"
+#include "unistd.h"
+#include "sys/socket.h"
+#include "linux/genetlink.h"
+#include "./metrics.h"
+#include "./netlink.h"
+#include "./netns.h"
+#include "./registry.h"
+
+// The uapi header of wireguard is not available on older distributions, so we keep a copy of its enums like wireguard.c does.
+#define WG_GENL_NAME "wireguard"
+#define WG_GENL_VERSION 1
+
+enum wg_cmd
+{
+  WG_CMD_GET_DEVICE,
+  WG_CMD_SET_DEVICE
+};
+
+enum wgdevice_flag
+{
+  WGDEVICE_F_REPLACE_PEERS = 1U << 0
+};
+
+enum wgdevice_attribute
+{
+  WGDEVICE_A_UNSPEC,
+  WGDEVICE_A_IFINDEX,
+  WGDEVICE_A_IFNAME,
+  WGDEVICE_A_PRIVATE_KEY,
+  WGDEVICE_A_PUBLIC_KEY,
+  WGDEVICE_A_FLAGS,
+  WGDEVICE_A_LISTEN_PORT,
+  WGDEVICE_A_FWMARK,
+  WGDEVICE_A_PEERS
+};
+
+enum wgpeer_flag
+{
+  WGPEER_F_REMOVE_ME = 1U << 0,
+  WGPEER_F_REPLACE_ALLOWEDIPS = 1U << 1
+};
+
+enum wgpeer_attribute
+{
+  WGPEER_A_UNSPEC,
+  WGPEER_A_PUBLIC_KEY,
+  WGPEER_A_PRESHARED_KEY,
+  WGPEER_A_FLAGS,
+  WGPEER_A_ENDPOINT,
+  WGPEER_A_PERSISTENT_KEEPALIVE_INTERVAL,
+  WGPEER_A_LAST_HANDSHAKE_TIME,
+  WGPEER_A_RX_BYTES,
+  WGPEER_A_TX_BYTES,
+  WGPEER_A_ALLOWEDIPS,
+  WGPEER_A_PROTOCOL_VERSION
+};
+
+enum wgallowedip_attribute
+{
+  WGALLOWEDIP_A_UNSPEC,
+  WGALLOWEDIP_A_FAMILY,
+  WGALLOWEDIP_A_IPADDR,
+  WGALLOWEDIP_A_CIDR_MASK
+};
+
+extern struct nlmsghdr *ewb_nl_message_begin(ewb_nl_message *message, char *data, size_t capacity, uint16_t type, uint16_t flags, uint32_t seq)
+{
+  message->data = data;
+  message->capacity = capacity;
+  message->length = NLMSG_HDRLEN;
+
+  struct nlmsghdr *header = (struct nlmsghdr *)data;
+  memset(header, 0, NLMSG_HDRLEN);
+  header->nlmsg_type = type;
+  header->nlmsg_flags = flags;
+  header->nlmsg_seq = seq;
+
+  return header;
+}
+
+extern void *ewb_nl_message_reserve(ewb_nl_message *message, size_t size)
+{
+  if (message->length + NLMSG_ALIGN(size) > message->capacity)
+  {
+    return NULL;
+  }
+
+  void *reserved = message->data + message->length;
+  memset(reserved, 0, NLMSG_ALIGN(size));
+  message->length += NLMSG_ALIGN(size);
+
+  return reserved;
+}
+
+extern bool ewb_nl_message_put(ewb_nl_message *message, uint16_t type, const void *data, size_t size)
+{
+  if (message->length + NLA_HDRLEN + NLA_ALIGN(size) > message->capacity)
+  {
+    return false;
+  }
+
+  struct nlattr *attr = (struct nlattr *)(message->data + message->length);
+  attr->nla_type = type;
+  attr->nla_len = NLA_HDRLEN + size;
+  memcpy(EWB_NL_ATTR_DATA(attr), data, size);
+  memset((char *)EWB_NL_ATTR_DATA(attr) + size, 0, NLA_ALIGN(size) - size);
+  message->length += NLA_HDRLEN + NLA_ALIGN(size);
+
+  return true;
+}
+
+extern struct nlattr *ewb_nl_message_nest_start(ewb_nl_message *message, uint16_t type)
+{
+  if (message->length + NLA_HDRLEN > message->capacity)
+  {
+    return NULL;
+  }
+
+  struct nlattr *nest = (struct nlattr *)(message->data + message->length);
+  nest->nla_type = type | NLA_F_NESTED;
+  message->length += NLA_HDRLEN;
+
+  return nest;
+}
+
+extern void ewb_nl_message_nest_end(ewb_nl_message *message, struct nlattr *nest)
+{
+  nest->nla_len = (message->data + message->length) - (char *)nest;
+}
+
+extern void ewb_nl_message_nest_cancel(ewb_nl_message *message, struct nlattr *nest)
+{
+  message->length = (char *)nest - message->data;
+}
+
+extern void ewb_nl_message_end(ewb_nl_message *message)
+{
+  ((struct nlmsghdr *)message->data)->nlmsg_len = message->length;
+}
+
+extern int ewb_nl_socket_open(int protocol, uint32_t *port_id)
+{
+  int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, protocol);
+  if (fd < 0)
+  {
+    return -errno;
+  }
+
+  struct sockaddr_nl addr = {.nl_family = AF_NETLINK};
+  socklen_t addr_length = sizeof(addr);
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || getsockname(fd, (struct sockaddr *)&addr, &addr_length) < 0)
+  {
+    int ret = -errno;
+    close(fd);
+    return ret;
+  }
+
+  // We never need the request echoed back in the ack, which is large for WG_CMD_SET_DEVICE.
+  int enabled = 1;
+  setsockopt(fd, SOL_NETLINK, NETLINK_CAP_ACK, &enabled, sizeof(enabled));
+
+  *port_id = addr.nl_pid;
+
+  return fd;
+}
+
+extern int ewb_nl_send(int fd, const void *data, size_t length)
+{
+  struct sockaddr_nl addr = {.nl_family = AF_NETLINK};
+
+  for (;;)
+  {
+    ssize_t sent = sendto(fd, data, length, 0, (struct sockaddr *)&addr, sizeof(addr));
+    if (sent < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (sent < 0)
+    {
+      return -errno;
+    }
+
+    ewb_metrics_record_bytes((size_t)sent, 0);
+
+    return (size_t)sent == length ? 0 : -EMSGSIZE;
+  }
+}
+
+extern int ewb_nl_receive(int fd, char *buffer, size_t size, uint32_t seq, ewb_nl_message_callback callback, void *data)
+{
+  int callback_ret = 0;
+
+  for (;;)
+  {
+    struct iovec iov = {buffer, size};
+    struct sockaddr_nl addr;
+    struct msghdr msg = {.msg_name = &addr, .msg_namelen = sizeof(addr), .msg_iov = &iov, .msg_iovlen = 1};
+
+    ssize_t received = recvmsg(fd, &msg, 0);
+    if (received < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (received < 0)
+    {
+      return -errno;
+    }
+    ewb_metrics_record_bytes(0, (size_t)received);
+    if (msg.msg_flags & MSG_TRUNC)
+    {
+      // The rest of the message is lost, and so is the state of the socket.
+      return -ENOBUFS;
+    }
+
+    int remaining = (int)received;
+    for (struct nlmsghdr *header = (struct nlmsghdr *)buffer; NLMSG_OK(header, remaining); header = NLMSG_NEXT(header, remaining))
+    {
+      if (header->nlmsg_seq != seq || header->nlmsg_type == NLMSG_NOOP)
+      {
+        continue;
+      }
+
+      if (header->nlmsg_type == NLMSG_ERROR)
+      {
+        struct nlmsgerr *error = (struct nlmsgerr *)NLMSG_DATA(header);
+
+        return error->error ? error->error : callback_ret;
+      }
+
+      if (header->nlmsg_type == NLMSG_DONE)
+      {
+        if (header->nlmsg_len >= NLMSG_LENGTH(sizeof(int)) && *(int *)NLMSG_DATA(header) < 0)
+        {
+          return *(int *)NLMSG_DATA(header);
+        }
+
+        return callback_ret;
+      }
+
+      // We keep draining the socket after a failed callback, so the next request starts clean.
+      if (callback != NULL && callback_ret == 0)
+      {
+        callback_ret = callback(header, data);
+      }
+    }
+  }
+}
+
+static int resolve_family_callback(const struct nlmsghdr *header, void *data)
+{
+  uint16_t *family_id = (uint16_t *)data;
+
+  struct nlattr *attr;
+  int remaining;
+  ewb_nl_for_each_attr(attr, (char *)NLMSG_DATA(header) + GENL_HDRLEN, (int)header->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN), remaining)
+  {
+    if (EWB_NL_ATTR_TYPE(attr) == CTRL_ATTR_FAMILY_ID && EWB_NL_ATTR_PAYLOAD(attr) >= (int)sizeof(uint16_t))
+    {
+      memcpy(family_id, EWB_NL_ATTR_DATA(attr), sizeof(uint16_t));
+    }
+  }
+
+  return 0;
+}
+
+static struct genlmsghdr *begin_genl_message(ewb_nl_session *session, ewb_nl_message *message, uint16_t type, uint16_t flags, uint8_t cmd, uint8_t version)
+{
+  ewb_nl_message_begin(message, session->message, EWB_NL_MESSAGE_SIZE, type, flags, ++session->seq);
+
+  struct genlmsghdr *genl = (struct genlmsghdr *)ewb_nl_message_reserve(message, sizeof(struct genlmsghdr));
+  genl->cmd = cmd;
+  genl->version = version;
+
+  return genl;
+}
+
+static void disconnect_session(ewb_nl_session *session)
+{
+  if (session->fd >= 0)
+  {
+    close(session->fd);
+  }
+
+  session->fd = -1;
+  session->family_id = 0;
+}
+
+static int connect_session(ewb_nl_session *session)
+{
+  int fd = ewb_netns_socket_open(session->netns_fd, NETLINK_GENERIC, &session->port_id);
+  if (fd < 0)
+  {
+    return fd;
+  }
+  session->fd = fd;
+
+  ewb_nl_message message;
+  begin_genl_message(session, &message, GENL_ID_CTRL, NLM_F_REQUEST | NLM_F_ACK, CTRL_CMD_GETFAMILY, 1);
+  ewb_nl_message_put(&message, CTRL_ATTR_FAMILY_NAME, WG_GENL_NAME, sizeof(WG_GENL_NAME));
+  ewb_nl_message_end(&message);
+
+  uint16_t family_id = 0;
+  int ret = ewb_nl_send(fd, message.data, message.length);
+  if (!ret)
+  {
+    ret = ewb_nl_receive(fd, session->receive, EWB_NL_RECEIVE_SIZE, session->seq, resolve_family_callback, &family_id);
+  }
+  if (!ret && family_id == 0)
+  {
+    ret = -EPROTONOSUPPORT;
+  }
+  if (ret)
+  {
+    disconnect_session(session);
+    return ret;
+  }
+
+  session->family_id = family_id;
+
+  return 0;
+}
+
+// Returns true if the failure is about the socket rather than the request itself.
+static bool is_session_failure(int ret)
+{
+  switch (-ret)
+  {
+  case EBADF:
+  case ENOTCONN:
+  case ECONNREFUSED:
+  case ECONNRESET:
+  case EPIPE:
+    return true;
+  default:
+    return false;
+  }
+}
+
+extern int ewb_nl_session_init(ewb_nl_session *session)
+{
+  return ewb_nl_session_init_netns(session, -1);
+}
+
+extern int ewb_nl_session_init_netns(ewb_nl_session *session, int netns_fd)
+{
+  memset(session, 0, sizeof(ewb_nl_session));
+  session->fd = -1;
+  session->netns_fd = netns_fd;
+  session->message = malloc(EWB_NL_MESSAGE_SIZE);
+  session->receive = malloc(EWB_NL_RECEIVE_SIZE);
+  if (session->message == NULL || session->receive == NULL)
+  {
+    free(session->message);
+    free(session->receive);
+    return -ENOMEM;
+  }
+
+  pthread_mutex_init(&session->lock, NULL);
+
+  int ret = connect_session(session);
+  if (ret)
+  {
+    ewb_nl_session_destroy(session);
+  }
+
+  return ret;
+}
+
+extern void ewb_nl_session_destroy(ewb_nl_session *session)
+{
+  disconnect_session(session);
+  free(session->message);
+  free(session->receive);
+  session->message = NULL;
+  session->receive = NULL;
+  pthread_mutex_destroy(&session->lock);
+}
+
+extern void ewb_nl_session_close(ewb_nl_session *session)
+{
+  pthread_mutex_lock(&session->lock);
+  disconnect_session(session);
+  session->is_closed = true;
+  pthread_mutex_unlock(&session->lock);
+}
+
+static void free_peer(struct wg_peer *peer)
+{
+  struct wg_allowedip *allowedip = peer->first_allowedip;
+  while (allowedip != NULL)
+  {
+    struct wg_allowedip *next_allowedip = allowedip->next_allowedip;
+    free(allowedip);
+    allowedip = next_allowedip;
+  }
+
+  free(peer);
+}
+
+static void parse_allowedip(const struct nlattr *nest, struct wg_allowedip *allowedip)
+{
+  struct nlattr *attr;
+  int remaining;
+  ewb_nl_for_each_nested(attr, nest, remaining)
+  {
+    switch (EWB_NL_ATTR_TYPE(attr))
+    {
+    case WGALLOWEDIP_A_FAMILY:
+      if (EWB_NL_ATTR_PAYLOAD(attr) >= (int)sizeof(uint16_t))
+      {
+        memcpy(&allowedip->family, EWB_NL_ATTR_DATA(attr), sizeof(uint16_t));
+      }
+      break;
+    case WGALLOWEDIP_A_IPADDR:
+      if (EWB_NL_ATTR_PAYLOAD(attr) == sizeof(struct in_addr))
+      {
+        memcpy(&allowedip->ip4, EWB_NL_ATTR_DATA(attr), sizeof(struct in_addr));
+      }
+      else if (EWB_NL_ATTR_PAYLOAD(attr) == sizeof(struct in6_addr))
+      {
+        memcpy(&allowedip->ip6, EWB_NL_ATTR_DATA(attr), sizeof(struct in6_addr));
+      }
+      break;
+    case WGALLOWEDIP_A_CIDR_MASK:
+      if (EWB_NL_ATTR_PAYLOAD(attr) >= (int)sizeof(uint8_t))
+      {
+        allowedip->cidr = *(uint8_t *)EWB_NL_ATTR_DATA(attr);
+      }
+      break;
+    }
+  }
+}
+
+static int parse_peer(const struct nlattr *nest, struct wg_device *device)
+{
+  struct wg_peer *peer = calloc(1, sizeof(struct wg_peer));
+  if (peer == NULL)
+  {
+    return -ENOMEM;
+  }
+
+  struct nlattr *attr;
+  int remaining;
+  ewb_nl_for_each_nested(attr, nest, remaining)
+  {
+    void *payload = EWB_NL_ATTR_DATA(attr);
+    int payload_length = EWB_NL_ATTR_PAYLOAD(attr);
+
+    switch (EWB_NL_ATTR_TYPE(attr))
+    {
+    case WGPEER_A_PUBLIC_KEY:
+      if (payload_length == sizeof(wg_key))
+      {
+        memcpy(peer->public_key, payload, sizeof(wg_key));
+        peer->flags |= WGPEER_HAS_PUBLIC_KEY;
+      }
+      break;
+    case WGPEER_A_PRESHARED_KEY:
+      if (payload_length == sizeof(wg_key))
+      {
+        memcpy(peer->preshared_key, payload, sizeof(wg_key));
+        if (!wg_key_is_zero(peer->preshared_key))
+        {
+          peer->flags |= WGPEER_HAS_PRESHARED_KEY;
+        }
+      }
+      break;
+    case WGPEER_A_ENDPOINT:
+      if (payload_length == sizeof(struct sockaddr_in) && ((struct sockaddr *)payload)->sa_family == AF_INET)
+      {
+        memcpy(&peer->endpoint.addr4, payload, sizeof(struct sockaddr_in));
+      }
+      else if (payload_length == sizeof(struct sockaddr_in6) && ((struct sockaddr *)payload)->sa_family == AF_INET6)
+      {
+        memcpy(&peer->endpoint.addr6, payload, sizeof(struct sockaddr_in6));
+      }
+      break;
+    case WGPEER_A_PERSISTENT_KEEPALIVE_INTERVAL:
+      if (payload_length >= (int)sizeof(uint16_t))
+      {
+        memcpy(&peer->persistent_keepalive_interval, payload, sizeof(uint16_t));
+      }
+      break;
+    case WGPEER_A_LAST_HANDSHAKE_TIME:
+      if (payload_length == sizeof(struct timespec64))
+      {
+        memcpy(&peer->last_handshake_time, payload, sizeof(struct timespec64));
+      }
+      break;
+    case WGPEER_A_RX_BYTES:
+      if (payload_length >= (int)sizeof(uint64_t))
+      {
+        memcpy(&peer->rx_bytes, payload, sizeof(uint64_t));
+      }
+      break;
+    case WGPEER_A_TX_BYTES:
+      if (payload_length >= (int)sizeof(uint64_t))
+      {
+        memcpy(&peer->tx_bytes, payload, sizeof(uint64_t));
+      }
+      break;
+    case WGPEER_A_ALLOWEDIPS:
+    {
+      struct nlattr *allowedip_attr;
+      int allowedip_remaining;
+      ewb_nl_for_each_nested(allowedip_attr, attr, allowedip_remaining)
+      {
+        struct wg_allowedip *allowedip = calloc(1, sizeof(struct wg_allowedip));
+        if (allowedip == NULL)
+        {
+          free_peer(peer);
+          return -ENOMEM;
+        }
+        parse_allowedip(allowedip_attr, allowedip);
+
+        if (peer->first_allowedip == NULL)
+        {
+          peer->first_allowedip = allowedip;
+        }
+        else
+        {
+          peer->last_allowedip->next_allowedip = allowedip;
+        }
+        peer->last_allowedip = allowedip;
+      }
+      break;
+    }
+    }
+  }
+
+  // The kernel continues a peer with many allowed ips in the next message, so we coalesce them here.
+  struct wg_peer *last_peer = device->last_peer;
+  if (last_peer != NULL && memcmp(last_peer->public_key, peer->public_key, sizeof(wg_key)) == 0)
+  {
+    if (peer->first_allowedip != NULL)
+    {
+      if (last_peer->first_allowedip == NULL)
+      {
+        last_peer->first_allowedip = peer->first_allowedip;
+      }
+      else
+      {
+        last_peer->last_allowedip->next_allowedip = peer->first_allowedip;
+      }
+      last_peer->last_allowedip = peer->last_allowedip;
+    }
+
+    free(peer);
+    return 0;
+  }
+
+  if (device->first_peer == NULL)
+  {
+    device->first_peer = peer;
+  }
+  else
+  {
+    device->last_peer->next_peer = peer;
+  }
+  device->last_peer = peer;
+
+  return 0;
+}
+
+static int parse_device_callback(const struct nlmsghdr *header, void *data)
+{
+  struct wg_device *device = (struct wg_device *)data;
+
+  struct nlattr *attr;
+  int remaining;
+  ewb_nl_for_each_attr(attr, (char *)NLMSG_DATA(header) + GENL_HDRLEN, (int)header->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN), remaining)
+  {
+    void *payload = EWB_NL_ATTR_DATA(attr);
+    int payload_length = EWB_NL_ATTR_PAYLOAD(attr);
+
+    switch (EWB_NL_ATTR_TYPE(attr))
+    {
+    case WGDEVICE_A_IFINDEX:
+      if (payload_length >= (int)sizeof(uint32_t))
+      {
+        memcpy(&device->ifindex, payload, sizeof(uint32_t));
+      }
+      break;
+    case WGDEVICE_A_IFNAME:
+      strncpy(device->name, (char *)payload, payload_length < IFNAMSIZ ? payload_length : IFNAMSIZ - 1);
+      break;
+    case WGDEVICE_A_PRIVATE_KEY:
+      if (payload_length == sizeof(wg_key))
+      {
+        memcpy(device->private_key, payload, sizeof(wg_key));
+        device->flags |= WGDEVICE_HAS_PRIVATE_KEY;
+      }
+      break;
+    case WGDEVICE_A_PUBLIC_KEY:
+      if (payload_length == sizeof(wg_key))
+      {
+        memcpy(device->public_key, payload, sizeof(wg_key));
+        device->flags |= WGDEVICE_HAS_PUBLIC_KEY;
+      }
+      break;
+    case WGDEVICE_A_LISTEN_PORT:
+      if (payload_length >= (int)sizeof(uint16_t))
+      {
+        memcpy(&device->listen_port, payload, sizeof(uint16_t));
+      }
+      break;
+    case WGDEVICE_A_FWMARK:
+      if (payload_length >= (int)sizeof(uint32_t))
+      {
+        memcpy(&device->fwmark, payload, sizeof(uint32_t));
+      }
+      break;
+    case WGDEVICE_A_PEERS:
+    {
+      struct nlattr *peer_attr;
+      int peer_remaining;
+      ewb_nl_for_each_nested(peer_attr, attr, peer_remaining)
+      {
+        int ret = parse_peer(peer_attr, device);
+        if (ret)
+        {
+          return ret;
+        }
+      }
+      break;
+    }
+    }
+  }
+
+  return 0;
+}
+
+static int get_device_by(ewb_nl_session *session, struct wg_device **device, const char *device_name, uint32_t ifindex)
+{
+  ewb_nl_message message;
+  begin_genl_message(session, &message, session->family_id, NLM_F_REQUEST | NLM_F_ACK | NLM_F_DUMP, WG_CMD_GET_DEVICE, WG_GENL_VERSION);
+  if (ifindex != 0)
+  {
+    ewb_nl_message_put(&message, WGDEVICE_A_IFINDEX, &ifindex, sizeof(ifindex));
+  }
+  else
+  {
+    ewb_nl_message_put(&message, WGDEVICE_A_IFNAME, device_name, strnlen(device_name, IFNAMSIZ - 1) + 1);
+  }
+  ewb_nl_message_end(&message);
+
+  int ret = ewb_nl_send(session->fd, message.data, message.length);
+  if (ret)
+  {
+    return ret;
+  }
+
+  struct wg_device *result = calloc(1, sizeof(struct wg_device));
+  if (result == NULL)
+  {
+    return -ENOMEM;
+  }
+
+  ret = ewb_nl_receive(session->fd, session->receive, EWB_NL_RECEIVE_SIZE, session->seq, parse_device_callback, result);
+  if (ret)
+  {
+    wg_free_device(result);
+    return ret;
+  }
+
+  *device = result;
+
+  return 0;
+}
+
+static int get_device(ewb_nl_session *session, struct wg_device **device, const char *device_name)
+{
+  // The registry saves the kernel from resolving the name, but may lag behind it, so a stale ifindex is asked again by the name.
+  // The registry watches the namespace of the process only, so the session in another namespace always goes by the name.
+  uint32_t ifindex = session->netns_fd < 0 ? ewb_registry_get_ifindex(device_name) : 0;
+  if (ifindex != 0)
+  {
+    int ret = get_device_by(session, device, device_name, ifindex);
+    if (!ret && strncmp((*device)->name, device_name, IFNAMSIZ) == 0)
+    {
+      return 0;
+    }
+    if (!ret)
+    {
+      wg_free_device(*device);
+      *device = NULL;
+    }
+    else if (ret != -ENODEV && ret != -EOPNOTSUPP)
+    {
+      return ret;
+    }
+  }
+
+  return get_device_by(session, device, device_name, 0);
+}
+
+static bool put_set_device_header(ewb_nl_session *session, ewb_nl_message *message, const struct wg_device *device, bool is_first)
+{
+  begin_genl_message(session, message, session->family_id, NLM_F_REQUEST | NLM_F_ACK, WG_CMD_SET_DEVICE, WG_GENL_VERSION);
+  if (!ewb_nl_message_put(message, WGDEVICE_A_IFNAME, device->name, strnlen(device->name, IFNAMSIZ - 1) + 1))
+  {
+    return false;
+  }
+
+  // The device properties only go into the first message, the following ones only continue the peers.
+  if (!is_first)
+  {
+    return true;
+  }
+
+  uint32_t flags = 0;
+  if (device->flags & WGDEVICE_REPLACE_PEERS)
+  {
+    flags |= WGDEVICE_F_REPLACE_PEERS;
+  }
+
+  return (
+    (!flags || ewb_nl_message_put(message, WGDEVICE_A_FLAGS, &flags, sizeof(flags))) &&
+    (!(device->flags & WGDEVICE_HAS_PRIVATE_KEY) || ewb_nl_message_put(message, WGDEVICE_A_PRIVATE_KEY, device->private_key, sizeof(wg_key))) &&
+    (!(device->flags & WGDEVICE_HAS_LISTEN_PORT) || ewb_nl_message_put(message, WGDEVICE_A_LISTEN_PORT, &device->listen_port, sizeof(uint16_t))) &&
+    (!(device->flags & WGDEVICE_HAS_FWMARK) || ewb_nl_message_put(message, WGDEVICE_A_FWMARK, &device->fwmark, sizeof(uint32_t)))
+  );
+}
+
+static bool put_peer_header(ewb_nl_message *message, const struct wg_peer *peer, bool is_continuation)
+{
+  if (!ewb_nl_message_put(message, WGPEER_A_PUBLIC_KEY, peer->public_key, sizeof(wg_key)))
+  {
+    return false;
+  }
+
+  // The continuation of a peer should not replace the allowed ips we sent in the previous message.
+  if (is_continuation)
+  {
+    return true;
+  }
+
+  uint32_t flags = 0;
+  if (peer->flags & WGPEER_REMOVE_ME)
+  {
+    flags |= WGPEER_F_REMOVE_ME;
+  }
+  if (peer->flags & WGPEER_REPLACE_ALLOWEDIPS)
+  {
+    flags |= WGPEER_F_REPLACE_ALLOWEDIPS;
+  }
+
+  size_t endpoint_size = 0;
+  if (peer->endpoint.addr.sa_family == AF_INET)
+  {
+    endpoint_size = sizeof(struct sockaddr_in);
+  }
+  else if (peer->endpoint.addr.sa_family == AF_INET6)
+  {
+    endpoint_size = sizeof(struct sockaddr_in6);
+  }
+
+  return (
+    (!flags || ewb_nl_message_put(message, WGPEER_A_FLAGS, &flags, sizeof(flags))) &&
+    (!(peer->flags & WGPEER_HAS_PRESHARED_KEY) || ewb_nl_message_put(message, WGPEER_A_PRESHARED_KEY, peer->preshared_key, sizeof(wg_key))) &&
+    (!endpoint_size || ewb_nl_message_put(message, WGPEER_A_ENDPOINT, &peer->endpoint, endpoint_size)) &&
+    (!(peer->flags & WGPEER_HAS_PERSISTENT_KEEPALIVE_INTERVAL) || ewb_nl_message_put(message, WGPEER_A_PERSISTENT_KEEPALIVE_INTERVAL, &peer->persistent_keepalive_interval, sizeof(uint16_t)))
+  );
+}
+
+static bool put_allowedip(ewb_nl_message *message, const struct wg_allowedip *allowedip)
+{
+  size_t checkpoint = message->length;
+
+  struct nlattr *nest = ewb_nl_message_nest_start(message, 0);
+  if (
+    nest == NULL ||
+    !ewb_nl_message_put(message, WGALLOWEDIP_A_FAMILY, &allowedip->family, sizeof(uint16_t)) ||
+    !ewb_nl_message_put(message, WGALLOWEDIP_A_IPADDR, &allowedip->ip6, allowedip->family == AF_INET6 ? sizeof(struct in6_addr) : sizeof(struct in_addr)) ||
+    !ewb_nl_message_put(message, WGALLOWEDIP_A_CIDR_MASK, &allowedip->cidr, sizeof(uint8_t))
+  )
+  {
+    message->length = checkpoint;
+    return false;
+  }
+
+  ewb_nl_message_nest_end(message, nest);
+
+  return true;
+}
+
+// Called with every message built for the device, which sends it to the kernel or hands it to the loopback.
+typedef int (*set_device_flush)(ewb_nl_session *session, ewb_nl_message *message, void *data);
+
+static int encode_set_device(ewb_nl_session *session, struct wg_device *device, set_device_flush flush, void *data)
+{
+  ewb_nl_message message;
+  struct wg_peer *peer = device->first_peer;
+  struct wg_allowedip *allowedip = NULL;
+  bool is_first = true;
+
+  for (;;)
+  {
+    if (!put_set_device_header(session, &message, device, is_first))
+    {
+      return -EMSGSIZE;
+    }
+    is_first = false;
+
+    bool is_full = false;
+    if (peer != NULL)
+    {
+      struct nlattr *peers_nest = ewb_nl_message_nest_start(&message, WGDEVICE_A_PEERS);
+      if (peers_nest == NULL)
+      {
+        return -EMSGSIZE;
+      }
+      size_t peers_start = message.length;
+
+      // The allowedip pointer is not NULL only if we are continuing the peer from the previous message.
+      for (; peer != NULL; peer = peer->next_peer, allowedip = NULL)
+      {
+        size_t checkpoint = message.length;
+        bool is_continuation = allowedip != NULL;
+
+        struct nlattr *peer_nest = ewb_nl_message_nest_start(&message, 0);
+        if (peer_nest == NULL || !put_peer_header(&message, peer, is_continuation))
+        {
+          message.length = checkpoint;
+          is_full = true;
+          break;
+        }
+
+        if (!(peer->flags & WGPEER_REMOVE_ME) && (is_continuation || peer->first_allowedip != NULL))
+        {
+          if (!is_continuation)
+          {
+            allowedip = peer->first_allowedip;
+          }
+
+          struct nlattr *allowedips_nest = ewb_nl_message_nest_start(&message, WGPEER_A_ALLOWEDIPS);
+          if (allowedips_nest == NULL)
+          {
+            if (is_continuation)
+            {
+              message.length = checkpoint;
+            }
+            is_full = true;
+          }
+          else
+          {
+            struct wg_allowedip *first_allowedip = allowedip;
+            for (; allowedip != NULL; allowedip = allowedip->next_allowedip)
+            {
+              if (!put_allowedip(&message, allowedip))
+              {
+                is_full = true;
+                break;
+              }
+            }
+
+            if (is_continuation && allowedip == first_allowedip)
+            {
+              // Nothing new for the peer fits in this message, so we leave it to the next one.
+              message.length = checkpoint;
+            }
+            else
+            {
+              ewb_nl_message_nest_end(&message, allowedips_nest);
+            }
+          }
+        }
+
+        if (message.length > checkpoint)
+        {
+          ewb_nl_message_nest_end(&message, peer_nest);
+        }
+        if (is_full)
+        {
+          // We continue the peer from the first allowed ip that did not fit.
+          break;
+        }
+      }
+
+      if (is_full && message.length == peers_start)
+      {
+        return -EMSGSIZE;
+      }
+      ewb_nl_message_nest_end(&message, peers_nest);
+    }
+
+    ewb_nl_message_end(&message);
+
+    int ret = flush(session, &message, data);
+    if (ret || !is_full)
+    {
+      return ret;
+    }
+  }
+}
+
+// Counts the messages acked by the kernel in data, so we know whether the device was already changed.
+static int send_set_device_message(ewb_nl_session *session, ewb_nl_message *message, void *data)
+{
+  size_t *acked = (size_t *)data;
+
+  int ret = ewb_nl_send(session->fd, message->data, message->length);
+  if (!ret)
+  {
+    ret = ewb_nl_receive(session->fd, session->receive, EWB_NL_RECEIVE_SIZE, session->seq, NULL, NULL);
+  }
+  if (!ret)
+  {
+    (*acked)++;
+  }
+
+  return ret;
+}
+
+static int set_device(ewb_nl_session *session, struct wg_device *device, size_t *acked)
+{
+  *acked = 0;
+
+  return encode_set_device(session, device, send_set_device_message, acked);
+}
+
+static uint64_t get_monotonic_ns(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+typedef struct
+{
+  struct wg_device *result;
+  ewb_nl_loopback_stats *stats;
+} loopback_context;
+
+// The set messages share the attributes of the dump, so we decode them as the kernel would answer them.
+static int decode_set_device_message(ewb_nl_session *session, ewb_nl_message *message, void *data)
+{
+  loopback_context *context = (loopback_context *)data;
+  uint64_t start = get_monotonic_ns();
+
+  int ret = parse_device_callback((const struct nlmsghdr *)message->data, context->result);
+
+  context->stats->decode_ns += get_monotonic_ns() - start;
+  context->stats->messages++;
+  context->stats->bytes += message->length;
+
+  return ret;
+}
+
+extern int ewb_nl_loopback_device(struct wg_device *device, struct wg_device **result, ewb_nl_loopback_stats *stats)
+{
+  memset(stats, 0, sizeof(ewb_nl_loopback_stats));
+
+  ewb_nl_session session = {.fd = -1};
+  session.message = malloc(EWB_NL_MESSAGE_SIZE);
+  loopback_context context = {.result = calloc(1, sizeof(struct wg_device)), .stats = stats};
+  if (session.message == NULL || context.result == NULL)
+  {
+    free(session.message);
+    free(context.result);
+    return -ENOMEM;
+  }
+
+  uint64_t start = get_monotonic_ns();
+  int ret = encode_set_device(&session, device, decode_set_device_message, &context);
+  stats->encode_ns = get_monotonic_ns() - start - stats->decode_ns;
+
+  free(session.message);
+
+  if (ret)
+  {
+    wg_free_device(context.result);
+    return ret;
+  }
+
+  *result = context.result;
+
+  return 0;
+}
+
+extern int ewb_nl_session_get_device(ewb_nl_session *session, struct wg_device **device, const char *device_name)
+{
+  pthread_mutex_lock(&session->lock);
+
+  if (session->is_closed)
+  {
+    pthread_mutex_unlock(&session->lock);
+    return -ESHUTDOWN;
+  }
+
+  // We reconnect once if the socket is gone, e.g. by the kernel module being reloaded.
+  int ret = session->fd < 0 ? connect_session(session) : 0;
+  if (!ret)
+  {
+    ret = get_device(session, device, device_name);
+  }
+  if (is_session_failure(ret))
+  {
+    disconnect_session(session);
+    ret = connect_session(session);
+    if (!ret)
+    {
+      ret = get_device(session, device, device_name);
+    }
+  }
+
+  pthread_mutex_unlock(&session->lock);
+
+  return ret;
+}
+
+extern int ewb_nl_session_set_device(ewb_nl_session *session, struct wg_device *device)
+{
+  pthread_mutex_lock(&session->lock);
+
+  if (session->is_closed)
+  {
+    pthread_mutex_unlock(&session->lock);
+    return -ESHUTDOWN;
+  }
+
+  // We reconnect once if the socket is gone, e.g. by the kernel module being reloaded.
+  // The request is sent again only if no message of it was applied, since the later messages only append to the first.
+  size_t acked = 0;
+  int ret = session->fd < 0 ? connect_session(session) : 0;
+  if (!ret)
+  {
+    ret = set_device(session, device, &acked);
+  }
+  if (is_session_failure(ret))
+  {
+    disconnect_session(session);
+    if (acked == 0)
+    {
+      ret = connect_session(session);
+      if (!ret)
+      {
+        ret = set_device(session, device, &acked);
+      }
+    }
+  }
+
+  pthread_mutex_unlock(&session->lock);
+
+  return ret;
+}
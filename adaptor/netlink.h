@@ -0,0 +1,93 @@
+#ifndef EWB_NETLINK_H
+#define EWB_NETLINK_H
+
+#include "stdbool.h"
+#include "stddef.h"
+#include "stdint.h"
+#include "pthread.h"
+#include "linux/netlink.h"
+#include "../externs/wireguard-tools/contrib/embeddable-wg-library/wireguard.h"
+
+// The size of the message we build before splitting the request into another message.
+#define EWB_NL_MESSAGE_SIZE 32768
+// The kernel will never send a dump message larger than 32KiB, so this is enough to receive anything.
+#define EWB_NL_RECEIVE_SIZE 32768
+
+typedef struct
+{
+  char *data;
+  size_t capacity;
+  size_t length;
+} ewb_nl_message;
+
+// Called for every message in a reply that is not an ack, done or error message.
+typedef int (*ewb_nl_message_callback)(const struct nlmsghdr *header, void *data);
+
+#define EWB_NL_ATTR_TYPE(attr) ((attr)->nla_type & NLA_TYPE_MASK)
+#define EWB_NL_ATTR_DATA(attr) ((void *)((char *)(attr) + NLA_HDRLEN))
+#define EWB_NL_ATTR_PAYLOAD(attr) ((int)(attr)->nla_len - NLA_HDRLEN)
+
+static inline bool ewb_nl_attr_ok(const struct nlattr *attr, int remaining)
+{
+  return remaining >= (int)sizeof(struct nlattr) && attr->nla_len >= sizeof(struct nlattr) && (int)attr->nla_len <= remaining;
+}
+
+static inline struct nlattr *ewb_nl_attr_next(const struct nlattr *attr, int *remaining)
+{
+  *remaining -= NLA_ALIGN(attr->nla_len);
+  return (struct nlattr *)((char *)attr + NLA_ALIGN(attr->nla_len));
+}
+
+#define ewb_nl_for_each_attr(attr, start, length, remaining) \
+  for ((remaining) = (length), (attr) = (struct nlattr *)(start); ewb_nl_attr_ok((attr), (remaining)); (attr) = ewb_nl_attr_next((attr), &(remaining)))
+#define ewb_nl_for_each_nested(attr, nest, remaining) \
+  ewb_nl_for_each_attr(attr, EWB_NL_ATTR_DATA(nest), EWB_NL_ATTR_PAYLOAD(nest), remaining)
+
+struct nlmsghdr *ewb_nl_message_begin(ewb_nl_message *message, char *data, size_t capacity, uint16_t type, uint16_t flags, uint32_t seq);
+void *ewb_nl_message_reserve(ewb_nl_message *message, size_t size);
+bool ewb_nl_message_put(ewb_nl_message *message, uint16_t type, const void *data, size_t size);
+struct nlattr *ewb_nl_message_nest_start(ewb_nl_message *message, uint16_t type);
+void ewb_nl_message_nest_end(ewb_nl_message *message, struct nlattr *nest);
+void ewb_nl_message_nest_cancel(ewb_nl_message *message, struct nlattr *nest);
+void ewb_nl_message_end(ewb_nl_message *message);
+
+int ewb_nl_socket_open(int protocol, uint32_t *port_id);
+int ewb_nl_send(int fd, const void *data, size_t length);
+int ewb_nl_receive(int fd, char *buffer, size_t size, uint32_t seq, ewb_nl_message_callback callback, void *data);
+
+// The generic netlink session keeps a socket and the resolved family id of wireguard across calls.
+// The functions below are serialized by the lock, so a session can be shared with the thread pool.
+typedef struct
+{
+  int fd;
+  // The namespace the socket is opened in again on a reconnect, or -1 for the one of the caller, owned by the caller.
+  int netns_fd;
+  uint16_t family_id;
+  uint32_t port_id;
+  uint32_t seq;
+  char *message;
+  char *receive;
+  bool is_closed;
+  pthread_mutex_t lock;
+} ewb_nl_session;
+
+int ewb_nl_session_init(ewb_nl_session *session);
+int ewb_nl_session_init_netns(ewb_nl_session *session, int netns_fd);
+void ewb_nl_session_destroy(ewb_nl_session *session);
+void ewb_nl_session_close(ewb_nl_session *session);
+int ewb_nl_session_get_device(ewb_nl_session *session, struct wg_device **device, const char *device_name);
+int ewb_nl_session_set_device(ewb_nl_session *session, struct wg_device *device);
+
+typedef struct
+{
+  uint64_t messages;
+  uint64_t bytes;
+  uint64_t encode_ns;
+  uint64_t decode_ns;
+} ewb_nl_loopback_stats;
+
+// Encodes the device into the messages of setDevice and decodes them back into a new device without a socket.
+// This stands in for the kernel to measure the netlink encoding alone.
+int ewb_nl_loopback_device(struct wg_device *device, struct wg_device **result, ewb_nl_loopback_stats *stats);
+
+#endif
@@ -0,0 +1,70 @@
+#include "errno.h"
+#include "fcntl.h"
+#include "pthread.h"
+#include "sched.h"
+#include "unistd.h"
+#include "./netlink.h"
+#include "./netns.h"
+
+typedef struct
+{
+  int netns_fd;
+  int protocol;
+  uint32_t port_id;
+  int ret;
+} socket_request;
+
+static void *open_socket_in_netns(void *data)
+{
+  socket_request *request = (socket_request *)data;
+
+  // The thread ends right after, so the namespace of the other threads is never touched.
+  if (setns(request->netns_fd, CLONE_NEWNET) < 0)
+  {
+    request->ret = -errno;
+    return NULL;
+  }
+
+  request->ret = ewb_nl_socket_open(request->protocol, &request->port_id);
+
+  return NULL;
+}
+
+extern int ewb_netns_open(const char *path)
+{
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+  return fd < 0 ? -errno : fd;
+}
+
+extern int ewb_netns_dup(int fd)
+{
+  int duplicated = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+
+  return duplicated < 0 ? -errno : duplicated;
+}
+
+extern int ewb_netns_socket_open(int netns_fd, int protocol, uint32_t *port_id)
+{
+  if (netns_fd < 0)
+  {
+    return ewb_nl_socket_open(protocol, port_id);
+  }
+
+  socket_request request = {.netns_fd = netns_fd, .protocol = protocol};
+
+  pthread_t thread;
+  int ret = pthread_create(&thread, NULL, open_socket_in_netns, &request);
+  if (ret)
+  {
+    return -ret;
+  }
+  pthread_join(thread, NULL);
+
+  if (request.ret >= 0)
+  {
+    *port_id = request.port_id;
+  }
+
+  return request.ret;
+}
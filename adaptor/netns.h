@@ -0,0 +1,14 @@
+#ifndef EWB_NETNS_H
+#define EWB_NETNS_H
+
+#include "stdint.h"
+
+// The network namespaces, given by a path such as /run/netns/name or /proc/<pid>/ns/net, or by an fd of one.
+// Opens the namespace of the path, or duplicates the fd, into an fd owned by the caller, returning -errno on failure.
+int ewb_netns_open(const char *path);
+int ewb_netns_dup(int fd);
+// Opens the netlink socket in the namespace, or in the namespace of the caller if the fd is negative.
+// The socket stays in the namespace it was opened in, so any thread can use it afterwards without entering the namespace.
+int ewb_netns_socket_open(int netns_fd, int protocol, uint32_t *port_id);
+
+#endif
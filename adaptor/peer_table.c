@@ -0,0 +1,142 @@
+#include "errno.h"
+#include "stdlib.h"
+#include "string.h"
+#include "./peer_table.h"
+
+static size_t get_slot(const ewb_peer_table *table, const wg_key key)
+{
+  uint64_t hash;
+  memcpy(&hash, key, sizeof(hash));
+
+  return (size_t)(hash * 0x9e3779b97f4a7c15ULL) & (table->capacity - 1);
+}
+
+static size_t find_slot(const ewb_peer_table *table, const wg_key key)
+{
+  size_t slot = get_slot(table, key);
+  while (table->values[slot] != NULL && memcmp(table->keys[slot], key, sizeof(wg_key)) != 0)
+  {
+    slot = (slot + 1) & (table->capacity - 1);
+  }
+
+  return slot;
+}
+
+static int allocate_table(ewb_peer_table *table, size_t capacity)
+{
+  table->keys = malloc(capacity * sizeof(wg_key));
+  table->values = calloc(capacity, sizeof(void *));
+  if (table->keys == NULL || table->values == NULL)
+  {
+    free(table->keys);
+    free(table->values);
+    return -ENOMEM;
+  }
+
+  table->capacity = capacity;
+  table->size = 0;
+
+  return 0;
+}
+
+extern int ewb_peer_table_init(ewb_peer_table *table, size_t expected_size)
+{
+  // We keep the load factor under a half, so the probing stays short.
+  size_t capacity = 16;
+  while (capacity < expected_size * 2)
+  {
+    capacity <<= 1;
+  }
+
+  return allocate_table(table, capacity);
+}
+
+extern void ewb_peer_table_destroy(ewb_peer_table *table)
+{
+  free(table->keys);
+  free(table->values);
+  table->keys = NULL;
+  table->values = NULL;
+  table->capacity = 0;
+  table->size = 0;
+}
+
+extern void *ewb_peer_table_get(const ewb_peer_table *table, const wg_key key)
+{
+  return table->values[find_slot(table, key)];
+}
+
+static int grow_table(ewb_peer_table *table)
+{
+  ewb_peer_table grown;
+  int ret = allocate_table(&grown, table->capacity << 1);
+  if (ret)
+  {
+    return ret;
+  }
+
+  size_t index;
+  ewb_peer_table_for_each(table, index)
+  {
+    size_t slot = find_slot(&grown, table->keys[index]);
+    memcpy(grown.keys[slot], table->keys[index], sizeof(wg_key));
+    grown.values[slot] = table->values[index];
+    grown.size++;
+  }
+
+  ewb_peer_table_destroy(table);
+  *table = grown;
+
+  return 0;
+}
+
+extern int ewb_peer_table_set(ewb_peer_table *table, const wg_key key, void *value)
+{
+  if ((table->size + 1) * 2 > table->capacity)
+  {
+    int ret = grow_table(table);
+    if (ret)
+    {
+      return ret;
+    }
+  }
+
+  size_t slot = find_slot(table, key);
+  if (table->values[slot] == NULL)
+  {
+    memcpy(table->keys[slot], key, sizeof(wg_key));
+    table->size++;
+  }
+  table->values[slot] = value;
+
+  return 0;
+}
+
+extern void *ewb_peer_table_remove(ewb_peer_table *table, const wg_key key)
+{
+  size_t slot = find_slot(table, key);
+  void *value = table->values[slot];
+  if (value == NULL)
+  {
+    return NULL;
+  }
+
+  // We shift the following entries back instead of leaving a tombstone, so lookups never slow down over time.
+  size_t mask = table->capacity - 1;
+  size_t hole = slot;
+  for (size_t next = (hole + 1) & mask; table->values[next] != NULL; next = (next + 1) & mask)
+  {
+    size_t home = get_slot(table, table->keys[next]);
+    if (((next - home) & mask) >= ((next - hole) & mask))
+    {
+      memcpy(table->keys[hole], table->keys[next], sizeof(wg_key));
+      table->values[hole] = table->values[next];
+      hole = next;
+    }
+  }
+
+  table->values[hole] = NULL;
+  table->size--;
+
+  return value;
+}
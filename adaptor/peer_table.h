@@ -0,0 +1,29 @@
+#ifndef EWB_PEER_TABLE_H
+#define EWB_PEER_TABLE_H
+
+#include "stddef.h"
+#include "stdint.h"
+#include "../externs/wireguard-tools/contrib/embeddable-wg-library/wireguard.h"
+
+// The open addressing hash table keyed by the public key of peers.
+// Public keys are uniformly random, so we take the first bytes of the key as the hash.
+typedef struct
+{
+  wg_key *keys;
+  void **values;
+  size_t capacity;
+  size_t size;
+} ewb_peer_table;
+
+int ewb_peer_table_init(ewb_peer_table *table, size_t expected_size);
+void ewb_peer_table_destroy(ewb_peer_table *table);
+void *ewb_peer_table_get(const ewb_peer_table *table, const wg_key key);
+int ewb_peer_table_set(ewb_peer_table *table, const wg_key key, void *value);
+void *ewb_peer_table_remove(ewb_peer_table *table, const wg_key key);
+
+// Iterates every occupied slot; the table should not be modified in the loop.
+#define ewb_peer_table_for_each(__table, __index) \
+  for ((__index) = 0; (__index) < (__table)->capacity; (__index)++) \
+    if ((__table)->values[(__index)] != NULL)
+
+#endif
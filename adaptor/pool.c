@@ -0,0 +1,328 @@
+#include "errno.h"
+#include "stdbool.h"
+#include "stdlib.h"
+#include "string.h"
+#include "./pool.h"
+
+static size_t get_address_bits(uint16_t family)
+{
+  return family == AF_INET6 ? 128 : 32;
+}
+
+static int get_address_bit(const uint8_t *addr, size_t bit)
+{
+  return (addr[bit / 8] >> (7 - bit % 8)) & 1;
+}
+
+static size_t get_host_bits(const ewb_pool *pool)
+{
+  return (size_t)__builtin_ctzll(pool->size);
+}
+
+// Checks the first bits of the address against the prefix of the pool.
+static bool is_matching_prefix(const ewb_pool *pool, const uint8_t *addr, size_t cidr)
+{
+  for (size_t bit = 0; bit < cidr && bit < pool->cidr; bit++)
+  {
+    if (get_address_bit(addr, bit) != get_address_bit(pool->base, bit))
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Gets the offset of the address masked by the prefix length in the pool, or -ERANGE if it's out of the pool.
+static int64_t get_offset(const ewb_pool *pool, const uint8_t *addr, size_t cidr)
+{
+  size_t address_bits = get_address_bits(pool->family);
+  size_t window_start = address_bits - get_host_bits(pool);
+
+  if (!is_matching_prefix(pool, addr, cidr))
+  {
+    return -ERANGE;
+  }
+
+  int64_t offset = 0;
+  for (size_t bit = pool->cidr; bit < address_bits && bit < cidr; bit++)
+  {
+    if (bit < window_start)
+    {
+      // The pool covers only the start of large prefixes, so the bits before the window should be zero.
+      if (get_address_bit(addr, bit))
+      {
+        return -ERANGE;
+      }
+      continue;
+    }
+
+    offset |= (int64_t)get_address_bit(addr, bit) << (address_bits - 1 - bit);
+  }
+
+  return offset;
+}
+
+// The first address is the network of ipv4 and the subnet router anycast of ipv6, and the last is the broadcast of ipv4.
+static bool is_reserved(const ewb_pool *pool, uint64_t offset)
+{
+  if (get_address_bits(pool->family) - pool->cidr < 2)
+  {
+    return false;
+  }
+
+  return offset == 0 || (pool->family == AF_INET && offset == pool->size - 1);
+}
+
+static void set_address_from_offset(const ewb_pool *pool, uint64_t offset, uint8_t *addr)
+{
+  size_t address_size = get_address_bits(pool->family) / 8;
+
+  memcpy(addr, pool->base, address_size);
+  for (size_t index = address_size; index > 0 && offset != 0; index--)
+  {
+    addr[index - 1] |= (uint8_t)(offset & 0xff);
+    offset >>= 8;
+  }
+}
+
+static bool is_taken(const ewb_pool *pool, uint64_t offset)
+{
+  return (pool->words[offset / 64] >> (offset % 64)) & 1;
+}
+
+static void take(ewb_pool *pool, uint64_t offset)
+{
+  size_t word = offset / 64;
+
+  pool->words[word] |= 1ULL << (offset % 64);
+  if (pool->words[word] == UINT64_MAX)
+  {
+    pool->full_words[word / 64] |= 1ULL << (word % 64);
+  }
+  pool->available--;
+}
+
+static void give_back(ewb_pool *pool, uint64_t offset)
+{
+  size_t word = offset / 64;
+
+  pool->words[word] &= ~(1ULL << (offset % 64));
+  pool->full_words[word / 64] &= ~(1ULL << (word % 64));
+  pool->available++;
+}
+
+extern int ewb_pool_init(ewb_pool *pool, uint16_t family, const void *addr, uint8_t cidr)
+{
+  memset(pool, 0, sizeof(ewb_pool));
+
+  if ((family != AF_INET && family != AF_INET6) || cidr > get_address_bits(family))
+  {
+    return -EINVAL;
+  }
+
+  size_t host_bits = get_address_bits(family) - cidr;
+  if (host_bits > EWB_POOL_MAX_HOST_BITS)
+  {
+    host_bits = EWB_POOL_MAX_HOST_BITS;
+  }
+
+  pool->family = family;
+  pool->cidr = cidr;
+  pool->size = 1ULL << host_bits;
+  pool->word_count = (pool->size + 63) / 64;
+
+  // The base is the masked prefix, so the addresses are the base with the offset in the host bits.
+  for (size_t bit = 0; bit < cidr; bit++)
+  {
+    if (get_address_bit(addr, bit))
+    {
+      pool->base[bit / 8] |= 0x80 >> (bit % 8);
+    }
+  }
+
+  size_t summary_count = (pool->word_count + 63) / 64;
+  pool->words = calloc(pool->word_count, sizeof(uint64_t));
+  pool->full_words = calloc(summary_count, sizeof(uint64_t));
+  if (pool->words == NULL || pool->full_words == NULL)
+  {
+    ewb_pool_destroy(pool);
+    return -ENOMEM;
+  }
+
+  // The bits past the end are taken from the start, so the allocator never looks at the size.
+  if (pool->size % 64 != 0)
+  {
+    pool->words[0] = ~((1ULL << pool->size) - 1);
+  }
+  for (size_t word = pool->word_count; word < summary_count * 64; word++)
+  {
+    pool->full_words[word / 64] |= 1ULL << (word % 64);
+  }
+  pool->available = pool->size;
+
+  if (is_reserved(pool, 0))
+  {
+    take(pool, 0);
+  }
+  if (is_reserved(pool, pool->size - 1))
+  {
+    take(pool, pool->size - 1);
+  }
+
+  return 0;
+}
+
+extern void ewb_pool_destroy(ewb_pool *pool)
+{
+  free(pool->words);
+  free(pool->full_words);
+  pool->words = NULL;
+  pool->full_words = NULL;
+  pool->word_count = 0;
+  pool->size = 0;
+  pool->available = 0;
+}
+
+static int64_t find_free_word(const ewb_pool *pool)
+{
+  size_t summary_count = (pool->word_count + 63) / 64;
+  size_t start = pool->cursor / 64;
+
+  // We continue from the last word allocated, so the released addresses are not given out again right away.
+  for (size_t step = 0; step <= summary_count; step++)
+  {
+    size_t index = (start + step) % summary_count;
+    uint64_t free_words = ~pool->full_words[index];
+    if (step == 0)
+    {
+      free_words &= UINT64_MAX << (pool->cursor % 64);
+    }
+    else if (step == summary_count)
+    {
+      free_words &= ~(UINT64_MAX << (pool->cursor % 64));
+    }
+
+    if (free_words != 0)
+    {
+      return (int64_t)(index * 64 + (size_t)__builtin_ctzll(free_words));
+    }
+  }
+
+  return -ENOSPC;
+}
+
+extern int ewb_pool_allocate(ewb_pool *pool, void *addr)
+{
+  if (pool->available == 0)
+  {
+    return -ENOSPC;
+  }
+
+  int64_t word = find_free_word(pool);
+  if (word < 0)
+  {
+    return (int)word;
+  }
+
+  uint64_t offset = (uint64_t)word * 64 + (uint64_t)__builtin_ctzll(~pool->words[word]);
+  take(pool, offset);
+  pool->cursor = (size_t)word;
+
+  set_address_from_offset(pool, offset, addr);
+
+  return 0;
+}
+
+// Releases a taken address, or returns -EINVAL if the address is not one the pool could have given out.
+extern int ewb_pool_release(ewb_pool *pool, const void *addr)
+{
+  int64_t offset = get_offset(pool, addr, get_address_bits(pool->family));
+  if (offset < 0 || (uint64_t)offset >= pool->size || is_reserved(pool, (uint64_t)offset))
+  {
+    return -EINVAL;
+  }
+  if (!is_taken(pool, (uint64_t)offset))
+  {
+    return -ENOENT;
+  }
+
+  give_back(pool, (uint64_t)offset);
+
+  return 0;
+}
+
+// Takes every address of the prefix in the pool, and returns the count of the addresses taken by this call.
+extern int64_t ewb_pool_reserve(ewb_pool *pool, uint16_t family, const void *addr, uint8_t cidr)
+{
+  size_t address_bits = get_address_bits(family);
+  if ((family != AF_INET && family != AF_INET6) || cidr > address_bits)
+  {
+    return -EINVAL;
+  }
+  if (family != pool->family)
+  {
+    return 0;
+  }
+
+  uint64_t start, end;
+  if (cidr <= pool->cidr)
+  {
+    if (!is_matching_prefix(pool, addr, cidr))
+    {
+      return 0;
+    }
+
+    start = 0;
+    end = pool->size;
+  }
+  else
+  {
+    int64_t offset = get_offset(pool, addr, cidr);
+    if (offset < 0)
+    {
+      return 0;
+    }
+
+    start = (uint64_t)offset;
+    end = address_bits - cidr >= EWB_POOL_MAX_HOST_BITS ? pool->size : start + (1ULL << (address_bits - cidr));
+    if (end > pool->size)
+    {
+      end = pool->size;
+    }
+  }
+
+  int64_t count = 0;
+  for (uint64_t offset = start; offset < end; offset++)
+  {
+    if (!is_taken(pool, offset))
+    {
+      take(pool, offset);
+      count++;
+    }
+  }
+
+  return count;
+}
+
+extern int64_t ewb_pool_reserve_device(ewb_pool *pool, const struct wg_device *device)
+{
+  int64_t count = 0;
+
+  const struct wg_peer *peer;
+  wg_for_each_peer(device, peer)
+  {
+    const struct wg_allowedip *allowedip;
+    wg_for_each_allowedip(peer, allowedip)
+    {
+      int64_t ret = ewb_pool_reserve(pool, allowedip->family, &allowedip->ip6, allowedip->cidr);
+      if (ret < 0)
+      {
+        return ret;
+      }
+      count += ret;
+    }
+  }
+
+  return count;
+}
@@ -0,0 +1,33 @@
+#ifndef EWB_POOL_H
+#define EWB_POOL_H
+
+#include "stddef.h"
+#include "stdint.h"
+#include "../externs/wireguard-tools/contrib/embeddable-wg-library/wireguard.h"
+
+// The pool covers at most 2^24 addresses from the start of the prefix, so a /64 of ipv6 takes 2MiB of bitmap.
+#define EWB_POOL_MAX_HOST_BITS 24
+
+// The bitmap allocator of the addresses in a prefix, where a set bit is a taken address.
+// The words fully taken are marked in the summary, so finding a free address skips 64 words at a time.
+typedef struct
+{
+  uint16_t family;
+  uint8_t cidr;
+  uint8_t base[16];
+  uint64_t size;
+  uint64_t available;
+  uint64_t *words;
+  uint64_t *full_words;
+  size_t word_count;
+  size_t cursor;
+} ewb_pool;
+
+int ewb_pool_init(ewb_pool *pool, uint16_t family, const void *addr, uint8_t cidr);
+void ewb_pool_destroy(ewb_pool *pool);
+int ewb_pool_allocate(ewb_pool *pool, void *addr);
+int ewb_pool_release(ewb_pool *pool, const void *addr);
+int64_t ewb_pool_reserve(ewb_pool *pool, uint16_t family, const void *addr, uint8_t cidr);
+int64_t ewb_pool_reserve_device(ewb_pool *pool, const struct wg_device *device);
+
+#endif
@@ -0,0 +1,666 @@
+#include "errno.h"
+#include "fcntl.h"
+#include "poll.h"
+#include "pthread.h"
+#include "stdlib.h"
+#include "string.h"
+#include "unistd.h"
+#include "sys/socket.h"
+#include "linux/if_link.h"
+#include "linux/rtnetlink.h"
+#include "./netlink.h"
+#include "./registry.h"
+
+#ifndef NETLINK_GET_STRICT_CHK
+#define NETLINK_GET_STRICT_CHK 12
+#endif
+
+#define WG_LINK_KIND "wireguard"
+// The wait before asking again for a dump the kernel refused while another was in flight.
+#define EWB_REGISTRY_RETRY_MS 100
+
+typedef struct registry_entry
+{
+  uint32_t ifindex;
+  char name[IFNAMSIZ];
+  uint64_t generation;
+  struct registry_entry *next_by_name;
+  struct registry_entry *next_by_index;
+} registry_entry;
+
+typedef struct
+{
+  int fd;
+  uint32_t port_id;
+  uint32_t dump_seq;
+  bool is_dumping;
+  // The listing asked for while another is in flight, which the kernel refuses with EBUSY, so it is sent once that one is done.
+  bool is_dump_pending;
+  uint64_t generation;
+  char *receive;
+  int stop_fds[2];
+  pthread_t thread;
+  size_t refs;
+  registry_entry *by_name[EWB_REGISTRY_BUCKETS];
+  registry_entry *by_index[EWB_REGISTRY_BUCKETS];
+  size_t count;
+  ewb_registry_listener *listeners;
+  // The lock of the entries and the listeners, which is never held across a system call.
+  pthread_mutex_t lock;
+} registry;
+
+// The lifecycle lock serializes acquire and release, so the thread is started and joined once.
+static pthread_mutex_t lifecycle_lock = PTHREAD_MUTEX_INITIALIZER;
+static registry shared_registry = {.fd = -1, .stop_fds = {-1, -1}, .lock = PTHREAD_MUTEX_INITIALIZER};
+
+static size_t hash_name(const char *name)
+{
+  // The name is short and unique, so FNV-1a spreads it well enough.
+  uint32_t hash = 2166136261u;
+  for (size_t index = 0; index < IFNAMSIZ && name[index] != '\0'; index++)
+  {
+    hash = (hash ^ (uint8_t)name[index]) * 16777619u;
+  }
+
+  return hash % EWB_REGISTRY_BUCKETS;
+}
+
+static registry_entry *find_by_name(const registry *reg, const char *name)
+{
+  registry_entry *entry = reg->by_name[hash_name(name)];
+  while (entry != NULL && strncmp(entry->name, name, IFNAMSIZ) != 0)
+  {
+    entry = entry->next_by_name;
+  }
+
+  return entry;
+}
+
+static registry_entry *find_by_index(const registry *reg, uint32_t ifindex)
+{
+  registry_entry *entry = reg->by_index[ifindex % EWB_REGISTRY_BUCKETS];
+  while (entry != NULL && entry->ifindex != ifindex)
+  {
+    entry = entry->next_by_index;
+  }
+
+  return entry;
+}
+
+static void unlink_entry(registry *reg, registry_entry *entry)
+{
+  registry_entry **slot = &reg->by_name[hash_name(entry->name)];
+  while (*slot != entry)
+  {
+    slot = &(*slot)->next_by_name;
+  }
+  *slot = entry->next_by_name;
+
+  slot = &reg->by_index[entry->ifindex % EWB_REGISTRY_BUCKETS];
+  while (*slot != entry)
+  {
+    slot = &(*slot)->next_by_index;
+  }
+  *slot = entry->next_by_index;
+
+  reg->count--;
+}
+
+static void link_entry(registry *reg, registry_entry *entry)
+{
+  size_t name_bucket = hash_name(entry->name);
+  entry->next_by_name = reg->by_name[name_bucket];
+  reg->by_name[name_bucket] = entry;
+
+  size_t index_bucket = entry->ifindex % EWB_REGISTRY_BUCKETS;
+  entry->next_by_index = reg->by_index[index_bucket];
+  reg->by_index[index_bucket] = entry;
+
+  reg->count++;
+}
+
+static void clear_entries(registry *reg)
+{
+  for (size_t bucket = 0; bucket < EWB_REGISTRY_BUCKETS; bucket++)
+  {
+    registry_entry *entry = reg->by_name[bucket];
+    while (entry != NULL)
+    {
+      registry_entry *next = entry->next_by_name;
+      free(entry);
+      entry = next;
+    }
+
+    reg->by_name[bucket] = NULL;
+    reg->by_index[bucket] = NULL;
+  }
+
+  reg->count = 0;
+}
+
+static int push_event(ewb_registry_batch *batch, size_t *capacity, ewb_registry_event_type type, const registry_entry *entry)
+{
+  if (batch->count == *capacity)
+  {
+    size_t next_capacity = *capacity ? *capacity * 2 : 8;
+    ewb_registry_event *events = realloc(batch->events, next_capacity * sizeof(ewb_registry_event));
+    if (events == NULL)
+    {
+      return -ENOMEM;
+    }
+
+    batch->events = events;
+    *capacity = next_capacity;
+  }
+
+  ewb_registry_event *event = &batch->events[batch->count++];
+  event->type = type;
+  event->ifindex = entry->ifindex;
+  memcpy(event->name, entry->name, IFNAMSIZ);
+
+  return 0;
+}
+
+static bool is_wireguard_link(const struct nlmsghdr *header, const char **name)
+{
+  const struct ifinfomsg *ifi = (const struct ifinfomsg *)NLMSG_DATA(header);
+  bool is_wireguard = false;
+  *name = NULL;
+
+  struct nlattr *attr;
+  int remaining;
+  ewb_nl_for_each_attr(attr, (char *)ifi + NLMSG_ALIGN(sizeof(struct ifinfomsg)), (int)header->nlmsg_len - NLMSG_LENGTH(sizeof(struct ifinfomsg)), remaining)
+  {
+    if (EWB_NL_ATTR_TYPE(attr) == IFLA_IFNAME && EWB_NL_ATTR_PAYLOAD(attr) > 0)
+    {
+      *name = (const char *)EWB_NL_ATTR_DATA(attr);
+    }
+    else if (EWB_NL_ATTR_TYPE(attr) == IFLA_LINKINFO)
+    {
+      struct nlattr *info;
+      int info_remaining;
+      ewb_nl_for_each_nested(info, attr, info_remaining)
+      {
+        if (EWB_NL_ATTR_TYPE(info) == IFLA_INFO_KIND && EWB_NL_ATTR_PAYLOAD(info) >= (int)sizeof(WG_LINK_KIND) - 1)
+        {
+          is_wireguard = strncmp((const char *)EWB_NL_ATTR_DATA(info), WG_LINK_KIND, EWB_NL_ATTR_PAYLOAD(info)) == 0;
+        }
+      }
+    }
+  }
+
+  return is_wireguard && *name != NULL;
+}
+
+// Applies a link message to the entries, which should be called with the lock held.
+static int apply_link_message(registry *reg, const struct nlmsghdr *header, ewb_registry_batch *batch, size_t *capacity)
+{
+  if (header->nlmsg_len < NLMSG_LENGTH(sizeof(struct ifinfomsg)))
+  {
+    return 0;
+  }
+
+  const struct ifinfomsg *ifi = (const struct ifinfomsg *)NLMSG_DATA(header);
+  uint32_t ifindex = (uint32_t)ifi->ifi_index;
+  registry_entry *entry = find_by_index(reg, ifindex);
+
+  const char *name;
+  if (header->nlmsg_type == RTM_DELLINK || !is_wireguard_link(header, &name))
+  {
+    if (entry == NULL)
+    {
+      return 0;
+    }
+
+    unlink_entry(reg, entry);
+    int ret = push_event(batch, capacity, EWB_REGISTRY_DEVICE_REMOVED, entry);
+    free(entry);
+    return ret;
+  }
+
+  // The renamed interface is reported as removed by the old name and added by the new one.
+  if (entry != NULL && strncmp(entry->name, name, IFNAMSIZ) != 0)
+  {
+    unlink_entry(reg, entry);
+    int ret = push_event(batch, capacity, EWB_REGISTRY_DEVICE_REMOVED, entry);
+    free(entry);
+    entry = NULL;
+    if (ret)
+    {
+      return ret;
+    }
+  }
+
+  if (entry == NULL)
+  {
+    entry = calloc(1, sizeof(registry_entry));
+    if (entry == NULL)
+    {
+      return -ENOMEM;
+    }
+
+    entry->ifindex = ifindex;
+    strncpy(entry->name, name, IFNAMSIZ - 1);
+    link_entry(reg, entry);
+
+    int ret = push_event(batch, capacity, EWB_REGISTRY_DEVICE_ADDED, entry);
+    if (ret)
+    {
+      return ret;
+    }
+  }
+
+  entry->generation = reg->generation;
+
+  return 0;
+}
+
+// Drops the entries not seen by the dump just finished, which were removed while the notifications were lost.
+static int finish_dump(registry *reg, ewb_registry_batch *batch, size_t *capacity)
+{
+  int ret = 0;
+
+  // The messages of the dump may have been lost along with the notifications, so only the pending dump can tell what was removed.
+  if (reg->is_dump_pending)
+  {
+    reg->is_dumping = false;
+    return 0;
+  }
+
+  for (size_t bucket = 0; bucket < EWB_REGISTRY_BUCKETS; bucket++)
+  {
+    registry_entry *entry = reg->by_name[bucket];
+    while (entry != NULL)
+    {
+      registry_entry *next = entry->next_by_name;
+      if (entry->generation != reg->generation)
+      {
+        unlink_entry(reg, entry);
+        if (!ret)
+        {
+          ret = push_event(batch, capacity, EWB_REGISTRY_DEVICE_REMOVED, entry);
+        }
+        free(entry);
+      }
+      entry = next;
+    }
+  }
+
+  reg->is_dumping = false;
+
+  return ret;
+}
+
+static int request_dump(registry *reg)
+{
+  char buffer[256] __attribute__((aligned(NLMSG_ALIGNTO)));
+  ewb_nl_message message;
+  ewb_nl_message_begin(&message, buffer, sizeof(buffer), RTM_GETLINK, NLM_F_REQUEST | NLM_F_DUMP, reg->dump_seq + 1);
+  struct ifinfomsg *ifi = (struct ifinfomsg *)ewb_nl_message_reserve(&message, sizeof(struct ifinfomsg));
+  ifi->ifi_family = AF_UNSPEC;
+
+  // The kind filter asks the kernel to dump the wireguard interfaces only, and the older kernel dumps every link which we filter ourselves.
+  uint32_t ext_mask = RTEXT_FILTER_SKIP_STATS;
+  ewb_nl_message_put(&message, IFLA_EXT_MASK, &ext_mask, sizeof(ext_mask));
+  struct nlattr *linkinfo = ewb_nl_message_nest_start(&message, IFLA_LINKINFO);
+  ewb_nl_message_put(&message, IFLA_INFO_KIND, WG_LINK_KIND, sizeof(WG_LINK_KIND) - 1);
+  ewb_nl_message_nest_end(&message, linkinfo);
+  ewb_nl_message_end(&message);
+
+  // The replies are read by the same thread after we return, so the dump is marked once the kernel took the request.
+  int ret = ewb_nl_send(reg->fd, message.data, message.length);
+  if (ret)
+  {
+    return ret;
+  }
+
+  reg->dump_seq++;
+  reg->generation++;
+  reg->is_dumping = true;
+  reg->is_dump_pending = false;
+
+  return 0;
+}
+
+// Sends the pending dump if no other is in flight, leaving it pending to be tried again if the kernel is still busy.
+static int send_pending_dump(registry *reg)
+{
+  if (!reg->is_dump_pending || reg->is_dumping)
+  {
+    return 0;
+  }
+
+  int ret = request_dump(reg);
+
+  return ret == -EBUSY ? 0 : ret;
+}
+
+static void notify_listeners(registry *reg, ewb_registry_batch *batch)
+{
+  for (ewb_registry_listener *listener = reg->listeners; listener != NULL; listener = listener->next)
+  {
+    ewb_registry_batch *copy = malloc(sizeof(ewb_registry_batch));
+    if (copy == NULL)
+    {
+      continue;
+    }
+
+    copy->count = batch->count;
+    copy->events = malloc(batch->count * sizeof(ewb_registry_event));
+    if (copy->events == NULL)
+    {
+      free(copy);
+      continue;
+    }
+    memcpy(copy->events, batch->events, batch->count * sizeof(ewb_registry_event));
+
+    listener->callback(copy, listener->data);
+  }
+}
+
+// Receives a datagram and applies its messages, returning -EAGAIN if there was nothing to read.
+static int receive_messages(registry *reg)
+{
+  ssize_t received = recv(reg->fd, reg->receive, EWB_NL_RECEIVE_SIZE, MSG_DONTWAIT);
+  if (received < 0)
+  {
+    return errno == EWOULDBLOCK ? -EAGAIN : -errno;
+  }
+
+  ewb_registry_batch batch = {0};
+  size_t capacity = 0;
+  int ret = 0;
+
+  pthread_mutex_lock(&reg->lock);
+
+  int remaining = (int)received;
+  for (struct nlmsghdr *header = (struct nlmsghdr *)reg->receive; ret == 0 && NLMSG_OK(header, remaining); header = NLMSG_NEXT(header, remaining))
+  {
+    bool is_dump_reply = header->nlmsg_pid == reg->port_id && header->nlmsg_seq == reg->dump_seq;
+
+    if (header->nlmsg_type == RTM_NEWLINK || header->nlmsg_type == RTM_DELLINK)
+    {
+      ret = apply_link_message(reg, header, &batch, &capacity);
+    }
+    else if (is_dump_reply && header->nlmsg_type == NLMSG_DONE)
+    {
+      ret = finish_dump(reg, &batch, &capacity);
+    }
+    else if (is_dump_reply && header->nlmsg_type == NLMSG_ERROR)
+    {
+      ret = ((struct nlmsgerr *)NLMSG_DATA(header))->error;
+      reg->is_dumping = false;
+    }
+  }
+
+  if (batch.count > 0)
+  {
+    notify_listeners(reg, &batch);
+  }
+
+  pthread_mutex_unlock(&reg->lock);
+
+  free(batch.events);
+
+  return ret;
+}
+
+static void *run_registry(void *data)
+{
+  registry *reg = (registry *)data;
+
+  for (;;)
+  {
+    struct pollfd fds[2] = {
+      {.fd = reg->fd, .events = POLLIN},
+      {.fd = reg->stop_fds[0], .events = POLLIN},
+    };
+
+    // The pending dump is tried again after a while, as a busy kernel may send nothing in between.
+    if (poll(fds, 2, reg->is_dump_pending ? EWB_REGISTRY_RETRY_MS : -1) < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      break;
+    }
+    if (fds[1].revents)
+    {
+      break;
+    }
+
+    int ret = fds[0].revents ? receive_messages(reg) : 0;
+
+    // The notifications overflowed the socket or were not applied, so we list the interfaces again to catch up.
+    if (ret == -ENOBUFS || ret == -ENOMEM)
+    {
+      reg->is_dump_pending = true;
+    }
+    send_pending_dump(reg);
+  }
+
+  return NULL;
+}
+
+static void close_registry(registry *reg)
+{
+  // The fd tells the readers whether the registry runs, so it is taken away under the lock along with the entries.
+  pthread_mutex_lock(&reg->lock);
+  int fd = reg->fd;
+  reg->fd = -1;
+  clear_entries(reg);
+  pthread_mutex_unlock(&reg->lock);
+
+  if (fd >= 0)
+  {
+    close(fd);
+  }
+  if (reg->stop_fds[0] >= 0)
+  {
+    close(reg->stop_fds[0]);
+    close(reg->stop_fds[1]);
+  }
+  free(reg->receive);
+
+  reg->is_dumping = false;
+  reg->is_dump_pending = false;
+  reg->stop_fds[0] = -1;
+  reg->stop_fds[1] = -1;
+  reg->receive = NULL;
+}
+
+static int open_registry(registry *reg)
+{
+  reg->receive = malloc(EWB_NL_RECEIVE_SIZE);
+  if (reg->receive == NULL)
+  {
+    return -ENOMEM;
+  }
+
+  if (pipe2(reg->stop_fds, O_CLOEXEC) < 0)
+  {
+    int ret = -errno;
+    close_registry(reg);
+    return ret;
+  }
+
+  int fd = ewb_nl_socket_open(NETLINK_ROUTE, &reg->port_id);
+  if (fd < 0)
+  {
+    close_registry(reg);
+    return fd;
+  }
+  pthread_mutex_lock(&reg->lock);
+  reg->fd = fd;
+  pthread_mutex_unlock(&reg->lock);
+
+  // We join the group before listing the interfaces, so no interface added in between is missed.
+  int group = RTNLGRP_LINK, enabled = 1;
+  setsockopt(fd, SOL_NETLINK, NETLINK_GET_STRICT_CHK, &enabled, sizeof(enabled));
+  if (setsockopt(fd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP, &group, sizeof(group)) < 0)
+  {
+    int ret = -errno;
+    close_registry(reg);
+    return ret;
+  }
+
+  // The first listing is done before the thread starts, so the registry is complete once acquired.
+  int ret = request_dump(reg);
+  while (!ret && (reg->is_dumping || reg->is_dump_pending))
+  {
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+    if (poll(&pfd, 1, reg->is_dump_pending ? EWB_REGISTRY_RETRY_MS : -1) < 0 && errno != EINTR)
+    {
+      ret = -errno;
+      break;
+    }
+
+    ret = pfd.revents ? receive_messages(reg) : 0;
+    if (ret == -EAGAIN)
+    {
+      ret = 0;
+    }
+    else if (ret == -ENOBUFS)
+    {
+      reg->is_dump_pending = true;
+      ret = 0;
+    }
+    if (!ret)
+    {
+      ret = send_pending_dump(reg);
+    }
+  }
+  if (ret)
+  {
+    close_registry(reg);
+    return ret;
+  }
+
+  ret = -pthread_create(&reg->thread, NULL, run_registry, reg);
+  if (ret)
+  {
+    close_registry(reg);
+    return ret;
+  }
+
+  return 0;
+}
+
+extern int ewb_registry_acquire(void)
+{
+  int ret = 0;
+
+  pthread_mutex_lock(&lifecycle_lock);
+  if (shared_registry.refs == 0)
+  {
+    ret = open_registry(&shared_registry);
+  }
+  if (!ret)
+  {
+    shared_registry.refs++;
+  }
+  pthread_mutex_unlock(&lifecycle_lock);
+
+  return ret;
+}
+
+extern void ewb_registry_release(void)
+{
+  pthread_mutex_lock(&lifecycle_lock);
+  if (shared_registry.refs > 0 && --shared_registry.refs == 0)
+  {
+    char byte = 0;
+    while (write(shared_registry.stop_fds[1], &byte, 1) < 0 && errno == EINTR)
+    {
+    }
+    pthread_join(shared_registry.thread, NULL);
+
+    close_registry(&shared_registry);
+  }
+  pthread_mutex_unlock(&lifecycle_lock);
+}
+
+extern bool ewb_registry_is_running(void)
+{
+  pthread_mutex_lock(&shared_registry.lock);
+  bool is_running = shared_registry.fd >= 0;
+  pthread_mutex_unlock(&shared_registry.lock);
+
+  return is_running;
+}
+
+extern char *ewb_registry_list_device_names(void)
+{
+  pthread_mutex_lock(&shared_registry.lock);
+
+  if (shared_registry.fd < 0)
+  {
+    pthread_mutex_unlock(&shared_registry.lock);
+    return NULL;
+  }
+
+  // The names are separated by the null character and the list ends with an empty name, the same as wg_list_device_names.
+  char *names = malloc(shared_registry.count * IFNAMSIZ + 1);
+  if (names == NULL)
+  {
+    pthread_mutex_unlock(&shared_registry.lock);
+    return NULL;
+  }
+
+  size_t length = 0;
+  for (size_t bucket = 0; bucket < EWB_REGISTRY_BUCKETS; bucket++)
+  {
+    for (registry_entry *entry = shared_registry.by_name[bucket]; entry != NULL; entry = entry->next_by_name)
+    {
+      size_t name_length = strnlen(entry->name, IFNAMSIZ - 1);
+      memcpy(names + length, entry->name, name_length);
+      names[length + name_length] = '\0';
+      length += name_length + 1;
+    }
+  }
+  names[length] = '\0';
+
+  pthread_mutex_unlock(&shared_registry.lock);
+
+  return names;
+}
+
+extern uint32_t ewb_registry_get_ifindex(const char *name)
+{
+  pthread_mutex_lock(&shared_registry.lock);
+  registry_entry *entry = shared_registry.fd >= 0 ? find_by_name(&shared_registry, name) : NULL;
+  uint32_t ifindex = entry != NULL ? entry->ifindex : 0;
+  pthread_mutex_unlock(&shared_registry.lock);
+
+  return ifindex;
+}
+
+extern void ewb_registry_add_listener(ewb_registry_listener *listener)
+{
+  pthread_mutex_lock(&shared_registry.lock);
+  listener->next = shared_registry.listeners;
+  shared_registry.listeners = listener;
+  pthread_mutex_unlock(&shared_registry.lock);
+}
+
+extern void ewb_registry_remove_listener(ewb_registry_listener *listener)
+{
+  pthread_mutex_lock(&shared_registry.lock);
+  ewb_registry_listener **slot = &shared_registry.listeners;
+  while (*slot != NULL && *slot != listener)
+  {
+    slot = &(*slot)->next;
+  }
+  if (*slot != NULL)
+  {
+    *slot = listener->next;
+  }
+  pthread_mutex_unlock(&shared_registry.lock);
+}
+
+extern void ewb_registry_batch_destroy(ewb_registry_batch *batch)
+{
+  free(batch->events);
+  free(batch);
+}
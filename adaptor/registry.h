@@ -0,0 +1,55 @@
+#ifndef EWB_REGISTRY_H
+#define EWB_REGISTRY_H
+
+#include "stdbool.h"
+#include "stddef.h"
+#include "stdint.h"
+#include "net/if.h"
+
+#define EWB_REGISTRY_BUCKETS 1024
+
+typedef enum
+{
+  EWB_REGISTRY_DEVICE_ADDED,
+  EWB_REGISTRY_DEVICE_REMOVED,
+} ewb_registry_event_type;
+
+typedef struct
+{
+  ewb_registry_event_type type;
+  uint32_t ifindex;
+  char name[IFNAMSIZ];
+} ewb_registry_event;
+
+typedef struct
+{
+  ewb_registry_event *events;
+  size_t count;
+} ewb_registry_batch;
+
+// Called on the registry thread with a batch owned by the callee, which should free it by ewb_registry_batch_destroy.
+// The callback should not block, as the other listeners and the registry wait for it.
+typedef void (*ewb_registry_callback)(ewb_registry_batch *batch, void *data);
+
+typedef struct ewb_registry_listener
+{
+  ewb_registry_callback callback;
+  void *data;
+  struct ewb_registry_listener *next;
+} ewb_registry_listener;
+
+// The registry of the wireguard interfaces in the process, kept up to date by the link notifications of rtnetlink on a thread.
+// It runs while acquired at least once, and the first acquire returns after the interfaces are listed.
+int ewb_registry_acquire(void);
+void ewb_registry_release(void);
+bool ewb_registry_is_running(void);
+// The names in the format of wg_list_device_names, or NULL if the registry is not running.
+char *ewb_registry_list_device_names(void);
+// The ifindex of the wireguard interface, or zero if the interface is unknown or the registry is not running.
+uint32_t ewb_registry_get_ifindex(const char *name);
+void ewb_registry_add_listener(ewb_registry_listener *listener);
+// The callback of the listener is not called after this returns.
+void ewb_registry_remove_listener(ewb_registry_listener *listener);
+void ewb_registry_batch_destroy(ewb_registry_batch *batch);
+
+#endif
@@ -0,0 +1,590 @@
+#include "errno.h"
+#include "pthread.h"
+#include "stdbool.h"
+#include "stdlib.h"
+#include "string.h"
+#include "unistd.h"
+#include "sys/socket.h"
+#include "net/if.h"
+#include "netinet/in.h"
+#include "linux/if_addr.h"
+#include "linux/rtnetlink.h"
+#include "./metrics.h"
+#include "./netlink.h"
+#include "./netns.h"
+#include "./rtnl.h"
+
+// The kernel queues the acks of a datagram before we read any, so the datagram is kept to what the receive buffer holds.
+#define EWB_RTNL_BATCH_SIZE 128
+
+// The kernel before 4.20 has no strict checking, so we still filter the dump by the ifindex ourselves.
+#ifndef NETLINK_GET_STRICT_CHK
+#define NETLINK_GET_STRICT_CHK 12
+#endif
+
+static ewb_rtnl_socket shared_socket = {.fd = -1, .netns_fd = -1, .lock = PTHREAD_MUTEX_INITIALIZER};
+
+// The calls without a socket of their own go through the one shared by the namespace of the process.
+static ewb_rtnl_socket *get_socket(ewb_rtnl_socket *rtnl)
+{
+  return rtnl != NULL ? rtnl : &shared_socket;
+}
+
+static void disconnect_socket(ewb_rtnl_socket *rtnl)
+{
+  if (rtnl->fd >= 0)
+  {
+    close(rtnl->fd);
+  }
+
+  rtnl->fd = -1;
+}
+
+static int connect_socket(ewb_rtnl_socket *rtnl)
+{
+  if (rtnl->is_closed)
+  {
+    return -ENOTCONN;
+  }
+
+  if (rtnl->receive == NULL)
+  {
+    rtnl->receive = malloc(EWB_NL_RECEIVE_SIZE);
+    if (rtnl->receive == NULL)
+    {
+      return -ENOMEM;
+    }
+  }
+
+  int fd = ewb_netns_socket_open(rtnl->netns_fd, NETLINK_ROUTE, &rtnl->port_id);
+  if (fd < 0)
+  {
+    return fd;
+  }
+
+  int enabled = 1;
+  setsockopt(fd, SOL_NETLINK, NETLINK_GET_STRICT_CHK, &enabled, sizeof(enabled));
+
+  rtnl->fd = fd;
+
+  return 0;
+}
+
+extern void ewb_rtnl_socket_init(ewb_rtnl_socket *rtnl, int netns_fd)
+{
+  memset(rtnl, 0, sizeof(ewb_rtnl_socket));
+  rtnl->fd = -1;
+  rtnl->netns_fd = netns_fd;
+  pthread_mutex_init(&rtnl->lock, NULL);
+}
+
+extern void ewb_rtnl_socket_close(ewb_rtnl_socket *rtnl)
+{
+  pthread_mutex_lock(&rtnl->lock);
+  disconnect_socket(rtnl);
+  rtnl->is_closed = true;
+  pthread_mutex_unlock(&rtnl->lock);
+}
+
+extern void ewb_rtnl_socket_destroy(ewb_rtnl_socket *rtnl)
+{
+  disconnect_socket(rtnl);
+  free(rtnl->receive);
+  rtnl->receive = NULL;
+  pthread_mutex_destroy(&rtnl->lock);
+}
+
+// Returns true if the failure is about the socket rather than the request, so the request can be sent again on a new socket.
+static bool is_socket_failure(int ret)
+{
+  switch (-ret)
+  {
+  case EBADF:
+  case ENOTCONN:
+  case ECONNREFUSED:
+  case ECONNRESET:
+  case EPIPE:
+  case ENOBUFS:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Sends the request built in the buffer and receives the reply, reconnecting the socket once if it went bad.
+static int request(ewb_rtnl_socket *rtnl, ewb_nl_message *message, ewb_nl_message_callback callback, void *data)
+{
+  int ret = 0;
+
+  for (int attempt = 0; attempt < 2; attempt++)
+  {
+    if (rtnl->fd < 0)
+    {
+      ret = connect_socket(rtnl);
+      if (ret)
+      {
+        return ret;
+      }
+    }
+
+    ((struct nlmsghdr *)message->data)->nlmsg_seq = ++rtnl->seq;
+
+    ret = ewb_nl_send(rtnl->fd, message->data, message->length);
+    if (!ret)
+    {
+      ret = ewb_nl_receive(rtnl->fd, rtnl->receive, EWB_NL_RECEIVE_SIZE, rtnl->seq, callback, data);
+    }
+    if (!is_socket_failure(ret))
+    {
+      return ret;
+    }
+
+    disconnect_socket(rtnl);
+  }
+
+  return ret;
+}
+
+typedef struct
+{
+  uint32_t ifindex;
+  ewb_rtnl_addresses *addresses;
+} get_addresses_context;
+
+static int parse_address_callback(const struct nlmsghdr *header, void *data)
+{
+  get_addresses_context *context = (get_addresses_context *)data;
+
+  if (header->nlmsg_type != RTM_NEWADDR || header->nlmsg_len < NLMSG_LENGTH(sizeof(struct ifaddrmsg)))
+  {
+    return 0;
+  }
+
+  const struct ifaddrmsg *ifa = (const struct ifaddrmsg *)NLMSG_DATA(header);
+  if ((context->ifindex != 0 && ifa->ifa_index != context->ifindex) || (ifa->ifa_family != AF_INET && ifa->ifa_family != AF_INET6))
+  {
+    return 0;
+  }
+
+  size_t address_size = ifa->ifa_family == AF_INET6 ? 16 : 4;
+  const void *address = NULL, *local = NULL;
+
+  struct nlattr *attr;
+  int remaining;
+  ewb_nl_for_each_attr(attr, (char *)ifa + NLMSG_ALIGN(sizeof(struct ifaddrmsg)), (int)header->nlmsg_len - NLMSG_LENGTH(sizeof(struct ifaddrmsg)), remaining)
+  {
+    if (EWB_NL_ATTR_PAYLOAD(attr) < (int)address_size)
+    {
+      continue;
+    }
+
+    if (EWB_NL_ATTR_TYPE(attr) == IFA_ADDRESS)
+    {
+      address = EWB_NL_ATTR_DATA(attr);
+    }
+    else if (EWB_NL_ATTR_TYPE(attr) == IFA_LOCAL)
+    {
+      local = EWB_NL_ATTR_DATA(attr);
+    }
+  }
+
+  // The address of the point to point interface is the one of the other end, and the local one is ours like getifaddrs takes it.
+  if (local != NULL)
+  {
+    address = local;
+  }
+  if (address == NULL)
+  {
+    return 0;
+  }
+
+  ewb_rtnl_addresses *addresses = context->addresses;
+  if (addresses->count == addresses->capacity)
+  {
+    size_t capacity = addresses->capacity ? addresses->capacity * 2 : 16;
+    ewb_rtnl_address *grown = realloc(addresses->addresses, capacity * sizeof(ewb_rtnl_address));
+    if (grown == NULL)
+    {
+      return -ENOMEM;
+    }
+    addresses->addresses = grown;
+    addresses->capacity = capacity;
+  }
+
+  ewb_rtnl_address *entry = &addresses->addresses[addresses->count++];
+  memset(entry, 0, sizeof(ewb_rtnl_address));
+  entry->ifindex = ifa->ifa_index;
+  entry->family = ifa->ifa_family;
+  entry->prefix = ifa->ifa_prefixlen;
+  memcpy(entry->addr, address, address_size);
+
+  return 0;
+}
+
+extern int ewb_rtnl_get_addresses(ewb_rtnl_socket *rtnl, uint32_t ifindex, ewb_rtnl_addresses *addresses)
+{
+  memset(addresses, 0, sizeof(ewb_rtnl_addresses));
+
+  char buffer[NLMSG_SPACE(sizeof(struct ifaddrmsg))] __attribute__((aligned(NLMSG_ALIGNTO)));
+  ewb_nl_message message;
+  ewb_nl_message_begin(&message, buffer, sizeof(buffer), RTM_GETADDR, NLM_F_REQUEST | NLM_F_DUMP, 0);
+
+  // The strict checking asks the kernel to dump the interface only, instead of every address of the host.
+  struct ifaddrmsg *ifa = (struct ifaddrmsg *)ewb_nl_message_reserve(&message, sizeof(struct ifaddrmsg));
+  ifa->ifa_family = AF_UNSPEC;
+  ifa->ifa_index = ifindex;
+  ewb_nl_message_end(&message);
+
+  get_addresses_context context = {.ifindex = ifindex, .addresses = addresses};
+
+  rtnl = get_socket(rtnl);
+  pthread_mutex_lock(&rtnl->lock);
+  int ret = request(rtnl, &message, parse_address_callback, &context);
+  pthread_mutex_unlock(&rtnl->lock);
+
+  if (ret)
+  {
+    ewb_rtnl_addresses_destroy(addresses);
+  }
+
+  return ret;
+}
+
+extern void ewb_rtnl_addresses_destroy(ewb_rtnl_addresses *addresses)
+{
+  free(addresses->addresses);
+  addresses->addresses = NULL;
+  addresses->count = 0;
+  addresses->capacity = 0;
+}
+
+// Receives the acks of the messages sent with the sequence numbers from the first, and returns the first error among them.
+static int receive_acks(ewb_rtnl_socket *rtnl, uint32_t first_seq, size_t count)
+{
+  int first_error = 0;
+  size_t acked = 0;
+
+  while (acked < count)
+  {
+    ssize_t received = recv(rtnl->fd, rtnl->receive, EWB_NL_RECEIVE_SIZE, 0);
+    if (received < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (received < 0)
+    {
+      return -errno;
+    }
+    ewb_metrics_record_bytes(0, (size_t)received);
+
+    int remaining = (int)received;
+    for (struct nlmsghdr *header = (struct nlmsghdr *)rtnl->receive; NLMSG_OK(header, remaining); header = NLMSG_NEXT(header, remaining))
+    {
+      if (header->nlmsg_type != NLMSG_ERROR || header->nlmsg_seq - first_seq >= count)
+      {
+        continue;
+      }
+
+      struct nlmsgerr *error = (struct nlmsgerr *)NLMSG_DATA(header);
+      if (error->error && first_error == 0)
+      {
+        first_error = error->error;
+      }
+      acked++;
+    }
+  }
+
+  return first_error;
+}
+
+static bool put_address_message(ewb_nl_message *message, char *data, size_t capacity, uint32_t seq, uint32_t ifindex, const ewb_rtnl_address *address)
+{
+  size_t address_size = address->family == AF_INET6 ? 16 : 4;
+  if (capacity < NLMSG_SPACE(sizeof(struct ifaddrmsg)) + 2 * (NLA_HDRLEN + NLA_ALIGN(address_size)))
+  {
+    return false;
+  }
+
+  // The address is replaced if it exists, so configuring the link twice is not an error.
+  ewb_nl_message_begin(message, data, capacity, RTM_NEWADDR, NLM_F_REQUEST | NLM_F_ACK | NLM_F_CREATE | NLM_F_REPLACE, seq);
+
+  struct ifaddrmsg *ifa = (struct ifaddrmsg *)ewb_nl_message_reserve(message, sizeof(struct ifaddrmsg));
+  ifa->ifa_family = address->family;
+  ifa->ifa_prefixlen = address->prefix;
+  ifa->ifa_scope = RT_SCOPE_UNIVERSE;
+  ifa->ifa_index = ifindex;
+
+  ewb_nl_message_put(message, IFA_LOCAL, address->addr, address_size);
+  ewb_nl_message_put(message, IFA_ADDRESS, address->addr, address_size);
+  ewb_nl_message_end(message);
+
+  return true;
+}
+
+static bool put_link_message(ewb_nl_message *message, char *data, size_t capacity, uint32_t seq, uint32_t ifindex, const ewb_rtnl_link_config *config)
+{
+  if (capacity < NLMSG_SPACE(sizeof(struct ifinfomsg)) + NLA_HDRLEN + NLA_ALIGN(sizeof(uint32_t)))
+  {
+    return false;
+  }
+
+  ewb_nl_message_begin(message, data, capacity, RTM_NEWLINK, NLM_F_REQUEST | NLM_F_ACK, seq);
+
+  struct ifinfomsg *ifi = (struct ifinfomsg *)ewb_nl_message_reserve(message, sizeof(struct ifinfomsg));
+  ifi->ifi_family = AF_UNSPEC;
+  ifi->ifi_index = (int)ifindex;
+  if (config->has_up)
+  {
+    ifi->ifi_flags = config->is_up ? IFF_UP : 0;
+    ifi->ifi_change = IFF_UP;
+  }
+
+  if (config->has_mtu)
+  {
+    ewb_nl_message_put(message, IFLA_MTU, &config->mtu, sizeof(uint32_t));
+  }
+  ewb_nl_message_end(message);
+
+  return true;
+}
+
+static int configure_link(ewb_rtnl_socket *rtnl, uint32_t ifindex, const ewb_rtnl_link_config *config)
+{
+  if (rtnl->fd < 0)
+  {
+    int ret = connect_socket(rtnl);
+    if (ret)
+    {
+      return ret;
+    }
+  }
+
+  char *buffer = malloc(EWB_NL_MESSAGE_SIZE);
+  if (buffer == NULL)
+  {
+    return -ENOMEM;
+  }
+
+  bool has_link_change = config->has_mtu || config->has_up;
+  size_t next_address = 0;
+  bool is_link_sent = !has_link_change;
+  int first_error = 0;
+
+  // The addresses go before the link, as the routes of the addresses are added as the link comes up.
+  // The messages that don't fit a datagram are sent in the following ones, each costing a round trip.
+  while (next_address < config->address_count || !is_link_sent)
+  {
+    size_t length = 0, count = 0;
+    uint32_t first_seq = rtnl->seq + 1;
+
+    ewb_nl_message message;
+    while (next_address < config->address_count && count < EWB_RTNL_BATCH_SIZE && put_address_message(&message, buffer + length, EWB_NL_MESSAGE_SIZE - length, ++rtnl->seq, ifindex, &config->addresses[next_address]))
+    {
+      length += NLMSG_ALIGN(message.length);
+      count++;
+      next_address++;
+    }
+    if (next_address == config->address_count && !is_link_sent && count < EWB_RTNL_BATCH_SIZE && put_link_message(&message, buffer + length, EWB_NL_MESSAGE_SIZE - length, ++rtnl->seq, ifindex, config))
+    {
+      length += NLMSG_ALIGN(message.length);
+      count++;
+      is_link_sent = true;
+    }
+    // The sequence number taken by the message that didn't fit is left unused, which the kernel doesn't care about.
+    rtnl->seq = first_seq + (uint32_t)count - 1;
+
+    int ret = ewb_nl_send(rtnl->fd, buffer, length);
+    if (!ret)
+    {
+      ret = receive_acks(rtnl, first_seq, count);
+    }
+    if (ret && is_socket_failure(ret))
+    {
+      disconnect_socket(rtnl);
+      free(buffer);
+      return ret;
+    }
+    if (ret && first_error == 0)
+    {
+      first_error = ret;
+    }
+  }
+
+  free(buffer);
+
+  return first_error;
+}
+
+extern int ewb_rtnl_configure_link(ewb_rtnl_socket *rtnl, uint32_t ifindex, const ewb_rtnl_link_config *config)
+{
+  rtnl = get_socket(rtnl);
+  pthread_mutex_lock(&rtnl->lock);
+  int ret = configure_link(rtnl, ifindex, config);
+  pthread_mutex_unlock(&rtnl->lock);
+
+  return ret;
+}
+
+static int parse_link_index_callback(const struct nlmsghdr *header, void *data)
+{
+  if (header->nlmsg_type == RTM_NEWLINK && header->nlmsg_len >= NLMSG_LENGTH(sizeof(struct ifinfomsg)))
+  {
+    *(uint32_t *)data = (uint32_t)((const struct ifinfomsg *)NLMSG_DATA(header))->ifi_index;
+  }
+
+  return 0;
+}
+
+// Builds the message of the link by its name, which every link request below is.
+static void begin_link_message(ewb_nl_message *message, char *buffer, size_t capacity, uint16_t type, uint16_t flags, const char *name)
+{
+  ewb_nl_message_begin(message, buffer, capacity, type, flags, 0);
+
+  struct ifinfomsg *ifi = (struct ifinfomsg *)ewb_nl_message_reserve(message, sizeof(struct ifinfomsg));
+  ifi->ifi_family = AF_UNSPEC;
+
+  ewb_nl_message_put(message, IFLA_IFNAME, name, strnlen(name, IFNAMSIZ - 1) + 1);
+}
+
+static int request_link(ewb_rtnl_socket *rtnl, ewb_nl_message *message, ewb_nl_message_callback callback, void *data)
+{
+  rtnl = get_socket(rtnl);
+  pthread_mutex_lock(&rtnl->lock);
+  int ret = request(rtnl, message, callback, data);
+  pthread_mutex_unlock(&rtnl->lock);
+
+  return ret;
+}
+
+extern int ewb_rtnl_get_ifindex(ewb_rtnl_socket *rtnl, const char *name, uint32_t *ifindex)
+{
+  char buffer[NLMSG_SPACE(sizeof(struct ifinfomsg)) + NLA_HDRLEN + NLA_ALIGN(IFNAMSIZ)] __attribute__((aligned(NLMSG_ALIGNTO)));
+  ewb_nl_message message;
+  begin_link_message(&message, buffer, sizeof(buffer), RTM_GETLINK, NLM_F_REQUEST | NLM_F_ACK, name);
+  ewb_nl_message_end(&message);
+
+  *ifindex = 0;
+  int ret = request_link(rtnl, &message, parse_link_index_callback, ifindex);
+
+  return ret ? ret : *ifindex == 0 ? -ENODEV : 0;
+}
+
+extern int ewb_rtnl_add_link(ewb_rtnl_socket *rtnl, const char *name, const char *kind)
+{
+  char buffer[NLMSG_SPACE(sizeof(struct ifinfomsg)) + NLA_HDRLEN + NLA_ALIGN(IFNAMSIZ) + 2 * NLA_HDRLEN + NLA_ALIGN(IFNAMSIZ)] __attribute__((aligned(NLMSG_ALIGNTO)));
+  ewb_nl_message message;
+  begin_link_message(&message, buffer, sizeof(buffer), RTM_NEWLINK, NLM_F_REQUEST | NLM_F_ACK | NLM_F_CREATE | NLM_F_EXCL, name);
+
+  struct nlattr *linkinfo = ewb_nl_message_nest_start(&message, IFLA_LINKINFO);
+  ewb_nl_message_put(&message, IFLA_INFO_KIND, kind, strnlen(kind, IFNAMSIZ - 1) + 1);
+  ewb_nl_message_nest_end(&message, linkinfo);
+  ewb_nl_message_end(&message);
+
+  return request_link(rtnl, &message, NULL, NULL);
+}
+
+extern int ewb_rtnl_del_link(ewb_rtnl_socket *rtnl, const char *name)
+{
+  char buffer[NLMSG_SPACE(sizeof(struct ifinfomsg)) + NLA_HDRLEN + NLA_ALIGN(IFNAMSIZ)] __attribute__((aligned(NLMSG_ALIGNTO)));
+  ewb_nl_message message;
+  begin_link_message(&message, buffer, sizeof(buffer), RTM_DELLINK, NLM_F_REQUEST | NLM_F_ACK, name);
+  ewb_nl_message_end(&message);
+
+  return request_link(rtnl, &message, NULL, NULL);
+}
+
+typedef struct
+{
+  const char *kind;
+  char *names;
+  size_t length;
+  size_t capacity;
+} list_links_context;
+
+static int parse_link_name_callback(const struct nlmsghdr *header, void *data)
+{
+  list_links_context *context = (list_links_context *)data;
+
+  if (header->nlmsg_type != RTM_NEWLINK || header->nlmsg_len < NLMSG_LENGTH(sizeof(struct ifinfomsg)))
+  {
+    return 0;
+  }
+
+  const char *name = NULL, *kind = NULL;
+  size_t name_length = 0;
+
+  struct nlattr *attr, *info_attr;
+  int remaining, info_remaining;
+  ewb_nl_for_each_attr(attr, (char *)NLMSG_DATA(header) + NLMSG_ALIGN(sizeof(struct ifinfomsg)), (int)header->nlmsg_len - NLMSG_LENGTH(sizeof(struct ifinfomsg)), remaining)
+  {
+    if (EWB_NL_ATTR_TYPE(attr) == IFLA_IFNAME && EWB_NL_ATTR_PAYLOAD(attr) > 0)
+    {
+      name = EWB_NL_ATTR_DATA(attr);
+      name_length = strnlen(name, (size_t)EWB_NL_ATTR_PAYLOAD(attr));
+    }
+    else if (EWB_NL_ATTR_TYPE(attr) == IFLA_LINKINFO)
+    {
+      ewb_nl_for_each_nested(info_attr, attr, info_remaining)
+      {
+        if (EWB_NL_ATTR_TYPE(info_attr) == IFLA_INFO_KIND && EWB_NL_ATTR_PAYLOAD(info_attr) > 0)
+        {
+          kind = EWB_NL_ATTR_DATA(info_attr);
+          if (strncmp(kind, context->kind, (size_t)EWB_NL_ATTR_PAYLOAD(info_attr)) != 0)
+          {
+            kind = NULL;
+          }
+        }
+      }
+    }
+  }
+
+  if (name == NULL || name_length == 0 || kind == NULL)
+  {
+    return 0;
+  }
+
+  // The names are kept in the format of wg_list_device_names, each terminated and the list by an empty one.
+  if (context->length + name_length + 2 > context->capacity)
+  {
+    size_t capacity = context->capacity * 2 > context->length + name_length + 2 ? context->capacity * 2 : context->length + name_length + 2;
+    char *names = realloc(context->names, capacity);
+    if (names == NULL)
+    {
+      return -ENOMEM;
+    }
+    context->names = names;
+    context->capacity = capacity;
+  }
+
+  memcpy(context->names + context->length, name, name_length);
+  context->length += name_length;
+  context->names[context->length++] = '\0';
+  context->names[context->length] = '\0';
+
+  return 0;
+}
+
+extern char *ewb_rtnl_list_links(ewb_rtnl_socket *rtnl, const char *kind)
+{
+  char buffer[NLMSG_SPACE(sizeof(struct ifinfomsg))] __attribute__((aligned(NLMSG_ALIGNTO)));
+  ewb_nl_message message;
+  ewb_nl_message_begin(&message, buffer, sizeof(buffer), RTM_GETLINK, NLM_F_REQUEST | NLM_F_DUMP, 0);
+
+  struct ifinfomsg *ifi = (struct ifinfomsg *)ewb_nl_message_reserve(&message, sizeof(struct ifinfomsg));
+  ifi->ifi_family = AF_UNSPEC;
+  ewb_nl_message_end(&message);
+
+  list_links_context context = {.kind = kind, .capacity = 64};
+  if ((context.names = calloc(1, context.capacity)) == NULL)
+  {
+    return NULL;
+  }
+
+  if (request_link(rtnl, &message, parse_link_name_callback, &context))
+  {
+    free(context.names);
+    return NULL;
+  }
+
+  return context.names;
+}
@@ -0,0 +1,65 @@
+#ifndef EWB_RTNL_H
+#define EWB_RTNL_H
+
+#include "pthread.h"
+#include "stdbool.h"
+#include "stddef.h"
+#include "stdint.h"
+
+typedef struct
+{
+  uint32_t ifindex;
+  uint16_t family;
+  uint8_t prefix;
+  uint8_t addr[16];
+} ewb_rtnl_address;
+
+typedef struct
+{
+  ewb_rtnl_address *addresses;
+  size_t count;
+  size_t capacity;
+} ewb_rtnl_addresses;
+
+typedef struct
+{
+  const ewb_rtnl_address *addresses;
+  size_t address_count;
+  bool has_mtu;
+  uint32_t mtu;
+  bool has_up;
+  bool is_up;
+} ewb_rtnl_link_config;
+
+// The route socket is opened on the first call and kept across calls, which are serialized by its lock.
+// The functions below take NULL for the socket shared by the namespace of the process.
+typedef struct
+{
+  int fd;
+  // The namespace the socket is opened in, or -1 for the one of the caller, owned by the caller.
+  int netns_fd;
+  uint32_t port_id;
+  uint32_t seq;
+  char *receive;
+  bool is_closed;
+  pthread_mutex_t lock;
+} ewb_rtnl_socket;
+
+void ewb_rtnl_socket_init(ewb_rtnl_socket *rtnl, int netns_fd);
+void ewb_rtnl_socket_destroy(ewb_rtnl_socket *rtnl);
+// Closes the socket for good, failing the calls after it like a closed session.
+void ewb_rtnl_socket_close(ewb_rtnl_socket *rtnl);
+
+// Dumps the addresses of the interface, or of every interface if the ifindex is zero.
+int ewb_rtnl_get_addresses(ewb_rtnl_socket *rtnl, uint32_t ifindex, ewb_rtnl_addresses *addresses);
+void ewb_rtnl_addresses_destroy(ewb_rtnl_addresses *addresses);
+// Sends every change of the config in a single datagram and collects the acks together, returning the first error.
+int ewb_rtnl_configure_link(ewb_rtnl_socket *rtnl, uint32_t ifindex, const ewb_rtnl_link_config *config);
+// The links by their names, as if_nametoindex and wg_add_device do in the namespace of the caller only.
+int ewb_rtnl_get_ifindex(ewb_rtnl_socket *rtnl, const char *name, uint32_t *ifindex);
+int ewb_rtnl_add_link(ewb_rtnl_socket *rtnl, const char *name, const char *kind);
+int ewb_rtnl_del_link(ewb_rtnl_socket *rtnl, const char *name);
+// Lists the names of the links of the kind, in the format of wg_list_device_names, or returns NULL on failure.
+char *ewb_rtnl_list_links(ewb_rtnl_socket *rtnl, const char *kind);
+
+#endif
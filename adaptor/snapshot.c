@@ -0,0 +1,276 @@
+#include "errno.h"
+#include "stdlib.h"
+#include "string.h"
+#include "./snapshot.h"
+
+static void get_table_size(const struct wg_device *device, size_t *peer_count, size_t *allowedip_count)
+{
+  struct wg_peer *peer;
+  struct wg_allowedip *allowedip;
+
+  *peer_count = 0;
+  *allowedip_count = 0;
+  wg_for_each_peer(device, peer)
+  {
+    (*peer_count)++;
+    wg_for_each_allowedip(peer, allowedip)
+    {
+      (*allowedip_count)++;
+    }
+  }
+}
+
+extern size_t ewb_snapshot_get_size(const struct wg_device *device)
+{
+  size_t peer_count, allowedip_count;
+  get_table_size(device, &peer_count, &allowedip_count);
+
+  return sizeof(ewb_snapshot_header) + peer_count * sizeof(ewb_snapshot_peer) + allowedip_count * sizeof(ewb_snapshot_allowedip);
+}
+
+extern void ewb_snapshot_write(const struct wg_device *device, void *buffer)
+{
+  size_t peer_count, allowedip_count;
+  get_table_size(device, &peer_count, &allowedip_count);
+
+  ewb_snapshot_header *header = buffer;
+  memset(header, 0, sizeof(*header));
+  header->magic = EWB_SNAPSHOT_MAGIC;
+  header->version = EWB_SNAPSHOT_VERSION;
+  header->header_size = sizeof(ewb_snapshot_header);
+  header->flags = device->flags;
+  header->ifindex = device->ifindex;
+  size_t name_length = strnlen(device->name, sizeof(header->name) - 1);
+  memcpy(header->name, device->name, name_length);
+  header->name[name_length] = '\0';
+  header->fwmark = device->fwmark;
+  header->listen_port = device->listen_port;
+  header->peer_count = peer_count;
+  header->allowedip_count = allowedip_count;
+  header->peer_offset = sizeof(ewb_snapshot_header);
+  header->allowedip_offset = header->peer_offset + peer_count * sizeof(ewb_snapshot_peer);
+  memcpy(header->public_key, device->public_key, sizeof(wg_key));
+  memcpy(header->private_key, device->private_key, sizeof(wg_key));
+
+  ewb_snapshot_peer *peer_entry = (ewb_snapshot_peer *)((char *)buffer + header->peer_offset);
+  ewb_snapshot_allowedip *allowedip_entry = (ewb_snapshot_allowedip *)((char *)buffer + header->allowedip_offset);
+  uint32_t allowedip_index = 0;
+  struct wg_peer *peer;
+  wg_for_each_peer(device, peer)
+  {
+    memset(peer_entry, 0, sizeof(*peer_entry));
+    memcpy(peer_entry->public_key, peer->public_key, sizeof(wg_key));
+    memcpy(peer_entry->preshared_key, peer->preshared_key, sizeof(wg_key));
+    if (peer->endpoint.addr.sa_family == AF_INET)
+    {
+      memcpy(peer_entry->endpoint, &peer->endpoint.addr4, sizeof(struct sockaddr_in));
+    }
+    else if (peer->endpoint.addr.sa_family == AF_INET6)
+    {
+      memcpy(peer_entry->endpoint, &peer->endpoint.addr6, sizeof(struct sockaddr_in6));
+    }
+    peer_entry->persistent_keepalive_interval = peer->persistent_keepalive_interval;
+    peer_entry->flags = peer->flags;
+    peer_entry->allowedip_index = allowedip_index;
+    peer_entry->rx_bytes = peer->rx_bytes;
+    peer_entry->tx_bytes = peer->tx_bytes;
+    peer_entry->last_handshake_time_sec = peer->last_handshake_time.tv_sec;
+    peer_entry->last_handshake_time_nsec = peer->last_handshake_time.tv_nsec;
+
+    struct wg_allowedip *allowedip;
+    wg_for_each_allowedip(peer, allowedip)
+    {
+      memset(allowedip_entry, 0, sizeof(*allowedip_entry));
+      allowedip_entry->family = allowedip->family;
+      allowedip_entry->cidr = allowedip->cidr;
+      if (allowedip->family == AF_INET)
+      {
+        memcpy(allowedip_entry->addr, &allowedip->ip4, sizeof(struct in_addr));
+      }
+      else
+      {
+        memcpy(allowedip_entry->addr, &allowedip->ip6, sizeof(struct in6_addr));
+      }
+
+      allowedip_entry++;
+      peer_entry->allowedip_count++;
+    }
+
+    allowedip_index += peer_entry->allowedip_count;
+    peer_entry++;
+  }
+}
+
+static int read_allowedip(const ewb_snapshot_allowedip *entry, struct wg_allowedip *allowedip)
+{
+  allowedip->family = entry->family;
+  allowedip->cidr = entry->cidr;
+  if (entry->family == AF_INET && entry->cidr <= 32)
+  {
+    memcpy(&allowedip->ip4, entry->addr, sizeof(struct in_addr));
+  }
+  else if (entry->family == AF_INET6 && entry->cidr <= 128)
+  {
+    memcpy(&allowedip->ip6, entry->addr, sizeof(struct in6_addr));
+  }
+  else
+  {
+    return -EINVAL;
+  }
+
+  return 0;
+}
+
+static int read_peer(const ewb_snapshot_peer *entry, const ewb_snapshot_allowedip *allowedip_table, uint32_t allowedip_count, struct wg_peer *peer)
+{
+  if (entry->allowedip_index > allowedip_count || entry->allowedip_count > allowedip_count - entry->allowedip_index)
+  {
+    return -EINVAL;
+  }
+
+  peer->flags = entry->flags;
+  memcpy(peer->public_key, entry->public_key, sizeof(wg_key));
+  memcpy(peer->preshared_key, entry->preshared_key, sizeof(wg_key));
+  peer->persistent_keepalive_interval = entry->persistent_keepalive_interval;
+  peer->rx_bytes = entry->rx_bytes;
+  peer->tx_bytes = entry->tx_bytes;
+  peer->last_handshake_time.tv_sec = entry->last_handshake_time_sec;
+  peer->last_handshake_time.tv_nsec = entry->last_handshake_time_nsec;
+
+  struct sockaddr endpoint;
+  memcpy(&endpoint, entry->endpoint, sizeof(endpoint));
+  if (endpoint.sa_family == AF_INET)
+  {
+    memcpy(&peer->endpoint.addr4, entry->endpoint, sizeof(struct sockaddr_in));
+  }
+  else if (endpoint.sa_family == AF_INET6)
+  {
+    memcpy(&peer->endpoint.addr6, entry->endpoint, sizeof(struct sockaddr_in6));
+  }
+  else if (endpoint.sa_family != AF_UNSPEC)
+  {
+    return -EINVAL;
+  }
+
+  for (uint32_t index = 0; index < entry->allowedip_count; index++)
+  {
+    struct wg_allowedip *allowedip = calloc(1, sizeof(struct wg_allowedip));
+    if (allowedip == NULL)
+    {
+      return -ENOMEM;
+    }
+
+    if (peer->first_allowedip == NULL)
+    {
+      peer->first_allowedip = allowedip;
+    }
+    else
+    {
+      peer->last_allowedip->next_allowedip = allowedip;
+    }
+    peer->last_allowedip = allowedip;
+
+    if (read_allowedip(&allowedip_table[entry->allowedip_index + index], allowedip))
+    {
+      return -EINVAL;
+    }
+  }
+
+  return 0;
+}
+
+extern int ewb_snapshot_read(const void *buffer, size_t size, struct wg_device **device)
+{
+  *device = NULL;
+
+  ewb_snapshot_header header;
+  if (size < sizeof(header))
+  {
+    return -EINVAL;
+  }
+
+  // The buffer of a typed array is not guaranteed to be aligned, so we copy the entries out before reading them.
+  memcpy(&header, buffer, sizeof(header));
+  if (
+    header.magic != EWB_SNAPSHOT_MAGIC ||
+    header.version != EWB_SNAPSHOT_VERSION ||
+    header.header_size < sizeof(header) ||
+    header.peer_offset < header.header_size ||
+    header.allowedip_offset < header.header_size ||
+    memchr(header.name, '\0', sizeof(header.name)) == NULL ||
+    (uint64_t)header.peer_offset + (uint64_t)header.peer_count * sizeof(ewb_snapshot_peer) > size ||
+    (uint64_t)header.allowedip_offset + (uint64_t)header.allowedip_count * sizeof(ewb_snapshot_allowedip) > size
+  )
+  {
+    return -EINVAL;
+  }
+
+  ewb_snapshot_allowedip *allowedip_table = malloc(header.allowedip_count * sizeof(ewb_snapshot_allowedip) + 1);
+  struct wg_device *result = calloc(1, sizeof(struct wg_device));
+  if (allowedip_table == NULL || result == NULL)
+  {
+    free(allowedip_table);
+    free(result);
+    return -ENOMEM;
+  }
+  memcpy(allowedip_table, (const char *)buffer + header.allowedip_offset, header.allowedip_count * sizeof(ewb_snapshot_allowedip));
+
+  size_t name_length = strnlen(header.name, sizeof(result->name) - 1);
+  memcpy(result->name, header.name, name_length);
+  result->name[name_length] = '\0';
+  result->ifindex = header.ifindex;
+  result->flags = header.flags;
+  result->fwmark = header.fwmark;
+  result->listen_port = header.listen_port;
+  memcpy(result->public_key, header.public_key, sizeof(wg_key));
+  memcpy(result->private_key, header.private_key, sizeof(wg_key));
+
+  int ret = 0;
+  for (uint32_t index = 0; index < header.peer_count && ret == 0; index++)
+  {
+    ewb_snapshot_peer entry;
+    memcpy(&entry, (const char *)buffer + header.peer_offset + index * sizeof(entry), sizeof(entry));
+
+    struct wg_peer *peer = calloc(1, sizeof(struct wg_peer));
+    if (peer == NULL)
+    {
+      ret = -ENOMEM;
+      break;
+    }
+
+    if (result->first_peer == NULL)
+    {
+      result->first_peer = peer;
+    }
+    else
+    {
+      result->last_peer->next_peer = peer;
+    }
+    result->last_peer = peer;
+
+    ret = read_peer(&entry, allowedip_table, header.allowedip_count, peer);
+  }
+
+  free(allowedip_table);
+
+  if (ret)
+  {
+    wg_free_device(result);
+    return ret;
+  }
+
+  *device = result;
+
+  return 0;
+}
+
+extern void ewb_snapshot_set_restore_flags(struct wg_device *device)
+{
+  device->flags = WGDEVICE_REPLACE_PEERS | WGDEVICE_HAS_PRIVATE_KEY | WGDEVICE_HAS_LISTEN_PORT | WGDEVICE_HAS_FWMARK;
+
+  struct wg_peer *peer;
+  wg_for_each_peer(device, peer)
+  {
+    peer->flags = WGPEER_HAS_PUBLIC_KEY | WGPEER_REPLACE_ALLOWEDIPS | WGPEER_HAS_PRESHARED_KEY | WGPEER_HAS_PERSISTENT_KEEPALIVE_INTERVAL;
+  }
+}
@@ -0,0 +1,75 @@
+#ifndef EWB_SNAPSHOT_H
+#define EWB_SNAPSHOT_H
+
+#include "stddef.h"
+#include "stdint.h"
+#include "../externs/wireguard-tools/contrib/embeddable-wg-library/wireguard.h"
+
+// The snapshot is a flat image of a device in a single buffer, in host byte order.
+// It starts with the header, followed by the peer table and the allowed ip table at the offsets given in the header.
+// Every table has a fixed stride, so any field can be read by its offset without decoding the rest.
+#define EWB_SNAPSHOT_MAGIC 0x53425745 // "EWBS" in little endian.
+#define EWB_SNAPSHOT_VERSION 1
+
+typedef struct
+{
+  uint32_t magic;
+  uint16_t version;
+  uint16_t header_size;
+  uint32_t flags;
+  uint32_t ifindex;
+  char name[16];
+  uint32_t fwmark;
+  uint16_t listen_port;
+  uint16_t reserved;
+  uint32_t peer_count;
+  uint32_t allowedip_count;
+  uint32_t peer_offset;
+  uint32_t allowedip_offset;
+  uint64_t reserved2;
+  wg_key public_key;
+  wg_key private_key;
+} ewb_snapshot_header;
+
+typedef struct
+{
+  wg_key public_key;
+  wg_key preshared_key;
+  // The raw struct sockaddr_in or struct sockaddr_in6, where the family is AF_UNSPEC if the peer has no endpoint.
+  uint8_t endpoint[28];
+  uint16_t persistent_keepalive_interval;
+  uint16_t reserved;
+  uint32_t flags;
+  // The allowed ips of the peer are the range starting at allowedip_index in the allowed ip table.
+  uint32_t allowedip_index;
+  uint32_t allowedip_count;
+  uint32_t reserved2;
+  uint64_t rx_bytes;
+  uint64_t tx_bytes;
+  int64_t last_handshake_time_sec;
+  int64_t last_handshake_time_nsec;
+} ewb_snapshot_peer;
+
+typedef struct
+{
+  uint16_t family;
+  uint8_t cidr;
+  uint8_t reserved;
+  // The struct in_addr or struct in6_addr, in network byte order.
+  uint8_t addr[16];
+  uint32_t reserved2;
+} ewb_snapshot_allowedip;
+
+_Static_assert(sizeof(ewb_snapshot_header) == 128, "The snapshot header should be 128 bytes!");
+_Static_assert(sizeof(ewb_snapshot_peer) == 144, "The snapshot peer should be 144 bytes!");
+_Static_assert(sizeof(ewb_snapshot_allowedip) == 24, "The snapshot allowed ip should be 24 bytes!");
+
+size_t ewb_snapshot_get_size(const struct wg_device *device);
+// Writes the snapshot of the device into the buffer, which should be ewb_snapshot_get_size(device) bytes at least.
+void ewb_snapshot_write(const struct wg_device *device, void *buffer);
+// Reads the snapshot into a newly allocated device, returning -EINVAL if the snapshot is malformed.
+int ewb_snapshot_read(const void *buffer, size_t size, struct wg_device **device);
+// Replaces the flags read from the snapshot, which are the ones of getDevice, with the flags of setconf, so setting the device restores the whole config.
+void ewb_snapshot_set_restore_flags(struct wg_device *device);
+
+#endif
@@ -0,0 +1,320 @@
+#include "errno.h"
+#include "fcntl.h"
+#include "pthread.h"
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "unistd.h"
+#include "sys/mman.h"
+#include "sys/socket.h"
+#include "sys/stat.h"
+#include "./snapshot.h"
+#include "./state.h"
+
+#define STATE_ALIGNMENT 8
+
+static uint32_t crc_table[256];
+static pthread_once_t crc_table_once = PTHREAD_ONCE_INIT;
+
+static void create_crc_table(void)
+{
+  for (uint32_t index = 0; index < 256; index++)
+  {
+    uint32_t value = index;
+    for (int bit = 0; bit < 8; bit++)
+    {
+      value = value & 1 ? (value >> 1) ^ 0xedb88320 : value >> 1;
+    }
+
+    crc_table[index] = value;
+  }
+}
+
+// The CRC-32 of zlib, chained like its crc32 from 0, so the checksum of a file can be checked with the usual tools.
+static uint32_t update_checksum(uint32_t crc, const uint8_t *data, size_t size)
+{
+  pthread_once(&crc_table_once, create_crc_table);
+
+  crc ^= 0xffffffff;
+  for (size_t index = 0; index < size; index++)
+  {
+    crc = crc_table[(crc ^ data[index]) & 0xff] ^ (crc >> 8);
+  }
+
+  return crc ^ 0xffffffff;
+}
+
+// The header is taken with its checksum as zero, while the mapped file is read as it is.
+static uint32_t get_checksum(const ewb_state_header *header, const uint8_t *data, size_t size)
+{
+  ewb_state_header zeroed = *header;
+  zeroed.checksum = 0;
+
+  uint32_t crc = update_checksum(0, (const uint8_t *)&zeroed, sizeof(zeroed));
+
+  return update_checksum(crc, data + sizeof(zeroed), size - sizeof(zeroed));
+}
+
+static uint64_t align(uint64_t offset)
+{
+  return (offset + STATE_ALIGNMENT - 1) & ~(uint64_t)(STATE_ALIGNMENT - 1);
+}
+
+static int write_all(int fd, const uint8_t *data, size_t size)
+{
+  while (size > 0)
+  {
+    ssize_t count = write(fd, data, size);
+    if (count < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (count <= 0)
+    {
+      return count < 0 ? -errno : -EIO;
+    }
+
+    data += count;
+    size -= (size_t)count;
+  }
+
+  return 0;
+}
+
+extern int ewb_state_write_file(const char *path, const ewb_state_entry *entries, size_t count)
+{
+  if (count > UINT32_MAX)
+  {
+    return -EINVAL;
+  }
+
+  // We lay the devices out first, so the whole file is built in a single buffer and written at once.
+  uint64_t size = sizeof(ewb_state_header) + count * sizeof(ewb_state_device);
+  for (size_t index = 0; index < count; index++)
+  {
+    size = align(size) + ewb_snapshot_get_size(entries[index].device);
+    size = align(size) + entries[index].address_count * sizeof(ewb_state_address);
+  }
+
+  uint8_t *buffer = calloc(1, size);
+  if (buffer == NULL)
+  {
+    return -ENOMEM;
+  }
+
+  ewb_state_header *header = (ewb_state_header *)buffer;
+  header->magic = EWB_STATE_MAGIC;
+  header->version = EWB_STATE_VERSION;
+  header->header_size = sizeof(ewb_state_header);
+  header->device_count = count;
+  header->size = size;
+  header->device_offset = sizeof(ewb_state_header);
+
+  ewb_state_device *device_table = (ewb_state_device *)(buffer + header->device_offset);
+  uint64_t offset = header->device_offset + count * sizeof(ewb_state_device);
+  for (size_t index = 0; index < count; index++)
+  {
+    const ewb_state_entry *entry = &entries[index];
+    ewb_state_device *device_entry = &device_table[index];
+
+    device_entry->snapshot_offset = align(offset);
+    device_entry->snapshot_size = ewb_snapshot_get_size(entry->device);
+    ewb_snapshot_write(entry->device, buffer + device_entry->snapshot_offset);
+    offset = device_entry->snapshot_offset + device_entry->snapshot_size;
+
+    device_entry->address_offset = align(offset);
+    device_entry->address_count = entry->address_count;
+    ewb_state_address *address_entry = (ewb_state_address *)(buffer + device_entry->address_offset);
+    for (size_t address_index = 0; address_index < entry->address_count; address_index++)
+    {
+      address_entry[address_index].family = entry->addresses[address_index].family;
+      address_entry[address_index].prefix = entry->addresses[address_index].prefix;
+      memcpy(address_entry[address_index].addr, entry->addresses[address_index].addr, sizeof(address_entry[address_index].addr));
+    }
+    offset = device_entry->address_offset + entry->address_count * sizeof(ewb_state_address);
+  }
+
+  header->checksum = get_checksum(header, buffer, size);
+
+  char *temp_path = malloc(strlen(path) + sizeof(".XXXXXX"));
+  if (temp_path == NULL)
+  {
+    free(buffer);
+    return -ENOMEM;
+  }
+  sprintf(temp_path, "%s.XXXXXX", path);
+
+  int ret = 0;
+  int fd = mkostemp(temp_path, O_CLOEXEC);
+  if (fd < 0)
+  {
+    ret = -errno;
+  }
+  else
+  {
+    ret = write_all(fd, buffer, size);
+    if (!ret && fsync(fd) < 0)
+    {
+      ret = -errno;
+    }
+    if (close(fd) < 0 && !ret)
+    {
+      ret = -errno;
+    }
+    if (!ret && rename(temp_path, path) < 0)
+    {
+      ret = -errno;
+    }
+    if (ret)
+    {
+      unlink(temp_path);
+    }
+  }
+
+  free(temp_path);
+  free(buffer);
+
+  return ret;
+}
+
+extern int ewb_state_open_file(const char *path, ewb_state_file *file)
+{
+  memset(file, 0, sizeof(*file));
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    return -errno;
+  }
+
+  struct stat sbuf;
+  if (fstat(fd, &sbuf) < 0)
+  {
+    int ret = -errno;
+    close(fd);
+    return ret;
+  }
+  if (!S_ISREG(sbuf.st_mode) || (size_t)sbuf.st_size < sizeof(ewb_state_header))
+  {
+    close(fd);
+    return -EINVAL;
+  }
+
+  // The whole file is read by the checksum anyway, so we fault the pages in with the mapping.
+  size_t size = (size_t)sbuf.st_size;
+  void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+  {
+    return -errno;
+  }
+
+  ewb_state_header header;
+  memcpy(&header, data, sizeof(header));
+  if (
+    header.magic != EWB_STATE_MAGIC ||
+    header.version != EWB_STATE_VERSION ||
+    header.header_size < sizeof(header) ||
+    header.size != size ||
+    header.device_offset < header.header_size ||
+    header.device_offset > size ||
+    header.device_count > (size - header.device_offset) / sizeof(ewb_state_device) ||
+    header.checksum != get_checksum(&header, data, size)
+  )
+  {
+    munmap(data, size);
+    return -EINVAL;
+  }
+
+  for (uint32_t index = 0; index < header.device_count; index++)
+  {
+    ewb_state_device entry;
+    memcpy(&entry, (const uint8_t *)data + header.device_offset + index * sizeof(entry), sizeof(entry));
+    if (
+      entry.snapshot_offset > size ||
+      entry.snapshot_size > size - entry.snapshot_offset ||
+      entry.address_offset > size ||
+      (uint64_t)entry.address_count * sizeof(ewb_state_address) > size - entry.address_offset
+    )
+    {
+      munmap(data, size);
+      return -EINVAL;
+    }
+  }
+
+  file->data = data;
+  file->size = size;
+  file->device_count = header.device_count;
+
+  return 0;
+}
+
+extern void ewb_state_close_file(ewb_state_file *file)
+{
+  if (file->data != NULL)
+  {
+    munmap((void *)file->data, file->size);
+  }
+
+  memset(file, 0, sizeof(*file));
+}
+
+extern int ewb_state_read_device(const ewb_state_file *file, uint32_t index, struct wg_device **device, ewb_rtnl_address **addresses, size_t *address_count)
+{
+  *device = NULL;
+  *addresses = NULL;
+  *address_count = 0;
+
+  if (index >= file->device_count)
+  {
+    return -EINVAL;
+  }
+
+  ewb_state_header header;
+  ewb_state_device entry;
+  memcpy(&header, file->data, sizeof(header));
+  memcpy(&entry, (const uint8_t *)file->data + header.device_offset + index * sizeof(entry), sizeof(entry));
+
+  struct wg_device *result;
+  int ret = ewb_snapshot_read((const uint8_t *)file->data + entry.snapshot_offset, entry.snapshot_size, &result);
+  if (ret)
+  {
+    return ret;
+  }
+
+  // The interface may be another one after a restart, so the device goes by its name alone.
+  result->ifindex = 0;
+  ewb_snapshot_set_restore_flags(result);
+
+  ewb_rtnl_address *result_addresses = calloc(entry.address_count + 1, sizeof(ewb_rtnl_address));
+  if (result_addresses == NULL)
+  {
+    wg_free_device(result);
+    return -ENOMEM;
+  }
+
+  for (uint32_t address_index = 0; address_index < entry.address_count; address_index++)
+  {
+    ewb_state_address address;
+    memcpy(&address, (const uint8_t *)file->data + entry.address_offset + address_index * sizeof(address), sizeof(address));
+    if (
+      (address.family != AF_INET || address.prefix > 32) &&
+      (address.family != AF_INET6 || address.prefix > 128)
+    )
+    {
+      free(result_addresses);
+      wg_free_device(result);
+      return -EINVAL;
+    }
+
+    result_addresses[address_index].family = address.family;
+    result_addresses[address_index].prefix = address.prefix;
+    memcpy(result_addresses[address_index].addr, address.addr, sizeof(address.addr));
+  }
+
+  *device = result;
+  *addresses = result_addresses;
+  *address_count = entry.address_count;
+
+  return 0;
+}
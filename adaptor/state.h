@@ -0,0 +1,73 @@
+#ifndef EWB_STATE_H
+#define EWB_STATE_H
+
+#include "stddef.h"
+#include "stdint.h"
+#include "./rtnl.h"
+#include "../externs/wireguard-tools/contrib/embeddable-wg-library/wireguard.h"
+
+// The state file keeps many devices with their interface addresses, in host byte order.
+// It starts with the header and the device table, and every device is a snapshot of snapshot.h followed by its addresses.
+// The checksum is the CRC-32 of the whole file with the checksum field as zero, so a torn or stale write is refused as a whole.
+#define EWB_STATE_MAGIC 0x54425745 // "EWBT" in little endian.
+#define EWB_STATE_VERSION 1
+
+typedef struct
+{
+  uint32_t magic;
+  uint16_t version;
+  uint16_t header_size;
+  uint32_t device_count;
+  uint32_t checksum;
+  uint64_t size;
+  uint64_t device_offset;
+} ewb_state_header;
+
+typedef struct
+{
+  uint64_t snapshot_offset;
+  uint64_t snapshot_size;
+  uint64_t address_offset;
+  uint32_t address_count;
+  uint32_t reserved;
+} ewb_state_device;
+
+typedef struct
+{
+  uint16_t family;
+  uint8_t prefix;
+  uint8_t reserved;
+  // The struct in_addr or struct in6_addr, in network byte order.
+  uint8_t addr[16];
+} ewb_state_address;
+
+_Static_assert(sizeof(ewb_state_header) == 32, "The state header should be 32 bytes!");
+_Static_assert(sizeof(ewb_state_device) == 32, "The state device should be 32 bytes!");
+_Static_assert(sizeof(ewb_state_address) == 20, "The state address should be 20 bytes!");
+
+typedef struct
+{
+  const struct wg_device *device;
+  const ewb_rtnl_address *addresses;
+  size_t address_count;
+} ewb_state_entry;
+
+// The state file mapped into memory, read by any number of threads at once.
+typedef struct
+{
+  const void *data;
+  size_t size;
+  uint32_t device_count;
+} ewb_state_file;
+
+// Writes the devices next to the path and renames the file over it, so the path always has a whole state.
+// The file is only readable by the owner, as it has the private keys.
+int ewb_state_write_file(const char *path, const ewb_state_entry *entries, size_t count);
+// Maps the file and checks its header, checksum, and device table, returning -EINVAL if it is malformed.
+int ewb_state_open_file(const char *path, ewb_state_file *file);
+void ewb_state_close_file(ewb_state_file *file);
+// Reads the device at the index into a newly allocated device with the flags of setconf, so it replaces the whole config.
+// The addresses are newly allocated as well, with the ifindex left to the caller.
+int ewb_state_read_device(const ewb_state_file *file, uint32_t index, struct wg_device **device, ewb_rtnl_address **addresses, size_t *address_count);
+
+#endif
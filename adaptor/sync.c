@@ -0,0 +1,294 @@
+#include "errno.h"
+#include "stdlib.h"
+#include "string.h"
+#include "./peer_table.h"
+#include "./sync.h"
+
+// The family, the prefix length and the masked address, so equal prefixes are equal in memcmp.
+#define CANONICAL_ALLOWEDIP_SIZE 18
+
+static void canonicalize_allowedip(const struct wg_allowedip *allowedip, uint8_t *canonical)
+{
+  size_t address_size = allowedip->family == AF_INET6 ? 16 : 4;
+  size_t cidr = allowedip->cidr > address_size * 8 ? address_size * 8 : allowedip->cidr;
+
+  memset(canonical, 0, CANONICAL_ALLOWEDIP_SIZE);
+  canonical[0] = allowedip->family == AF_INET6 ? 6 : 4;
+  canonical[1] = (uint8_t)cidr;
+  memcpy(canonical + 2, &allowedip->ip6, address_size);
+
+  // The kernel stores the prefix masked, so `10.0.0.1/24` in the config is `10.0.0.0/24` in the device.
+  for (size_t bit = cidr; bit < address_size * 8; bit++)
+  {
+    canonical[2 + bit / 8] &= ~(0x80 >> (bit % 8));
+  }
+}
+
+static int compare_canonical_allowedips(const void *a, const void *b)
+{
+  return memcmp(a, b, CANONICAL_ALLOWEDIP_SIZE);
+}
+
+static uint8_t *create_canonical_allowedips(const struct wg_peer *peer, size_t *count)
+{
+  *count = 0;
+
+  const struct wg_allowedip *allowedip;
+  wg_for_each_allowedip(peer, allowedip)
+  {
+    (*count)++;
+  }
+
+  uint8_t *canonical = malloc(*count * CANONICAL_ALLOWEDIP_SIZE + 1);
+  if (canonical == NULL)
+  {
+    return NULL;
+  }
+
+  size_t index = 0;
+  wg_for_each_allowedip(peer, allowedip)
+  {
+    canonicalize_allowedip(allowedip, canonical + CANONICAL_ALLOWEDIP_SIZE * index++);
+  }
+  qsort(canonical, *count, CANONICAL_ALLOWEDIP_SIZE, compare_canonical_allowedips);
+
+  return canonical;
+}
+
+static int is_allowedips_equal(const struct wg_peer *current, const struct wg_peer *desired)
+{
+  size_t current_count, desired_count;
+  uint8_t *current_canonical = create_canonical_allowedips(current, &current_count);
+  uint8_t *desired_canonical = create_canonical_allowedips(desired, &desired_count);
+  if (current_canonical == NULL || desired_canonical == NULL)
+  {
+    free(current_canonical);
+    free(desired_canonical);
+    return -ENOMEM;
+  }
+
+  int is_equal = current_count == desired_count && memcmp(current_canonical, desired_canonical, current_count * CANONICAL_ALLOWEDIP_SIZE) == 0;
+
+  free(current_canonical);
+  free(desired_canonical);
+
+  return is_equal;
+}
+
+static bool is_endpoint_equal(const wg_endpoint *current, const wg_endpoint *desired)
+{
+  if (current->addr.sa_family != desired->addr.sa_family)
+  {
+    return false;
+  }
+
+  if (desired->addr.sa_family == AF_INET)
+  {
+    return current->addr4.sin_port == desired->addr4.sin_port && current->addr4.sin_addr.s_addr == desired->addr4.sin_addr.s_addr;
+  }
+
+  return current->addr6.sin6_port == desired->addr6.sin6_port && memcmp(&current->addr6.sin6_addr, &desired->addr6.sin6_addr, sizeof(struct in6_addr)) == 0;
+}
+
+// Strips the unchanged properties from the desired peer and sets the flags to apply, which stay 0 if the peer is up to date.
+static int reduce_peer(const struct wg_peer *current, struct wg_peer *desired, uint32_t *flags)
+{
+  *flags = 0;
+
+  if (memcmp(current->preshared_key, desired->preshared_key, sizeof(wg_key)) != 0)
+  {
+    *flags |= WGPEER_HAS_PRESHARED_KEY;
+  }
+  if (current->persistent_keepalive_interval != desired->persistent_keepalive_interval)
+  {
+    *flags |= WGPEER_HAS_PERSISTENT_KEEPALIVE_INTERVAL;
+  }
+
+  // The endpoint of the peer roams, so we only touch it if the config asks for a specific one.
+  bool is_endpoint_changed = desired->endpoint.addr.sa_family != AF_UNSPEC && !is_endpoint_equal(&current->endpoint, &desired->endpoint);
+  if (!is_endpoint_changed)
+  {
+    desired->endpoint.addr.sa_family = AF_UNSPEC;
+  }
+
+  int is_equal = is_allowedips_equal(current, desired);
+  if (is_equal < 0)
+  {
+    return is_equal;
+  }
+  if (is_equal)
+  {
+    desired->first_allowedip = NULL;
+    desired->last_allowedip = NULL;
+  }
+  else
+  {
+    *flags |= WGPEER_REPLACE_ALLOWEDIPS;
+  }
+
+  if (*flags || is_endpoint_changed)
+  {
+    *flags |= WGPEER_HAS_PUBLIC_KEY;
+  }
+
+  return 0;
+}
+
+extern int ewb_sync_reduce_device(const struct wg_device *current, struct wg_device *desired, ewb_arena *arena, ewb_sync_summary *summary)
+{
+  memset(summary, 0, sizeof(ewb_sync_summary));
+
+  size_t current_count = 0, desired_count = 0;
+  struct wg_peer *peer;
+  wg_for_each_peer(current, peer)
+  {
+    current_count++;
+  }
+  wg_for_each_peer(desired, peer)
+  {
+    desired_count++;
+  }
+
+  ewb_peer_table table, desired_table;
+  int ret = ewb_peer_table_init(&table, current_count);
+  if (ret)
+  {
+    return ret;
+  }
+  if ((ret = ewb_peer_table_init(&desired_table, desired_count)))
+  {
+    ewb_peer_table_destroy(&table);
+    return ret;
+  }
+
+  summary->added = malloc((desired_count + 1) * sizeof(wg_key));
+  summary->updated = malloc((desired_count + 1) * sizeof(wg_key));
+  summary->removed = malloc((current_count + 1) * sizeof(wg_key));
+  if (summary->added == NULL || summary->updated == NULL || summary->removed == NULL)
+  {
+    ret = -ENOMEM;
+    goto out;
+  }
+
+  wg_for_each_peer(current, peer)
+  {
+    if ((ret = ewb_peer_table_set(&table, peer->public_key, peer)))
+    {
+      goto out;
+    }
+  }
+
+  uint32_t device_flags = 0;
+  if (memcmp(current->private_key, desired->private_key, sizeof(wg_key)) != 0)
+  {
+    device_flags |= WGDEVICE_HAS_PRIVATE_KEY;
+  }
+  // The zero listen port lets the kernel pick one, so we do not fight over the picked port on every sync.
+  if (desired->listen_port != 0 && current->listen_port != desired->listen_port)
+  {
+    device_flags |= WGDEVICE_HAS_LISTEN_PORT;
+  }
+  if (current->fwmark != desired->fwmark)
+  {
+    device_flags |= WGDEVICE_HAS_FWMARK;
+  }
+  desired->flags = device_flags;
+  summary->is_device_changed = device_flags != 0;
+
+  struct wg_peer *previous_peer = NULL;
+  struct wg_peer *next_peer;
+  for (peer = desired->first_peer; peer != NULL; peer = next_peer)
+  {
+    next_peer = peer->next_peer;
+
+    // The second peer with the same key would be counted as added, as the first one already took the current peer out of the table.
+    if (ewb_peer_table_get(&desired_table, peer->public_key) != NULL)
+    {
+      ret = -EINVAL;
+      goto out;
+    }
+    if ((ret = ewb_peer_table_set(&desired_table, peer->public_key, peer)))
+    {
+      goto out;
+    }
+
+    // We take the peer out of the table, so the peers left over at the end are the ones to remove.
+    const struct wg_peer *current_peer = ewb_peer_table_remove(&table, peer->public_key);
+    if (current_peer == NULL)
+    {
+      peer->flags = WGPEER_HAS_PUBLIC_KEY | WGPEER_HAS_PRESHARED_KEY | WGPEER_HAS_PERSISTENT_KEEPALIVE_INTERVAL | WGPEER_REPLACE_ALLOWEDIPS;
+      memcpy(summary->added[summary->added_count++], peer->public_key, sizeof(wg_key));
+      previous_peer = peer;
+      continue;
+    }
+
+    uint32_t peer_flags;
+    if ((ret = reduce_peer(current_peer, peer, &peer_flags)))
+    {
+      goto out;
+    }
+
+    if (peer_flags)
+    {
+      peer->flags = peer_flags;
+      memcpy(summary->updated[summary->updated_count++], peer->public_key, sizeof(wg_key));
+      previous_peer = peer;
+      continue;
+    }
+
+    if (previous_peer == NULL)
+    {
+      desired->first_peer = next_peer;
+    }
+    else
+    {
+      previous_peer->next_peer = next_peer;
+    }
+    summary->unchanged_count++;
+  }
+  desired->last_peer = previous_peer;
+
+  struct wg_peer *removals = table.size > 0 ? ewb_arena_alloc(arena, table.size * sizeof(struct wg_peer)) : NULL;
+  if (table.size > 0 && removals == NULL)
+  {
+    ret = -ENOMEM;
+    goto out;
+  }
+
+  size_t index;
+  ewb_peer_table_for_each(&table, index)
+  {
+    struct wg_peer *removal = &removals[summary->removed_count];
+    memcpy(removal->public_key, table.keys[index], sizeof(wg_key));
+    removal->flags = WGPEER_HAS_PUBLIC_KEY | WGPEER_REMOVE_ME;
+    memcpy(summary->removed[summary->removed_count++], removal->public_key, sizeof(wg_key));
+
+    if (desired->last_peer == NULL)
+    {
+      desired->first_peer = removal;
+    }
+    else
+    {
+      desired->last_peer->next_peer = removal;
+    }
+    desired->last_peer = removal;
+  }
+
+out:
+  ewb_peer_table_destroy(&table);
+  ewb_peer_table_destroy(&desired_table);
+  if (ret)
+  {
+    ewb_sync_summary_destroy(summary);
+  }
+
+  return ret;
+}
+
+extern void ewb_sync_summary_destroy(ewb_sync_summary *summary)
+{
+  free(summary->added);
+  free(summary->removed);
+  free(summary->updated);
+  memset(summary, 0, sizeof(ewb_sync_summary));
+}
@@ -0,0 +1,28 @@
+#ifndef EWB_SYNC_H
+#define EWB_SYNC_H
+
+#include "stdbool.h"
+#include "stddef.h"
+#include "./arena.h"
+#include "../externs/wireguard-tools/contrib/embeddable-wg-library/wireguard.h"
+
+typedef struct
+{
+  wg_key *added;
+  size_t added_count;
+  wg_key *removed;
+  size_t removed_count;
+  wg_key *updated;
+  size_t updated_count;
+  size_t unchanged_count;
+  bool is_device_changed;
+} ewb_sync_summary;
+
+// Reduces the desired device into the minimal delta to apply over the current device.
+// The desired device is built in the arena, so the peers that are already up to date are only unlinked,
+// and the peers only in the current device are allocated from the arena and appended with WGPEER_REMOVE_ME.
+// Returns -EINVAL if the desired device has the same public key more than once.
+int ewb_sync_reduce_device(const struct wg_device *current, struct wg_device *desired, ewb_arena *arena, ewb_sync_summary *summary);
+void ewb_sync_summary_destroy(ewb_sync_summary *summary);
+
+#endif
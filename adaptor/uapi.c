@@ -0,0 +1,714 @@
+#include "dirent.h"
+#include "errno.h"
+#include "pthread.h"
+#include "stdarg.h"
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "unistd.h"
+#include "arpa/inet.h"
+#include "net/if.h"
+#include "sys/socket.h"
+#include "sys/stat.h"
+#include "sys/un.h"
+#include "./metrics.h"
+#include "./uapi.h"
+
+#define SOCKET_PATH_SIZE sizeof(((struct sockaddr_un *)0)->sun_path)
+
+static pthread_mutex_t socket_directory_lock = PTHREAD_MUTEX_INITIALIZER;
+static char socket_directory[SOCKET_PATH_SIZE] = EWB_UAPI_SOCKET_DIRECTORY;
+
+extern void ewb_uapi_set_socket_directory(const char *directory)
+{
+  pthread_mutex_lock(&socket_directory_lock);
+  strncpy(socket_directory, directory, SOCKET_PATH_SIZE - 1);
+  pthread_mutex_unlock(&socket_directory_lock);
+}
+
+static int get_socket_path(const char *device_name, char *path)
+{
+  pthread_mutex_lock(&socket_directory_lock);
+  int length = snprintf(path, SOCKET_PATH_SIZE, "%s/%s.sock", socket_directory, device_name);
+  pthread_mutex_unlock(&socket_directory_lock);
+
+  return length < 0 || (size_t)length >= SOCKET_PATH_SIZE ? -ENAMETOOLONG : 0;
+}
+
+extern bool ewb_uapi_has_device(const char *device_name)
+{
+  char path[SOCKET_PATH_SIZE];
+  struct stat sbuf;
+
+  return get_socket_path(device_name, path) == 0 && stat(path, &sbuf) == 0 && S_ISSOCK(sbuf.st_mode);
+}
+
+extern char *ewb_uapi_list_device_names(void)
+{
+  char directory[SOCKET_PATH_SIZE];
+  pthread_mutex_lock(&socket_directory_lock);
+  memcpy(directory, socket_directory, SOCKET_PATH_SIZE);
+  pthread_mutex_unlock(&socket_directory_lock);
+
+  size_t length = 0, capacity = IFNAMSIZ * 4;
+  char *names = malloc(capacity + 1);
+  if (names == NULL)
+  {
+    return NULL;
+  }
+
+  // The directory is missing if no userspace implementation ever ran, which is an empty list.
+  DIR *dir = opendir(directory);
+  if (dir != NULL)
+  {
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+      size_t name_length = strlen(entry->d_name);
+      if (name_length <= 5 || name_length - 5 >= IFNAMSIZ || strcmp(entry->d_name + name_length - 5, ".sock") != 0)
+      {
+        continue;
+      }
+      name_length -= 5;
+
+      if (length + name_length + 1 > capacity)
+      {
+        capacity *= 2;
+        char *next_names = realloc(names, capacity + 1);
+        if (next_names == NULL)
+        {
+          closedir(dir);
+          free(names);
+          return NULL;
+        }
+        names = next_names;
+      }
+
+      memcpy(names + length, entry->d_name, name_length);
+      names[length + name_length] = '\0';
+      length += name_length + 1;
+    }
+
+    closedir(dir);
+  }
+
+  names[length] = '\0';
+
+  return names;
+}
+
+static int connect_device(const char *device_name)
+{
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  int ret = get_socket_path(device_name, addr.sun_path);
+  if (ret)
+  {
+    return ret;
+  }
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+  {
+    return -errno;
+  }
+
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+  {
+    ret = -errno;
+    close(fd);
+    return ret;
+  }
+
+  return fd;
+}
+
+// The commands are written into a fixed buffer and sent whenever it fills, so a large device costs no allocation.
+typedef struct
+{
+  int fd;
+  int error;
+  size_t length;
+  char data[EWB_UAPI_BUFFER_SIZE];
+} uapi_writer;
+
+static void flush_writer(uapi_writer *writer)
+{
+  size_t offset = 0;
+  while (!writer->error && offset < writer->length)
+  {
+    ssize_t written = send(writer->fd, writer->data + offset, writer->length - offset, MSG_NOSIGNAL);
+    if (written < 0)
+    {
+      if (errno != EINTR)
+      {
+        writer->error = -errno;
+      }
+      continue;
+    }
+
+    offset += (size_t)written;
+    ewb_metrics_record_bytes((size_t)written, 0);
+  }
+
+  writer->length = 0;
+}
+
+static void write_line(uapi_writer *writer, const char *format, ...)
+{
+  for (int attempt = 0; attempt < 2 && !writer->error; attempt++)
+  {
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(writer->data + writer->length, sizeof(writer->data) - writer->length, format, args);
+    va_end(args);
+
+    if (length >= 0 && (size_t)length < sizeof(writer->data) - writer->length)
+    {
+      writer->length += (size_t)length;
+      return;
+    }
+
+    flush_writer(writer);
+  }
+
+  if (!writer->error)
+  {
+    writer->error = -EMSGSIZE;
+  }
+}
+
+static void write_key_line(uapi_writer *writer, const char *name, const wg_key key)
+{
+  static const char hex_digits[] = "0123456789abcdef";
+  char hex[sizeof(wg_key) * 2 + 1];
+
+  for (size_t index = 0; index < sizeof(wg_key); index++)
+  {
+    hex[index * 2] = hex_digits[key[index] >> 4];
+    hex[index * 2 + 1] = hex_digits[key[index] & 0xf];
+  }
+  hex[sizeof(wg_key) * 2] = '\0';
+
+  write_line(writer, "%s=%s\n", name, hex);
+}
+
+static void write_endpoint_line(uapi_writer *writer, const wg_endpoint *endpoint)
+{
+  char addr[INET6_ADDRSTRLEN];
+
+  if (endpoint->addr.sa_family == AF_INET && inet_ntop(AF_INET, &endpoint->addr4.sin_addr, addr, sizeof(addr)) != NULL)
+  {
+    write_line(writer, "endpoint=%s:%u\n", addr, ntohs(endpoint->addr4.sin_port));
+  }
+  else if (endpoint->addr.sa_family == AF_INET6 && inet_ntop(AF_INET6, &endpoint->addr6.sin6_addr, addr, sizeof(addr)) != NULL)
+  {
+    write_line(writer, "endpoint=[%s]:%u\n", addr, ntohs(endpoint->addr6.sin6_port));
+  }
+}
+
+static void write_allowedip_line(uapi_writer *writer, const struct wg_allowedip *allowedip)
+{
+  char addr[INET6_ADDRSTRLEN];
+
+  if (inet_ntop(allowedip->family, &allowedip->ip6, addr, sizeof(addr)) != NULL)
+  {
+    write_line(writer, "allowed_ip=%s/%u\n", addr, allowedip->cidr);
+  }
+}
+
+// The lines are split in place in a fixed buffer, and only the tail of a line cut by a read is moved to the front.
+typedef struct
+{
+  int fd;
+  size_t start;
+  size_t end;
+  char data[EWB_UAPI_BUFFER_SIZE];
+} uapi_reader;
+
+// The buffers are reused by every call on the thread, as a call never runs inside another on the same thread.
+static __thread uapi_writer thread_writer;
+static __thread uapi_reader thread_reader;
+
+static uapi_writer *begin_writer(int fd)
+{
+  thread_writer.fd = fd;
+  thread_writer.error = 0;
+  thread_writer.length = 0;
+
+  return &thread_writer;
+}
+
+static uapi_reader *begin_reader(int fd)
+{
+  thread_reader.fd = fd;
+  thread_reader.start = 0;
+  thread_reader.end = 0;
+
+  return &thread_reader;
+}
+
+static int read_line(uapi_reader *reader, char **line)
+{
+  for (;;)
+  {
+    char *newline = memchr(reader->data + reader->start, '\n', reader->end - reader->start);
+    if (newline != NULL)
+    {
+      *newline = '\0';
+      *line = reader->data + reader->start;
+      reader->start = (size_t)(newline - reader->data) + 1;
+      return 0;
+    }
+
+    if (reader->start > 0)
+    {
+      memmove(reader->data, reader->data + reader->start, reader->end - reader->start);
+      reader->end -= reader->start;
+      reader->start = 0;
+    }
+    if (reader->end == sizeof(reader->data))
+    {
+      return -EMSGSIZE;
+    }
+
+    ssize_t received = recv(reader->fd, reader->data + reader->end, sizeof(reader->data) - reader->end, 0);
+    if (received < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      return -errno;
+    }
+    if (received == 0)
+    {
+      // The reply always ends with an empty line, so the peer closing before it is a broken reply.
+      return -EPROTO;
+    }
+
+    reader->end += (size_t)received;
+    ewb_metrics_record_bytes(0, (size_t)received);
+  }
+}
+
+static int parse_uint(const char *value, uint64_t max, uint64_t *result)
+{
+  char *end;
+  errno = 0;
+  unsigned long long parsed = strtoull(value, &end, 10);
+  if (errno || end == value || *end != '\0' || value[0] == '-' || parsed > max)
+  {
+    return -EINVAL;
+  }
+
+  *result = parsed;
+
+  return 0;
+}
+
+static int parse_hex_digit(char digit)
+{
+  if (digit >= '0' && digit <= '9')
+  {
+    return digit - '0';
+  }
+  if (digit >= 'a' && digit <= 'f')
+  {
+    return digit - 'a' + 10;
+  }
+  if (digit >= 'A' && digit <= 'F')
+  {
+    return digit - 'A' + 10;
+  }
+
+  return -1;
+}
+
+static int parse_key(const char *value, wg_key key)
+{
+  if (strlen(value) != sizeof(wg_key) * 2)
+  {
+    return -EINVAL;
+  }
+
+  for (size_t index = 0; index < sizeof(wg_key); index++)
+  {
+    int high = parse_hex_digit(value[index * 2]), low = parse_hex_digit(value[index * 2 + 1]);
+    if (high < 0 || low < 0)
+    {
+      return -EINVAL;
+    }
+
+    key[index] = (uint8_t)(high << 4 | low);
+  }
+
+  return 0;
+}
+
+static int parse_endpoint(char *value, wg_endpoint *endpoint)
+{
+  char *port = strrchr(value, ':');
+  if (port == NULL)
+  {
+    return -EINVAL;
+  }
+  *port++ = '\0';
+
+  uint64_t port_number;
+  if (parse_uint(port, 65535, &port_number))
+  {
+    return -EINVAL;
+  }
+
+  size_t length = strlen(value);
+  if (length >= 2 && value[0] == '[' && value[length - 1] == ']')
+  {
+    value[length - 1] = '\0';
+    if (inet_pton(AF_INET6, value + 1, &endpoint->addr6.sin6_addr) != 1)
+    {
+      return -EINVAL;
+    }
+
+    endpoint->addr6.sin6_family = AF_INET6;
+    endpoint->addr6.sin6_port = htons((uint16_t)port_number);
+    return 0;
+  }
+
+  if (inet_pton(AF_INET, value, &endpoint->addr4.sin_addr) != 1)
+  {
+    return -EINVAL;
+  }
+
+  endpoint->addr4.sin_family = AF_INET;
+  endpoint->addr4.sin_port = htons((uint16_t)port_number);
+
+  return 0;
+}
+
+static int parse_allowedip(char *value, struct wg_allowedip *allowedip)
+{
+  char *cidr = strchr(value, '/');
+  if (cidr == NULL)
+  {
+    return -EINVAL;
+  }
+  *cidr++ = '\0';
+
+  allowedip->family = strchr(value, ':') != NULL ? AF_INET6 : AF_INET;
+
+  uint64_t cidr_number;
+  if (
+    inet_pton(allowedip->family, value, &allowedip->ip6) != 1 ||
+    parse_uint(cidr, allowedip->family == AF_INET6 ? 128 : 32, &cidr_number)
+  )
+  {
+    return -EINVAL;
+  }
+  allowedip->cidr = (uint8_t)cidr_number;
+
+  return 0;
+}
+
+static int parse_peer_line(struct wg_peer *peer, const char *key, char *value)
+{
+  uint64_t number;
+
+  if (strcmp(key, "preshared_key") == 0)
+  {
+    if (parse_key(value, peer->preshared_key))
+    {
+      return -EINVAL;
+    }
+    if (!wg_key_is_zero(peer->preshared_key))
+    {
+      peer->flags |= WGPEER_HAS_PRESHARED_KEY;
+    }
+  }
+  else if (strcmp(key, "endpoint") == 0)
+  {
+    return parse_endpoint(value, &peer->endpoint);
+  }
+  else if (strcmp(key, "persistent_keepalive_interval") == 0)
+  {
+    if (parse_uint(value, UINT16_MAX, &number))
+    {
+      return -EINVAL;
+    }
+    peer->persistent_keepalive_interval = (uint16_t)number;
+  }
+  else if (strcmp(key, "allowed_ip") == 0)
+  {
+    struct wg_allowedip *allowedip = calloc(1, sizeof(struct wg_allowedip));
+    if (allowedip == NULL)
+    {
+      return -ENOMEM;
+    }
+
+    if (peer->first_allowedip == NULL)
+    {
+      peer->first_allowedip = allowedip;
+    }
+    else
+    {
+      peer->last_allowedip->next_allowedip = allowedip;
+    }
+    peer->last_allowedip = allowedip;
+
+    return parse_allowedip(value, allowedip);
+  }
+  else if (strcmp(key, "last_handshake_time_sec") == 0)
+  {
+    if (parse_uint(value, INT64_MAX, &number))
+    {
+      return -EINVAL;
+    }
+    peer->last_handshake_time.tv_sec = (int64_t)number;
+  }
+  else if (strcmp(key, "last_handshake_time_nsec") == 0)
+  {
+    if (parse_uint(value, INT64_MAX, &number))
+    {
+      return -EINVAL;
+    }
+    peer->last_handshake_time.tv_nsec = (int64_t)number;
+  }
+  else if (strcmp(key, "rx_bytes") == 0)
+  {
+    if (parse_uint(value, UINT64_MAX, &number))
+    {
+      return -EINVAL;
+    }
+    peer->rx_bytes = number;
+  }
+  else if (strcmp(key, "tx_bytes") == 0)
+  {
+    if (parse_uint(value, UINT64_MAX, &number))
+    {
+      return -EINVAL;
+    }
+    peer->tx_bytes = number;
+  }
+
+  // The other keys, e.g. protocol_version, say nothing the wg_peer has a place for.
+  return 0;
+}
+
+// Applies a line of the get reply to the device, which is filled in the order the lines arrive.
+static int parse_device_line(struct wg_device *device, const char *key, char *value, int *reply_errno)
+{
+  uint64_t number;
+
+  if (strcmp(key, "errno") == 0)
+  {
+    if (parse_uint(value, INT32_MAX, &number))
+    {
+      return -EPROTO;
+    }
+    *reply_errno = (int)number;
+  }
+  else if (strcmp(key, "public_key") == 0)
+  {
+    struct wg_peer *peer = calloc(1, sizeof(struct wg_peer));
+    if (peer == NULL)
+    {
+      return -ENOMEM;
+    }
+
+    if (device->first_peer == NULL)
+    {
+      device->first_peer = peer;
+    }
+    else
+    {
+      device->last_peer->next_peer = peer;
+    }
+    device->last_peer = peer;
+
+    if (parse_key(value, peer->public_key))
+    {
+      return -EINVAL;
+    }
+    peer->flags |= WGPEER_HAS_PUBLIC_KEY;
+  }
+  else if (device->last_peer != NULL)
+  {
+    // Every line after the first public key belongs to the last peer.
+    return parse_peer_line(device->last_peer, key, value);
+  }
+  else if (strcmp(key, "private_key") == 0)
+  {
+    if (parse_key(value, device->private_key))
+    {
+      return -EINVAL;
+    }
+
+    // The userspace api does not tell the public key, so we derive it as the kernel does.
+    if (!wg_key_is_zero(device->private_key))
+    {
+      wg_generate_public_key(device->public_key, device->private_key);
+      device->flags |= WGDEVICE_HAS_PRIVATE_KEY | WGDEVICE_HAS_PUBLIC_KEY;
+    }
+  }
+  else if (strcmp(key, "listen_port") == 0)
+  {
+    if (parse_uint(value, UINT16_MAX, &number))
+    {
+      return -EINVAL;
+    }
+    device->listen_port = (uint16_t)number;
+  }
+  else if (strcmp(key, "fwmark") == 0)
+  {
+    if (parse_uint(value, UINT32_MAX, &number))
+    {
+      return -EINVAL;
+    }
+    device->fwmark = (uint32_t)number;
+  }
+
+  return 0;
+}
+
+extern int ewb_uapi_get_device(struct wg_device **device, const char *device_name)
+{
+  int fd = connect_device(device_name);
+  if (fd < 0)
+  {
+    return fd;
+  }
+
+  struct wg_device *result = calloc(1, sizeof(struct wg_device));
+  if (result == NULL)
+  {
+    close(fd);
+    return -ENOMEM;
+  }
+  strncpy(result->name, device_name, IFNAMSIZ - 1);
+
+  uapi_writer *writer = begin_writer(fd);
+  write_line(writer, "get=1\n\n");
+  flush_writer(writer);
+  int ret = writer->error;
+
+  uapi_reader *reader = begin_reader(fd);
+
+  int reply_errno = 0;
+  while (!ret)
+  {
+    char *line;
+    ret = read_line(reader, &line);
+    if (ret || line[0] == '\0')
+    {
+      break;
+    }
+
+    char *value = strchr(line, '=');
+    if (value == NULL)
+    {
+      ret = -EPROTO;
+      break;
+    }
+    *value++ = '\0';
+
+    ret = parse_device_line(result, line, value, &reply_errno);
+  }
+
+  close(fd);
+
+  if (!ret && reply_errno)
+  {
+    ret = -reply_errno;
+  }
+  if (ret)
+  {
+    wg_free_device(result);
+    return ret;
+  }
+
+  *device = result;
+
+  return 0;
+}
+
+extern int ewb_uapi_set_device(struct wg_device *device)
+{
+  int fd = connect_device(device->name);
+  if (fd < 0)
+  {
+    return fd;
+  }
+
+  uapi_writer *writer = begin_writer(fd);
+  write_line(writer, "set=1\n");
+  if (device->flags & WGDEVICE_HAS_PRIVATE_KEY)
+  {
+    write_key_line(writer, "private_key", device->private_key);
+  }
+  if (device->flags & WGDEVICE_HAS_LISTEN_PORT)
+  {
+    write_line(writer, "listen_port=%u\n", device->listen_port);
+  }
+  if (device->flags & WGDEVICE_HAS_FWMARK)
+  {
+    write_line(writer, "fwmark=%u\n", device->fwmark);
+  }
+  if (device->flags & WGDEVICE_REPLACE_PEERS)
+  {
+    write_line(writer, "replace_peers=true\n");
+  }
+
+  struct wg_peer *peer;
+  wg_for_each_peer(device, peer)
+  {
+    write_key_line(writer, "public_key", peer->public_key);
+    if (peer->flags & WGPEER_REMOVE_ME)
+    {
+      write_line(writer, "remove=true\n");
+      continue;
+    }
+    if (peer->flags & WGPEER_HAS_PRESHARED_KEY)
+    {
+      write_key_line(writer, "preshared_key", peer->preshared_key);
+    }
+    write_endpoint_line(writer, &peer->endpoint);
+    if (peer->flags & WGPEER_HAS_PERSISTENT_KEEPALIVE_INTERVAL)
+    {
+      write_line(writer, "persistent_keepalive_interval=%u\n", peer->persistent_keepalive_interval);
+    }
+    if (peer->flags & WGPEER_REPLACE_ALLOWEDIPS)
+    {
+      write_line(writer, "replace_allowed_ips=true\n");
+    }
+
+    struct wg_allowedip *allowedip;
+    wg_for_each_allowedip(peer, allowedip)
+    {
+      write_allowedip_line(writer, allowedip);
+    }
+  }
+  write_line(writer, "\n");
+  flush_writer(writer);
+  int ret = writer->error;
+
+  uapi_reader *reader = begin_reader(fd);
+  int reply_errno = 0;
+  while (!ret)
+  {
+    char *line;
+    ret = read_line(reader, &line);
+    if (ret || line[0] == '\0')
+    {
+      break;
+    }
+
+    uint64_t number;
+    if (strncmp(line, "errno=", 6) == 0 && parse_uint(line + 6, INT32_MAX, &number) == 0)
+    {
+      reply_errno = (int)number;
+    }
+  }
+
+  close(fd);
+
+  return ret ? ret : -reply_errno;
+}
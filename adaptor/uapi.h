@@ -0,0 +1,21 @@
+#ifndef EWB_UAPI_H
+#define EWB_UAPI_H
+
+#include "stdbool.h"
+#include "../externs/wireguard-tools/contrib/embeddable-wg-library/wireguard.h"
+
+// The directory wireguard-go and boringtun put the control sockets of their interfaces in, as <name>.sock.
+#define EWB_UAPI_SOCKET_DIRECTORY "/var/run/wireguard"
+// The longest line of the protocol is an allowed ip or an endpoint of ipv6, far below this.
+#define EWB_UAPI_BUFFER_SIZE 4096
+
+// The cross-platform userspace api of wireguard, a line-based text protocol over a unix socket.
+// See https://www.wireguard.com/xplatform/ for the protocol.
+void ewb_uapi_set_socket_directory(const char *directory);
+bool ewb_uapi_has_device(const char *device_name);
+// Lists the interfaces with a socket, in the format of wg_list_device_names.
+char *ewb_uapi_list_device_names(void);
+int ewb_uapi_get_device(struct wg_device **device, const char *device_name);
+int ewb_uapi_set_device(struct wg_device *device);
+
+#endif
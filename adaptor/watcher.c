@@ -0,0 +1,326 @@
+#include "errno.h"
+#include "stdlib.h"
+#include "string.h"
+#include "time.h"
+#include "./backend.h"
+#include "./watcher.h"
+
+typedef struct
+{
+  wg_endpoint endpoint;
+  struct timespec64 last_handshake_time;
+  uint64_t rx_bytes;
+  uint64_t tx_bytes;
+  uint64_t generation;
+} peer_state;
+
+static bool is_endpoint_equal(const wg_endpoint *a, const wg_endpoint *b)
+{
+  if (a->addr.sa_family != b->addr.sa_family)
+  {
+    return false;
+  }
+
+  if (a->addr.sa_family == AF_INET)
+  {
+    return a->addr4.sin_port == b->addr4.sin_port && a->addr4.sin_addr.s_addr == b->addr4.sin_addr.s_addr;
+  }
+  if (a->addr.sa_family == AF_INET6)
+  {
+    return a->addr6.sin6_port == b->addr6.sin6_port &&
+           a->addr6.sin6_scope_id == b->addr6.sin6_scope_id &&
+           memcmp(&a->addr6.sin6_addr, &b->addr6.sin6_addr, sizeof(struct in6_addr)) == 0;
+  }
+
+  return true;
+}
+
+static int push_event(ewb_watch_batch *batch, size_t *capacity, ewb_watch_event_type type, const wg_key public_key, const peer_state *state)
+{
+  if (batch->count == *capacity)
+  {
+    size_t next_capacity = *capacity ? *capacity * 2 : 16;
+    ewb_watch_event *events = realloc(batch->events, next_capacity * sizeof(ewb_watch_event));
+    if (events == NULL)
+    {
+      return -ENOMEM;
+    }
+
+    batch->events = events;
+    *capacity = next_capacity;
+  }
+
+  ewb_watch_event *event = &batch->events[batch->count++];
+  event->type = type;
+  memcpy(event->public_key, public_key, sizeof(wg_key));
+  event->endpoint = state->endpoint;
+  event->last_handshake_time = state->last_handshake_time;
+  event->rx_bytes = state->rx_bytes;
+  event->tx_bytes = state->tx_bytes;
+
+  return 0;
+}
+
+static int diff_peer(ewb_watcher *watcher, const struct wg_peer *peer, ewb_watch_batch *batch, size_t *capacity)
+{
+  peer_state *state = ewb_peer_table_get(&watcher->peers, peer->public_key);
+  if (state == NULL)
+  {
+    state = malloc(sizeof(peer_state));
+    if (state == NULL || ewb_peer_table_set(&watcher->peers, peer->public_key, state))
+    {
+      free(state);
+      return -ENOMEM;
+    }
+
+    state->endpoint = peer->endpoint;
+    state->last_handshake_time = peer->last_handshake_time;
+    state->rx_bytes = peer->rx_bytes;
+    state->tx_bytes = peer->tx_bytes;
+    state->generation = watcher->generation;
+
+    // The first poll only takes the baseline, so we don't report every peer of the device as added.
+    return watcher->generation > 1 ? push_event(batch, capacity, EWB_WATCH_PEER_ADDED, peer->public_key, state) : 0;
+  }
+
+  bool is_handshake_changed = state->last_handshake_time.tv_sec != peer->last_handshake_time.tv_sec ||
+                              state->last_handshake_time.tv_nsec != peer->last_handshake_time.tv_nsec;
+  bool is_endpoint_changed = !is_endpoint_equal(&state->endpoint, &peer->endpoint);
+  bool is_transfer_changed = state->rx_bytes != peer->rx_bytes || state->tx_bytes != peer->tx_bytes;
+
+  state->endpoint = peer->endpoint;
+  state->last_handshake_time = peer->last_handshake_time;
+  state->rx_bytes = peer->rx_bytes;
+  state->tx_bytes = peer->tx_bytes;
+  state->generation = watcher->generation;
+
+  int ret = 0;
+  if (is_handshake_changed)
+  {
+    ret = push_event(batch, capacity, EWB_WATCH_HANDSHAKE, peer->public_key, state);
+  }
+  if (ret == 0 && is_endpoint_changed)
+  {
+    ret = push_event(batch, capacity, EWB_WATCH_ENDPOINT, peer->public_key, state);
+  }
+  if (ret == 0 && is_transfer_changed)
+  {
+    ret = push_event(batch, capacity, EWB_WATCH_TRANSFER, peer->public_key, state);
+  }
+
+  return ret;
+}
+
+static int diff_device(ewb_watcher *watcher, const struct wg_device *device, ewb_watch_batch *batch)
+{
+  size_t capacity = 0;
+  int ret = 0;
+
+  watcher->generation++;
+
+  struct wg_peer *peer;
+  wg_for_each_peer(device, peer)
+  {
+    if ((ret = diff_peer(watcher, peer, batch, &capacity)))
+    {
+      return ret;
+    }
+  }
+
+  if (watcher->peers.size == 0)
+  {
+    return 0;
+  }
+
+  // The peers we did not see in this poll are gone; collect them first as the table can't be modified while iterating.
+  wg_key *removed_keys = malloc(watcher->peers.size * sizeof(wg_key));
+  if (removed_keys == NULL)
+  {
+    return -ENOMEM;
+  }
+
+  size_t removed_count = 0, index;
+  ewb_peer_table_for_each(&watcher->peers, index)
+  {
+    peer_state *state = watcher->peers.values[index];
+    if (state->generation != watcher->generation)
+    {
+      memcpy(removed_keys[removed_count++], watcher->peers.keys[index], sizeof(wg_key));
+    }
+  }
+
+  for (size_t i = 0; i < removed_count; i++)
+  {
+    peer_state *state = ewb_peer_table_remove(&watcher->peers, removed_keys[i]);
+    if (ret == 0)
+    {
+      ret = push_event(batch, &capacity, EWB_WATCH_PEER_REMOVED, removed_keys[i], state);
+    }
+
+    free(state);
+  }
+
+  free(removed_keys);
+
+  return ret;
+}
+
+static void poll_device(ewb_watcher *watcher, bool *is_failing)
+{
+  struct wg_device *device = NULL;
+  int ret = ewb_backend_get_device(watcher->has_session ? &watcher->session : NULL, &device, watcher->device_name);
+
+  ewb_watch_batch *batch = calloc(1, sizeof(ewb_watch_batch));
+  if (batch == NULL)
+  {
+    wg_free_device(device);
+    return;
+  }
+
+  if (ret == 0 && device != NULL)
+  {
+    ret = diff_device(watcher, device, batch);
+  }
+  else if (ret == 0)
+  {
+    ret = -ENODEV;
+  }
+
+  wg_free_device(device);
+
+  if (ret)
+  {
+    // We report the error only when the device becomes unreadable, instead of on every interval.
+    batch->count = 0;
+    batch->error = ret;
+    if (*is_failing)
+    {
+      ewb_watch_batch_destroy(batch);
+      return;
+    }
+
+    *is_failing = true;
+    watcher->callback(batch, watcher->data);
+    return;
+  }
+
+  *is_failing = false;
+
+  if (batch->count == 0)
+  {
+    ewb_watch_batch_destroy(batch);
+    return;
+  }
+
+  watcher->callback(batch, watcher->data);
+}
+
+static void *run_watcher(void *data)
+{
+  ewb_watcher *watcher = data;
+  bool is_failing = false;
+
+  pthread_mutex_lock(&watcher->lock);
+  while (!watcher->is_stopped)
+  {
+    pthread_mutex_unlock(&watcher->lock);
+    poll_device(watcher, &is_failing);
+    pthread_mutex_lock(&watcher->lock);
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += watcher->interval_ms / 1000;
+    deadline.tv_nsec += (long)(watcher->interval_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000)
+    {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+
+    int wait_ret = 0;
+    while (!watcher->is_stopped && wait_ret != ETIMEDOUT)
+    {
+      wait_ret = pthread_cond_timedwait(&watcher->cond, &watcher->lock, &deadline);
+    }
+  }
+  pthread_mutex_unlock(&watcher->lock);
+
+  return NULL;
+}
+
+extern int ewb_watcher_start(ewb_watcher *watcher, const char *device_name, uint32_t interval_ms, ewb_watch_callback callback, void *data)
+{
+  memset(watcher, 0, sizeof(*watcher));
+  watcher->interval_ms = interval_ms;
+  watcher->callback = callback;
+  watcher->data = data;
+
+  watcher->device_name = strdup(device_name);
+  if (watcher->device_name == NULL || ewb_peer_table_init(&watcher->peers, 16))
+  {
+    free(watcher->device_name);
+    return -ENOMEM;
+  }
+
+  // Polling over our own session spares a socket and a family lookup per interval; the library is the fallback.
+  watcher->has_session = ewb_nl_session_init(&watcher->session) == 0;
+
+  pthread_condattr_t cond_attr;
+  pthread_condattr_init(&cond_attr);
+  pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&watcher->cond, &cond_attr);
+  pthread_condattr_destroy(&cond_attr);
+  pthread_mutex_init(&watcher->lock, NULL);
+
+  int ret = pthread_create(&watcher->thread, NULL, run_watcher, watcher);
+  if (ret)
+  {
+    pthread_cond_destroy(&watcher->cond);
+    pthread_mutex_destroy(&watcher->lock);
+    if (watcher->has_session)
+    {
+      ewb_nl_session_destroy(&watcher->session);
+    }
+    ewb_peer_table_destroy(&watcher->peers);
+    free(watcher->device_name);
+    return -ret;
+  }
+
+  return 0;
+}
+
+extern void ewb_watcher_stop(ewb_watcher *watcher)
+{
+  pthread_mutex_lock(&watcher->lock);
+  watcher->is_stopped = true;
+  pthread_cond_signal(&watcher->cond);
+  pthread_mutex_unlock(&watcher->lock);
+
+  pthread_join(watcher->thread, NULL);
+
+  size_t index;
+  ewb_peer_table_for_each(&watcher->peers, index)
+  {
+    free(watcher->peers.values[index]);
+  }
+
+  pthread_cond_destroy(&watcher->cond);
+  pthread_mutex_destroy(&watcher->lock);
+  if (watcher->has_session)
+  {
+    ewb_nl_session_destroy(&watcher->session);
+  }
+  ewb_peer_table_destroy(&watcher->peers);
+  free(watcher->device_name);
+}
+
+extern void ewb_watch_batch_destroy(ewb_watch_batch *batch)
+{
+  if (batch == NULL)
+  {
+    return;
+  }
+
+  free(batch->events);
+  free(batch);
+}
@@ -0,0 +1,65 @@
+#ifndef EWB_WATCHER_H
+#define EWB_WATCHER_H
+
+#include "stdbool.h"
+#include "stddef.h"
+#include "stdint.h"
+#include "pthread.h"
+#include "../externs/wireguard-tools/contrib/embeddable-wg-library/wireguard.h"
+#include "./netlink.h"
+#include "./peer_table.h"
+
+typedef enum
+{
+  EWB_WATCH_PEER_ADDED,
+  EWB_WATCH_PEER_REMOVED,
+  EWB_WATCH_HANDSHAKE,
+  EWB_WATCH_ENDPOINT,
+  EWB_WATCH_TRANSFER,
+} ewb_watch_event_type;
+
+// The event carries the state of the peer after the change, or the last known state if the peer was removed.
+typedef struct
+{
+  ewb_watch_event_type type;
+  wg_key public_key;
+  wg_endpoint endpoint;
+  struct timespec64 last_handshake_time;
+  uint64_t rx_bytes;
+  uint64_t tx_bytes;
+} ewb_watch_event;
+
+// The events of a single poll, or the error of the poll in -errno if the device could not be read.
+typedef struct
+{
+  ewb_watch_event *events;
+  size_t count;
+  int error;
+} ewb_watch_batch;
+
+// Called on the watcher thread with a batch owned by the callee, which should free it by ewb_watch_batch_destroy.
+// The callback is called only if the poll has events, or once when polling starts to fail.
+typedef void (*ewb_watch_callback)(ewb_watch_batch *batch, void *data);
+
+typedef struct
+{
+  char *device_name;
+  uint32_t interval_ms;
+  ewb_watch_callback callback;
+  void *data;
+  ewb_nl_session session;
+  bool has_session;
+  ewb_peer_table peers;
+  uint64_t generation;
+  bool is_stopped;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+} ewb_watcher;
+
+int ewb_watcher_start(ewb_watcher *watcher, const char *device_name, uint32_t interval_ms, ewb_watch_callback callback, void *data);
+// Stops the thread and waits for it, so the callback will not be called after this returns.
+void ewb_watcher_stop(ewb_watcher *watcher);
+void ewb_watch_batch_destroy(ewb_watch_batch *batch);
+
+#endif
@@ -0,0 +1,78 @@
+#include "pthread.h"
+#include "unistd.h"
+#include "./workers.h"
+
+typedef struct
+{
+  size_t next_index;
+  size_t count;
+  ewb_workers_callback callback;
+  void *data;
+} workers_run;
+
+static void *run_worker(void *data)
+{
+  workers_run *run = (workers_run *)data;
+
+  ewb_nl_session session;
+  ewb_nl_session *session_ptr = ewb_nl_session_init(&session) ? NULL : &session;
+
+  size_t index;
+  while ((index = __atomic_fetch_add(&run->next_index, 1, __ATOMIC_RELAXED)) < run->count)
+  {
+    run->callback(session_ptr, index, run->data);
+  }
+
+  if (session_ptr != NULL)
+  {
+    ewb_nl_session_destroy(session_ptr);
+  }
+
+  return NULL;
+}
+
+extern size_t ewb_workers_get_default_concurrency(void)
+{
+  long processor_count = sysconf(_SC_NPROCESSORS_ONLN);
+
+  return processor_count > 0 ? (size_t)processor_count : 1;
+}
+
+extern void ewb_workers_run(size_t count, size_t concurrency, ewb_workers_callback callback, void *data)
+{
+  if (count == 0)
+  {
+    return;
+  }
+
+  workers_run run = {
+    .next_index = 0,
+    .count = count,
+    .callback = callback,
+    .data = data,
+  };
+
+  size_t thread_count = concurrency < count ? concurrency : count;
+  if (thread_count > EWB_WORKERS_MAX_THREADS)
+  {
+    thread_count = EWB_WORKERS_MAX_THREADS;
+  }
+
+  // A thread we could not start is not needed, as the others take its indexes.
+  pthread_t threads[EWB_WORKERS_MAX_THREADS];
+  size_t started_count = 0;
+  for (size_t index = 1; index < thread_count; index++)
+  {
+    if (pthread_create(&threads[started_count], NULL, run_worker, &run) == 0)
+    {
+      started_count++;
+    }
+  }
+
+  run_worker(&run);
+
+  for (size_t index = 0; index < started_count; index++)
+  {
+    pthread_join(threads[index], NULL);
+  }
+}
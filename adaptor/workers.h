@@ -0,0 +1,20 @@
+#ifndef EWB_WORKERS_H
+#define EWB_WORKERS_H
+
+#include "stddef.h"
+#include "./netlink.h"
+
+#define EWB_WORKERS_MAX_THREADS 64
+
+// Called on a worker for each index of the run, with the netlink session of the worker.
+// The session is NULL if the worker could not open one, and the backends then open a socket per call.
+typedef void (*ewb_workers_callback)(ewb_nl_session *session, size_t index, void *data);
+
+// Runs the callback for every index below the count on up to the concurrency of threads, each with its own netlink session.
+// The indexes are taken one by one as the workers get free, so a slow device does not hold up the others.
+// The calling thread is one of the workers, and the run returns once every index is done.
+void ewb_workers_run(size_t count, size_t concurrency, ewb_workers_callback callback, void *data);
+// The concurrency of a run without one, which is the number of processors online.
+size_t ewb_workers_get_default_concurrency(void);
+
+#endif
@@ -0,0 +1,38 @@
+import {readFileSync} from 'fs';
+
+// Usage: node bench/compare.js base.json head.json [--threshold 0.1]
+// Exits with 1 if the median of any stage got slower than the threshold allows.
+const [basePath, headPath, ...rest] = process.argv.slice(2);
+const threshold = rest[0] === '--threshold' ? Number(rest[1]) : 0.1;
+
+if (!basePath || !headPath) {
+	console.error('Usage: node bench/compare.js base.json head.json [--threshold 0.1]');
+	process.exit(2);
+}
+
+const load = path => JSON.parse(readFileSync(path, 'utf8'));
+const keyOf = result => `${result.backend}/${result.stage}/${result.peers}/${result.fanout}`;
+
+const base = load(basePath);
+const head = load(headPath);
+const baseResults = new Map(base.results.map(result => [keyOf(result), result]));
+
+let isRegressed = false;
+
+console.log(`base ${base.commit || basePath} -> head ${head.commit || headPath}`);
+
+for (const result of head.results) {
+	const baseline = baseResults.get(keyOf(result));
+
+	if (!baseline) {
+		continue;
+	}
+
+	const ratio = result.medianMs / baseline.medianMs;
+	const isSlower = ratio > 1 + threshold;
+
+	isRegressed ||= isSlower;
+	console.log(`${isSlower ? '!' : ' '} ${keyOf(result).padEnd(44)} ${baseline.medianMs.toFixed(3).padStart(10)}ms -> ${result.medianMs.toFixed(3).padStart(10)}ms (${((ratio - 1) * 100).toFixed(1)}%)`);
+}
+
+process.exit(isRegressed ? 1 : 0);
@@ -0,0 +1,214 @@
+import {execFileSync} from 'child_process';
+import {writeFileSync} from 'fs';
+import {fileURLToPath} from 'url';
+import {wg, WgDevice} from '../out/index.js';
+
+// Usage: node bench/marshalling.js [--backend loopback|kernel] [--peers 1000,10000,100000] [--fanout 1,4,16] [--iterations 5] [--output result.json]
+// The kernel backend runs itself again in a throwaway network namespace, so it needs root and the wireguard module.
+const parseArgs = argv => {
+	const options = {
+		backend: 'loopback',
+		peers: [1000, 10000, 100000],
+		fanout: [1, 4, 16],
+		iterations: 5,
+		output: '',
+		netns: '',
+	};
+
+	for (let i = 0; i < argv.length; i += 2) {
+		const key = argv[i].replace(/^--/, '');
+		const value = argv[i + 1];
+
+		if (key === 'peers' || key === 'fanout') {
+			options[key] = value.split(',').map(Number);
+		} else if (key === 'iterations') {
+			options.iterations = Number(value);
+		} else if (key in options) {
+			options[key] = value;
+		} else {
+			throw new Error(`Unknown option: ${argv[i]}`);
+		}
+	}
+
+	return options;
+};
+
+const createDevice = (peerCount, fanout) => {
+	const pairs = wg.generateKeyPairs(peerCount + 1);
+	const peers = [];
+
+	for (let i = 0; i < peerCount; i++) {
+		const allowedIps = [];
+
+		// Every peer gets its own /32s from 10.0.0.0/8, so the fan-out does not make the prefixes overlap.
+		for (let j = 0; j < fanout; j++) {
+			const n = (i * fanout) + j;
+
+			allowedIps.push({family: wg.AF_INET, addr: `10.${(n >> 16) & 0xff}.${(n >> 8) & 0xff}.${n & 0xff}`, cidr: 32});
+		}
+
+		peers.push({
+			flags: wg.WGPEER_HAS_PUBLIC_KEY | wg.WGPEER_REPLACE_ALLOWEDIPS,
+			publicKey: pairs.subarray(((i + 1) * 64) + 32, (i + 2) * 64).toString('base64'),
+			presharedKey: '',
+			endpoint: `192.168.${(i >> 8) & 0xff}.${i & 0xff}:51820`,
+			persistentKeepaliveInterval: 25,
+			allowedIps,
+		});
+	}
+
+	return {
+		name: 'wgbench0',
+		ifindex: 0,
+		flags: wg.WGDEVICE_HAS_PRIVATE_KEY | wg.WGDEVICE_HAS_LISTEN_PORT | wg.WGDEVICE_REPLACE_PEERS,
+		publicKey: '',
+		privateKey: pairs.subarray(0, 32).toString('base64'),
+		fwmark: 0,
+		listenPort: 51820,
+		peers,
+	};
+};
+
+const summarize = samples => {
+	const sorted = [...samples].sort((a, b) => a - b);
+	const pick = ratio => sorted[Math.min(sorted.length - 1, Math.floor(ratio * sorted.length))];
+
+	return {
+		minMs: sorted[0],
+		medianMs: pick(0.5),
+		p95Ms: pick(0.95),
+		meanMs: sorted.reduce((sum, sample) => sum + sample, 0) / sorted.length,
+	};
+};
+
+const time = callback => {
+	const start = process.hrtime.bigint();
+	const result = callback();
+
+	return {result, ms: Number(process.hrtime.bigint() - start) / 1e6};
+};
+
+// Each stage is timed on its own, so a regression points at the layer that caused it.
+const runLoopback = (device, iterations, record) => {
+	if (typeof wg.loopbackDevice !== 'function') {
+		throw new Error('The loopback backend needs the binding built by `pnpm build:bench`!');
+	}
+
+	const samples = {};
+	const push = (stage, ms) => {
+		(samples[stage] ||= []).push(ms);
+	};
+
+	for (let i = 0; i <= iterations; i++) {
+		const {stats} = wg.loopbackDevice(device);
+		const wrapped = time(() => new WgDevice(device));
+		const wrappedStats = wg.loopbackDevice({...wrapped.result, peers: wrapped.result.peers}).stats;
+
+		// The first round warms up the code paths and is left out.
+		if (i === 0) {
+			continue;
+		}
+
+		push('unmarshal', stats.unmarshalMs);
+		push('encode', stats.encodeMs);
+		push('decode', stats.decodeMs);
+		push('marshal', stats.marshalMs);
+		push('wrapper.construct', wrapped.ms);
+		push('wrapper.unmarshal', wrappedStats.unmarshalMs);
+		record.messages = stats.messages;
+		record.bytes = stats.bytes;
+	}
+
+	return samples;
+};
+
+const runKernel = (device, iterations) => {
+	const samples = {};
+	const push = (stage, ms) => {
+		(samples[stage] ||= []).push(ms);
+	};
+
+	if (wg.listDeviceNames().includes(device.name)) {
+		wg.removeDevice(device.name);
+	}
+
+	wg.addDevice(device.name);
+
+	try {
+		for (let i = 0; i <= iterations; i++) {
+			const set = time(() => wg.setDevice(device));
+			const get = time(() => wg.getDevice(device.name));
+			const snapshot = time(() => wg.getDeviceSnapshot(device.name));
+
+			if (i === 0) {
+				continue;
+			}
+
+			push('kernel.setDevice', set.ms);
+			push('kernel.getDevice', get.ms);
+			push('kernel.getDeviceSnapshot', snapshot.ms);
+		}
+	} finally {
+		wg.removeDevice(device.name);
+	}
+
+	return samples;
+};
+
+const getCommit = () => {
+	try {
+		return execFileSync('git', ['rev-parse', 'HEAD'], {encoding: 'utf8', stdio: ['ignore', 'pipe', 'ignore']}).trim();
+	} catch {
+		return '';
+	}
+};
+
+const options = parseArgs(process.argv.slice(2));
+
+if (options.backend === 'kernel' && !options.netns) {
+	const netns = `ewb-bench-${process.pid}`;
+
+	execFileSync('ip', ['netns', 'add', netns]);
+
+	try {
+		execFileSync('ip', ['netns', 'exec', netns, process.execPath, fileURLToPath(import.meta.url), ...process.argv.slice(2), '--netns', netns], {stdio: 'inherit'});
+	} finally {
+		execFileSync('ip', ['netns', 'del', netns]);
+	}
+
+	process.exit(0);
+}
+
+const results = [];
+
+for (const peerCount of options.peers) {
+	for (const fanout of options.fanout) {
+		const device = createDevice(peerCount, fanout);
+		const record = {};
+		const samples = options.backend === 'kernel'
+			? runKernel(device, options.iterations)
+			: runLoopback(device, options.iterations, record);
+
+		for (const [stage, stageSamples] of Object.entries(samples)) {
+			const result = {backend: options.backend, stage, peers: peerCount, fanout, iterations: stageSamples.length, ...record, ...summarize(stageSamples)};
+
+			results.push(result);
+			console.error(`${stage.padEnd(26)} peers=${String(peerCount).padEnd(7)} fanout=${String(fanout).padEnd(3)} median=${result.medianMs.toFixed(3)}ms`);
+		}
+	}
+}
+
+const report = JSON.stringify({
+	commit: getCommit(),
+	node: process.version,
+	napi: process.versions.napi,
+	platform: `${process.platform}-${process.arch}`,
+	date: new Date().toISOString(),
+	results,
+}, null, 2);
+
+if (options.output) {
+	writeFileSync(options.output, report);
+} else {
+	console.log(report);
+}
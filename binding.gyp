@@ -9,15 +9,42 @@
             }
         }
     },
+    "variables": {
+        "ewb_bench%": 0
+    },
     "targets": [
         {
             "target_name": "<(module_name)",
             "defines": [
                 "NAPI_VERSION=<(napi_build_version)",
+                "_GNU_SOURCE",
+            ],
+            "conditions": [
+                ["ewb_bench==1", {
+                    "defines": ["EWB_BENCH"]
+                }]
             ],
             "sources": [
                 "./adaptor/EmbeddableWireguardExtension.c",
+                "./adaptor/arena.c",
+                "./adaptor/backend.c",
+                "./adaptor/conf.c",
+                "./adaptor/keygen.c",
+                "./adaptor/lpm.c",
+                "./adaptor/metrics.c",
                 "./adaptor/napi_utils.c",
+                "./adaptor/netlink.c",
+                "./adaptor/netns.c",
+                "./adaptor/peer_table.c",
+                "./adaptor/pool.c",
+                "./adaptor/registry.c",
+                "./adaptor/rtnl.c",
+                "./adaptor/snapshot.c",
+                "./adaptor/state.c",
+                "./adaptor/sync.c",
+                "./adaptor/uapi.c",
+                "./adaptor/watcher.c",
+                "./adaptor/workers.c",
                 "./externs/wireguard-tools/contrib/embeddable-wg-library/wireguard.c"
             ]
         },
@@ -1,6 +1,6 @@
 import bin from '@mapbox/node-pre-gyp';
 import path from 'path';
-import {type Binding, type WireguardAllowedIp, type WireguardPeer, type WireguardDevice, type AddressFamily} from '../types/wg.js';
+import {type Binding, type WireguardAllowedIp, type WireguardPeer, type WireguardDevice, type WireguardSyncSummary, type WireguardPeerStats, type WireguardKey, type WireguardKeyFormat, type WireguardAllowedIpIndex, type WireguardAllowedIpMatch, type WireguardAllowedIpOverlap, type WireguardAddressPool, type WireguardLinkConfig, type AddressFamily} from '../types/wg.js';
 import {createRequire} from 'module';
 
 const bindingPath = bin.find(path.resolve(path.join(import.meta.url.split('://')[1], '../../package.json')));
@@ -12,6 +12,15 @@ export type {
 	WireguardAllowedIp,
 	WireguardPeer,
 	WireguardDevice,
+	WireguardSyncSummary,
+	WireguardPeerStats,
+	WireguardKey,
+	WireguardKeyFormat,
+	WireguardAllowedIpIndex,
+	WireguardAllowedIpMatch,
+	WireguardAllowedIpOverlap,
+	WireguardAddressPool,
+	WireguardLinkConfig,
 };
 
 export class WgPeer {
@@ -94,13 +103,20 @@ export class WgPeer {
 	}
 
 	private update() {
-		wg.setDevice({
-			...this.device,
-			peers: [this],
-		});
+		this.device.apply([this]);
 	}
 }
 
+type WgPeerState = Pick<WgPeer, 'flags' | 'publicKey' | 'presharedKey' | 'endpoint' | 'persistentKeepaliveInterval' | 'allowedIps'>;
+
+type WgDeviceState = {
+	device: Pick<WgDevice, 'flags' | 'publicKey' | 'privateKey' | 'fwmark' | 'listenPort'>;
+	peers: WgPeer[];
+	peerStates: Map<WgPeer, WgPeerState>;
+	pendingPeers: WgPeer[];
+	poolAddresses: Map<WgPeer, {pool: WireguardAddressPool; addr: string}>;
+};
+
 export class WgDevice {
 	name: string;
 	ifindex: number;
@@ -112,6 +128,10 @@ export class WgDevice {
 
 	peers: WgPeer[] = [];
 
+	private batchDepth = 0;
+	private readonly pendingPeers = new Set<WgPeer>();
+	private readonly poolAddresses = new Map<WgPeer, {pool: WireguardAddressPool; addr: string}>();
+
 	constructor(device: WireguardDevice) {
 		this.name = device.name;
 		this.ifindex = device.ifindex;
@@ -144,6 +164,18 @@ export class WgDevice {
 		return this;
 	}
 
+	/**
+	 * Configures the addresses, the state, and the mtu of the device interface in a single round trip.
+	 * @example device.configureLink({addresses: [{ip: '10.0.0.1', prefix: 24}], up: true, mtu: 1420});
+	 * @param config The link config; the properties not given are left as is.
+	 * @returns Returns `this`.
+	 */
+	configureLink(config: WireguardLinkConfig) {
+		wg.configureLink(this.name, config);
+
+		return this;
+	}
+
 	/**
 	 * Sets the public key for the device.
 	 * @example device.setPublicKey(wg.generatePrivateKey(device.publicKey));
@@ -206,23 +238,152 @@ export class WgDevice {
 
 	/**
 	 * Adds a peer to the device.
+	 * If the address pool is given, the peer gets a free address of the pool as an allowed ip besides the ones of the source.
+	 * The address goes back to the pool when the peer is removed, or when the peer could not be added or its transaction is rolled back.
+	 * @example device.addPeer(source, wg.createAddressPool('10.8.0.0/16', wg.getDevice(device.name)));
 	 * @param source The peer source.
+	 * @param pool The address pool to assign the address of the peer from.
 	 * @returns Returns `this`.
 	 */
-	addPeer(source: WireguardPeer) {
-		const peer = new WgPeer(this, source);
+	addPeer(source: WireguardPeer, pool?: WireguardAddressPool) {
+		let {allowedIps} = source;
+		let addr: string | null = null;
+
+		if (pool) {
+			addr = pool.allocate();
+
+			if (addr === null) {
+				throw new Error('The address pool has no address left!');
+			}
+
+			allowedIps = [...allowedIps, {family: pool.family, addr, cidr: pool.family === wg.AF_INET ? 32 : 128}];
+		}
+
+		const peer = new WgPeer(this, {...source, allowedIps});
 
 		peer.flags = wg.WGPEER_REPLACE_ALLOWEDIPS | wg.WGPEER_HAS_PUBLIC_KEY | wg.WGPEER_HAS_PRESHARED_KEY;
 
-		wg.setDevice({
-			...this,
-			peers: [peer],
-		});
 		this.peers.push(peer);
 
+		if (pool && addr !== null) {
+			this.poolAddresses.set(peer, {pool, addr});
+		}
+
+		try {
+			this.apply([peer]);
+		} catch (error: unknown) {
+			// The kernel never got the peer, so we take it back along with its address.
+			this.peers = this.peers.filter(added => added !== peer);
+			this.pendingPeers.delete(peer);
+			this.poolAddresses.delete(peer);
+
+			if (pool && addr !== null) {
+				pool.release(addr);
+			}
+
+			throw error;
+		}
+
+		return this;
+	}
+
+	/**
+	 * Starts gathering the changes of the device and its peers instead of sending each of them.
+	 * The changes are sent in a single `wg.setDevice` call by `commit`; batches can be nested.
+	 * @example device.batch().setListenPort(8888).setPrivateKey(wg.generatePrivateKey()).commit();
+	 * @returns Returns `this`.
+	 */
+	batch() {
+		this.batchDepth++;
+
+		return this;
+	}
+
+	/**
+	 * Closes the batch opened by `batch` and sends the gathered changes if it is the outermost one.
+	 * @returns Returns `this`.
+	 */
+	commit() {
+		if (this.batchDepth > 0) {
+			this.batchDepth--;
+		}
+
+		if (this.batchDepth === 0) {
+			this.flush();
+		}
+
+		return this;
+	}
+
+	/**
+	 * Runs the callback in a batch, so every change made in it costs a single round trip to the kernel.
+	 * If the callback throws, the gathered changes are dropped without being sent, and the device and its peers are put back as they were before the callback.
+	 * @example device.transaction(tx => tx.setListenPort(8888).addPeer(peer));
+	 * @param callback The callback making changes on the device.
+	 * @returns Returns `this`.
+	 */
+	transaction(callback: (device: this) => void) {
+		const state = this.save();
+
+		this.batch();
+
+		try {
+			callback(this);
+		} catch (error: unknown) {
+			this.batchDepth--;
+			this.restore(state);
+
+			if (this.batchDepth === 0) {
+				this.discard();
+			}
+
+			throw error;
+		}
+
+		return this.commit();
+	}
+
+	/**
+	 * Applies the changes of the device and the given peers, or defers them to `commit` in a batch.
+	 * @param peers The peers having changes.
+	 * @returns Returns `this`.
+	 */
+	apply(peers: WgPeer[] = []) {
+		for (const peer of peers) {
+			this.pendingPeers.add(peer);
+		}
+
+		if (this.batchDepth === 0) {
+			this.flush();
+		}
+
 		return this;
 	}
 
+	/**
+	 * Converges the device to the given config, sending only the peers that differ from the device.
+	 * The peers not in the config are removed from the device.
+	 * The config should not have the same public key more than once.
+	 * @example device.sync({...config, peers: desiredPeers});
+	 * @param config The desired config of the device.
+	 * @returns The summary of the changes.
+	 */
+	sync(config: WireguardDevice) {
+		const summary = wg.syncDevice(this.name, config);
+
+		if (config.privateKey && config.privateKey !== this.privateKey) {
+			this.publicKey = wg.generatePublicKey(config.privateKey);
+		}
+
+		this.privateKey = config.privateKey;
+		this.fwmark = config.fwmark;
+		this.listenPort = config.listenPort || this.listenPort;
+
+		this.peers = config.peers.map(peer => new WgPeer(this, peer));
+
+		return summary;
+	}
+
 	/**
 	 * Removes the device.
 	 */
@@ -231,9 +392,386 @@ export class WgDevice {
 	}
 
 	private update() {
-		wg.setDevice({
-			...this,
-			peers: [],
-		});
+		this.apply();
+	}
+
+	private flush() {
+		const peers = [...this.pendingPeers];
+
+		if (this.flags === 0 && peers.length === 0) {
+			return;
+		}
+
+		// The flags describe the changes we are sending, so they are dropped even if the kernel refused them, rather than sent again by the next call.
+		try {
+			wg.setDevice({
+				name: this.name,
+				ifindex: this.ifindex,
+				flags: this.flags,
+				publicKey: this.publicKey,
+				privateKey: this.privateKey,
+				fwmark: this.fwmark,
+				listenPort: this.listenPort,
+				peers: peers.map(peer => ({
+					flags: peer.flags,
+					publicKey: peer.publicKey,
+					presharedKey: peer.presharedKey,
+					endpoint: peer.endpoint,
+					persistentKeepaliveInterval: peer.persistentKeepaliveInterval,
+					allowedIps: peer.allowedIps,
+				})),
+			});
+
+			// The addresses of the removed peers go back to their pools only after the kernel dropped the peers.
+			for (const peer of peers) {
+				const assigned = this.poolAddresses.get(peer);
+
+				if (assigned && (peer.flags & wg.WGPEER_REMOVE_ME) !== 0) {
+					assigned.pool.release(assigned.addr);
+					this.poolAddresses.delete(peer);
+				}
+			}
+		} finally {
+			this.discard();
+		}
+	}
+
+	// The fields are copied rather than the objects, so the peers keep their identity across a rollback.
+	private save(): WgDeviceState {
+		const {flags, publicKey, privateKey, fwmark, listenPort} = this;
+
+		return {
+			device: {flags, publicKey, privateKey, fwmark, listenPort},
+			peers: [...this.peers],
+			peerStates: new Map<WgPeer, WgPeerState>(this.peers.map(peer => [peer, {
+				flags: peer.flags,
+				publicKey: peer.publicKey,
+				presharedKey: peer.presharedKey,
+				endpoint: peer.endpoint,
+				persistentKeepaliveInterval: peer.persistentKeepaliveInterval,
+				allowedIps: [...peer.allowedIps],
+			}])),
+			pendingPeers: [...this.pendingPeers],
+			poolAddresses: new Map(this.poolAddresses),
+		};
+	}
+
+	private restore(state: WgDeviceState) {
+		Object.assign(this, state.device);
+
+		// The peers removed in the callback are taken back too, so their state is restored along with the others.
+		for (const [peer, peerState] of state.peerStates) {
+			Object.assign(peer, peerState);
+		}
+
+		this.peers = [...state.peers];
+
+		this.pendingPeers.clear();
+
+		for (const peer of state.pendingPeers) {
+			this.pendingPeers.add(peer);
+		}
+
+		// The addresses assigned in the callback were never sent, so they go back to their pools.
+		for (const [peer, assigned] of this.poolAddresses) {
+			if (!state.poolAddresses.has(peer)) {
+				assigned.pool.release(assigned.addr);
+			}
+		}
+
+		this.poolAddresses.clear();
+
+		for (const [peer, assigned] of state.poolAddresses) {
+			this.poolAddresses.set(peer, assigned);
+		}
+	}
+
+	private discard() {
+		this.flags = 0;
+
+		for (const peer of this.pendingPeers) {
+			peer.flags = 0;
+		}
+
+		this.pendingPeers.clear();
+	}
+}
+
+// The snapshot is written in host byte order, see adaptor/snapshot.h for the layout.
+const isLittleEndian = new Uint8Array(new Uint16Array([1]).buffer)[0] === 1;
+
+const snapshotMagic = 0x53_42_57_45;
+const snapshotVersion = 1;
+const snapshotPeerSize = 144;
+const snapshotAllowedIpSize = 24;
+
+const formatIpv4 = (bytes: Uint8Array) => bytes.join('.');
+
+const formatIpv6 = (bytes: Uint8Array) => {
+	const groups: number[] = [];
+
+	for (let i = 0; i < 16; i += 2) {
+		groups.push((bytes[i] << 8) | bytes[i + 1]);
+	}
+
+	// Compress the longest run of zero groups, like inet_ntop does.
+	let bestStart = -1;
+	let bestLength = 1;
+
+	for (let i = 0; i < 8;) {
+		let length = 0;
+
+		while (i + length < 8 && groups[i + length] === 0) {
+			length++;
+		}
+
+		if (length > bestLength) {
+			bestStart = i;
+			bestLength = length;
+		}
+
+		i += length + 1;
+	}
+
+	const hex = groups.map(group => group.toString(16));
+
+	if (bestStart < 0) {
+		return hex.join(':');
+	}
+
+	return hex.slice(0, bestStart).join(':') + '::' + hex.slice(bestStart + bestLength).join(':');
+};
+
+/**
+ * The lazy reader of a peer in the device snapshot.
+ * Each field is decoded from the snapshot only when it is accessed.
+ */
+export class WgSnapshotPeer {
+	private readonly snapshot: WgDeviceSnapshot;
+	private readonly view: DataView;
+	private readonly offset: number;
+
+	constructor(snapshot: WgDeviceSnapshot, view: DataView, offset: number) {
+		this.snapshot = snapshot;
+		this.view = view;
+		this.offset = offset;
+	}
+
+	get publicKey() {
+		return this.getKey(0);
+	}
+
+	get presharedKey() {
+		return this.getKey(32);
+	}
+
+	get endpoint() {
+		const family = this.view.getUint16(this.offset + 64, isLittleEndian);
+		const port = this.view.getUint16(this.offset + 66, false);
+
+		if (family === wg.AF_INET) {
+			return `${formatIpv4(this.getBytes(68, 4))}:${port}`;
+		}
+
+		if (family === wg.AF_INET6) {
+			return `${formatIpv6(this.getBytes(72, 16))}:${port}`;
+		}
+
+		return '';
+	}
+
+	get persistentKeepaliveInterval() {
+		return this.view.getUint16(this.offset + 92, isLittleEndian);
+	}
+
+	get flags() {
+		return this.view.getUint32(this.offset + 96, isLittleEndian);
+	}
+
+	get rxBytes() {
+		return this.view.getBigUint64(this.offset + 112, isLittleEndian);
+	}
+
+	get txBytes() {
+		return this.view.getBigUint64(this.offset + 120, isLittleEndian);
+	}
+
+	/**
+	 * The time of the last handshake in milliseconds since the epoch.
+	 */
+	get lastHandshakeTime() {
+		const seconds = Number(this.view.getBigInt64(this.offset + 128, isLittleEndian));
+		const nanoseconds = Number(this.view.getBigInt64(this.offset + 136, isLittleEndian));
+
+		return (seconds * 1000) + (nanoseconds / 1_000_000);
+	}
+
+	get allowedIps() {
+		const index = this.view.getUint32(this.offset + 100, isLittleEndian);
+		const count = this.view.getUint32(this.offset + 104, isLittleEndian);
+		const allowedIps: WireguardAllowedIp[] = [];
+
+		for (let i = 0; i < count; i++) {
+			allowedIps.push(this.snapshot.getAllowedIp(index + i));
+		}
+
+		return allowedIps;
+	}
+
+	/**
+	 * Decodes every field of the peer.
+	 * @returns The peer object in the shape of `wg.getDevice`.
+	 */
+	toPeer(): WireguardPeer {
+		return {
+			flags: this.flags,
+			publicKey: this.publicKey,
+			presharedKey: this.presharedKey,
+			endpoint: this.endpoint,
+			persistentKeepaliveInterval: this.persistentKeepaliveInterval,
+			allowedIps: this.allowedIps,
+		};
+	}
+
+	private getBytes(offset: number, length: number) {
+		return new Uint8Array(this.view.buffer, this.view.byteOffset + this.offset + offset, length);
+	}
+
+	private getKey(offset: number) {
+		return Buffer.from(this.view.buffer, this.view.byteOffset + this.offset + offset, 32).toString('base64');
+	}
+}
+
+/**
+ * The lazy reader of the device snapshot from `wg.getDeviceSnapshot`.
+ * The snapshot keeps the whole device in a single ArrayBuffer, so reading a few fields of a large device does not create an object for every peer.
+ */
+export class WgDeviceSnapshot {
+	/**
+	 * Takes the snapshot of the device.
+	 * @example const snapshot = WgDeviceSnapshot.fromDevice('wgtest0');
+	 * @param deviceName The name of the device.
+	 * @returns The snapshot of the device.
+	 */
+	static fromDevice(deviceName: string) {
+		return new WgDeviceSnapshot(wg.getDeviceSnapshot(deviceName));
+	}
+
+	readonly buffer: ArrayBuffer;
+
+	private readonly view: DataView;
+
+	constructor(buffer: ArrayBuffer) {
+		this.buffer = buffer;
+		this.view = new DataView(buffer);
+
+		if (
+			buffer.byteLength < 128
+			|| this.view.getUint32(0, isLittleEndian) !== snapshotMagic
+			|| this.view.getUint16(4, isLittleEndian) !== snapshotVersion
+		) {
+			throw new Error('The buffer is not a device snapshot!');
+		}
+	}
+
+	get flags() {
+		return this.view.getUint32(8, isLittleEndian);
+	}
+
+	get ifindex() {
+		return this.view.getUint32(12, isLittleEndian);
+	}
+
+	get name() {
+		const name = Buffer.from(this.buffer, 16, 16);
+
+		return name.subarray(0, name.indexOf(0)).toString();
+	}
+
+	get fwmark() {
+		return this.view.getUint32(32, isLittleEndian);
+	}
+
+	get listenPort() {
+		return this.view.getUint16(36, isLittleEndian);
+	}
+
+	get peerCount() {
+		return this.view.getUint32(40, isLittleEndian);
+	}
+
+	get publicKey() {
+		return Buffer.from(this.buffer, 64, 32).toString('base64');
+	}
+
+	get privateKey() {
+		return Buffer.from(this.buffer, 96, 32).toString('base64');
+	}
+
+	/**
+	 * Gets the reader of the peer at the index of the peer table.
+	 * @param index The index of the peer.
+	 * @returns The peer reader.
+	 */
+	getPeer(index: number) {
+		if (index < 0 || index >= this.peerCount) {
+			throw new RangeError('The index of the peer is out of range!');
+		}
+
+		return new WgSnapshotPeer(this, this.view, this.view.getUint32(48, isLittleEndian) + (index * snapshotPeerSize));
+	}
+
+	/**
+	 * Iterates the peers without decoding them.
+	 * @example for (const peer of snapshot.peers()) console.log(peer.publicKey, peer.rxBytes);
+	 */
+	* peers() {
+		for (let i = 0; i < this.peerCount; i++) {
+			yield this.getPeer(i);
+		}
+	}
+
+	/**
+	 * Gets the allowed ip at the index of the allowed ip table.
+	 * @param index The index of the allowed ip.
+	 * @returns The allowed ip.
+	 */
+	getAllowedIp(index: number): WireguardAllowedIp {
+		const offset = this.view.getUint32(52, isLittleEndian) + (index * snapshotAllowedIpSize);
+		const family = this.view.getUint16(offset, isLittleEndian) as AddressFamily;
+		const addr = family === wg.AF_INET
+			? formatIpv4(new Uint8Array(this.buffer, offset + 4, 4))
+			: formatIpv6(new Uint8Array(this.buffer, offset + 4, 16));
+
+		return {
+			family,
+			addr,
+			cidr: this.view.getUint8(offset + 2),
+		};
+	}
+
+	/**
+	 * Decodes every field of the device.
+	 * @returns The device object in the shape of `wg.getDevice`.
+	 */
+	toDevice(): WireguardDevice {
+		return {
+			name: this.name,
+			ifindex: this.ifindex,
+			flags: this.flags,
+			publicKey: this.publicKey,
+			privateKey: this.privateKey,
+			fwmark: this.fwmark,
+			listenPort: this.listenPort,
+			peers: [...this.peers()].map(peer => peer.toPeer()),
+		};
+	}
+
+	/**
+	 * Applies the snapshot to the device it was taken from.
+	 * The config of the device is replaced as a whole, as with `wg setconf`, so the peers missing from the snapshot are removed.
+	 */
+	apply() {
+		wg.setDeviceFromSnapshot(this.buffer);
 	}
 }
@@ -3,6 +3,7 @@ export type AddressFamily = Binding['AF_INET'] | Binding['AF_INET6'];
 export type InterfaceAddress = {
 	family: AddressFamily;
 	ip: string;
+	prefix: number;
 };
 
 export type WireguardAllowedIp = {
@@ -11,37 +12,294 @@ export type WireguardAllowedIp = {
 	cidr: number;
 };
 
-export type WireguardPeer = {
+export type WireguardLinkAddress = {
+	ip: string;
+	prefix?: number;
+};
+
+export type WireguardLinkConfig = {
+	addresses?: WireguardLinkAddress[];
+	up?: boolean;
+	mtu?: number;
+};
+
+export type WireguardKey = string | Uint8Array;
+
+export type WireguardKeyFormat = 'base64' | 'binary';
+
+export type WireguardGetOptions = {
+	keyFormat?: WireguardKeyFormat;
+};
+
+export type WireguardPeer<Key extends WireguardKey = string> = {
 	flags: number;
-	publicKey: string;
-	presharedKey: string;
+	publicKey: Key;
+	presharedKey: Key;
 	endpoint: string;
 	persistentKeepaliveInterval: number;
 	allowedIps: WireguardAllowedIp[];
 };
 
-export type WireguardDevice = {
+export type WireguardDevice<Key extends WireguardKey = string> = {
 	name: string;
 	ifindex: number;
 	flags: number;
-	publicKey: string;
-	privateKey: string;
+	publicKey: Key;
+	privateKey: Key;
 	fwmark: number;
 	listenPort: number;
-	peers: WireguardPeer[];
+	peers: Array<WireguardPeer<Key>>;
+};
+
+export type WireguardGetDevice = {
+	(deviceName: string, options: {keyFormat: 'binary'}): WireguardDevice<Buffer>;
+	(deviceName: string, options?: WireguardGetOptions): WireguardDevice;
+};
+
+export type WireguardGetDeviceAsync = {
+	(deviceName: string, options: {keyFormat: 'binary'}): Promise<WireguardDevice<Buffer>>;
+	(deviceName: string, options?: WireguardGetOptions): Promise<WireguardDevice>;
+};
+
+export type WireguardIterateOptions = WireguardGetOptions & {
+	batchSize?: number;
+};
+
+export type WireguardIteratePeers = {
+	(deviceName: string, options: WireguardIterateOptions & {keyFormat: 'binary'}): AsyncIterableIterator<Array<WireguardPeer<Buffer>>>;
+	(deviceName: string, options?: WireguardIterateOptions): AsyncIterableIterator<Array<WireguardPeer>>;
+};
+
+export type WireguardSyncSummary = {
+	added: string[];
+	removed: string[];
+	updated: string[];
+	unchanged: number;
+	deviceChanged: boolean;
+};
+
+export type WireguardChunkProgress = {
+	applied: number;
+	total: number;
+	offset: number;
+};
+
+export type WireguardChunkOptions = {
+	chunkSize?: number;
+	offset?: number;
+	onProgress?: (progress: WireguardChunkProgress) => void;
+};
+
+export type WireguardChunkResult = {
+	applied: string[];
+	indeterminate: string[];
+	offset: number;
+	done: boolean;
+	error: Error | null;
+};
+
+export type WireguardApplyManyEntry = {
+	name: string;
+	config: WireguardDevice<WireguardKey>;
+};
+
+export type WireguardApplyManyOptions = {
+	concurrency?: number;
+};
+
+export type WireguardApplyManyResult = {
+	name: string;
+	summary: WireguardSyncSummary | null;
+	error: (Error & {errno: number}) | null;
+};
+
+export type WireguardApplyManyReport = {
+	results: WireguardApplyManyResult[];
+	succeeded: number;
+	failed: number;
+};
+
+export type WireguardRestoreResult = {
+	name: string;
+	error: Error | null;
+};
+
+export type WireguardRestoreReport = {
+	results: WireguardRestoreResult[];
+	succeeded: number;
+	failed: number;
+};
+
+export type WireguardPeerStats = {
+	publicKeys: Buffer;
+	rxBytes: BigUint64Array;
+	txBytes: BigUint64Array;
+	lastHandshakeTime: Float64Array;
+};
+
+export type WireguardPeerEvent = {
+	type: 'added' | 'removed' | 'handshake' | 'endpoint' | 'transfer';
+	publicKey: string;
+	endpoint: string;
+	lastHandshakeTime: number;
+	rxBytes: number;
+	txBytes: number;
+};
+
+export type WireguardLatencyHistogram = {
+	count: number;
+	meanMs: number;
+	p50Ms: number;
+	p90Ms: number;
+	p99Ms: number;
+	p999Ms: number;
+	maxMs: number;
+	buckets: Array<[upperBoundMs: number, count: number]>;
+};
+
+export type WireguardOperationMetrics = {
+	calls: number;
+	errors: Partial<Record<string, number>>;
+	bytesSent: number;
+	bytesReceived: number;
+	peers: number;
+	allowedips: number;
+	marshal: WireguardLatencyHistogram;
+	kernel: WireguardLatencyHistogram;
+};
+
+export type WireguardMetrics = Record<'getDevice' | 'setDevice' | 'listDeviceNames' | 'generateKeys' | 'interfaceAddress' | 'addRemoveDevice', WireguardOperationMetrics>;
+
+export type WireguardWatchOptions = {
+	intervalMs?: number;
+	keyFormat?: WireguardKeyFormat;
+};
+
+export type WireguardWatchHandle = {
+	close: () => void;
+	ref: () => WireguardWatchHandle;
+	unref: () => WireguardWatchHandle;
+};
+
+export type WireguardDeviceEvent = {
+	type: 'added' | 'removed';
+	name: string;
+	ifindex: number;
+};
+
+export type WireguardAllowedIpMatch<Key extends WireguardKey = string> = {
+	publicKey: Key;
+	allowedIp: WireguardAllowedIp;
+};
+
+export type WireguardAllowedIpOverlap<Key extends WireguardKey = string> = {
+	publicKey: Key;
+	allowedIp: WireguardAllowedIp;
+	conflictingPublicKey: Key;
+	conflictingAllowedIp: WireguardAllowedIp;
+};
+
+export type WireguardAllowedIpIndex<Key extends WireguardKey = string> = {
+	lookup: (ip: string) => WireguardAllowedIpMatch<Key> | null;
+	classify: (ips: string[]) => Array<Key | null>;
+	findOverlaps: (device: WireguardDevice<WireguardKey>) => Array<WireguardAllowedIpOverlap<Key>>;
+	update: (device: WireguardDevice<WireguardKey>) => WireguardAllowedIpIndex<Key>;
+};
+
+export type WireguardAddressPool = {
+	family: AddressFamily;
+	cidr: number;
+	allocate: () => string | null;
+	release: (ip: string) => boolean;
+	reserve: (prefix: string) => number;
+	seed: (device: WireguardDevice<WireguardKey>) => number;
+	available: () => number;
+};
+
+export type WireguardSession = {
+	getDevice: WireguardGetDevice;
+	setDevice: (device: WireguardDevice<WireguardKey>) => void;
+	getDeviceAsync: WireguardGetDeviceAsync;
+	setDeviceAsync: (device: WireguardDevice<WireguardKey>) => Promise<void>;
+	setDeviceChunked: (device: WireguardDevice<WireguardKey>, options?: WireguardChunkOptions) => Promise<WireguardChunkResult>;
+	iteratePeers: WireguardIteratePeers;
+	getPeerStats: (deviceName: string) => WireguardPeerStats;
+	getDeviceSnapshot: (deviceName: string) => ArrayBuffer;
+	setDeviceFromSnapshot: (snapshot: ArrayBuffer | ArrayBufferView) => void;
+	setConfFromFile: (deviceName: string, path: string) => void;
+	showConf: (deviceName: string) => string;
+	syncDevice: (deviceName: string, device: WireguardDevice<WireguardKey>) => WireguardSyncSummary;
+	syncDeviceAsync: (deviceName: string, device: WireguardDevice<WireguardKey>) => Promise<WireguardSyncSummary>;
+	addDevice: (deviceName: string) => void;
+	removeDevice: (deviceName: string) => void;
+	listDeviceNames: () => string[];
+	getInterfaceAddress: (deviceName: string) => InterfaceAddress[];
+	getInterfaceAddresses: (deviceNames: string[]) => InterfaceAddress[][];
+	configureLink: (deviceName: string, config: WireguardLinkConfig) => void;
+	close: () => void;
+};
+
+export type WireguardSessionOptions = {
+	netns?: string | number;
 };
 
 export type Binding = {
-	getDevice: (deviceName: string) => WireguardDevice;
-	setDevice: (device: WireguardDevice) => void;
+	getDevice: WireguardGetDevice;
+	setDevice: (device: WireguardDevice<WireguardKey>) => void;
 	addDevice: (deviceName: string) => void;
 	removeDevice: (deviceName: string) => void;
 	listDeviceNames: () => string[];
-	generatePublicKey: (privateKey: string) => string;
-	generatePrivateKey: () => string;
-	generatePresharedKey: () => string;
+	getDeviceAsync: WireguardGetDeviceAsync;
+	setDeviceAsync: (device: WireguardDevice<WireguardKey>) => Promise<void>;
+	setDeviceChunked: (device: WireguardDevice<WireguardKey>, options?: WireguardChunkOptions) => Promise<WireguardChunkResult>;
+	addDeviceAsync: (deviceName: string) => Promise<void>;
+	removeDeviceAsync: (deviceName: string) => Promise<void>;
+	listDeviceNamesAsync: () => Promise<string[]>;
+	iteratePeers: WireguardIteratePeers;
+	getPeerStats: (deviceName: string) => WireguardPeerStats;
+	getDeviceSnapshot: (deviceName: string) => ArrayBuffer;
+	setDeviceFromSnapshot: (snapshot: ArrayBuffer | ArrayBufferView) => void;
+	setConfFromFile: (deviceName: string, path: string) => void;
+	showConf: (deviceName: string) => string;
+	syncDevice: (deviceName: string, device: WireguardDevice<WireguardKey>) => WireguardSyncSummary;
+	syncDeviceAsync: (deviceName: string, device: WireguardDevice<WireguardKey>) => Promise<WireguardSyncSummary>;
+	applyMany: (entries: WireguardApplyManyEntry[], options?: WireguardApplyManyOptions) => Promise<WireguardApplyManyReport>;
+	saveState: (path: string, deviceNames?: string[]) => Promise<string[]>;
+	restoreState: (path: string) => Promise<WireguardRestoreReport>;
+	watch: (deviceName: string, options: WireguardWatchOptions, callback: (error: Error | null, events: WireguardPeerEvent[]) => void) => WireguardWatchHandle;
+	watchDevices: (callback: (events: WireguardDeviceEvent[]) => void) => WireguardWatchHandle;
+	enableDeviceRegistry: () => void;
+	disableDeviceRegistry: () => void;
+	createAllowedIpIndex: {
+		(device: WireguardDevice<WireguardKey> | null | undefined, options: {keyFormat: 'binary'}): WireguardAllowedIpIndex<Buffer>;
+		(device?: WireguardDevice<WireguardKey> | null, options?: WireguardGetOptions): WireguardAllowedIpIndex;
+	};
+	createAddressPool: (prefix: string, device?: WireguardDevice<WireguardKey> | null) => WireguardAddressPool;
+	openSession: (options?: WireguardSessionOptions) => WireguardSession;
+	setKeyFormat: (format: WireguardKeyFormat) => void;
+	setUapiSocketDirectory: (directory: string) => void;
+	generatePublicKey: {
+		(privateKey: string): string;
+		(privateKey: Uint8Array): Buffer;
+	};
+	generatePrivateKey: {
+		(options: {keyFormat: 'binary'}): Buffer;
+		(options?: WireguardGetOptions): string;
+	};
+	generatePresharedKey: {
+		(options: {keyFormat: 'binary'}): Buffer;
+		(options?: WireguardGetOptions): string;
+	};
+	generateKeyPairs: (count: number) => Buffer;
+	generatePresharedKeys: (count: number) => Buffer;
+	generateKeyPairsAsync: (count: number) => Promise<Buffer>;
+	generatePresharedKeysAsync: (count: number) => Promise<Buffer>;
 	getInterfaceAddress: (deviceName: string) => InterfaceAddress[];
-	setInterfaceAddress: (deviceName: string, address: InterfaceAddress) => void;
+	getInterfaceAddresses: (deviceNames: string[]) => InterfaceAddress[][];
+	setInterfaceAddress: (deviceName: string, address: Pick<InterfaceAddress, 'family' | 'ip'>) => void;
+	configureLink: (deviceName: string, config: WireguardLinkConfig) => void;
+	getMetrics: () => WireguardMetrics;
+	resetMetrics: () => void;
 	WGDEVICE_REPLACE_PEERS: number;
 	WGDEVICE_HAS_PRIVATE_KEY: number;
 	WGDEVICE_HAS_PUBLIC_KEY: number;